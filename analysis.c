@@ -0,0 +1,309 @@
+/**
+ * @file analysis.c
+ * @brief Implementation of analysing positions with parallel rollouts.
+ *
+ * The continuations of one chunk of positions are split into jobs of ROLLOUTS_PER_JOB
+ * games for one candidate move. Each job plays its games in lockstep and writes its
+ * points to its own slot, so threads never share counters.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "analysis.h"
+#include "parallel.h"
+#include "position.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** Number of continuations one job plays in lockstep. */
+#define ROLLOUTS_PER_JOB 64
+
+/**
+ * @struct AnalysisContext
+ * @brief Work shared by the threads analysing one chunk of positions.
+ */
+typedef struct {
+    const GameState* positions;   /**< The positions */
+    const AnalysisConfig* config; /**< The analysis settings */
+    const int* jobPosition;       /**< Position of each (position, move) pair */
+    const Move* jobMove;          /**< Move of each (position, move) pair */
+    int blocksPerMove;            /**< Jobs per (position, move) pair */
+    double* points;               /**< Points won, one slot per job */
+    GameState* threadStates;      /**< Games per thread, ROLLOUTS_PER_JOB each */
+    const Strategy** threadSeats; /**< Seats per thread, ROLLOUTS_PER_JOB * MAX_PLAYERS each */
+} AnalysisContext;
+
+/**
+ * @brief Plays one block of continuations of one candidate move.
+ *
+ * @param job Index of the job: pair * blocksPerMove + block.
+ * @param thread Index of the thread, selecting its games and seats.
+ * @param context Pointer to the AnalysisContext.
+ */
+static void rolloutJob(int job, int thread, void* context) {
+    AnalysisContext* analysis = context;
+    const AnalysisConfig* config = analysis->config;
+    int pair = job / analysis->blocksPerMove;
+    int block = job % analysis->blocksPerMove;
+    int position = analysis->jobPosition[pair];
+    Move move = analysis->jobMove[pair];
+    int first = block * ROLLOUTS_PER_JOB;
+    int numGames = config->rollouts - first < ROLLOUTS_PER_JOB ? config->rollouts - first : ROLLOUTS_PER_JOB;
+    int mover = analysis->positions[position].currentPlayer;
+
+    Rng rng;
+    seedRng(&rng, config->seed ^ ((uint64_t)position << 40) ^ ((uint64_t)move << 32) ^ (uint64_t)block);
+
+    GameState* states = analysis->threadStates + (size_t)thread * ROLLOUTS_PER_JOB;
+    const Strategy** seats = analysis->threadSeats + (size_t)thread * ROLLOUTS_PER_JOB * MAX_PLAYERS;
+    for (int g = 0; g < numGames; ++g) {
+        GameState* state = &states[g];
+        copyGameState(state, &analysis->positions[position]);
+        seedRng(&state->rng, nextRandom(&rng));
+        playMove(state, move);
+        for (int seat = 0; seat < state->numPlayers; ++seat) {
+            seats[g * state->numPlayers + seat] = config->policy;
+        }
+    }
+    if (playGames(states, seats, numGames, &rng) != 0) {
+        for (int g = 0; g < numGames; ++g) {
+            playGame(&states[g], &seats[g * states[g].numPlayers], &rng);
+        }
+    }
+
+    double points = 0.0;
+    for (int g = 0; g < numGames; ++g) {
+        points += states[g].winner == mover ? 1.0 : (states[g].winner < 0 ? 0.5 : 0.0);
+    }
+    analysis->points[job] = points;
+}
+
+/**
+ * @brief Evaluates every legal move of several positions.
+ *
+ * @param positions The positions.
+ * @param count Number of positions.
+ * @param config Pointer to the analysis settings.
+ * @param evaluations Output array of count * MAX_MOVES evaluations.
+ * @param numMoves Output array receiving the number of legal moves of each position.
+ * @return 0 on success, -1 if memory runs out.
+ */
+int analyzePositions(const GameState* positions, int count, const AnalysisConfig* config,
+                     MoveEvaluation* evaluations, int* numMoves) {
+    int numPairs = 0;
+    for (int p = 0; p < count; ++p) {
+        numMoves[p] = isGameOver(&positions[p]) ? 0 : countCardIds(legalMoves(&positions[p]));
+        numPairs += numMoves[p];
+    }
+
+    int blocksPerMove = (config->rollouts + ROLLOUTS_PER_JOB - 1) / ROLLOUTS_PER_JOB;
+    int* jobPosition = malloc((numPairs + 1) * sizeof(int));
+    Move* jobMove = malloc((numPairs + 1) * sizeof(Move));
+    double* points = malloc(((size_t)numPairs * blocksPerMove + 1) * sizeof(double));
+    // On the heap rather than each job's stack, as a state grows with MAX_PLAYERS.
+    int numThreads = config->numThreads > 0 ? config->numThreads : defaultThreadCount();
+    GameState* threadStates = malloc((size_t)numThreads * ROLLOUTS_PER_JOB * sizeof(GameState));
+    const Strategy** threadSeats = malloc((size_t)numThreads * ROLLOUTS_PER_JOB * MAX_PLAYERS * sizeof(Strategy*));
+    if (jobPosition == NULL || jobMove == NULL || points == NULL || threadStates == NULL || threadSeats == NULL) {
+        free(jobPosition);
+        free(jobMove);
+        free(points);
+        free(threadStates);
+        free(threadSeats);
+        return -1;
+    }
+
+    int pair = 0;
+    for (int p = 0; p < count; ++p) {
+        if (numMoves[p] == 0) {
+            continue;
+        }
+        for (CardMask legal = legalMoves(&positions[p]); legal; legal &= legal - 1) {
+            jobPosition[pair] = p;
+            jobMove[pair++] = lowestCardId(legal);
+        }
+    }
+
+    AnalysisContext context = { positions, config, jobPosition, jobMove, blocksPerMove, points,
+                                threadStates, threadSeats };
+    runParallel(numThreads, numPairs * blocksPerMove, rolloutJob, &context);
+    free(threadStates);
+    free(threadSeats);
+
+    // Wilson score interval at 95% for the share of points won.
+    const double z = 1.96;
+    for (pair = 0; pair < numPairs; ++pair) {
+        double won = 0.0;
+        for (int b = 0; b < blocksPerMove; ++b) {
+            won += points[pair * blocksPerMove + b];
+        }
+        double n = config->rollouts;
+        double rate = won / n;
+        double centre = (rate + z * z / (2 * n)) / (1 + z * z / n);
+        double margin = z * sqrt(rate * (1 - rate) / n + z * z / (4 * n * n)) / (1 + z * z / n);
+
+        int p = jobPosition[pair];
+        int k = 0;
+        while (pair - k > 0 && jobPosition[pair - k - 1] == p) {
+            k++;
+        }
+        evaluations[p * MAX_MOVES + k] = (MoveEvaluation) { jobMove[pair], config->rollouts, rate, centre - margin, centre + margin };
+    }
+
+    free(jobPosition);
+    free(jobMove);
+    free(points);
+    return 0;
+}
+
+/**
+ * @brief Writes the report of one analysed position.
+ *
+ * @param output Stream that receives the report.
+ * @param line The position text.
+ * @param lineNumber The line the position was read from.
+ * @param evaluations The evaluations of its moves.
+ * @param numMoves Number of moves.
+ */
+static void printEvaluations(FILE* output, const char* line, long lineNumber, const MoveEvaluation* evaluations, int numMoves) {
+    fprintf(output, "position %ld: %s\n", lineNumber, line);
+    if (numMoves == 0) {
+        fprintf(output, "  game over\n");
+        return;
+    }
+    for (int k = 0; k < numMoves; ++k) {
+        const MoveEvaluation* e = &evaluations[k];
+        char name[5] = "draw";
+        if (e->move != MOVE_DRAW) {
+            name[0] = "23456789TJQKA"[e->move % NUM_RANKS];
+            name[1] = "cshd"[e->move / NUM_RANKS];
+            name[2] = '\0';
+        }
+        fprintf(output, "  %-4s %.3f [%.3f, %.3f] %d\n", name, e->winRate, e->low, e->high, e->rollouts);
+    }
+}
+
+/**
+ * @brief Analyses every position in a stream and writes a report.
+ *
+ * Reads ANALYSIS_CHUNK positions at a time, analyses them together and reports them in
+ * input order before reading more.
+ *
+ * @param input Stream of positions, one per line.
+ * @param output Stream that receives the report.
+ * @param config Pointer to the analysis settings.
+ * @return The number of positions analysed, or -1 if memory runs out.
+ */
+long analyzeStream(FILE* input, FILE* output, const AnalysisConfig* config) {
+    GameState* positions = malloc(ANALYSIS_CHUNK * sizeof(GameState));
+    uint8_t* valid = malloc(ANALYSIS_CHUNK);
+    char* lines = malloc((size_t)ANALYSIS_CHUNK * MAX_POSITION_LENGTH);
+    long* lineNumbers = malloc(ANALYSIS_CHUNK * sizeof(long));
+    MoveEvaluation* evaluations = malloc((size_t)ANALYSIS_CHUNK * MAX_MOVES * sizeof(MoveEvaluation));
+    int* numMoves = malloc(ANALYSIS_CHUNK * sizeof(int));
+    long analysed = -1;
+    if (positions == NULL || valid == NULL || lines == NULL || lineNumbers == NULL || evaluations == NULL || numMoves == NULL) {
+        goto done;
+    }
+
+    analysed = 0;
+    long lineNumber = 0;
+    int endOfInput = 0;
+    while (!endOfInput) {
+        int count = 0;
+        while (count < ANALYSIS_CHUNK) {
+            char* line = lines + (size_t)count * MAX_POSITION_LENGTH;
+            if (fgets(line, MAX_POSITION_LENGTH, input) == NULL) {
+                endOfInput = 1;
+                break;
+            }
+            lineNumber++;
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] == '\0' || line[0] == '#') {
+                continue;
+            }
+            // Invalid lines keep their slot so the report stays in input order.
+            valid[count] = parsePosition(line, &positions[count], config->seed ^ (uint64_t)lineNumber) >= 0;
+            if (!valid[count]) {
+                initGameState(&positions[count], NUM_PLAYERS, 1, 0);
+                positions[count].winner = 0;
+            }
+            lineNumbers[count++] = lineNumber;
+        }
+
+        if (count > 0 && analyzePositions(positions, count, config, evaluations, numMoves) != 0) {
+            analysed = -1;
+            goto done;
+        }
+        for (int p = 0; p < count; ++p) {
+            if (!valid[p]) {
+                fprintf(output, "position %ld: invalid: %s\n", lineNumbers[p], lines + (size_t)p * MAX_POSITION_LENGTH);
+                continue;
+            }
+            printEvaluations(output, lines + (size_t)p * MAX_POSITION_LENGTH, lineNumbers[p], evaluations + p * MAX_MOVES, numMoves[p]);
+        }
+        fflush(output);
+        for (int p = 0; p < count; ++p) {
+            analysed += valid[p];
+        }
+    }
+
+done:
+    free(positions);
+    free(valid);
+    free(lines);
+    free(lineNumbers);
+    free(evaluations);
+    free(numMoves);
+    return analysed;
+}
+
+/**
+ * @brief Analyses positions from command-line arguments.
+ *
+ * @param argc Number of arguments after the "analyze" command.
+ * @param argv The arguments after the "analyze" command.
+ * @return 0 on success, 1 on invalid arguments or input.
+ */
+int runAnalysisCli(int argc, char** argv) {
+    AnalysisConfig config = { NULL, 1000, 0, (uint64_t)time(NULL) };
+    const char* policy = "random";
+    const char* path = NULL;
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--rollouts") == 0 && i + 1 < argc) {
+            config.rollouts = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc) {
+            policy = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            config.numThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            config.seed = strtoull(argv[++i], NULL, 10);
+        } else if (path == NULL && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "Usage: analyze [--rollouts N] [--policy STRATEGY] [--threads N] [--seed N] [FILE]\n");
+            return 1;
+        }
+    }
+
+    config.policy = openStrategy(policy);
+    FILE* input = path != NULL ? fopen(path, "r") : stdin;
+    if (config.policy == NULL || input == NULL || config.rollouts < 1) {
+        fprintf(stderr, "Invalid policy, input file or rollout count\n");
+        closeStrategy(config.policy);
+        if (input != NULL && input != stdin) {
+            fclose(input);
+        }
+        return 1;
+    }
+
+    long analysed = analyzeStream(input, stdout, &config);
+    if (input != stdin) {
+        fclose(input);
+    }
+    closeStrategy(config.policy);
+    return analysed < 0 ? 1 : 0;
+}
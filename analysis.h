@@ -0,0 +1,92 @@
+/**
+ * @file analysis.h
+ * @brief Header file for analysing positions with parallel rollouts.
+ *
+ * For each legal move in a position, many continuations are played out to the end with a
+ * rollout strategy, and the share won by the player to move is reported with a 95%
+ * confidence interval. Positions are read in the format of position.h and processed in
+ * fixed-size chunks, so input files of any size run in bounded memory.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "gamestate.h"
+#include "strategy.h"
+
+/** Number of distinct moves: every card identity and drawing. */
+#define MAX_MOVES (MOVE_DRAW + 1)
+
+/** Number of positions analysed together; bounds the memory used by analyzeStream. */
+#define ANALYSIS_CHUNK 256
+
+/**
+ * @struct AnalysisConfig
+ * @brief Settings of an analysis.
+ */
+typedef struct {
+    const Strategy* policy; /**< Strategy that plays both seats in the continuations */
+    int rollouts;           /**< Continuations per candidate move */
+    int numThreads;         /**< Number of worker threads; 0 uses every core */
+    uint64_t seed;          /**< Seed for the continuations */
+} AnalysisConfig;
+
+/**
+ * @struct MoveEvaluation
+ * @brief Result of the continuations of one candidate move.
+ */
+typedef struct {
+    Move move;      /**< The candidate move */
+    int rollouts;   /**< Number of continuations played */
+    double winRate; /**< Share of points won by the player making the move (draws count half) */
+    double low;     /**< Lower end of the 95% Wilson interval */
+    double high;    /**< Upper end of the 95% Wilson interval */
+} MoveEvaluation;
+
+/**
+ * @brief Evaluates every legal move of several positions.
+ *
+ * Every continuation draws from the hidden deck with its own generator.
+ *
+ * @param positions The positions.
+ * @param count Number of positions.
+ * @param config Pointer to the analysis settings.
+ * @param evaluations Output array of count * MAX_MOVES evaluations; position i uses
+ *                    entries i * MAX_MOVES to i * MAX_MOVES + numMoves[i] - 1.
+ * @param numMoves Output array receiving the number of legal moves of each position.
+ * @return 0 on success, -1 if memory runs out.
+ */
+int analyzePositions(const GameState* positions, int count, const AnalysisConfig* config,
+                     MoveEvaluation* evaluations, int* numMoves);
+
+/**
+ * @brief Analyses every position in a stream and writes a report.
+ *
+ * Blank lines and lines starting with '#' are skipped; invalid lines are reported and
+ * skipped.
+ *
+ * @param input Stream of positions, one per line.
+ * @param output Stream that receives the report.
+ * @param config Pointer to the analysis settings.
+ * @return The number of positions analysed, or -1 if memory runs out.
+ */
+long analyzeStream(FILE* input, FILE* output, const AnalysisConfig* config);
+
+/**
+ * @brief Analyses positions from command-line arguments.
+ *
+ * Usage: analyze [--rollouts N] [--policy STRATEGY] [--threads N] [--seed N] [FILE]
+ * Positions are read from FILE, or from standard input if it is not given.
+ *
+ * @param argc Number of arguments after the "analyze" command.
+ * @param argv The arguments after the "analyze" command.
+ * @return 0 on success, 1 on invalid arguments or input.
+ */
+int runAnalysisCli(int argc, char** argv);
+
+#endif /* ANALYSIS_H */
@@ -0,0 +1,206 @@
+/**
+ * @file batchenv.c
+ * @brief Implementation of the batched game environment used for reinforcement learning.
+ *
+ * The games are kept as parallel arrays: one contiguous array of engine states and one of
+ * per-game step data. A step makes the caller's actions, then all opponent replies as one
+ * batch, and writes its outputs directly into the caller's buffers, with no per-game
+ * calls across the interface.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "batchenv.h"
+#include "encoder.h"
+#include "gamestate.h"
+#include "strategy.h"
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(BATCH_OBSERVATION_SIZE == OBSERVATION_SIZE, "batch observations are encoder observations");
+
+/**
+ * @struct BatchEnv
+ * @brief A batch of games.
+ */
+struct BatchEnv {
+    int capacity;              /**< Maximum number of games */
+    int numGames;              /**< Number of games currently running */
+    int numPacks;              /**< Number of packs per game */
+    const Strategy* opponent;  /**< Strategy for seat 1, or NULL for self-play */
+    GameState* states;         /**< Engine state of each game */
+    uint8_t* movers;           /**< Seat that made the caller's action in each game */
+    const GameState** batch;   /**< Scratch: games where the opponent is to move */
+    int* index;                /**< Scratch: slot of each game in batch */
+    Move* moves;               /**< Scratch: opponent moves for batch */
+    Rng seeds;                 /**< Generator of the seeds for new deals */
+    Rng opponentRng;           /**< Generator passed to the opponent strategy */
+    uint64_t illegalActions;   /**< Number of illegal actions replaced */
+};
+
+/**
+ * @brief Creates a batch environment.
+ *
+ * @param capacity Maximum number of games in the batch.
+ * @param numPacks Number of packs per game.
+ * @param opponent Strategy for seat 1 as accepted by openStrategy, or NULL for self-play.
+ * @param seed Seed for the deals.
+ * @return The environment, or NULL if the arguments are invalid or memory runs out.
+ */
+BatchEnv* batchEnvCreate(int capacity, int numPacks, const char* opponent, uint64_t seed) {
+    if (capacity < 1 || numPacks < 1 || numPacks > MAX_PACKS) {
+        return NULL;
+    }
+    const Strategy* strategy = opponent != NULL ? openStrategy(opponent) : NULL;
+    if (opponent != NULL && strategy == NULL) {
+        return NULL;
+    }
+
+    BatchEnv* env = calloc(1, sizeof(BatchEnv));
+    if (env == NULL) {
+        closeStrategy(strategy);
+        return NULL;
+    }
+    env->capacity = capacity;
+    env->numPacks = numPacks;
+    env->opponent = strategy;
+    env->states = malloc(capacity * sizeof(GameState));
+    env->movers = malloc(capacity);
+    env->batch = malloc(capacity * sizeof(GameState*));
+    env->index = malloc(capacity * sizeof(int));
+    env->moves = malloc(capacity * sizeof(Move));
+    seedRng(&env->seeds, seed);
+    seedRng(&env->opponentRng, ~seed);
+    if (env->states == NULL || env->movers == NULL ||
+        env->batch == NULL || env->index == NULL || env->moves == NULL) {
+        batchEnvDestroy(env);
+        return NULL;
+    }
+    return env;
+}
+
+/**
+ * @brief Destroys a batch environment.
+ *
+ * @param env The environment, or NULL.
+ */
+void batchEnvDestroy(BatchEnv* env) {
+    if (env != NULL) {
+        closeStrategy(env->opponent);
+        free(env->states);
+        free(env->movers);
+        free(env->batch);
+        free(env->index);
+        free(env->moves);
+        free(env);
+    }
+}
+
+/**
+ * @brief Writes the legal-action mask of the player to move.
+ *
+ * @param state Pointer to the game state.
+ * @param mask Output buffer of NUM_ACTIONS bytes.
+ */
+static void writeLegalMask(const GameState* state, uint8_t* mask) {
+    CardMask legal = legalMoves(state);
+    for (int action = 0; action < NUM_ACTIONS; ++action) {
+        mask[action] = (uint8_t)((legal >> action) & 1);
+    }
+}
+
+/**
+ * @brief Deals a new game into a slot. Seat 0 always moves first.
+ *
+ * @param env The environment.
+ * @param game Index of the slot.
+ */
+static void startSlot(BatchEnv* env, int game) {
+    initGameState(&env->states[game], NUM_PLAYERS, env->numPacks, nextRandom(&env->seeds));
+}
+
+/**
+ * @brief Starts numGames new games and writes their first observations.
+ *
+ * @param env The environment.
+ * @param numGames Number of games to run, at most the capacity.
+ * @param observations Output buffer of numGames * BATCH_OBSERVATION_SIZE bytes.
+ * @param legalMasks Output buffer of numGames * NUM_ACTIONS bytes, 1 for each legal action.
+ * @return 0 on success, -1 if numGames is out of range.
+ */
+int batchEnvReset(BatchEnv* env, int numGames, uint8_t* observations, uint8_t* legalMasks) {
+    if (numGames < 1 || numGames > env->capacity) {
+        return -1;
+    }
+    env->numGames = numGames;
+    for (int game = 0; game < numGames; ++game) {
+        startSlot(env, game);
+        encodeObservation(&env->states[game], env->states[game].currentPlayer, observations + (size_t)game * BATCH_OBSERVATION_SIZE);
+        writeLegalMask(&env->states[game], legalMasks + (size_t)game * NUM_ACTIONS);
+    }
+    return 0;
+}
+
+/**
+ * @brief Makes one action in every game and writes the results.
+ *
+ * @param env The environment.
+ * @param actions One action per game.
+ * @param observations Output buffer of numGames * BATCH_OBSERVATION_SIZE bytes.
+ * @param rewards Output buffer of numGames rewards.
+ * @param dones Output buffer of numGames done flags.
+ * @param legalMasks Output buffer of numGames * NUM_ACTIONS bytes.
+ */
+void batchEnvStep(BatchEnv* env, const int32_t* actions, uint8_t* observations, float* rewards, uint8_t* dones, uint8_t* legalMasks) {
+    for (int game = 0; game < env->numGames; ++game) {
+        GameState* state = &env->states[game];
+        Move move = actions[game];
+        if (!isLegalMove(state, move)) {
+            move = chooseFirstPlayable(state, NULL, NULL);
+            env->illegalActions++;
+        }
+        env->movers[game] = state->currentPlayer;
+        playMove(state, move);
+    }
+
+    // Turns alternate, so the opponent replies at most once; all replies are one batch.
+    if (env->opponent != NULL) {
+        int size = 0;
+        for (int game = 0; game < env->numGames; ++game) {
+            if (!isGameOver(&env->states[game])) {
+                env->index[size] = game;
+                env->batch[size++] = &env->states[game];
+            }
+        }
+        chooseMoves(env->opponent, env->batch, size, &env->opponentRng, env->moves);
+        for (int k = 0; k < size; ++k) {
+            playMove(&env->states[env->index[k]], env->moves[k]);
+        }
+    }
+
+    for (int game = 0; game < env->numGames; ++game) {
+        GameState* state = &env->states[game];
+        int mover = env->movers[game];
+        float reward = 0.0f;
+        int done = isGameOver(state);
+        if (done) {
+            reward = state->winner == mover ? 1.0f : (state->winner >= 0 ? -1.0f : 0.0f);
+            startSlot(env, game);
+        }
+        rewards[game] = reward;
+        dones[game] = (uint8_t)done;
+        encodeObservation(state, state->currentPlayer, observations + (size_t)game * BATCH_OBSERVATION_SIZE);
+        writeLegalMask(state, legalMasks + (size_t)game * NUM_ACTIONS);
+    }
+}
+
+/**
+ * @brief Returns the number of illegal actions replaced since the environment was created.
+ *
+ * @param env The environment.
+ * @return The number of illegal actions.
+ */
+uint64_t batchEnvIllegalActions(const BatchEnv* env) {
+    return env->illegalActions;
+}
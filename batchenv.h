@@ -0,0 +1,97 @@
+/**
+ * @file batchenv.h
+ * @brief Header file for the batched game environment used for reinforcement learning.
+ *
+ * A batch environment holds many games and advances all of them with one call, writing
+ * observations, rewards, done flags and legal-action masks straight into contiguous
+ * buffers owned by the caller. Finished games restart automatically. The functions use
+ * only plain C types so they can be called through any foreign-function interface.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef BATCH_ENV_H
+#define BATCH_ENV_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of actions: one per card identity, then drawing. */
+#define NUM_ACTIONS 53
+
+/** Number of bytes in one observation (OBSERVATION_SIZE; see encoder.h for the layout). */
+#define BATCH_OBSERVATION_SIZE 160
+
+/**
+ * @struct BatchEnv
+ * @brief Opaque batch of games.
+ */
+typedef struct BatchEnv BatchEnv;
+
+/**
+ * @brief Creates a batch environment.
+ *
+ * With an opponent, the caller always plays seat 0 and the opponent strategy plays seat 1
+ * between steps, deciding for all games in one batch. Without one (NULL), each action is
+ * made by whichever seat is to move, for self-play.
+ *
+ * @param capacity Maximum number of games in the batch.
+ * @param numPacks Number of packs per game.
+ * @param opponent Strategy for seat 1 as accepted by openStrategy, or NULL for self-play.
+ * @param seed Seed for the deals.
+ * @return The environment, or NULL if the arguments are invalid or memory runs out.
+ */
+BatchEnv* batchEnvCreate(int capacity, int numPacks, const char* opponent, uint64_t seed);
+
+/**
+ * @brief Destroys a batch environment.
+ *
+ * @param env The environment, or NULL.
+ */
+void batchEnvDestroy(BatchEnv* env);
+
+/**
+ * @brief Starts numGames new games and writes their first observations.
+ *
+ * @param env The environment.
+ * @param numGames Number of games to run, at most the capacity.
+ * @param observations Output buffer of numGames * BATCH_OBSERVATION_SIZE bytes.
+ * @param legalMasks Output buffer of numGames * NUM_ACTIONS bytes, 1 for each legal action.
+ * @return 0 on success, -1 if numGames is out of range.
+ */
+int batchEnvReset(BatchEnv* env, int numGames, uint8_t* observations, uint8_t* legalMasks);
+
+/**
+ * @brief Makes one action in every game and writes the results.
+ *
+ * An illegal action is replaced by the first legal move and counted (see
+ * batchEnvIllegalActions). The reward is for the seat that acted: 1 for a win, -1 for a
+ * loss (only with an opponent) and 0 otherwise. When a game ends, its done flag is set
+ * and the observation and mask written are those of the next game in that slot.
+ *
+ * @param env The environment.
+ * @param actions One action per game.
+ * @param observations Output buffer of numGames * BATCH_OBSERVATION_SIZE bytes.
+ * @param rewards Output buffer of numGames rewards.
+ * @param dones Output buffer of numGames done flags.
+ * @param legalMasks Output buffer of numGames * NUM_ACTIONS bytes.
+ */
+void batchEnvStep(BatchEnv* env, const int32_t* actions, uint8_t* observations, float* rewards, uint8_t* dones, uint8_t* legalMasks);
+
+/**
+ * @brief Returns the number of illegal actions replaced since the environment was created.
+ *
+ * @param env The environment.
+ * @return The number of illegal actions.
+ */
+uint64_t batchEnvIllegalActions(const BatchEnv* env);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BATCH_ENV_H */
@@ -0,0 +1,286 @@
+/**
+ * @file broadcast.c
+ * @brief Implementation of shared message buffers and the output queues that send them.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "broadcast.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/** Most pieces gathered into one write. */
+#define MAX_FLUSH_PIECES 64
+
+/**
+ * @brief Returns the budget a cache charges, for buffers too large for its chunks.
+ *
+ * @param chunks Pointer to the cache, or NULL.
+ * @return The budget, or NULL without a cache.
+ */
+static MemoryBudget* budgetOf(SlabCache* chunks) {
+    return chunks != NULL ? chunks->depot->budget : NULL;
+}
+
+/**
+ * @brief Creates a shared buffer holding a copy of a message.
+ *
+ * @param data The message.
+ * @param length Number of bytes in the message.
+ * @param chunks Cache of the calling thread to take the buffer from, or NULL.
+ * @return Pointer to the buffer, holding one reference for the caller, or NULL if out of memory.
+ */
+SharedBuffer* createSharedBuffer(const void* data, size_t length, SlabCache* chunks) {
+    size_t size = sizeof(SharedBuffer) + length;
+    int chunked = chunks != NULL && size <= BUFFER_CHUNK_SIZE;
+    SharedBuffer* buffer;
+    if (chunked) {
+        buffer = allocSlab(chunks);
+    } else if (reserveMemory(budgetOf(chunks), size) == 0) {
+        buffer = malloc(size);
+        if (buffer == NULL) {
+            releaseMemory(budgetOf(chunks), size);
+        }
+    } else {
+        buffer = NULL;
+    }
+    if (buffer == NULL) {
+        return NULL;
+    }
+    buffer->refs = 1;
+    buffer->chunked = chunked;
+    buffer->length = length;
+    memcpy(buffer->data, data, length);
+    return buffer;
+}
+
+/**
+ * @brief Drops a reference to a shared buffer, freeing it with the last one.
+ *
+ * @param buffer Pointer to the buffer, or NULL.
+ * @param chunks Cache of the calling thread to return the buffer to, or NULL.
+ */
+void releaseSharedBuffer(SharedBuffer* buffer, SlabCache* chunks) {
+    if (buffer == NULL || --buffer->refs > 0) {
+        return;
+    }
+    if (buffer->chunked) {
+        freeSlab(chunks, buffer);
+    } else {
+        releaseMemory(budgetOf(chunks), sizeof(SharedBuffer) + buffer->length);
+        free(buffer);
+    }
+}
+
+/**
+ * @brief Frees a queue's private bytes.
+ *
+ * @param queue Pointer to the queue.
+ */
+static void freeBytes(OutputQueue* queue) {
+    if (queue->chunkedBytes) {
+        freeSlab(queue->chunks, queue->bytes);
+    } else if (queue->bytes != NULL) {
+        releaseMemory(budgetOf(queue->chunks), queue->capacity);
+        free(queue->bytes);
+    }
+}
+
+/**
+ * @brief Moves a queue's private bytes to a buffer big enough for more.
+ *
+ * The first buffer is a chunk when the queue has a cache; larger ones double in size.
+ *
+ * @param queue Pointer to the queue.
+ * @param needed Bytes the buffer must hold.
+ * @return 0 on success, -1 if the budget is spent or memory runs out.
+ */
+static int growBytes(OutputQueue* queue, size_t needed) {
+    int chunked = queue->chunks != NULL && needed <= BUFFER_CHUNK_SIZE;
+    size_t capacity = BUFFER_CHUNK_SIZE;
+    char* bytes;
+    if (chunked) {
+        bytes = allocSlab(queue->chunks);
+    } else {
+        while (capacity < needed || capacity <= queue->capacity) {
+            capacity *= 2;
+        }
+        if (reserveMemory(budgetOf(queue->chunks), capacity) != 0) {
+            return -1;
+        }
+        bytes = malloc(capacity);
+        if (bytes == NULL) {
+            releaseMemory(budgetOf(queue->chunks), capacity);
+        }
+    }
+    if (bytes == NULL) {
+        return -1;
+    }
+    if (queue->length > 0) {
+        memcpy(bytes, queue->bytes, queue->length);
+    }
+    freeBytes(queue);
+    queue->bytes = bytes;
+    queue->capacity = capacity;
+    queue->chunkedBytes = chunked;
+    return 0;
+}
+
+/**
+ * @brief Gives an empty queue its first chunk now, so its usual output takes no memory later.
+ *
+ * @param queue Pointer to the queue.
+ * @return 0 on success, -1 if the budget is spent or memory runs out.
+ */
+int reserveOutputChunk(OutputQueue* queue) {
+    return queue->capacity > 0 ? 0 : growBytes(queue, 1);
+}
+
+/**
+ * @brief Appends a copy of some bytes to a queue.
+ *
+ * @param queue Pointer to the queue.
+ * @param data The bytes.
+ * @param length Number of bytes.
+ * @param limit Most bytes the queue may hold.
+ * @return 0 on success, -1 if the queue would exceed the limit or memory runs out.
+ */
+int queueBytes(OutputQueue* queue, const void* data, size_t length, size_t limit) {
+    if (queue->pending + length > limit) {
+        return -1;
+    }
+    if (queue->sharedHead < queue->sharedCount) {
+        // Bytes may not overtake the shared buffers already waiting.
+        SharedBuffer* buffer = createSharedBuffer(data, length, queue->chunks);
+        if (buffer == NULL) {
+            return -1;
+        }
+        int result = queueShared(queue, buffer, limit);
+        releaseSharedBuffer(buffer, queue->chunks);
+        return result;
+    }
+
+    if (queue->length + length > queue->capacity && growBytes(queue, queue->length + length) != 0) {
+        return -1;
+    }
+    memcpy(queue->bytes + queue->length, data, length);
+    queue->length += length;
+    queue->pending += length;
+    return 0;
+}
+
+/**
+ * @brief Appends a reference to a shared buffer to a queue.
+ *
+ * @param queue Pointer to the queue.
+ * @param buffer Pointer to the buffer; the queue takes its own reference.
+ * @param limit Most bytes the queue may hold.
+ * @return 0 on success, -1 if the queue would exceed the limit or memory runs out.
+ */
+int queueShared(OutputQueue* queue, SharedBuffer* buffer, size_t limit) {
+    if (queue->pending + buffer->length > limit) {
+        return -1;
+    }
+    if (queue->sharedCount == queue->sharedCapacity) {
+        if (queue->sharedHead > 0) {
+            queue->sharedCount -= queue->sharedHead;
+            memmove(queue->shared, queue->shared + queue->sharedHead, queue->sharedCount * sizeof(SharedBuffer*));
+            queue->sharedHead = 0;
+        } else {
+            int capacity = queue->sharedCapacity > 0 ? 2 * queue->sharedCapacity : 8;
+            SharedBuffer** shared = realloc(queue->shared, capacity * sizeof(SharedBuffer*));
+            if (shared == NULL) {
+                return -1;
+            }
+            queue->shared = shared;
+            queue->sharedCapacity = capacity;
+        }
+    }
+    buffer->refs++;
+    queue->shared[queue->sharedCount++] = buffer;
+    queue->pending += buffer->length;
+    return 0;
+}
+
+/**
+ * @brief Removes bytes that were sent from the front of a queue.
+ *
+ * @param queue Pointer to the queue.
+ * @param sent Number of bytes sent.
+ */
+static void consumeOutput(OutputQueue* queue, size_t sent) {
+    queue->pending -= sent;
+    size_t fromBytes = sent < queue->length ? sent : queue->length;
+    memmove(queue->bytes, queue->bytes + fromBytes, queue->length - fromBytes);
+    queue->length -= fromBytes;
+    sent -= fromBytes;
+
+    while (sent > 0) {
+        SharedBuffer* buffer = queue->shared[queue->sharedHead];
+        size_t left = buffer->length - queue->sharedSent;
+        if (sent < left) {
+            queue->sharedSent += sent;
+            break;
+        }
+        sent -= left;
+        releaseSharedBuffer(buffer, queue->chunks);
+        queue->sharedHead++;
+        queue->sharedSent = 0;
+    }
+    if (queue->sharedHead == queue->sharedCount) {
+        queue->sharedHead = queue->sharedCount = 0;
+    }
+}
+
+/**
+ * @brief Sends as much of a queue as a non-blocking socket takes, with scatter-gather writes.
+ *
+ * @param queue Pointer to the queue.
+ * @param fd The socket.
+ * @return 0 if the queue was sent or the socket is full, -1 if the socket failed.
+ */
+int flushOutputQueue(OutputQueue* queue, int fd) {
+    while (queue->pending > 0) {
+        struct iovec pieces[MAX_FLUSH_PIECES];
+        int count = 0;
+        if (queue->length > 0) {
+            pieces[count++] = (struct iovec) { queue->bytes, queue->length };
+        }
+        for (int i = queue->sharedHead; i < queue->sharedCount && count < MAX_FLUSH_PIECES; ++i) {
+            size_t skip = i == queue->sharedHead ? queue->sharedSent : 0;
+            pieces[count++] = (struct iovec) { queue->shared[i]->data + skip, queue->shared[i]->length - skip };
+        }
+
+        // sendmsg rather than writev, so a closed peer gives EPIPE instead of SIGPIPE.
+        struct msghdr message = { .msg_iov = pieces, .msg_iovlen = (size_t)count };
+        ssize_t n = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        consumeOutput(queue, (size_t)n);
+    }
+    return 0;
+}
+
+/**
+ * @brief Frees everything a queue holds and empties it.
+ *
+ * @param queue Pointer to the queue.
+ */
+void freeOutputQueue(OutputQueue* queue) {
+    for (int i = queue->sharedHead; i < queue->sharedCount; ++i) {
+        releaseSharedBuffer(queue->shared[i], queue->chunks);
+    }
+    free(queue->shared);
+    freeBytes(queue);
+    SlabCache* chunks = queue->chunks;
+    memset(queue, 0, sizeof(*queue));
+    queue->chunks = chunks;
+}
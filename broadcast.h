@@ -0,0 +1,130 @@
+/**
+ * @file broadcast.h
+ * @brief Header file for shared message buffers and the output queues that send them.
+ *
+ * A message meant for many connections, such as a move seen by every spectator of a
+ * match, is encoded once into a SharedBuffer. Each connection's OutputQueue then holds a
+ * reference to the buffer rather than a copy, and sends its queue with one scatter-gather
+ * write, so fanning a message out to N connections costs N pointers instead of N
+ * encodings. Buffers are immutable once created and freed when their last reference is
+ * released.
+ *
+ * Reference counts are plain integers: a buffer and every queue holding it must belong to
+ * the same thread.
+ *
+ * Given a SlabCache of BUFFER_CHUNK_SIZE objects, small buffers and a queue's first private
+ * chunk come from the cache, and anything larger is charged to the cache's budget, so the
+ * output of every connection counts against the server's memory budget. Calls on queues
+ * and buffers that meet must pass caches of the same depot, or all pass NULL to use malloc
+ * alone.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include <stddef.h>
+#include "slab.h"
+
+/** Size of the chunks small buffers are taken from. */
+#define BUFFER_CHUNK_SIZE 256
+
+/**
+ * @struct SharedBuffer
+ * @brief An immutable, reference-counted message.
+ */
+typedef struct {
+    int refs;      /**< Number of holders */
+    int chunked;   /**< 1 if the buffer is a chunk from a SlabCache */
+    size_t length; /**< Number of bytes in data */
+    char data[];   /**< The message */
+} SharedBuffer;
+
+/**
+ * @struct OutputQueue
+ * @brief Bytes waiting to be sent on one socket, in order.
+ *
+ * Bytes queued while no shared buffer is waiting are copied into the private buffer,
+ * which is always sent first; once shared buffers are waiting, further bytes are queued
+ * behind them in a buffer of their own, so the order of the stream is kept.
+ */
+typedef struct {
+    char* bytes;            /**< Private bytes, sent before any shared buffer */
+    size_t length;          /**< Number of bytes in bytes */
+    size_t capacity;        /**< Size of bytes */
+    SharedBuffer** shared;  /**< Shared buffers after the private bytes, from sharedHead */
+    int sharedHead;         /**< Index of the first shared buffer not fully sent */
+    int sharedCount;        /**< Index after the last shared buffer */
+    int sharedCapacity;     /**< Size of shared */
+    size_t sharedSent;      /**< Bytes of the first shared buffer already sent */
+    size_t pending;         /**< Total bytes waiting */
+    int chunkedBytes;       /**< 1 if bytes is a chunk from a SlabCache */
+    SlabCache* chunks;      /**< Cache of the queue's thread that chunks come from, or NULL */
+} OutputQueue;
+
+/**
+ * @brief Creates a shared buffer holding a copy of a message.
+ *
+ * @param data The message.
+ * @param length Number of bytes in the message.
+ * @param chunks Cache of the calling thread to take the buffer from, or NULL.
+ * @return Pointer to the buffer, holding one reference for the caller, or NULL if out of memory.
+ */
+SharedBuffer* createSharedBuffer(const void* data, size_t length, SlabCache* chunks);
+
+/**
+ * @brief Drops a reference to a shared buffer, freeing it with the last one.
+ *
+ * @param buffer Pointer to the buffer, or NULL.
+ * @param chunks Cache of the calling thread to return the buffer to, or NULL.
+ */
+void releaseSharedBuffer(SharedBuffer* buffer, SlabCache* chunks);
+
+/**
+ * @brief Gives an empty queue its first chunk now, so its usual output takes no memory later.
+ *
+ * @param queue Pointer to the queue.
+ * @return 0 on success, -1 if the budget is spent or memory runs out.
+ */
+int reserveOutputChunk(OutputQueue* queue);
+
+/**
+ * @brief Appends a copy of some bytes to a queue.
+ *
+ * @param queue Pointer to the queue.
+ * @param data The bytes.
+ * @param length Number of bytes.
+ * @param limit Most bytes the queue may hold.
+ * @return 0 on success, -1 if the queue would exceed the limit or memory runs out.
+ */
+int queueBytes(OutputQueue* queue, const void* data, size_t length, size_t limit);
+
+/**
+ * @brief Appends a reference to a shared buffer to a queue.
+ *
+ * @param queue Pointer to the queue.
+ * @param buffer Pointer to the buffer; the queue takes its own reference.
+ * @param limit Most bytes the queue may hold.
+ * @return 0 on success, -1 if the queue would exceed the limit or memory runs out.
+ */
+int queueShared(OutputQueue* queue, SharedBuffer* buffer, size_t limit);
+
+/**
+ * @brief Sends as much of a queue as a non-blocking socket takes, with scatter-gather writes.
+ *
+ * @param queue Pointer to the queue.
+ * @param fd The socket.
+ * @return 0 if the queue was sent or the socket is full, -1 if the socket failed.
+ */
+int flushOutputQueue(OutputQueue* queue, int fd);
+
+/**
+ * @brief Frees everything a queue holds and empties it.
+ *
+ * @param queue Pointer to the queue.
+ */
+void freeOutputQueue(OutputQueue* queue);
+
+#endif /* BROADCAST_H */
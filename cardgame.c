@@ -17,20 +17,40 @@
 /**
  * @brief Prompts the user to enter the number of packs of cards for the game.
  *
- * The user is prompted until a valid number of packs (between 1 and 10) is entered.
+ * The user is prompted until a valid number of packs (between 1 and MAX_PACKS) is entered.
  *
  * @return The number of packs entered by the user.
  */
 int getNumPacksFromUser() {
     int numPacks;
     do {
-        printf("Enter the number of packs of cards from one to ten: ");
+        printf("Enter the number of packs of cards from 1 to %d: ", MAX_PACKS);
         scanf_s("%u", &numPacks);
-    } while (numPacks < 1 || numPacks > 10);
+    } while (numPacks < 1 || numPacks > MAX_PACKS);
 
     return numPacks;
 }
 
+/**
+ * @brief Prompts the user to enter the number of players for the game.
+ *
+ * The user is prompted until a number is entered from two up to the most players the
+ * packs can deal CARDS_PER_PLAYER cards to while leaving a card to turn up.
+ *
+ * @param numPacks The number of packs in the game.
+ * @return The number of players entered by the user.
+ */
+int getNumPlayersFromUser(int numPacks) {
+    int maxPlayers = (numPacks * NUM_CARD_IDS - 1) / CARDS_PER_PLAYER;
+    int numPlayers;
+    do {
+        printf("Enter the number of players from two to %d: ", maxPlayers);
+        scanf_s("%u", &numPlayers);
+    } while (numPlayers < 2 || numPlayers > maxPlayers);
+
+    return numPlayers;
+}
+
 /**
  * @brief Initializes a deck of cards with the specified number of packs.
  *
@@ -40,7 +60,7 @@ int getNumPacksFromUser() {
  * @return The initialized deck of cards.
  */
 DeckOfCards initializeDeck(int numPacks) {
-    DeckOfCards deck = { NULL, 0, {0} };
+    DeckOfCards deck = { NULL, 0, {0}, 0 };
     for (int pack = 0; pack < numPacks; ++pack) {
         for (int suit = Club; suit <= Diamond; ++suit) {
             for (int rank = Two; rank <= Ace; ++rank) {
@@ -51,6 +71,90 @@ DeckOfCards initializeDeck(int numPacks) {
     return deck;
 }
 
+/**
+ * @brief Initializes a deck of the specified number of packs as card counts.
+ *
+ * @param numPacks The number of packs in the deck.
+ * @return The initialized deck, ready to draw from without shuffling.
+ */
+CardMultiset initializeMultiset(int numPacks) {
+    CardMultiset deck;
+    for (int id = 0; id < NUM_CARD_IDS; ++id) {
+        deck.counts[id] = (uint32_t)numPacks;
+    }
+    deck.size = (uint32_t)numPacks * NUM_CARD_IDS;
+    return deck;
+}
+
+/**
+ * @brief Adds a card to a deck kept as card counts.
+ *
+ * @param deck Pointer to the deck.
+ * @param card The card to be added to the deck.
+ */
+void addCardToMultiset(CardMultiset* deck, PlayingCard card) {
+    deck->counts[cardToId(card)]++;
+    deck->size++;
+}
+
+/**
+ * @brief Draws a random card from a non-empty deck kept as card counts.
+ *
+ * @param deck Pointer to the deck.
+ * @return The card drawn from the deck.
+ */
+PlayingCard drawRandomCard(CardMultiset* deck) {
+    // Two calls cover every deck size even where RAND_MAX is only 32767.
+    uint64_t r = ((uint64_t)rand() * ((uint64_t)RAND_MAX + 1) + (uint64_t)rand()) % deck->size;
+    int id = 0;
+    while (r >= deck->counts[id]) {
+        r -= deck->counts[id++];
+    }
+    deck->counts[id]--;
+    deck->size--;
+    return idToCard(id);
+}
+
+/**
+ * @brief Makes room in a deck for a number of cards, at least doubling its array when it grows.
+ *
+ * @param deck Pointer to the deck of cards.
+ * @param size The number of cards the deck must be able to hold.
+ */
+static void reserveDeck(DeckOfCards* deck, int size) {
+    if (size <= deck->capacity) {
+        return;
+    }
+    int capacity = deck->capacity > 0 ? 2 * deck->capacity : 8;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    deck->cards = realloc(deck->cards, capacity * sizeof(PlayingCard));
+    deck->capacity = capacity;
+}
+
+/**
+ * @brief Deals a hand of the given size to each player from a deck kept as card counts.
+ *
+ * Each hand grows once to take its whole slice of the deal, rather than once per card.
+ * Draws are random, so dealing each player's cards together gives the same deal as
+ * dealing one card to each player in turn.
+ *
+ * @param hiddenDeck Pointer to the deck, which must hold numPlayers * handSize cards.
+ * @param players Pointer to the first of the players' decks.
+ * @param numPlayers The number of players.
+ * @param handSize The number of cards dealt to each player.
+ */
+void dealCards(CardMultiset* hiddenDeck, DeckOfCards* players, int numPlayers, int handSize) {
+    for (int player = 0; player < numPlayers; ++player) {
+        DeckOfCards* hand = &players[player];
+        reserveDeck(hand, hand->size + handSize);
+        for (int i = 0; i < handSize; ++i) {
+            hand->cards[hand->size++] = drawRandomCard(hiddenDeck);
+        }
+    }
+}
+
 /**
  * @brief Shuffles the cards in the deck using the Fisher-Yates algorithm.
  *
@@ -111,6 +215,50 @@ const char* rankToString(Rank rank) {
     }
 }
 
+/**
+ * @brief Converts a card to its identity in the range [0, NUM_CARD_IDS).
+ *
+ * @param card The card to convert.
+ * @return The card identity (suit * NUM_RANKS + rank).
+ */
+int cardToId(PlayingCard card) {
+    return card.suit * NUM_RANKS + card.rank;
+}
+
+/**
+ * @brief Converts a card identity back to a card.
+ *
+ * @param id The card identity in the range [0, NUM_CARD_IDS).
+ * @return The card with that identity.
+ */
+PlayingCard idToCard(int id) {
+    return (PlayingCard) { (Suit)(id / NUM_RANKS), (Rank)(id % NUM_RANKS) };
+}
+
+/**
+ * @brief Returns the mask of every card identity of the given suit.
+ *
+ * @param suit The suit.
+ * @return A mask with the thirteen identities of the suit set.
+ */
+CardMask suitMask(Suit suit) {
+    return ((CardMask)0x1FFF) << (suit * NUM_RANKS);
+}
+
+/**
+ * @brief Returns the mask of every card identity of the given rank.
+ *
+ * @param rank The rank.
+ * @return A mask with the four identities of the rank set.
+ */
+CardMask rankMask(Rank rank) {
+    CardMask mask = 0;
+    for (int suit = Club; suit <= Diamond; ++suit) {
+        mask |= (CardMask)1 << (suit * NUM_RANKS + rank);
+    }
+    return mask;
+}
+
 /**
  * @brief Sorts the cards in the deck in ascending order of rank.
  *
@@ -135,7 +283,7 @@ void customSort(DeckOfCards* deck) {
  * @param card The card to be added to the deck.
  */
 void addCardToDeck(DeckOfCards* deck, PlayingCard card) {
-    deck->cards = realloc(deck->cards, (deck->size + 1) * sizeof(PlayingCard));
+    reserveDeck(deck, deck->size + 1);
     deck->cards[deck->size++] = card;
 }
 
@@ -148,7 +296,6 @@ void addCardToDeck(DeckOfCards* deck, PlayingCard card) {
 PlayingCard drawCard(DeckOfCards* deck) {
     PlayingCard topCard = deck->cards[deck->size - 1];
     deck->size--;
-    deck->cards = realloc(deck->cards, deck->size * sizeof(PlayingCard));
     return topCard;
 }
 
@@ -165,30 +312,67 @@ int canPlayCard(PlayingCard card, PlayingCard topCard) {
     return (card.rank == topCard.rank || card.suit == topCard.suit);
 }
 
+/**
+ * @brief Returns the mask of every card that can be played on the top card.
+ *
+ * @param topCard The top card of the played deck.
+ * @return The identities with the same suit or rank as the top card.
+ */
+CardMask matchingCardsMask(PlayingCard topCard) {
+    return suitMask(topCard.suit) | rankMask(topCard.rank);
+}
+
+/**
+ * @brief Returns every legal move for a player in one call.
+ *
+ * @param player Pointer to the player's deck.
+ * @param topCard The top card of the played deck.
+ * @return The identities of the player's playable cards, or DRAW_MOVE_BIT if there are none.
+ */
+CardMask legalMoveMask(const DeckOfCards* player, PlayingCard topCard) {
+    CardMask held = 0;
+    for (int i = 0; i < player->size; ++i) {
+        held |= (CardMask)1 << cardToId(player->cards[i]);
+    }
+    CardMask legal = held & matchingCardsMask(topCard);
+    return legal ? legal : DRAW_MOVE_BIT;
+}
+
 /**
  * @brief Performs a turn in the game for the current player.
  *
  * The player attempts to play a card from their deck, and if not possible,
- * draws a card from the hidden deck. The played card is added to the played deck.
+ * draws a card from the hidden deck, or passes if it is empty. The played card is added to
+ * the played deck, as is a card turned up when there is no top card. When the hidden deck
+ * runs out, the played cards are returned to it. If every card is in the players' hands,
+ * nothing can be turned up and the player leads any card.
  *
  * @param hiddenDeck Pointer to the hidden deck of cards.
  * @param player Pointer to the current player's deck.
  * @param playedDeck Pointer to the played deck of cards.
  * @param currentPlayer The turn of the current player.
  */
-void takeTurn(DeckOfCards* hiddenDeck, DeckOfCards* player, DeckOfCards* playedDeck, PlayerTurn currentPlayer) {
+void takeTurn(CardMultiset* hiddenDeck, DeckOfCards* player, DeckOfCards* playedDeck, PlayerTurn currentPlayer) {
     PlayingCard topCard = playedDeck->topCard;
 
-    if (topCard.rank == 0) {
-        topCard = drawCard(hiddenDeck);
+    int leads = 0;
+    if (topCard.rank == 0 && hiddenDeck->size > 0) {
+        // The turned-up card goes on the played deck, so a reshuffle returns it to the hidden deck.
+        topCard = drawRandomCard(hiddenDeck);
+        playedDeck->topCard = topCard;
+        addCardToDeck(playedDeck, topCard);
         printf("\nPlayer %d's turn - Top card: %s of %s\n", currentPlayer + 1, rankToString(topCard.rank), suitToString(topCard.suit));
+    } else if (topCard.rank == 0) {
+        leads = 1;
+        printf("\nPlayer %d's turn - No card to turn up, so any card may be played\n", currentPlayer + 1);
     } else {
         printf("\nPlayer %d's turn - Top card: %s of %s (last played)\n", currentPlayer + 1, rankToString(topCard.rank), suitToString(topCard.suit));
     }
 
-    int matchIndex = -1;
-    for (int i = 0; i < player->size; ++i) {
-        if (canPlayCard(player->cards[i], topCard)) {
+    int matchIndex = leads ? 0 : -1;
+    CardMask legal = leads ? 0 : legalMoveMask(player, topCard);
+    for (int i = 0; i < player->size && !(legal & DRAW_MOVE_BIT); ++i) {
+        if (legal & ((CardMask)1 << cardToId(player->cards[i]))) {
             matchIndex = i;
             break;
         }
@@ -203,12 +387,13 @@ void takeTurn(DeckOfCards* hiddenDeck, DeckOfCards* player, DeckOfCards* playedD
         for (int i = matchIndex; i < player->size; ++i) {
             player->cards[i] = player->cards[i + 1];
         }
-        player->cards = realloc(player->cards, player->size * sizeof(PlayingCard));
 
         printf("\nPlayer %d's cards:\n", currentPlayer + 1);
         displayDeck(*player);
+    } else if (hiddenDeck->size == 0) {
+        printf("Player %d passes: the hidden deck is empty\n", currentPlayer + 1);
     } else {
-        PlayingCard drawnCard = drawCard(hiddenDeck);
+        PlayingCard drawnCard = drawRandomCard(hiddenDeck);
         addCardToDeck(player, drawnCard);  // Add the drawn card to the player's deck
         printf("Player %d picks a card from the hidden deck\n", currentPlayer + 1);
 
@@ -218,48 +403,68 @@ void takeTurn(DeckOfCards* hiddenDeck, DeckOfCards* player, DeckOfCards* playedD
 
     if (hiddenDeck->size == 0) {
         printf("\nReshuffling the deck!\n");
-        hiddenDeck->cards = realloc(hiddenDeck->cards, playedDeck->size * sizeof(PlayingCard));
         for (int i = 0; i < playedDeck->size; ++i) {
-            hiddenDeck->cards[i] = playedDeck->cards[i];
+            addCardToMultiset(hiddenDeck, playedDeck->cards[i]);
         }
-        hiddenDeck->size = playedDeck->size;
-
+        // Keep the array: the played deck fills up again straight away.
         playedDeck->size = 0;
         playedDeck->topCard.rank = 0; // Reset the top card when reshuffling
-
-        shuffleDeck(hiddenDeck);
     }
 }
 
 /**
- * @brief Checks if the game has finished by determining if any player has an empty deck.
+ * @brief Checks if the game has finished after a player's turn.
+ *
+ * Only the player who just moved can have emptied their deck, so this checks that player
+ * alone and takes the same time however many players there are.
  *
- * @param player1 Pointer to the first player's deck.
- * @param player2 Pointer to the second player's deck.
+ * @param player Pointer to the deck of the player who just moved.
  * @return 1 if the game has finished, 0 otherwise.
  */
-int isGameFinished(DeckOfCards* player1, DeckOfCards* player2) {
-    return (player1->size == 0 || player2->size == 0);
+int isGameFinished(const DeckOfCards* player) {
+    return player->size == 0;
+}
+
+/**
+ * @brief Plays the next turn of a game and passes play on.
+ *
+ * @param game Pointer to the game.
+ * @return 1 if the game has finished, 0 otherwise.
+ */
+int stepCardGame(CardGame* game) {
+    if (game->finished) {
+        return 1;
+    }
+    DeckOfCards* player = &game->players[game->currentPlayer];
+    takeTurn(game->hiddenDeck, player, game->playedDeck, game->currentPlayer);
+    if (isGameFinished(player)) {
+        game->finished = 1;
+        return 1;
+    }
+    int next = (int)game->currentPlayer + 1;
+    game->currentPlayer = (next == game->numPlayers) ? PlayerOne : (PlayerTurn)next;
+    return 0;
 }
 
 /**
- * @brief Starts the card game between two players.
+ * @brief Starts the card game between any number of players.
  *
- * The game proceeds with players taking turns until one of them runs out of cards.
+ * The game proceeds with players taking turns in order until one of them runs out of cards,
+ * one stepCardGame call per turn.
  *
  * @param hiddenDeck Pointer to the hidden deck of cards.
- * @param player1 Pointer to the first player's deck.
- * @param player2 Pointer to the second player's deck.
+ * @param players Array of the players' decks, in turn order.
+ * @param numPlayers The number of players.
  * @param playedDeck Pointer to the played deck of cards.
  * @param currentPlayer Pointer to the variable indicating the current player's turn.
  */
-void startGame(DeckOfCards* hiddenDeck, DeckOfCards* player1, DeckOfCards* player2, DeckOfCards* playedDeck, PlayerTurn* currentPlayer) {
+void startGame(CardMultiset* hiddenDeck, DeckOfCards* players, int numPlayers, DeckOfCards* playedDeck, PlayerTurn* currentPlayer) {
     printf("\nGame started!\n");
 
-    while (!isGameFinished(player1, player2)) {
-        takeTurn(hiddenDeck, (*currentPlayer == PlayerOne) ? player1 : player2, playedDeck, *currentPlayer);
-        *currentPlayer = (*currentPlayer == PlayerOne) ? PlayerTwo : PlayerOne;
+    CardGame game = { hiddenDeck, players, numPlayers, playedDeck, *currentPlayer, 0 };
+    while (!stepCardGame(&game)) {
     }
+    *currentPlayer = game.currentPlayer;
 
     printf("\nGame over!\n");
 }
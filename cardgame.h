@@ -13,6 +13,21 @@
 #ifndef CARD_GAME_H
 #define CARD_GAME_H
 
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/** Number of suits in one pack. */
+#define NUM_SUITS 4
+
+/** Number of ranks in each suit. */
+#define NUM_RANKS 13
+
+/** Number of distinct card identities in one pack (suit * NUM_RANKS + rank). */
+#define NUM_CARD_IDS 52
+
 /**
  * @enum Suit
  * @brief Enumeration of card suits.
@@ -41,25 +56,98 @@ typedef struct {
     Rank rank; /**< The rank of the card */
 } PlayingCard;
 
+/**
+ * @brief Set of card identities, one bit per identity (bit suit * NUM_RANKS + rank).
+ */
+typedef uint64_t CardMask;
+
+/**
+ * @brief Returns the lowest card identity in a non-empty mask.
+ *
+ * @param mask The card mask; must not be zero.
+ * @return The lowest card identity set in the mask.
+ */
+static inline int lowestCardId(CardMask mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+/**
+ * @brief Counts the card identities in a mask.
+ *
+ * @param mask The card mask.
+ * @return The number of bits set in the mask.
+ */
+static inline int countCardIds(CardMask mask) {
+#if defined(_MSC_VER)
+    return (int)__popcnt64(mask);
+#else
+    return __builtin_popcountll(mask);
+#endif
+}
+
+/** Bit set in a legal move mask when the only legal move is to draw. */
+#define DRAW_MOVE_BIT ((CardMask)1 << NUM_CARD_IDS)
+
 /**
  * @struct DeckOfCards
  * @brief Structure representing a deck of cards.
+ *
+ * The array only ever grows, doubling as needed, so a game reuses the same few blocks
+ * rather than reallocating on every card played or drawn.
  */
 typedef struct {
     PlayingCard* cards;  /**< Array of cards in the deck */
     int size;            /**< Number of cards in the deck */
     PlayingCard topCard; /**< The top card of the deck */
+    int capacity;        /**< Number of cards the array has room for */
 } DeckOfCards;
 
 /**
  * @enum PlayerTurn
- * @brief Enumeration of player turns.
+ * @brief Index of the player whose turn it is; games with more players continue past PlayerTwo.
  */
 typedef enum {
     PlayerOne, /**< Player One's turn */
     PlayerTwo  /**< Player Two's turn */
 } PlayerTurn;
 
+/** Number of cards dealt to each player at the start of the game. */
+#define CARDS_PER_PLAYER 8
+
+/** Maximum number of packs in a game. */
+#define MAX_PACKS 1000000
+
+/**
+ * @struct CardMultiset
+ * @brief A deck of cards kept as the count of each card identity.
+ *
+ * Drawing picks a random card, which is the same as drawing the top card of a shuffled
+ * deck, so a deck of any number of packs takes the same memory and set-up time.
+ */
+typedef struct {
+    uint32_t counts[NUM_CARD_IDS]; /**< Count of each card identity in the deck */
+    uint32_t size;                 /**< Number of cards in the deck */
+} CardMultiset;
+
+/**
+ * @struct CardGame
+ * @brief A game in progress, kept between turns so it can be played one turn at a time.
+ */
+typedef struct {
+    CardMultiset* hiddenDeck; /**< The hidden deck */
+    DeckOfCards* players;     /**< The players' decks, in turn order */
+    int numPlayers;           /**< Number of players */
+    DeckOfCards* playedDeck;  /**< The played deck */
+    PlayerTurn currentPlayer; /**< Player to move next, or the winner once finished */
+    int finished;             /**< 1 once a player has run out of cards */
+} CardGame;
+
 /**
  * @brief Initializes a deck of cards with the specified number of packs.
  *
@@ -70,6 +158,44 @@ typedef enum {
  */
 DeckOfCards initializeDeck(int numPacks);
 
+/**
+ * @brief Initializes a deck of the specified number of packs as card counts.
+ *
+ * @param numPacks The number of packs in the deck.
+ * @return The initialized deck, ready to draw from without shuffling.
+ */
+CardMultiset initializeMultiset(int numPacks);
+
+/**
+ * @brief Adds a card to a deck kept as card counts.
+ *
+ * @param deck Pointer to the deck.
+ * @param card The card to be added to the deck.
+ */
+void addCardToMultiset(CardMultiset* deck, PlayingCard card);
+
+/**
+ * @brief Draws a random card from a non-empty deck kept as card counts.
+ *
+ * @param deck Pointer to the deck.
+ * @return The card drawn from the deck.
+ */
+PlayingCard drawRandomCard(CardMultiset* deck);
+
+/**
+ * @brief Deals a hand of the given size to each player from a deck kept as card counts.
+ *
+ * Each hand grows once to take its whole slice of the deal, rather than once per card.
+ * Draws are random, so dealing each player's cards together gives the same deal as
+ * dealing one card to each player in turn.
+ *
+ * @param hiddenDeck Pointer to the deck, which must hold numPlayers * handSize cards.
+ * @param players Pointer to the first of the players' decks.
+ * @param numPlayers The number of players.
+ * @param handSize The number of cards dealt to each player.
+ */
+void dealCards(CardMultiset* hiddenDeck, DeckOfCards* players, int numPlayers, int handSize);
+
 /**
  * @brief Shuffles the cards in the deck using the Fisher-Yates algorithm.
  *
@@ -100,6 +226,38 @@ const char* suitToString(Suit suit);
  */
 const char* rankToString(Rank rank);
 
+/**
+ * @brief Converts a card to its identity in the range [0, NUM_CARD_IDS).
+ *
+ * @param card The card to convert.
+ * @return The card identity (suit * NUM_RANKS + rank).
+ */
+int cardToId(PlayingCard card);
+
+/**
+ * @brief Converts a card identity back to a card.
+ *
+ * @param id The card identity in the range [0, NUM_CARD_IDS).
+ * @return The card with that identity.
+ */
+PlayingCard idToCard(int id);
+
+/**
+ * @brief Returns the mask of every card identity of the given suit.
+ *
+ * @param suit The suit.
+ * @return A mask with the thirteen identities of the suit set.
+ */
+CardMask suitMask(Suit suit);
+
+/**
+ * @brief Returns the mask of every card identity of the given rank.
+ *
+ * @param rank The rank.
+ * @return A mask with the four identities of the rank set.
+ */
+CardMask rankMask(Rank rank);
+
 /**
  * @brief Sorts the cards in the deck in ascending order of rank.
  *
@@ -134,48 +292,91 @@ PlayingCard drawCard(DeckOfCards* deck);
  */
 int canPlayCard(PlayingCard card, PlayingCard topCard);
 
+/**
+ * @brief Returns the mask of every card that can be played on the top card.
+ *
+ * @param topCard The top card of the played deck.
+ * @return The identities with the same suit or rank as the top card.
+ */
+CardMask matchingCardsMask(PlayingCard topCard);
+
+/**
+ * @brief Returns every legal move for a player in one call.
+ *
+ * @param player Pointer to the player's deck.
+ * @param topCard The top card of the played deck.
+ * @return The identities of the player's playable cards, or DRAW_MOVE_BIT if there are none.
+ */
+CardMask legalMoveMask(const DeckOfCards* player, PlayingCard topCard);
+
 /**
  * @brief Performs a turn in the game for the current player.
  *
  * The player attempts to play a card from their deck, and if not possible,
  * draws a card from the hidden deck. The played card is added to the played deck.
+ * When the hidden deck runs out, the played cards are returned to it.
  *
  * @param hiddenDeck Pointer to the hidden deck of cards.
  * @param player Pointer to the current player's deck.
  * @param playedDeck Pointer to the played deck of cards.
  * @param currentPlayer The turn of the current player.
  */
-void takeTurn(DeckOfCards* hiddenDeck, DeckOfCards* player, DeckOfCards* playedDeck, PlayerTurn currentPlayer);
+void takeTurn(CardMultiset* hiddenDeck, DeckOfCards* player, DeckOfCards* playedDeck, PlayerTurn currentPlayer);
 
 /**
- * @brief Checks if the game has finished by determining if any player has an empty deck.
+ * @brief Checks if the game has finished after a player's turn.
  *
- * @param player1 Pointer to the first player's deck.
- * @param player2 Pointer to the second player's deck.
+ * Only the player who just moved can have emptied their deck, so this checks that player
+ * alone and takes the same time however many players there are.
+ *
+ * @param player Pointer to the deck of the player who just moved.
  * @return 1 if the game has finished, 0 otherwise.
  */
-int isGameFinished(DeckOfCards* player1, DeckOfCards* player2);
+int isGameFinished(const DeckOfCards* player);
 
 /**
- * @brief Starts the card game between two players.
+ * @brief Plays the next turn of a game and passes play on.
  *
- * The game proceeds with players taking turns until one of them runs out of cards.
+ * Nothing in a turn waits for input, so a caller can interleave the turns of many games,
+ * or stop between turns and resume later.
+ *
+ * @param game Pointer to the game.
+ * @return 1 if the game has finished, 0 otherwise.
+ */
+int stepCardGame(CardGame* game);
+
+/**
+ * @brief Starts the card game between any number of players.
+ *
+ * The game proceeds with players taking turns in order until one of them runs out of cards,
+ * one stepCardGame call per turn.
  *
  * @param hiddenDeck Pointer to the hidden deck of cards.
- * @param player1 Pointer to the first player's deck.
- * @param player2 Pointer to the second player's deck.
+ * @param players Array of the players' decks, in turn order.
+ * @param numPlayers The number of players.
  * @param playedDeck Pointer to the played deck of cards.
  * @param currentPlayer Pointer to the variable indicating the current player's turn.
  */
-void startGame(DeckOfCards* hiddenDeck, DeckOfCards* player1, DeckOfCards* player2, DeckOfCards* playedDeck, PlayerTurn* currentPlayer);
+void startGame(CardMultiset* hiddenDeck, DeckOfCards* players, int numPlayers, DeckOfCards* playedDeck, PlayerTurn* currentPlayer);
 
 /**
  * @brief Prompts the user to enter the number of packs of cards for the game.
  *
- * The user is prompted until a valid number of packs (between 1 and 10) is entered.
+ * The user is prompted until a valid number of packs (between 1 and MAX_PACKS) is entered.
  *
  * @return The number of packs entered by the user.
  */
 int getNumPacksFromUser();
 
+/**
+ * @brief Prompts the user to enter the number of players for the game.
+ *
+ * The user is prompted until a number is entered from two up to the most players the
+ * packs can deal CARDS_PER_PLAYER cards to while leaving a card to turn up.
+ *
+ * @param numPacks The number of packs in the game.
+ * @return The number of players entered by the user.
+ */
+int getNumPlayersFromUser(int numPacks);
+
 #endif /* CARD_GAME_H */
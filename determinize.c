@@ -0,0 +1,187 @@
+/**
+ * @file determinize.c
+ * @brief Implementation of sampling hidden information consistent with what a player has seen.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "determinize.h"
+
+/**
+ * @brief Resets the model to an unconstrained hand of the given size.
+ *
+ * @param model Pointer to the model to reset.
+ * @param handSize The number of cards in the opponent's hand.
+ */
+void resetOpponentModel(OpponentModel* model, int handSize) {
+    model->numGroups = 0;
+    if (handSize > 0) {
+        model->groups[0] = (HandConstraint) { handSize, 0 };
+        model->numGroups = 1;
+    }
+}
+
+/**
+ * @brief Records that the opponent drew a card because they could not play on topCard.
+ *
+ * All cards held so far gain the exclusion, and the drawn card starts a new group. When
+ * the model is full, the two newest groups are merged, keeping only their common
+ * exclusions; this loosens the newest constraint but never makes the model inconsistent.
+ *
+ * @param model Pointer to the model to update.
+ * @param topCard The top card the opponent could not match.
+ */
+void noteOpponentDraw(OpponentModel* model, PlayingCard topCard) {
+    CardMask excluded = suitMask(topCard.suit) | rankMask(topCard.rank);
+    for (int i = 0; i < model->numGroups; ++i) {
+        model->groups[i].excluded |= excluded;
+    }
+
+    // Groups that now share the same exclusions carry no separate information.
+    int kept = 0;
+    for (int i = 0; i < model->numGroups; ++i) {
+        if (kept > 0 && model->groups[kept - 1].excluded == model->groups[i].excluded) {
+            model->groups[kept - 1].size += model->groups[i].size;
+        } else {
+            model->groups[kept++] = model->groups[i];
+        }
+    }
+    model->numGroups = kept;
+
+    if (model->numGroups == MAX_CONSTRAINT_GROUPS) {
+        HandConstraint* older = &model->groups[MAX_CONSTRAINT_GROUPS - 2];
+        HandConstraint* newer = &model->groups[MAX_CONSTRAINT_GROUPS - 1];
+        older->size += newer->size;
+        older->excluded &= newer->excluded;
+        model->numGroups--;
+    }
+    model->groups[model->numGroups++] = (HandConstraint) { 1, 0 };
+}
+
+/**
+ * @brief Records that the opponent played a card from their hand.
+ *
+ * The card is charged to the oldest group that could have held it, which keeps the
+ * remaining constraints as weak as the evidence allows. If no group could have held it,
+ * the assumption that the opponent always plays when able was wrong, and all
+ * exclusions are dropped.
+ *
+ * @param model Pointer to the model to update.
+ * @param card The card the opponent played.
+ */
+void noteOpponentPlay(OpponentModel* model, PlayingCard card) {
+    CardMask bit = (CardMask)1 << cardToId(card);
+    int group = -1;
+    for (int i = 0; i < model->numGroups; ++i) {
+        if (!(model->groups[i].excluded & bit)) {
+            group = i;
+            break;
+        }
+    }
+
+    if (group == -1) {
+        resetOpponentModel(model, opponentHandSize(model) - 1);
+        return;
+    }
+
+    if (--model->groups[group].size == 0) {
+        for (int i = group; i < model->numGroups - 1; ++i) {
+            model->groups[i] = model->groups[i + 1];
+        }
+        model->numGroups--;
+    }
+}
+
+/**
+ * @brief Returns the number of cards in the opponent's hand according to the model.
+ *
+ * @param model Pointer to the model.
+ * @return The total size of all groups.
+ */
+int opponentHandSize(const OpponentModel* model) {
+    int size = 0;
+    for (int i = 0; i < model->numGroups; ++i) {
+        size += model->groups[i].size;
+    }
+    return size;
+}
+
+/**
+ * @brief Deals the unseen cards into the opponent's hand and the hidden deck.
+ *
+ * Groups are filled in order of how few unseen cards they allow. Because the groups'
+ * allowed sets are nested, the number of choices at every step is the same whatever was
+ * picked before, so drawing each card uniformly from what its group allows gives a deal
+ * that is uniform over all consistent deals. The leftover cards form the hidden deck, whose
+ * draws are random, so it needs no order.
+ *
+ * @param unseen Count of each card identity the player cannot see.
+ * @param model Pointer to the model of the opponent's hand.
+ * @param opponentHand Output array receiving opponentHandSize(model) card identities.
+ * @param deck Output array receiving the count of each identity left for the hidden deck.
+ * @param rng Pointer to the random number generator.
+ * @return The number of cards left for the hidden deck, or -1 if no consistent deal exists.
+ */
+int sampleDeal(const uint32_t unseen[NUM_CARD_IDS], const OpponentModel* model, uint8_t* opponentHand, uint32_t deck[NUM_CARD_IDS], Rng* rng) {
+    uint32_t remaining[NUM_CARD_IDS];
+    CardMask present = 0;
+    for (int id = 0; id < NUM_CARD_IDS; ++id) {
+        remaining[id] = unseen[id];
+        if (unseen[id] > 0) {
+            present |= (CardMask)1 << id;
+        }
+    }
+
+    // Order the groups by how many unseen cards they allow, fewest first.
+    int order[MAX_CONSTRAINT_GROUPS];
+    uint32_t allowedCount[MAX_CONSTRAINT_GROUPS];
+    for (int i = 0; i < model->numGroups; ++i) {
+        uint32_t count = 0;
+        for (CardMask m = present & ~model->groups[i].excluded; m; m &= m - 1) {
+            count += remaining[lowestCardId(m)];
+        }
+        int j = i;
+        while (j > 0 && allowedCount[order[j - 1]] > count) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+        allowedCount[i] = count;
+    }
+
+    int dealt = 0;
+    for (int k = 0; k < model->numGroups; ++k) {
+        const HandConstraint* group = &model->groups[order[k]];
+        CardMask allowed = ~group->excluded;
+        uint32_t total = 0;
+        for (CardMask m = present & allowed; m; m &= m - 1) {
+            total += remaining[lowestCardId(m)];
+        }
+        if (total < (uint32_t)group->size) {
+            return -1;
+        }
+
+        for (int n = 0; n < group->size; ++n) {
+            uint32_t r = randomBelow(rng, total--);
+            CardMask m = present & allowed;
+            int id = lowestCardId(m);
+            while (r >= remaining[id]) {
+                r -= remaining[id];
+                m &= m - 1;
+                id = lowestCardId(m);
+            }
+            if (--remaining[id] == 0) {
+                present &= ~((CardMask)1 << id);
+            }
+            opponentHand[dealt++] = (uint8_t)id;
+        }
+    }
+
+    int deckSize = 0;
+    for (int id = 0; id < NUM_CARD_IDS; ++id) {
+        deck[id] = remaining[id];
+        deckSize += (int)remaining[id];
+    }
+    return deckSize;
+}
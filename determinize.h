@@ -0,0 +1,96 @@
+/**
+ * @file determinize.h
+ * @brief Header file for sampling hidden information consistent with what a player has seen.
+ *
+ * Search-based players (for example ISMCTS) need many "determinizations": complete deals
+ * of the cards they cannot see into the opponent's hand and the hidden deck. This file
+ * declares a model of what is known about the opponent's hand and a sampler that builds
+ * such deals directly, uniformly among the deals consistent with that knowledge.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef DETERMINIZE_H
+#define DETERMINIZE_H
+
+#include <stdint.h>
+#include "cardgame.h"
+#include "rng.h"
+
+/** Maximum number of constraint groups tracked for the opponent's hand. */
+#define MAX_CONSTRAINT_GROUPS 16
+
+/**
+ * @struct HandConstraint
+ * @brief A group of opponent cards that share the same known exclusions.
+ */
+typedef struct {
+    int size;          /**< Number of opponent cards in the group */
+    CardMask excluded; /**< Card identities none of these cards can be */
+} HandConstraint;
+
+/**
+ * @struct OpponentModel
+ * @brief What is known about the opponent's hand, as groups ordered oldest first.
+ *
+ * Each time the opponent draws instead of playing, every card they held could not match
+ * the top card, so the suit and rank of that card are excluded for all existing groups.
+ * Cards drawn later are unconstrained, so older groups always exclude at least as much as
+ * newer ones. The sampler relies on this nesting to sample uniformly.
+ */
+typedef struct {
+    HandConstraint groups[MAX_CONSTRAINT_GROUPS]; /**< Constraint groups, oldest first */
+    int numGroups;                                /**< Number of groups in use */
+} OpponentModel;
+
+/**
+ * @brief Resets the model to an unconstrained hand of the given size.
+ *
+ * @param model Pointer to the model to reset.
+ * @param handSize The number of cards in the opponent's hand.
+ */
+void resetOpponentModel(OpponentModel* model, int handSize);
+
+/**
+ * @brief Records that the opponent drew a card because they could not play on topCard.
+ *
+ * @param model Pointer to the model to update.
+ * @param topCard The top card the opponent could not match.
+ */
+void noteOpponentDraw(OpponentModel* model, PlayingCard topCard);
+
+/**
+ * @brief Records that the opponent played a card from their hand.
+ *
+ * @param model Pointer to the model to update.
+ * @param card The card the opponent played.
+ */
+void noteOpponentPlay(OpponentModel* model, PlayingCard card);
+
+/**
+ * @brief Returns the number of cards in the opponent's hand according to the model.
+ *
+ * @param model Pointer to the model.
+ * @return The total size of all groups.
+ */
+int opponentHandSize(const OpponentModel* model);
+
+/**
+ * @brief Deals the unseen cards into the opponent's hand and the hidden deck.
+ *
+ * Every physical unseen card is treated as distinct, and the result is uniform among all
+ * deals in which each opponent group avoids its excluded identities. The deal is built
+ * constructively, most constrained group first, so its cost does not depend on how
+ * unlikely the constraints are.
+ *
+ * @param unseen Count of each card identity the player cannot see.
+ * @param model Pointer to the model of the opponent's hand.
+ * @param opponentHand Output array receiving opponentHandSize(model) card identities.
+ * @param deck Output array receiving the count of each identity left for the hidden deck.
+ * @param rng Pointer to the random number generator.
+ * @return The number of cards left for the hidden deck, or -1 if no consistent deal exists.
+ */
+int sampleDeal(const uint32_t unseen[NUM_CARD_IDS], const OpponentModel* model, uint8_t* opponentHand, uint32_t deck[NUM_CARD_IDS], Rng* rng);
+
+#endif /* DETERMINIZE_H */
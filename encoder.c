@@ -0,0 +1,135 @@
+/**
+ * @file encoder.c
+ * @brief Implementation of encoding a player's view of a game as a fixed-length tensor.
+ *
+ * The planes are built straight from the count vectors of the game state, sixteen (bytes)
+ * or eight (floats) card identities per instruction where SSE2 or AVX2 is available. Each
+ * plane is 52 entries long, so the last four entries of each are done without SIMD.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "encoder.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ENCODER_SSE2 1
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define ENCODER_AVX2 1
+#endif
+
+/** Number of plane entries handled by SIMD; the rest are handled one at a time. */
+#define SIMD_PLANE_SIZE 48
+
+/**
+ * @brief Saturates a count to a byte.
+ *
+ * @param count The count.
+ * @return The count, or 255 if it is larger.
+ */
+static uint8_t saturate(unsigned count) {
+    return (uint8_t)(count < 255 ? count : 255);
+}
+
+/**
+ * @brief Packs a plane of 52 counts into bytes with saturation.
+ *
+ * @param counts The counts.
+ * @param plane Output plane of 52 bytes.
+ */
+static void packCountPlane(const uint16_t* counts, uint8_t* plane) {
+    int id = 0;
+#if defined(ENCODER_SSE2)
+    for (; id < SIMD_PLANE_SIZE; id += 16) {
+        __m128i low = _mm_loadu_si128((const __m128i*)(counts + id));
+        __m128i high = _mm_loadu_si128((const __m128i*)(counts + id + 8));
+        // packus treats its input as signed, so counts are clamped to 255 first. SSE2 has
+        // no unsigned 16-bit min; x - max(x - 255, 0) is one, with a saturating subtract.
+        __m128i limit = _mm_set1_epi16(255);
+        low = _mm_sub_epi16(low, _mm_subs_epu16(low, limit));
+        high = _mm_sub_epi16(high, _mm_subs_epu16(high, limit));
+        _mm_storeu_si128((__m128i*)(plane + id), _mm_packus_epi16(low, high));
+    }
+#endif
+    for (; id < NUM_CARD_IDS; ++id) {
+        plane[id] = saturate(counts[id]);
+    }
+}
+
+/**
+ * @brief Encodes a player's view as bytes.
+ *
+ * @param state Pointer to the game state.
+ * @param player The player whose view is encoded.
+ * @param observation Output buffer of OBSERVATION_SIZE bytes.
+ */
+void encodeObservation(const GameState* state, int player, uint8_t* observation) {
+    packCountPlane(state->hands[player].counts, observation + OBS_HAND);
+    packCountPlane(state->played, observation + OBS_PLAYED);
+
+    uint8_t* top = observation + OBS_TOP_CARD;
+    int id = 0;
+#if defined(ENCODER_SSE2)
+    __m128i topCard = _mm_set1_epi8((char)state->topCard);
+    __m128i one = _mm_set1_epi8(1);
+    __m128i ids = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    for (; id < SIMD_PLANE_SIZE; id += 16) {
+        _mm_storeu_si128((__m128i*)(top + id), _mm_and_si128(_mm_cmpeq_epi8(ids, topCard), one));
+        ids = _mm_add_epi8(ids, _mm_set1_epi8(16));
+    }
+#endif
+    for (; id < NUM_CARD_IDS; ++id) {
+        top[id] = (uint8_t)(id == state->topCard);
+    }
+
+    observation[OBS_OPPONENT_SIZE] = saturate(state->hands[nextPlayer(state, player)].size);
+    observation[OBS_HIDDEN_SIZE] = saturate(state->hiddenSize);
+    memset(observation + OBS_HIDDEN_SIZE + 1, 0, OBSERVATION_SIZE - OBS_HIDDEN_SIZE - 1);
+}
+
+/**
+ * @brief Converts a plane of 52 counts to scaled floats.
+ *
+ * @param counts The counts.
+ * @param scale The factor applied to every count.
+ * @param plane Output plane of 52 floats.
+ */
+static void scaleCountPlane(const uint16_t* counts, float scale, float* plane) {
+    int id = 0;
+#if defined(ENCODER_AVX2)
+    __m256 factor = _mm256_set1_ps(scale);
+    for (; id < SIMD_PLANE_SIZE; id += 8) {
+        __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(counts + id)));
+        _mm256_storeu_ps(plane + id, _mm256_mul_ps(_mm256_cvtepi32_ps(wide), factor));
+    }
+#endif
+    for (; id < NUM_CARD_IDS; ++id) {
+        plane[id] = counts[id] * scale;
+    }
+}
+
+/**
+ * @brief Encodes a player's view as floats.
+ *
+ * @param state Pointer to the game state.
+ * @param player The player whose view is encoded.
+ * @param observation Output buffer of OBSERVATION_SIZE floats.
+ */
+void encodeObservationFloat(const GameState* state, int player, float* observation) {
+    float perPack = 1.0f / state->numPacks;
+    float perCard = perPack / NUM_CARD_IDS;
+    scaleCountPlane(state->hands[player].counts, perPack, observation + OBS_HAND);
+    scaleCountPlane(state->played, perPack, observation + OBS_PLAYED);
+
+    memset(observation + OBS_TOP_CARD, 0, NUM_CARD_IDS * sizeof(float));
+    observation[OBS_TOP_CARD + state->topCard] = 1.0f;
+
+    observation[OBS_OPPONENT_SIZE] = state->hands[nextPlayer(state, player)].size * perCard;
+    observation[OBS_HIDDEN_SIZE] = state->hiddenSize * perCard;
+    memset(observation + OBS_HIDDEN_SIZE + 1, 0, (OBSERVATION_SIZE - OBS_HIDDEN_SIZE - 1) * sizeof(float));
+}
@@ -0,0 +1,61 @@
+/**
+ * @file encoder.h
+ * @brief Header file for encoding a player's view of a game as a fixed-length tensor.
+ *
+ * The view holds what a player may know: their hand counts, the top card, the played
+ * pile, the opponent's hand size and the hidden deck size. It is encoded as a vector of
+ * OBSERVATION_SIZE bytes or floats, laid out as feature planes over the card identities
+ * so neural networks can read it directly.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <stdint.h>
+#include "gamestate.h"
+
+/** Offset of the plane of the player's hand counts. */
+#define OBS_HAND 0
+
+/** Offset of the one-hot plane of the top card. */
+#define OBS_TOP_CARD (OBS_HAND + NUM_CARD_IDS)
+
+/** Offset of the plane of the played-pile counts. */
+#define OBS_PLAYED (OBS_TOP_CARD + NUM_CARD_IDS)
+
+/** Offset of the hand size of the next player to move (the opponent in a head-to-head match). */
+#define OBS_OPPONENT_SIZE (OBS_PLAYED + NUM_CARD_IDS)
+
+/** Offset of the hidden deck size. */
+#define OBS_HIDDEN_SIZE (OBS_OPPONENT_SIZE + 1)
+
+/** Length of an observation, padded to a multiple of 16 with zeros. */
+#define OBSERVATION_SIZE 160
+
+/**
+ * @brief Encodes a player's view as bytes.
+ *
+ * Counts and sizes saturate at 255.
+ *
+ * @param state Pointer to the game state.
+ * @param player The player whose view is encoded.
+ * @param observation Output buffer of OBSERVATION_SIZE bytes.
+ */
+void encodeObservation(const GameState* state, int player, uint8_t* observation);
+
+/**
+ * @brief Encodes a player's view as floats.
+ *
+ * Counts are divided by the number of packs, so each is in [0, 1] for cards in one place,
+ * and sizes are divided by the number of cards in the game.
+ *
+ * @param state Pointer to the game state.
+ * @param player The player whose view is encoded.
+ * @param observation Output buffer of OBSERVATION_SIZE floats.
+ */
+void encodeObservationFloat(const GameState* state, int player, float* observation);
+
+#endif /* ENCODER_H */
@@ -0,0 +1,78 @@
+/**
+ * @file gamerunner.c
+ * @brief Implementation of running a game as a resumable state machine.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "gamerunner.h"
+#include <stddef.h>
+
+/**
+ * @brief Starts a runner on a game.
+ *
+ * @param runner Pointer to the runner.
+ * @param state Pointer to the game to run, which is copied.
+ * @param seats Strategy of each of the game's players, or NULL for players whose moves are
+ *              submitted; a NULL array makes every player submitted.
+ * @param seed Seed for the strategies.
+ */
+void startRunner(GameRunner* runner, const GameState* state, const Strategy* const* seats, uint64_t seed) {
+    for (int seat = 0; seat < MAX_PLAYERS; ++seat) {
+        runner->seats[seat] = seats != NULL && seat < state->numPlayers ? seats[seat] : NULL;
+    }
+    seedRng(&runner->rng, seed);
+    runner->pending = MOVE_DRAW;
+    runner->hasPending = 0;
+    copyGameState(&runner->state, state);
+}
+
+/**
+ * @brief Submits the move of a player without a strategy.
+ *
+ * @param runner Pointer to the runner.
+ * @param player The player submitting the move.
+ * @param move The move.
+ * @return SubmitAccepted if the runner was waiting for that player and the move is legal.
+ */
+SubmitResult submitMove(GameRunner* runner, int player, Move move) {
+    const GameState* state = &runner->state;
+    if (isGameOver(state) || state->currentPlayer != player || runner->seats[player] != NULL || runner->hasPending) {
+        return SubmitNotYourTurn;
+    }
+    if (!isLegalMove(state, move)) {
+        return SubmitIllegal;
+    }
+    runner->pending = move;
+    runner->hasPending = 1;
+    return SubmitAccepted;
+}
+
+/**
+ * @brief Advances a runner by at most one move; never waits.
+ *
+ * @param runner Pointer to the runner.
+ * @param undo Pointer to the record that receives what the move changed, when one is made.
+ * @return RunnerMoved if a move was made, RunnerAwaitingMove if the player to move has
+ *         no strategy and has not submitted a move, or RunnerFinished if the game is over.
+ */
+RunnerEvent stepRunner(GameRunner* runner, UndoRecord* undo) {
+    GameState* state = &runner->state;
+    if (isGameOver(state)) {
+        return RunnerFinished;
+    }
+
+    const Strategy* strategy = runner->seats[state->currentPlayer];
+    Move move;
+    if (strategy != NULL) {
+        move = strategy->chooseMove(state, strategy->params, &runner->rng);
+    } else if (runner->hasPending) {
+        move = runner->pending;
+        runner->hasPending = 0;
+    } else {
+        return RunnerAwaitingMove;
+    }
+    applyMove(state, move, undo);
+    return RunnerMoved;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file gamerunner.h
+ * @brief Header file for running a game as a resumable state machine.
+ *
+ * A GameRunner plays a game one move at a time without ever waiting. Seats played by a
+ * strategy move as soon as they are stepped; a seat with no strategy belongs to a human or
+ * remote player, and the runner stops there until the caller submits that player's move.
+ * All of a game's progress lives in the runner, so thousands of games waiting on people
+ * take no thread or stack each: the caller resumes whichever one has a move to submit.
+ *
+ * A typical driver submits a move when one arrives, then steps until the runner asks for
+ * the next one or the game ends:
+ *
+ *   if (submitMove(&runner, seat, move) == SubmitAccepted) {
+ *       while ((event = stepRunner(&runner, &undo)) == RunnerMoved) {
+ *           ...report undo.move...
+ *       }
+ *   }
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef GAME_RUNNER_H
+#define GAME_RUNNER_H
+
+#include <stdint.h>
+#include "gamestate.h"
+#include "rng.h"
+#include "strategy.h"
+
+/**
+ * @enum RunnerEvent
+ * @brief What a step of a runner did.
+ */
+typedef enum {
+    RunnerMoved,        /**< A move was made; step again */
+    RunnerAwaitingMove, /**< The player to move has no strategy; submit their move */
+    RunnerFinished      /**< The game is over */
+} RunnerEvent;
+
+/**
+ * @enum SubmitResult
+ * @brief Whether a submitted move was accepted.
+ */
+typedef enum {
+    SubmitAccepted,    /**< The move will be made by the next step */
+    SubmitNotYourTurn, /**< The player is not the one the runner is waiting for */
+    SubmitIllegal      /**< The move breaks the rules */
+} SubmitResult;
+
+/**
+ * @struct GameRunner
+ * @brief A game and who plays each seat, suspended between moves.
+ */
+typedef struct {
+    const Strategy* seats[MAX_PLAYERS]; /**< Strategy of each seat, or NULL for a submitted player */
+    Rng rng;                            /**< Generator passed to the strategies */
+    Move pending;                       /**< Move submitted for the player to move */
+    int hasPending;                     /**< 1 if pending holds a move not yet made */
+    GameState state;                    /**< The game; last, as only its used hands matter */
+} GameRunner;
+
+/**
+ * @brief Starts a runner on a game.
+ *
+ * @param runner Pointer to the runner.
+ * @param state Pointer to the game to run, which is copied.
+ * @param seats Strategy of each of the game's players, or NULL for players whose moves are
+ *              submitted; a NULL array makes every player submitted.
+ * @param seed Seed for the strategies.
+ */
+void startRunner(GameRunner* runner, const GameState* state, const Strategy* const* seats, uint64_t seed);
+
+/**
+ * @brief Submits the move of a player without a strategy.
+ *
+ * @param runner Pointer to the runner.
+ * @param player The player submitting the move.
+ * @param move The move.
+ * @return SubmitAccepted if the runner was waiting for that player and the move is legal.
+ */
+SubmitResult submitMove(GameRunner* runner, int player, Move move);
+
+/**
+ * @brief Advances a runner by at most one move; never waits.
+ *
+ * @param runner Pointer to the runner.
+ * @param undo Pointer to the record that receives what the move changed, when one is made.
+ * @return RunnerMoved if a move was made, RunnerAwaitingMove if the player to move has
+ *         no strategy and has not submitted a move, or RunnerFinished if the game is over.
+ */
+RunnerEvent stepRunner(GameRunner* runner, UndoRecord* undo);
+
+#endif /* GAME_RUNNER_H */
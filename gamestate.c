@@ -0,0 +1,461 @@
+/**
+ * @file gamestate.c
+ * @brief Implementation of the compact game engine used by bots and simulations.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "gamestate.h"
+#include <stddef.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#define ALWAYS_INLINE __forceinline
+#else
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#endif
+
+/** The rulesets, in RuleSetId order. */
+static const RuleSet ruleSets[NUM_RULE_SETS] = {
+#define RULE_SET_ENTRY(id, name, wild, drawTwo, skip, reverse, drawUntilPlayable) \
+    { name, wild, drawTwo, skip, reverse, drawUntilPlayable },
+    RULE_SETS(RULE_SET_ENTRY)
+#undef RULE_SET_ENTRY
+};
+
+/**
+ * @brief Draws a random card from the non-empty hidden deck.
+ *
+ * @param state Pointer to the game state.
+ * @return The identity of the card drawn.
+ */
+static int drawHiddenCard(GameState* state) {
+    uint32_t r = randomBelow(&state->rng, state->hiddenSize);
+
+    // Pick the suit, then the rank, by counting the running totals that do not exceed r.
+    // Which card is drawn is random, so this avoids branches that would be mispredicted.
+    uint32_t below1 = state->deckSuits[0];
+    uint32_t below2 = below1 + state->deckSuits[1];
+    uint32_t below3 = below2 + state->deckSuits[2];
+    int suit = (r >= below1) + (r >= below2) + (r >= below3);
+    const uint32_t below[NUM_SUITS] = { 0, below1, below2, below3 };
+    r -= below[suit];
+
+    // Running totals of the first twelve ranks, built as a shallow tree of additions so the
+    // rank is found in a few cycles rather than one dependent addition per rank.
+    const uint32_t* c = &state->deck[suit * NUM_RANKS];
+    uint32_t p1 = c[0] + c[1];
+    uint32_t p3 = p1 + (c[2] + c[3]);
+    uint32_t p5 = p3 + (c[4] + c[5]);
+    uint32_t p7 = p3 + ((c[4] + c[5]) + (c[6] + c[7]));
+    uint32_t p9 = p7 + (c[8] + c[9]);
+    uint32_t p11 = p9 + (c[10] + c[11]);
+    int rank = (c[0] <= r) + (p1 <= r) + (p1 + c[2] <= r) + (p3 <= r) + (p3 + c[4] <= r) + (p5 <= r)
+             + (p5 + c[6] <= r) + (p7 <= r) + (p7 + c[8] <= r) + (p9 <= r) + (p9 + c[10] <= r) + (p11 <= r);
+
+    int card = suit * NUM_RANKS + rank;
+    state->deck[card]--;
+    state->deckSuits[suit]--;
+    state->hiddenSize--;
+    return card;
+}
+
+/**
+ * @brief Deals every player's hand from the hidden deck.
+ *
+ * Draws from the hidden deck are already in random order, so each player takes the next
+ * handSize cards as one slice instead of one card per player in turn. The deal has the same
+ * distribution, and each hand is built in a local mask and written once.
+ *
+ * @param state Pointer to the game state, with empty hands.
+ * @param handSize The number of cards dealt to each player.
+ */
+static void dealHands(GameState* state, int handSize) {
+    for (int player = 0; player < state->numPlayers; ++player) {
+        Hand* hand = &state->hands[player];
+        CardMask held = 0;
+        for (int i = 0; i < handSize; ++i) {
+            int card = drawHiddenCard(state);
+            hand->counts[card]++;
+            held |= (CardMask)1 << card;
+        }
+        hand->held = held;
+        hand->size = (uint16_t)handSize;
+    }
+}
+
+/**
+ * @brief Initializes a game with a given hand size: deals each player's hand and turns the top card.
+ *
+ * The same seed always produces the same deal, so different strategies can be compared
+ * on exactly the same cards. The packs must hold at least numPlayers * handSize + 1 cards.
+ * The game uses the standard rules; set ruleSet afterwards for another ruleset. The card
+ * turned up has no special effect.
+ *
+ * @param state Pointer to the state to initialize.
+ * @param numPlayers The number of players, from 2 to MAX_PLAYERS.
+ * @param handSize The number of cards dealt to each player, at least 1.
+ * @param numPacks The number of packs to use, from 1 to MAX_PACKS.
+ * @param seed The seed that determines the deal and every later draw.
+ */
+void dealGameState(GameState* state, int numPlayers, int handSize, int numPacks, uint64_t seed) {
+    memset(state, 0, offsetof(GameState, hands) + numPlayers * sizeof(Hand));
+    state->numPlayers = (uint16_t)numPlayers;
+    state->numPacks = (uint32_t)numPacks;
+    state->winner = -1;
+    seedRng(&state->rng, seed);
+
+    for (int id = 0; id < NUM_CARD_IDS; ++id) {
+        state->deck[id] = (uint32_t)numPacks;
+    }
+    for (int suit = 0; suit < NUM_SUITS; ++suit) {
+        state->deckSuits[suit] = (uint32_t)numPacks * NUM_RANKS;
+    }
+    state->hiddenSize = (uint32_t)numPacks * NUM_CARD_IDS;
+
+    dealHands(state, handSize);
+
+    state->topCard = (uint8_t)drawHiddenCard(state);
+    state->activeSuit = (uint8_t)(state->topCard / NUM_RANKS);
+    state->direction = 1;
+    state->played[state->topCard]++;
+    state->playedSize = 1;
+}
+
+/**
+ * @brief Initializes a game: deals each player INITIAL_HAND_SIZE cards and turns the top card.
+ *
+ * @param state Pointer to the state to initialize.
+ * @param numPlayers The number of players, from 2 to MAX_PLAYERS.
+ * @param numPacks The number of packs to use, from 1 to MAX_PACKS.
+ * @param seed The seed that determines the deal and every later draw.
+ */
+void initGameState(GameState* state, int numPlayers, int numPacks, uint64_t seed) {
+    dealGameState(state, numPlayers, INITIAL_HAND_SIZE, numPacks, seed);
+}
+
+/**
+ * @brief Returns the description of a ruleset.
+ *
+ * @param id The ruleset.
+ * @return Pointer to its description.
+ */
+const RuleSet* getRuleSet(RuleSetId id) {
+    return &ruleSets[id];
+}
+
+/**
+ * @brief Looks up a ruleset by name.
+ *
+ * @param name The ruleset's name, as listed in RULE_SETS.
+ * @return The ruleset, or -1 if there is none with that name.
+ */
+int findRuleSet(const char* name) {
+    for (int id = 0; id < NUM_RULE_SETS; ++id) {
+        if (strcmp(ruleSets[id].name, name) == 0) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Copies a game state, skipping the unused hands.
+ *
+ * @param destination Pointer to the state that receives the copy.
+ * @param source Pointer to the state to copy.
+ */
+void copyGameState(GameState* destination, const GameState* source) {
+    memcpy(destination, source, offsetof(GameState, hands) + source->numPlayers * sizeof(Hand));
+}
+
+/**
+ * @brief Checks if a card identity can be played on a top card.
+ *
+ * A card can be played if it has the same rank or suit as the top card.
+ *
+ * @param card The identity of the card to check.
+ * @param topCard The identity of the top card.
+ * @return 1 if the card can be played, 0 otherwise.
+ */
+int canPlayCardId(int card, int topCard) {
+    return (card / NUM_RANKS == topCard / NUM_RANKS || card % NUM_RANKS == topCard % NUM_RANKS);
+}
+
+/**
+ * @brief Returns the mask of every card identity that can be played on a top card.
+ *
+ * @param topCard The identity of the top card.
+ * @return The identities with the same suit or rank as the top card.
+ */
+CardMask matchingCardIds(int topCard) {
+    CardMask suit = (CardMask)0x1FFF << (topCard / NUM_RANKS * NUM_RANKS);
+    CardMask rank = (CardMask)0x8004002001ULL << (topCard % NUM_RANKS);
+    return suit | rank;
+}
+
+/**
+ * @brief Returns every legal move under a ruleset known at compile time.
+ *
+ * @param state Pointer to the game state.
+ * @param rules The ruleset; a constant, so unused rules cost nothing.
+ * @return The mask of legal moves.
+ */
+static ALWAYS_INLINE CardMask legalMovesWithRules(const GameState* state, const RuleSet rules) {
+    CardMask matching = (CardMask)0x1FFF << (state->activeSuit * NUM_RANKS);
+    matching |= (CardMask)0x8004002001ULL << (state->topCard % NUM_RANKS);
+    if (rules.wildRank != NO_RANK) {
+        matching |= (CardMask)0x8004002001ULL << rules.wildRank;
+    }
+    CardMask playable = state->hands[state->currentPlayer].held & matching;
+    return playable ? playable : DRAW_MOVE_BIT;
+}
+
+/**
+ * @brief Returns every legal move for the player to move in one call.
+ *
+ * @param state Pointer to the game state.
+ * @return The mask of legal moves.
+ */
+CardMask legalMoves(const GameState* state) {
+    switch (state->ruleSet) {
+#define RULE_SET_CASE(id, name, wild, drawTwo, skip, reverse, drawUntilPlayable) \
+    case id: \
+        return legalMovesWithRules(state, (RuleSet) { name, wild, drawTwo, skip, reverse, drawUntilPlayable });
+    RULE_SETS(RULE_SET_CASE)
+#undef RULE_SET_CASE
+    }
+    return DRAW_MOVE_BIT;
+}
+
+/**
+ * @brief Checks if a move is legal for the player to move.
+ *
+ * @param state Pointer to the game state.
+ * @param move The move to check.
+ * @return 1 if the move is legal, 0 otherwise.
+ */
+int isLegalMove(const GameState* state, Move move) {
+    int card = moveCard(move);
+    int suit = declaredSuit(move);
+    if (move < 0 || card > MOVE_DRAW || suit >= NUM_SUITS) {
+        return 0;
+    }
+    if (suit >= 0 && (card == MOVE_DRAW || card % NUM_RANKS != ruleSets[state->ruleSet].wildRank)) {
+        return 0;
+    }
+    return (legalMoves(state) >> card) & 1;
+}
+
+/**
+ * @brief Returns the played pile, except its top card, to the empty hidden deck.
+ *
+ * Draws are random, so the returned cards need no shuffling.
+ *
+ * @param state Pointer to the game state.
+ */
+static void reshufflePlayedPile(GameState* state) {
+    state->played[state->topCard]--;
+    for (int id = 0; id < NUM_CARD_IDS; ++id) {
+        state->deck[id] = state->played[id];
+        state->deckSuits[id / NUM_RANKS] += state->played[id];
+        state->played[id] = 0;
+    }
+    state->hiddenSize = state->playedSize - 1u;
+    state->played[state->topCard] = 1;
+    state->playedSize = 1;
+}
+
+/**
+ * @brief Returns the played pile to the hidden deck if the deck is empty and the pile is not.
+ *
+ * @param state Pointer to the game state.
+ * @param undo Pointer to the record of the move in progress.
+ */
+static void refillHiddenDeck(GameState* state, UndoRecord* undo) {
+    if (state->hiddenSize == 0 && state->playedSize > 1) {
+        reshufflePlayedPile(state);
+        undo->reshuffleAfter = undo->numDrawn;
+    }
+}
+
+/**
+ * @brief Draws cards from the hidden deck into a player's hand, stopping if both the deck
+ *        and the rest of the played pile run out.
+ *
+ * @param state Pointer to the game state.
+ * @param player The player who draws.
+ * @param count The number of cards to draw.
+ * @param undo Pointer to the record of the move in progress.
+ */
+static void drawCards(GameState* state, int player, int count, UndoRecord* undo) {
+    Hand* hand = &state->hands[player];
+    undo->drawer = (uint16_t)player;
+    for (int i = 0; i < count; ++i) {
+        refillHiddenDeck(state, undo);
+        if (state->hiddenSize == 0) {
+            break;
+        }
+        int card = drawHiddenCard(state);
+        hand->counts[card]++;
+        hand->size++;
+        hand->held |= (CardMask)1 << card;
+        undo->drawn[undo->numDrawn++] = (uint8_t)card;
+    }
+}
+
+/**
+ * @brief Makes a legal move under a ruleset known at compile time.
+ *
+ * @param state Pointer to the game state.
+ * @param move The move to make; must be legal.
+ * @param undo Pointer to the record that receives what the move changed.
+ * @param rules The ruleset; a constant, so unused rules cost nothing.
+ */
+static ALWAYS_INLINE void applyMoveWithRules(GameState* state, Move move, UndoRecord* undo, const RuleSet rules) {
+    int player = state->currentPlayer;
+    undo->move = move;
+    undo->player = (uint16_t)player;
+    undo->drawer = (uint16_t)player;
+    undo->direction = state->direction;
+    undo->previousTop = state->topCard;
+    undo->previousSuit = state->activeSuit;
+    undo->numDrawn = 0;
+    undo->reshuffleAfter = NO_CARD;
+    undo->rng = state->rng;
+
+    int next;
+    if (move == MOVE_DRAW) {
+        drawCards(state, player, 1, undo);
+        next = rules.drawUntilPlayable && undo->numDrawn > 0 ? player : nextPlayer(state, player);
+    } else {
+        int card = moveCard(move);
+        int rank = card % NUM_RANKS;
+        Hand* hand = &state->hands[player];
+        if (--hand->counts[card] == 0) {
+            hand->held &= ~((CardMask)1 << card);
+        }
+        hand->size--;
+        state->played[card]++;
+        state->playedSize++;
+        state->topCard = (uint8_t)card;
+        state->activeSuit = (uint8_t)(card / NUM_RANKS);
+        if (rules.wildRank != NO_RANK && rank == rules.wildRank && declaredSuit(move) >= 0) {
+            state->activeSuit = (uint8_t)declaredSuit(move);
+        }
+        if (hand->size == 0) {
+            state->winner = (int16_t)player;
+        }
+
+        if (rules.reverseRank != NO_RANK && rank == rules.reverseRank) {
+            state->direction = (int8_t)-state->direction;
+        }
+        next = nextPlayer(state, player);
+        if (rules.drawTwoRank != NO_RANK && rank == rules.drawTwoRank && state->winner < 0) {
+            drawCards(state, next, 2, undo);
+            next = nextPlayer(state, next);
+        } else if (rules.skipRank != NO_RANK && rank == rules.skipRank) {
+            next = nextPlayer(state, next);
+        }
+    }
+
+    refillHiddenDeck(state, undo);
+    state->turn++;
+    state->currentPlayer = (uint16_t)next;
+}
+
+/**
+ * @brief Makes a legal move for the player to move and passes the turn.
+ *
+ * @param state Pointer to the game state.
+ * @param move The move to make; must be legal.
+ */
+void playMove(GameState* state, Move move) {
+    UndoRecord undo;
+    applyMove(state, move, &undo);
+}
+
+/**
+ * @brief Makes a legal move in place and records how to undo it.
+ *
+ * Dispatches to the move kernel compiled for the game's ruleset.
+ *
+ * @param state Pointer to the game state.
+ * @param move The move to make; must be legal.
+ * @param undo Pointer to the record that receives what the move changed.
+ */
+void applyMove(GameState* state, Move move, UndoRecord* undo) {
+    switch (state->ruleSet) {
+#define RULE_SET_CASE(id, name, wild, drawTwo, skip, reverse, drawUntilPlayable) \
+    case id: \
+        applyMoveWithRules(state, move, undo, (RuleSet) { name, wild, drawTwo, skip, reverse, drawUntilPlayable }); \
+        break;
+    RULE_SETS(RULE_SET_CASE)
+#undef RULE_SET_CASE
+    }
+}
+
+/**
+ * @brief Takes back the last move made with applyMove.
+ *
+ * Undoes the move's steps in reverse: the drawn cards go back to the hidden deck, with the
+ * played pile taken back out of it at the point it was returned, then the played card
+ * goes back to its player's hand.
+ *
+ * @param state Pointer to the game state.
+ * @param undo Pointer to the record filled in by applyMove for that move.
+ */
+void undoMove(GameState* state, const UndoRecord* undo) {
+    state->currentPlayer = undo->player;
+    state->direction = undo->direction;
+    state->turn--;
+    state->rng = undo->rng;
+
+    Hand* drawer = &state->hands[undo->drawer];
+    for (int i = undo->numDrawn; ; --i) {
+        if (i == undo->reshuffleAfter) {
+            for (int id = 0; id < NUM_CARD_IDS; ++id) {
+                state->played[id] += (uint16_t)state->deck[id];
+                state->deck[id] = 0;
+            }
+            memset(state->deckSuits, 0, sizeof(state->deckSuits));
+            state->playedSize += (uint16_t)state->hiddenSize;
+            state->hiddenSize = 0;
+        }
+        if (i == 0) {
+            break;
+        }
+        int card = undo->drawn[i - 1];
+        state->deck[card]++;
+        state->deckSuits[card / NUM_RANKS]++;
+        state->hiddenSize++;
+        if (--drawer->counts[card] == 0) {
+            drawer->held &= ~((CardMask)1 << card);
+        }
+        drawer->size--;
+    }
+
+    if (undo->move != MOVE_DRAW) {
+        int card = moveCard(undo->move);
+        Hand* hand = &state->hands[undo->player];
+        state->played[card]--;
+        state->playedSize--;
+        hand->counts[card]++;
+        hand->size++;
+        hand->held |= (CardMask)1 << card;
+        state->topCard = undo->previousTop;
+        state->activeSuit = undo->previousSuit;
+        state->winner = -1;
+    }
+}
+
+/**
+ * @brief Checks if the game has finished, either by a win or by reaching MAX_TURNS.
+ *
+ * @param state Pointer to the game state.
+ * @return 1 if the game has finished, 0 otherwise.
+ */
+int isGameOver(const GameState* state) {
+    return (state->winner >= 0 || state->turn >= MAX_TURNS);
+}
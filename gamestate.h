@@ -0,0 +1,353 @@
+/**
+ * @file gamestate.h
+ * @brief Header file for the compact game engine used by bots and simulations.
+ *
+ * The interactive game in cardgame.c keeps each deck in a heap array and prints every
+ * turn. This file declares a fixed-size, pointer-free game state with the same rules,
+ * which can be copied, stored and simulated millions of times without any output or
+ * allocation. Cards are stored as identities (see cardToId) and hands as per-identity
+ * counts, so several packs are supported. The hidden deck is kept as per-identity counts
+ * too, and each draw picks one of its cards at random, which is the same as drawing from a
+ * shuffled deck; memory and set-up time therefore do not grow with the number of packs.
+ * A game has from two to MAX_PLAYERS players, whose hands are stored one after another at
+ * the end of the state.
+ *
+ * MAX_PLAYERS is a capacity fixed at build time: every state holds that many hands of
+ * 120 bytes each, used or not, though copies and the server's matches take only the hands
+ * in use. Jobs keep their games on the heap, so raising it costs memory but no stack.
+ * Seats are single bytes on the wire and in the move log, with 0xFF meaning none, so
+ * MAX_PLAYERS is at most 254; the "players" self-test plays, analyses and serves games of
+ * MAX_PLAYERS players, so a build with -DMAX_PLAYERS=254 checks the largest.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef GAME_STATE_H
+#define GAME_STATE_H
+
+#include <stdint.h>
+#include "cardgame.h"
+#include "rng.h"
+
+/** Number of players in a head-to-head match, as played by tournaments and bots. */
+#define NUM_PLAYERS 2
+
+#ifndef MAX_PLAYERS
+/** Maximum number of players in a game; build with a larger value for big lobbies. */
+#define MAX_PLAYERS 8
+#endif
+
+#if MAX_PLAYERS < 2 || MAX_PLAYERS > 254
+#error "MAX_PLAYERS must be from 2 to 254, as seats are sent and logged as bytes with 0xFF for none"
+#endif
+
+/** Number of cards dealt to each player unless a game asks for another hand size. */
+#define INITIAL_HAND_SIZE 8
+
+/** Number of turns after which a game is abandoned as a draw. */
+#define MAX_TURNS 2000
+
+/** Marks a missing card, for example an empty top card. */
+#define NO_CARD 0xFF
+
+/** Move that draws from the hidden deck instead of playing a card. */
+#define MOVE_DRAW NUM_CARD_IDS
+
+/** Marks a special rank that a ruleset does not use. */
+#define NO_RANK 0xFF
+
+/** Most cards a single move can make a player draw (a draw-two penalty). */
+#define MAX_DRAWS_PER_MOVE 2
+
+/**
+ * @brief A move: a card identity to play, or MOVE_DRAW.
+ *
+ * The bits above the low six may name the suit declared with a wild card; see makeWildMove.
+ */
+typedef int Move;
+
+/**
+ * @brief Builds a move that plays a wild card and declares the suit to follow.
+ *
+ * A wild card played as a plain card identity keeps its own suit.
+ *
+ * @param card The identity of the wild card.
+ * @param suit The declared suit.
+ * @return The move.
+ */
+static inline Move makeWildMove(int card, Suit suit) {
+    return card | ((int)suit + 1) << 6;
+}
+
+/**
+ * @brief Returns the card identity of a move, or MOVE_DRAW.
+ *
+ * @param move The move.
+ * @return The move without any declared suit.
+ */
+static inline int moveCard(Move move) {
+    return move & 0x3F;
+}
+
+/**
+ * @brief Returns the suit a move declares, or -1 if it declares none.
+ *
+ * @param move The move.
+ * @return The declared suit, or -1.
+ */
+static inline int declaredSuit(Move move) {
+    return (move >> 6) - 1;
+}
+
+/**
+ * @brief Lists the rulesets as data, one X(...) entry each.
+ *
+ * The arguments are: identifier, name, wild rank (playable on any card; its player
+ * declares the suit to follow), draw-two rank (the next player draws two cards and misses
+ * their turn), skip rank (the next player misses their turn), reverse rank (the order of
+ * play turns around), and whether a player who draws keeps drawing until they can play.
+ * NO_RANK turns a rule off. Each entry is compiled into its own move kernel, so a ruleset
+ * pays only for the rules it uses.
+ */
+#define RULE_SETS(X) \
+    X(RulesStandard,          "standard",            NO_RANK, NO_RANK, NO_RANK, NO_RANK, 0) \
+    X(RulesCrazyEights,       "crazy-eights",        Eight,   NO_RANK, NO_RANK, NO_RANK, 0) \
+    X(RulesAction,            "action",              NO_RANK, Two,     Queen,   Ace,     0) \
+    X(RulesDrawUntilPlayable, "draw-until-playable", NO_RANK, NO_RANK, NO_RANK, NO_RANK, 1) \
+    X(RulesHouse,             "house",               Eight,   Two,     Queen,   Ace,     1)
+
+/**
+ * @enum RuleSetId
+ * @brief Identifiers of the rulesets listed in RULE_SETS.
+ */
+typedef enum {
+#define RULE_SET_ID(id, name, wild, drawTwo, skip, reverse, drawUntilPlayable) id,
+    RULE_SETS(RULE_SET_ID)
+#undef RULE_SET_ID
+    NUM_RULE_SETS
+} RuleSetId;
+
+/**
+ * @struct RuleSet
+ * @brief Description of a ruleset, as listed in RULE_SETS.
+ */
+typedef struct {
+    const char* name;          /**< Name used on the command line */
+    uint8_t wildRank;          /**< Rank playable on any card, or NO_RANK */
+    uint8_t drawTwoRank;       /**< Rank that makes the next player draw two and miss a turn, or NO_RANK */
+    uint8_t skipRank;          /**< Rank that makes the next player miss a turn, or NO_RANK */
+    uint8_t reverseRank;       /**< Rank that reverses the order of play, or NO_RANK */
+    uint8_t drawUntilPlayable; /**< 1 if a player who draws keeps the turn while cards remain */
+} RuleSet;
+
+/**
+ * @struct Hand
+ * @brief Cards held by one player.
+ */
+typedef struct {
+    CardMask held;                  /**< Identities present in the hand */
+    uint16_t size;                  /**< Number of cards in the hand */
+    uint16_t counts[NUM_CARD_IDS];  /**< Count of each card identity in the hand */
+} Hand;
+
+/**
+ * @struct GameState
+ * @brief Complete state of one game.
+ *
+ * Only the first numPlayers hands are used; copyGameState copies just those.
+ */
+typedef struct {
+    uint32_t deck[NUM_CARD_IDS];               /**< Count of each identity in the hidden deck */
+    uint32_t deckSuits[NUM_SUITS];             /**< Number of cards of each suit in the hidden deck */
+    uint32_t hiddenSize;                       /**< Number of cards in the hidden deck */
+    uint32_t numPacks;                         /**< Number of packs the game was dealt from */
+    uint16_t played[NUM_CARD_IDS];             /**< Count of each identity in the played pile, top card included */
+    uint16_t playedSize;                       /**< Number of cards in the played pile */
+    uint8_t topCard;                           /**< Identity of the top card of the played pile */
+    uint8_t activeSuit;                        /**< Suit to follow: the top card's, or the one declared with a wild */
+    uint8_t ruleSet;                           /**< RuleSetId of the rules in play */
+    int8_t direction;                          /**< 1 while play moves to higher players, -1 after a reverse */
+    uint16_t numPlayers;                       /**< Number of players, from 2 to MAX_PLAYERS */
+    uint16_t currentPlayer;                    /**< Player to move */
+    int16_t winner;                            /**< Player who emptied their hand, or -1 */
+    uint32_t turn;                             /**< Number of moves made so far */
+    Rng rng;                                   /**< Generator used to draw from the hidden deck */
+    Hand hands[MAX_PLAYERS];                   /**< Hand of each player, in turn order */
+} GameState;
+
+/**
+ * @struct UndoRecord
+ * @brief What applyMove changed, so undoMove can restore the state exactly.
+ *
+ * A reshuffle needs no copy of the played pile: the hidden deck afterwards holds exactly
+ * the reshuffled cards, less any drawn later in the move, so they are moved back from it,
+ * and the saved generator state makes the same cards get drawn again if the move is
+ * replayed. A move returns the played pile at most once, since no card is played after it.
+ */
+typedef struct {
+    Move move;                           /**< The move made */
+    uint16_t player;                     /**< Player who made the move */
+    uint16_t drawer;                     /**< Player who drew the cards in drawn */
+    int8_t direction;                    /**< Direction of play before the move */
+    uint8_t previousTop;                 /**< Top card before the move */
+    uint8_t previousSuit;                /**< Active suit before the move */
+    uint8_t numDrawn;                    /**< Number of cards drawn during the move */
+    uint8_t drawn[MAX_DRAWS_PER_MOVE];   /**< Cards drawn during the move, in order */
+    uint8_t reshuffleAfter;              /**< Cards drawn before the played pile was returned, or NO_CARD */
+    Rng rng;                             /**< Generator state before the move */
+} UndoRecord;
+
+/**
+ * @brief Initializes a game with a given hand size: deals each player's hand and turns the top card.
+ *
+ * The same seed always produces the same deal, so different strategies can be compared
+ * on exactly the same cards. The packs must hold at least numPlayers * handSize + 1 cards.
+ * The game uses the standard rules; set ruleSet afterwards for another ruleset. The card
+ * turned up has no special effect.
+ *
+ * @param state Pointer to the state to initialize.
+ * @param numPlayers The number of players, from 2 to MAX_PLAYERS.
+ * @param handSize The number of cards dealt to each player, at least 1.
+ * @param numPacks The number of packs to use, from 1 to MAX_PACKS.
+ * @param seed The seed that determines the deal and every later draw.
+ */
+void dealGameState(GameState* state, int numPlayers, int handSize, int numPacks, uint64_t seed);
+
+/**
+ * @brief Initializes a game: deals each player INITIAL_HAND_SIZE cards and turns the top card.
+ *
+ * @param state Pointer to the state to initialize.
+ * @param numPlayers The number of players, from 2 to MAX_PLAYERS.
+ * @param numPacks The number of packs to use, from 1 to MAX_PACKS.
+ * @param seed The seed that determines the deal and every later draw.
+ */
+void initGameState(GameState* state, int numPlayers, int numPacks, uint64_t seed);
+
+/**
+ * @brief Copies a game state, skipping the unused hands.
+ *
+ * @param destination Pointer to the state that receives the copy.
+ * @param source Pointer to the state to copy.
+ */
+void copyGameState(GameState* destination, const GameState* source);
+
+/**
+ * @brief Returns the player who moves after the given one in the current direction of play.
+ *
+ * @param state Pointer to the game state.
+ * @param player The player.
+ * @return The next player in turn order.
+ */
+static inline int nextPlayer(const GameState* state, int player) {
+    if (state->direction > 0) {
+        return player + 1 == state->numPlayers ? 0 : player + 1;
+    }
+    return (player == 0 ? state->numPlayers : player) - 1;
+}
+
+/**
+ * @brief Returns the description of a ruleset.
+ *
+ * @param id The ruleset.
+ * @return Pointer to its description.
+ */
+const RuleSet* getRuleSet(RuleSetId id);
+
+/**
+ * @brief Looks up a ruleset by name.
+ *
+ * @param name The ruleset's name, as listed in RULE_SETS.
+ * @return The ruleset, or -1 if there is none with that name.
+ */
+int findRuleSet(const char* name);
+
+/**
+ * @brief Checks if a card identity can be played on a top card.
+ *
+ * A card can be played if it has the same rank or suit as the top card.
+ *
+ * @param card The identity of the card to check.
+ * @param topCard The identity of the top card.
+ * @return 1 if the card can be played, 0 otherwise.
+ */
+int canPlayCardId(int card, int topCard);
+
+/**
+ * @brief Returns the mask of every card identity that can be played on a top card.
+ *
+ * @param topCard The identity of the top card.
+ * @return The identities with the same suit or rank as the top card.
+ */
+CardMask matchingCardIds(int topCard);
+
+/**
+ * @brief Returns every legal move for the player to move in one call.
+ *
+ * Bit i is set if card identity i can be played under the game's ruleset. If none can,
+ * only DRAW_MOVE_BIT (bit MOVE_DRAW) is set. A wild card may also be played with
+ * makeWildMove to declare a suit.
+ *
+ * @param state Pointer to the game state.
+ * @return The mask of legal moves.
+ */
+CardMask legalMoves(const GameState* state);
+
+/**
+ * @brief Checks if a move is legal for the player to move.
+ *
+ * Playing is legal for any held card that matches the top card or the active suit, or is
+ * wild. Only wild cards may declare a suit. Drawing is legal only when no held card can be
+ * played, as in takeTurn.
+ *
+ * @param state Pointer to the game state.
+ * @param move The move to check.
+ * @return 1 if the move is legal, 0 otherwise.
+ */
+int isLegalMove(const GameState* state, Move move);
+
+/**
+ * @brief Makes a legal move for the player to move and passes the turn.
+ *
+ * Cards with a special rank under the game's ruleset take effect. When the hidden deck runs
+ * out, the played pile except its top card is returned to it. Drawing from an empty hidden
+ * deck passes.
+ *
+ * @param state Pointer to the game state.
+ * @param move The move to make; must be legal.
+ */
+void playMove(GameState* state, Move move);
+
+/**
+ * @brief Makes a legal move in place and records how to undo it.
+ *
+ * Searches can walk the game tree on a single state with applyMove and undoMove instead
+ * of copying the state at every node.
+ *
+ * @param state Pointer to the game state.
+ * @param move The move to make; must be legal.
+ * @param undo Pointer to the record that receives what the move changed.
+ */
+void applyMove(GameState* state, Move move, UndoRecord* undo);
+
+/**
+ * @brief Takes back the last move made with applyMove.
+ *
+ * Moves must be undone in the reverse order they were made.
+ *
+ * @param state Pointer to the game state.
+ * @param undo Pointer to the record filled in by applyMove for that move.
+ */
+void undoMove(GameState* state, const UndoRecord* undo);
+
+/**
+ * @brief Checks if the game has finished, either by a win or by reaching MAX_TURNS.
+ *
+ * applyMove records the winner as soon as a hand empties, so this never scans the hands.
+ *
+ * @param state Pointer to the game state.
+ * @return 1 if the game has finished, 0 otherwise.
+ */
+int isGameOver(const GameState* state);
+
+#endif /* GAME_STATE_H */
@@ -0,0 +1,717 @@
+/**
+ * @file loadtest.c
+ * @brief Implementation of the load generator that benchmarks the game server.
+ *
+ * Players that are thinking wait in a binary heap ordered by when they will answer, and
+ * each worker sleeps in epoll_wait only until the earliest of them is due.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* clock_gettime */
+#endif
+#include "loadtest.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "parallel.h"
+#include "protocol.h"
+#include "server.h"
+
+/** Most events taken from epoll at once. */
+#define MAX_EVENTS 256
+
+/** Frames a player's receive buffer holds. */
+#define RECEIVE_FRAMES 64
+
+/**
+ * @struct LoadClient
+ * @brief One simulated player.
+ */
+typedef struct {
+    int fd;                                            /**< The socket, or -1 once closed */
+    int seat;                                          /**< Seat in the current match, or -1 */
+    int heapIndex;                                     /**< Position in the think heap, or -1 */
+    uint64_t dueAt;                                    /**< When a thinking player answers */
+    uint64_t moveSentAt;                               /**< When the move awaiting its ack was sent, or 0 */
+    uint64_t lastMoveAt;                               /**< When the last move of this match was sent, or 0 */
+    GameState view;                                    /**< What the player can see of its match */
+    _Alignas(Frame) char in[RECEIVE_FRAMES * FRAME_SIZE]; /**< Received bytes not yet handled */
+    int inLength;                                      /**< Number of bytes in in */
+} LoadClient;
+
+/**
+ * @struct LoadWorker
+ * @brief State of one worker thread and its share of the players.
+ */
+typedef struct {
+    const LoadTestConfig* config; /**< The load test settings */
+    LoadClient* clients;          /**< The worker's players */
+    int numClients;               /**< Number of players */
+    LoadClient** heap;            /**< Thinking players, earliest answer first */
+    int heapSize;                 /**< Number of thinking players */
+    int epollFd;                  /**< The worker's epoll instance */
+    Rng rng;                      /**< Generator for the policy and think times */
+    uint64_t deadline;            /**< When the worker stops */
+    LoadTestResult result;        /**< Totals of this worker */
+} LoadWorker;
+
+/**
+ * @brief Returns the monotonic clock in nanoseconds.
+ *
+ * @return The current time.
+ */
+static uint64_t nowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * @brief Returns the histogram bucket of a latency.
+ *
+ * Values below LATENCY_SUB_BUCKETS have a bucket each; above that, each power of two is
+ * split into LATENCY_SUB_BUCKETS equal parts.
+ *
+ * @param nanoseconds The latency.
+ * @return The bucket index.
+ */
+static int latencyBucket(uint64_t nanoseconds) {
+    if (nanoseconds < LATENCY_SUB_BUCKETS) {
+        return (int)nanoseconds;
+    }
+    int log2 = 63 - __builtin_clzll(nanoseconds);
+    int shift = log2 - 3;
+    return (shift + 1) * LATENCY_SUB_BUCKETS + (int)((nanoseconds >> shift) & (LATENCY_SUB_BUCKETS - 1));
+}
+
+/**
+ * @brief Returns the smallest latency of a histogram bucket.
+ *
+ * @param bucket The bucket index.
+ * @return The latency in nanoseconds.
+ */
+static uint64_t bucketFloor(int bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS) {
+        return (uint64_t)bucket;
+    }
+    int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    return (uint64_t)(LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << shift;
+}
+
+/**
+ * @brief Adds a latency to a histogram.
+ *
+ * @param histogram Pointer to the histogram.
+ * @param nanoseconds The latency.
+ */
+void recordLatency(LatencyHistogram* histogram, uint64_t nanoseconds) {
+    histogram->counts[latencyBucket(nanoseconds)]++;
+    histogram->total++;
+    if (nanoseconds > histogram->max) {
+        histogram->max = nanoseconds;
+    }
+}
+
+/**
+ * @brief Adds every sample of one histogram to another.
+ *
+ * @param total Pointer to the histogram that receives the samples.
+ * @param part Pointer to the histogram to add.
+ */
+void mergeLatencies(LatencyHistogram* total, const LatencyHistogram* part) {
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; ++bucket) {
+        total->counts[bucket] += part->counts[bucket];
+    }
+    total->total += part->total;
+    if (part->max > total->max) {
+        total->max = part->max;
+    }
+}
+
+/**
+ * @brief Returns a percentile of a histogram.
+ *
+ * @param histogram Pointer to the histogram.
+ * @param percentile The percentile, from 0 to 100.
+ * @return The latency in nanoseconds, accurate to within 1/LATENCY_SUB_BUCKETS, or 0 if
+ *         the histogram is empty.
+ */
+uint64_t latencyPercentile(const LatencyHistogram* histogram, double percentile) {
+    if (histogram->total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)ceil(percentile / 100.0 * (double)histogram->total);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; ++bucket) {
+        seen += histogram->counts[bucket];
+        if (seen >= rank) {
+            // Report the middle of the bucket, but never more than the largest sample.
+            uint64_t middle = (bucketFloor(bucket) + bucketFloor(bucket + 1)) / 2;
+            return middle < histogram->max ? middle : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+/**
+ * @brief Swaps two entries of the think heap.
+ *
+ * @param worker Pointer to the worker.
+ * @param i Index of one entry.
+ * @param j Index of the other entry.
+ */
+static void swapHeap(LoadWorker* worker, int i, int j) {
+    LoadClient* a = worker->heap[i];
+    worker->heap[i] = worker->heap[j];
+    worker->heap[j] = a;
+    worker->heap[i]->heapIndex = i;
+    worker->heap[j]->heapIndex = j;
+}
+
+/**
+ * @brief Adds a thinking player to the heap.
+ *
+ * @param worker Pointer to the worker.
+ * @param client Pointer to the player, with dueAt set.
+ */
+static void pushThinking(LoadWorker* worker, LoadClient* client) {
+    int i = worker->heapSize++;
+    worker->heap[i] = client;
+    client->heapIndex = i;
+    while (i > 0 && worker->heap[(i - 1) / 2]->dueAt > worker->heap[i]->dueAt) {
+        swapHeap(worker, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+/**
+ * @brief Removes the player that answers first from the heap.
+ *
+ * @param worker Pointer to the worker, whose heap must not be empty.
+ * @return The player.
+ */
+static LoadClient* popThinking(LoadWorker* worker) {
+    LoadClient* first = worker->heap[0];
+    swapHeap(worker, 0, --worker->heapSize);
+    first->heapIndex = -1;
+    int i = 0;
+    for (;;) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < worker->heapSize && worker->heap[left]->dueAt < worker->heap[smallest]->dueAt) {
+            smallest = left;
+        }
+        if (right < worker->heapSize && worker->heap[right]->dueAt < worker->heap[smallest]->dueAt) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        swapHeap(worker, i, smallest);
+        i = smallest;
+    }
+    return first;
+}
+
+/**
+ * @brief Draws a think time.
+ *
+ * @param worker Pointer to the worker.
+ * @return The think time in nanoseconds.
+ */
+static uint64_t drawThinkTime(LoadWorker* worker) {
+    double mean = worker->config->thinkMeanUs * 1000.0;
+    double unit = (double)(nextRandom(&worker->rng) >> 11) * 0x1p-53;
+    switch (worker->config->think) {
+    case ThinkFixed:
+        return (uint64_t)mean;
+    case ThinkUniform:
+        return (uint64_t)(2.0 * mean * unit);
+    case ThinkExponential:
+        return (uint64_t)(-mean * log1p(-unit));
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Sends a frame to the server.
+ *
+ * @param worker Pointer to the worker.
+ * @param client Pointer to the player.
+ * @param frame The frame.
+ * @return 0 on success, -1 if the connection failed and was closed.
+ */
+static int sendToServer(LoadWorker* worker, LoadClient* client, Frame frame) {
+    if (send(client->fd, &frame, sizeof(frame), MSG_NOSIGNAL) == (ssize_t)sizeof(frame)) {
+        return 0;
+    }
+    // A frame is far smaller than the socket buffer, so a short send means the server is gone.
+    close(client->fd);
+    client->fd = -1;
+    worker->result.errors++;
+    return -1;
+}
+
+/**
+ * @brief Lets the policy choose a move for a player and sends it.
+ *
+ * @param worker Pointer to the worker.
+ * @param client Pointer to the player, whose turn it is.
+ */
+static void sendMove(LoadWorker* worker, LoadClient* client) {
+    Move move = worker->config->policy->chooseMove(&client->view, worker->config->policy->params, &worker->rng);
+    Frame frame = moveCard(move) == MOVE_DRAW
+                ? makeFrame(FrameDraw, NO_SEAT, NO_CARD, NO_SUIT, 0, 0)
+                : makeFrame(FramePlay, NO_SEAT, moveCard(move), declaredSuit(move) >= 0 ? declaredSuit(move) : NO_SUIT, 0, 0);
+    client->moveSentAt = client->lastMoveAt = nowNs();
+    sendToServer(worker, client, frame);
+}
+
+/**
+ * @brief Starts a player's view of a new match.
+ *
+ * The view knows the rules, the packs, the hand sizes and the top card; the player's own
+ * cards arrive in the deal frames that follow, and the other hands stay empty.
+ *
+ * @param worker Pointer to the worker.
+ * @param client Pointer to the player.
+ * @param frame Pointer to the FrameStart.
+ */
+static void startView(LoadWorker* worker, LoadClient* client, const Frame* frame) {
+    GameState* view = &client->view;
+    int numPlayers = frame->value;
+    memset(view, 0, sizeof(*view));
+    view->numPlayers = (uint16_t)numPlayers;
+    view->numPacks = (uint32_t)worker->config->numPacks;
+    view->ruleSet = (uint8_t)worker->config->ruleSet;
+    view->direction = 1;
+    view->winner = -1;
+    view->hiddenSize = view->numPacks * NUM_CARD_IDS - numPlayers * INITIAL_HAND_SIZE - 1;
+    for (int seat = 0; seat < numPlayers; ++seat) {
+        view->hands[seat].size = INITIAL_HAND_SIZE;
+    }
+    client->seat = frame->seat;
+    client->lastMoveAt = 0;
+}
+
+/**
+ * @brief Updates a player's view with a move reported by the server.
+ *
+ * @param worker Pointer to the worker.
+ * @param client Pointer to the player.
+ * @param frame Pointer to the FrameDelta.
+ */
+static void applyDelta(LoadWorker* worker, LoadClient* client, const Frame* frame) {
+    GameState* view = &client->view;
+    if (frame->card < NUM_CARD_IDS) {
+        Hand* hand = &view->hands[frame->seat];
+        hand->size--;
+        if (frame->seat == client->seat && --hand->counts[frame->card] == 0) {
+            hand->held &= ~((CardMask)1 << frame->card);
+        }
+        view->played[frame->card]++;
+        view->playedSize++;
+        view->topCard = frame->card;
+    }
+    view->activeSuit = frame->suit;
+    view->hands[frame->extra].size += frame->value;
+    view->hiddenSize -= frame->value < view->hiddenSize ? frame->value : view->hiddenSize;
+    view->turn++;
+
+    if (frame->seat == client->seat && client->moveSentAt != 0) {
+        recordLatency(&worker->result.moveAck, nowNs() - client->moveSentAt);
+        client->moveSentAt = 0;
+        worker->result.moves++;
+    }
+}
+
+/**
+ * @brief Builds the join a player sends, asking for the match size, packs and rules of the test.
+ *
+ * @param config Pointer to the load test settings.
+ * @return The FrameJoin.
+ */
+static Frame joinFrame(const LoadTestConfig* config) {
+    return makeFrame(FrameJoin, NO_SEAT, config->ruleSet, config->numPacks, config->numPlayers, 0);
+}
+
+/**
+ * @brief Handles one frame from the server.
+ *
+ * @param worker Pointer to the worker.
+ * @param client Pointer to the player.
+ * @param frame Pointer to the frame, in place in the receive buffer.
+ */
+static void handleFrame(LoadWorker* worker, LoadClient* client, const Frame* frame) {
+    Hand* hand;
+    switch (frame->type) {
+    case FrameStart:
+        startView(worker, client, frame);
+        break;
+    case FrameDeal:
+        hand = &client->view.hands[client->seat];
+        hand->counts[frame->card] += frame->value;
+        hand->held |= (CardMask)1 << frame->card;
+        break;
+    case FrameDelta:
+        applyDelta(worker, client, frame);
+        break;
+    case FrameTurn:
+        client->view.topCard = frame->card;
+        client->view.activeSuit = frame->suit;
+        client->view.currentPlayer = frame->seat;
+        if (client->lastMoveAt != 0) {
+            recordLatency(&worker->result.turnTrip, nowNs() - client->lastMoveAt);
+        }
+        client->dueAt = nowNs() + drawThinkTime(worker);
+        pushThinking(worker, client);
+        break;
+    case FrameOver:
+        // Every seat is told; only the first counts the match.
+        if (client->seat == 0) {
+            worker->result.matches++;
+        }
+        client->seat = -1;
+        sendToServer(worker, client, joinFrame(worker->config));
+        break;
+    case FrameError:
+        // The view has drifted from the server's state; drop the player rather than guess.
+        worker->result.errors++;
+        close(client->fd);
+        client->fd = -1;
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Reads and handles everything the server has sent a player.
+ *
+ * @param worker Pointer to the worker.
+ * @param client Pointer to the player.
+ */
+static void readFrames(LoadWorker* worker, LoadClient* client) {
+    while (client->fd >= 0) {
+        ssize_t n = recv(client->fd, client->in + client->inLength, sizeof(client->in) - client->inLength, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (n <= 0) {
+            close(client->fd);
+            client->fd = -1;
+            worker->result.errors++;
+            return;
+        }
+        int end = client->inLength + (int)n;
+        int start = 0;
+        while (end - start >= FRAME_SIZE && client->fd >= 0) {
+            handleFrame(worker, client, (const Frame*)(client->in + start));
+            start += FRAME_SIZE;
+        }
+        memmove(client->in, client->in + start, end - start);
+        client->inLength = end - start;
+    }
+}
+
+/**
+ * @brief Connects a player to the server.
+ *
+ * @param config Pointer to the load test settings.
+ * @return The non-blocking socket, or -1 on failure.
+ */
+static int connectToServer(const LoadTestConfig* config) {
+    int unixSocket = config->socketPath != NULL;
+    int fd = socket(unixSocket ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int status;
+    if (unixSocket) {
+        struct sockaddr_un address = { .sun_family = AF_UNIX };
+        strncpy(address.sun_path, config->socketPath, sizeof(address.sun_path) - 1);
+        status = connect(fd, (struct sockaddr*)&address, sizeof(address));
+    } else {
+        struct sockaddr_in address = { .sin_family = AF_INET, .sin_port = htons((uint16_t)config->port) };
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        status = connect(fd, (struct sockaddr*)&address, sizeof(address));
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    if (status != 0 || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Connects a worker's players and drives them until the deadline; a job of runParallel.
+ *
+ * @param job Index of the worker.
+ * @param thread Index of the thread running the worker.
+ * @param context Pointer to the array of LoadWorkers.
+ */
+static void runLoadWorker(int job, int thread, void* context) {
+    (void)thread;
+    LoadWorker* worker = &((LoadWorker*)context)[job];
+    const LoadTestConfig* config = worker->config;
+    worker->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (worker->epollFd < 0) {
+        return;
+    }
+
+    for (int i = 0; i < worker->numClients; ++i) {
+        LoadClient* client = &worker->clients[i];
+        client->seat = -1;
+        client->heapIndex = -1;
+        client->fd = connectToServer(config);
+        if (client->fd < 0) {
+            continue;
+        }
+        struct epoll_event event = { .events = EPOLLIN | EPOLLRDHUP | EPOLLET, .data.ptr = client };
+        epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, client->fd, &event);
+        worker->result.connected++;
+        sendToServer(worker, client, joinFrame(config));
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    for (;;) {
+        uint64_t now = nowNs();
+        while (worker->heapSize > 0 && worker->heap[0]->dueAt <= now) {
+            LoadClient* client = popThinking(worker);
+            if (client->fd >= 0) {
+                sendMove(worker, client);
+            }
+        }
+        if (now >= worker->deadline) {
+            break;
+        }
+        uint64_t wake = worker->heapSize > 0 && worker->heap[0]->dueAt < worker->deadline ? worker->heap[0]->dueAt : worker->deadline;
+        int timeout = (int)((wake - now + 999999) / 1000000);
+        int count = epoll_wait(worker->epollFd, events, MAX_EVENTS, timeout);
+        for (int i = 0; i < count; ++i) {
+            readFrames(worker, events[i].data.ptr);
+        }
+    }
+
+    for (int i = 0; i < worker->numClients; ++i) {
+        if (worker->clients[i].fd >= 0) {
+            close(worker->clients[i].fd);
+        }
+    }
+    close(worker->epollFd);
+}
+
+/**
+ * @brief Runs a load test against a running server.
+ *
+ * @param config Pointer to the load test settings.
+ * @param result Pointer to the result.
+ * @return 0 on success, -1 if the settings are invalid or no player could connect.
+ */
+int runLoadTest(const LoadTestConfig* config, LoadTestResult* result) {
+    memset(result, 0, sizeof(*result));
+    if (config->numClients < 1 || config->numPlayers < 2 || config->numPlayers > MAX_PLAYERS
+        || config->numPacks < 1 || config->numPacks >= NO_SUIT || config->numPacks > MAX_PACKS || config->policy == NULL
+        || config->ruleSet < 0 || config->ruleSet >= NUM_RULE_SETS || config->durationSeconds <= 0) {
+        return -1;
+    }
+
+    // Every player holds a descriptor; allow as many as the hard limit permits.
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    int numThreads = config->numThreads > 0 ? config->numThreads : defaultThreadCount();
+    if (numThreads > config->numClients) {
+        numThreads = config->numClients;
+    }
+    LoadWorker* workers = calloc(numThreads, sizeof(LoadWorker));
+    LoadClient* clients = calloc(config->numClients, sizeof(LoadClient));
+    LoadClient** heap = malloc(config->numClients * sizeof(LoadClient*));
+    if (workers == NULL || clients == NULL || heap == NULL) {
+        free(workers);
+        free(clients);
+        free(heap);
+        return -1;
+    }
+
+    uint64_t start = nowNs();
+    uint64_t deadline = start + (uint64_t)(config->durationSeconds * 1e9);
+    Rng seeds;
+    seedRng(&seeds, config->seed);
+    int first = 0;
+    for (int i = 0; i < numThreads; ++i) {
+        int count = config->numClients / numThreads + (i < config->numClients % numThreads);
+        workers[i].config = config;
+        workers[i].clients = clients + first;
+        workers[i].heap = heap + first;
+        workers[i].numClients = count;
+        workers[i].deadline = deadline;
+        seedRng(&workers[i].rng, nextRandom(&seeds));
+        first += count;
+    }
+
+    runParallel(numThreads, numThreads, runLoadWorker, workers);
+
+    result->seconds = (double)(nowNs() - start) / 1e9;
+    for (int i = 0; i < numThreads; ++i) {
+        result->connected += workers[i].result.connected;
+        result->matches += workers[i].result.matches;
+        result->moves += workers[i].result.moves;
+        result->errors += workers[i].result.errors;
+        mergeLatencies(&result->moveAck, &workers[i].result.moveAck);
+        mergeLatencies(&result->turnTrip, &workers[i].result.turnTrip);
+    }
+    free(workers);
+    free(clients);
+    free(heap);
+    return result->connected > 0 ? 0 : -1;
+}
+
+/**
+ * @brief Prints one line of latency percentiles in microseconds.
+ *
+ * @param name Name of the latency.
+ * @param histogram Pointer to its histogram.
+ */
+static void printLatencies(const char* name, const LatencyHistogram* histogram) {
+    printf("%-16s p50 %9.1f  p90 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f us  (%llu samples)\n", name,
+           latencyPercentile(histogram, 50) / 1e3, latencyPercentile(histogram, 90) / 1e3,
+           latencyPercentile(histogram, 99) / 1e3, latencyPercentile(histogram, 99.9) / 1e3,
+           histogram->max / 1e3, (unsigned long long)histogram->total);
+}
+
+/**
+ * @brief Prints the usage of the loadtest command.
+ */
+static void printLoadTestUsage(void) {
+    fprintf(stderr, "Usage: loadtest [--port N | --unix PATH] [--clients N] [--players N] [--packs N] [--rules NAME]\n"
+                    "                [--policy SPEC] [--think none|fixed:US|uniform:US|exp:US] [--duration SECONDS]\n"
+                    "                [--threads N] [--seed N]\n");
+}
+
+/**
+ * @brief Parses a think time specification such as "exp:500".
+ *
+ * @param spec The specification.
+ * @param config Pointer to the settings that receive the distribution and mean.
+ * @return 0 on success, -1 if the specification is invalid.
+ */
+static int parseThink(const char* spec, LoadTestConfig* config) {
+    static const struct {
+        const char* prefix;
+        ThinkDistribution think;
+    } kinds[] = { { "fixed:", ThinkFixed }, { "uniform:", ThinkUniform }, { "exp:", ThinkExponential } };
+    if (strcmp(spec, "none") == 0) {
+        config->think = ThinkNone;
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); ++i) {
+        size_t length = strlen(kinds[i].prefix);
+        if (strncmp(spec, kinds[i].prefix, length) == 0) {
+            config->think = kinds[i].think;
+            config->thinkMeanUs = atof(spec + length);
+            return config->thinkMeanUs >= 0 ? 0 : -1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Runs a load test from command-line arguments and prints the report.
+ *
+ * @param argc Number of arguments after the "loadtest" command.
+ * @param argv The arguments after the "loadtest" command.
+ * @return 0 on success, 1 on invalid arguments or if the test cannot run.
+ */
+int runLoadTestCli(int argc, char** argv) {
+    LoadTestConfig config = { NULL, DEFAULT_SERVER_PORT, 1000, NUM_PLAYERS, 1, RulesStandard, findStrategy("random"),
+                              ThinkNone, 0, 10, 0, (uint64_t)time(NULL) };
+    const Strategy* opened = NULL;
+    int status = 1;
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            config.port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--unix") == 0 && i + 1 < argc) {
+            config.socketPath = argv[++i];
+        } else if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) {
+            config.numClients = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--players") == 0 && i + 1 < argc) {
+            config.numPlayers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--packs") == 0 && i + 1 < argc) {
+            config.numPacks = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rules") == 0 && i + 1 < argc) {
+            int ruleSet = findRuleSet(argv[++i]);
+            if (ruleSet < 0) {
+                fprintf(stderr, "Unknown rules: %s\n", argv[i]);
+                goto done;
+            }
+            config.ruleSet = (RuleSetId)ruleSet;
+        } else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc) {
+            closeStrategy(opened);
+            if ((opened = openStrategy(argv[++i])) == NULL) {
+                fprintf(stderr, "Unknown policy: %s\n", argv[i]);
+                goto done;
+            }
+            config.policy = opened;
+        } else if (strcmp(argv[i], "--think") == 0 && i + 1 < argc) {
+            if (parseThink(argv[++i], &config) != 0) {
+                fprintf(stderr, "Invalid think time: %s\n", argv[i]);
+                goto done;
+            }
+        } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            config.durationSeconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            config.numThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            config.seed = strtoull(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            printLoadTestUsage();
+            goto done;
+        }
+    }
+
+    LoadTestResult result;
+    if (runLoadTest(&config, &result) != 0) {
+        fprintf(stderr, "Cannot run the load test; is the server running?\n");
+        printLoadTestUsage();
+        goto done;
+    }
+    printf("%d of %d players connected, %.1f s\n", result.connected, config.numClients, result.seconds);
+    printf("%ld matches (%.1f/s), %ld moves (%.1f/s), %ld errors\n", result.matches, result.matches / result.seconds,
+           result.moves, result.moves / result.seconds, result.errors);
+    printLatencies("move to ack", &result.moveAck);
+    printLatencies("turn round trip", &result.turnTrip);
+    status = 0;
+
+done:
+    closeStrategy(opened);
+    return status;
+}
@@ -0,0 +1,134 @@
+/**
+ * @file loadtest.h
+ * @brief Header file for the load generator that benchmarks the game server.
+ *
+ * The load generator opens many simulated players against a running server, all speaking
+ * the binary protocol of protocol.h. Each player rebuilds what it can see of its match in
+ * a GameState (its own hand, the top card, the played pile and every hand size), lets a
+ * strategy choose its move after a think time, and joins a new match as soon as one ends.
+ * Worker threads each drive their share of the players from one epoll loop.
+ *
+ * Two latencies are measured: move to ack, from sending a move to receiving the server's
+ * delta for it, and turn round trip, from sending a move to being asked for the next one,
+ * which includes the other players' think times.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef LOADTEST_H
+#define LOADTEST_H
+
+#include <stdint.h>
+#include "gamestate.h"
+#include "strategy.h"
+
+/** Number of histogram buckets per power of two; latencies are kept to within 1/8. */
+#define LATENCY_SUB_BUCKETS 8
+
+/** Number of histogram buckets, enough for any 64-bit latency in nanoseconds. */
+#define LATENCY_BUCKETS (64 * LATENCY_SUB_BUCKETS)
+
+/**
+ * @enum ThinkDistribution
+ * @brief How long a simulated player waits before answering a turn.
+ */
+typedef enum {
+    ThinkNone,        /**< Answer at once */
+    ThinkFixed,       /**< Always wait the mean */
+    ThinkUniform,     /**< Wait uniformly between zero and twice the mean */
+    ThinkExponential  /**< Wait an exponentially distributed time with the given mean */
+} ThinkDistribution;
+
+/**
+ * @struct LoadTestConfig
+ * @brief Settings of a load test.
+ */
+typedef struct {
+    const char* socketPath;         /**< Unix domain socket of the server, or NULL for TCP */
+    int port;                       /**< Localhost TCP port, when socketPath is NULL */
+    int numClients;                 /**< Number of simulated players */
+    int numPlayers;                 /**< Players per match */
+    int numPacks;                   /**< Packs per match, asked for with each join; below NO_SUIT */
+    RuleSetId ruleSet;              /**< Rules of the matches, asked for with each join */
+    const Strategy* policy;         /**< Strategy every player uses */
+    ThinkDistribution think;        /**< Distribution of think times */
+    double thinkMeanUs;             /**< Mean think time in microseconds */
+    double durationSeconds;         /**< How long to run */
+    int numThreads;                 /**< Number of worker threads; 0 uses every core */
+    uint64_t seed;                  /**< Seed for the policies and think times */
+} LoadTestConfig;
+
+/**
+ * @struct LatencyHistogram
+ * @brief Log-linear histogram of latencies in nanoseconds.
+ */
+typedef struct {
+    uint64_t counts[LATENCY_BUCKETS]; /**< Number of samples in each bucket */
+    uint64_t total;                   /**< Number of samples */
+    uint64_t max;                     /**< Largest sample */
+} LatencyHistogram;
+
+/**
+ * @struct LoadTestResult
+ * @brief Results of a load test.
+ */
+typedef struct {
+    int connected;              /**< Players that connected */
+    long matches;               /**< Matches finished */
+    long moves;                 /**< Moves acknowledged */
+    long errors;                /**< Refused moves and lost connections */
+    double seconds;             /**< Time measured */
+    LatencyHistogram moveAck;   /**< Move to ack */
+    LatencyHistogram turnTrip;  /**< Turn round trip */
+} LoadTestResult;
+
+/**
+ * @brief Adds a latency to a histogram.
+ *
+ * @param histogram Pointer to the histogram.
+ * @param nanoseconds The latency.
+ */
+void recordLatency(LatencyHistogram* histogram, uint64_t nanoseconds);
+
+/**
+ * @brief Adds every sample of one histogram to another.
+ *
+ * @param total Pointer to the histogram that receives the samples.
+ * @param part Pointer to the histogram to add.
+ */
+void mergeLatencies(LatencyHistogram* total, const LatencyHistogram* part);
+
+/**
+ * @brief Returns a percentile of a histogram.
+ *
+ * @param histogram Pointer to the histogram.
+ * @param percentile The percentile, from 0 to 100.
+ * @return The latency in nanoseconds, accurate to within 1/LATENCY_SUB_BUCKETS, or 0 if
+ *         the histogram is empty.
+ */
+uint64_t latencyPercentile(const LatencyHistogram* histogram, double percentile);
+
+/**
+ * @brief Runs a load test against a running server.
+ *
+ * @param config Pointer to the load test settings.
+ * @param result Pointer to the result.
+ * @return 0 on success, -1 if the settings are invalid or no player could connect.
+ */
+int runLoadTest(const LoadTestConfig* config, LoadTestResult* result);
+
+/**
+ * @brief Runs a load test from command-line arguments and prints the report.
+ *
+ * Usage: loadtest [--port N | --unix PATH] [--clients N] [--players N] [--packs N]
+ *                 [--rules NAME] [--policy SPEC] [--think none|fixed:US|uniform:US|exp:US]
+ *                 [--duration SECONDS] [--threads N] [--seed N]
+ *
+ * @param argc Number of arguments after the "loadtest" command.
+ * @param argv The arguments after the "loadtest" command.
+ * @return 0 on success, 1 on invalid arguments or if the test cannot run.
+ */
+int runLoadTestCli(int argc, char** argv);
+
+#endif /* LOADTEST_H */
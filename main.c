@@ -11,57 +11,87 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include "analysis.h"
 #include "cardgame.h"
+#include "loadtest.h"
+#include "selftest.h"
+#include "server.h"
+#include "tournament.h"
+#include "tuner.h"
 
 /**
  * @brief The main entry point for the card game program.
  *
  * The function initializes the random number generator, prompts the user for the number
- * of packs, initializes decks, shuffles cards, and starts the card game between two players.
+ * of packs and players, initializes decks, deals cards, and starts the card game.
+ * When the first argument names a command, that command runs instead:
+ *   tournament  Plays strategies against each other and prints their ratings.
+ *   tune        Tunes the weights of the heuristic strategy.
+ *   analyze     Reports the win probability of every move in positions read from a file.
+ *   serve       Hosts matches for clients connecting over a local socket.
+ *   loadtest    Plays many simulated players against a running server and reports latencies.
+ *   selftest    Runs the self-tests of the engine, the persistence files and the server.
  *
+ * @param argc Number of command-line arguments.
+ * @param argv The command-line arguments.
  * @return 0 on successful execution.
  */
-int main() {
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "tournament") == 0) {
+        return runTournamentCli(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "tune") == 0) {
+        return runTunerCli(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "analyze") == 0) {
+        return runAnalysisCli(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "serve") == 0) {
+        return runServerCli(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "loadtest") == 0) {
+        return runLoadTestCli(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "selftest") == 0) {
+        return runSelfTestCli(argc - 2, argv + 2);
+    }
+
     srand(time(NULL)); // Seed the random number generator.
 
     // Prompt the user for the number of packs.
     int numPacks = getNumPacksFromUser();
 
-    // Initialize the hidden deck and shuffle the cards.
-    DeckOfCards hiddenDeck = initializeDeck(numPacks);
-    shuffleDeck(&hiddenDeck);
-
-    // Initialize player decks and the played deck.
-    DeckOfCards player1 = { NULL, 0, {0} };
-    DeckOfCards player2 = { NULL, 0, {0} };
-    DeckOfCards playedDeck = { NULL, 0, {0} };
+    // Initialize the hidden deck as card counts; draws pick random cards, so no shuffle is needed.
+    CardMultiset hiddenDeck = initializeMultiset(numPacks);
 
-    // Draw initial cards for both players.
-    for (int i = 0; i < 8; ++i) {
-        addCardToDeck(&player1, drawCard(&hiddenDeck));
-        addCardToDeck(&player2, drawCard(&hiddenDeck));
-    }
+    // Prompt the user for the number of players.
+    int numPlayers = getNumPlayersFromUser(numPacks);
 
-    // Sort the initial cards for both players.
-    customSort(&player1);
-    customSort(&player2);
+    // Initialize the player decks, stored one after another, and the played deck.
+    DeckOfCards* players = calloc(numPlayers, sizeof(DeckOfCards));
+    DeckOfCards playedDeck = { NULL, 0, {0}, 0 };
 
-    // Display the initial cards for both players.
-    printf("Player 1's cards:\n");
-    displayDeck(player1);
+    // Deal the initial cards for every player.
+    dealCards(&hiddenDeck, players, numPlayers, CARDS_PER_PLAYER);
 
-    printf("\nPlayer 2's cards:\n");
-    displayDeck(player2);
+    // Sort and display the initial cards of every player.
+    for (int player = 0; player < numPlayers; ++player) {
+        customSort(&players[player]);
+        printf("%sPlayer %d's cards:\n", player == 0 ? "" : "\n", player + 1);
+        displayDeck(players[player]);
+    }
 
     // Start the card game with player turns.
     PlayerTurn currentPlayer = PlayerOne;
-    startGame(&hiddenDeck, &player1, &player2, &playedDeck, &currentPlayer);
+    startGame(&hiddenDeck, players, numPlayers, &playedDeck, &currentPlayer);
 
     // Free allocated memory for decks.
-    free(hiddenDeck.cards);
-    free(player1.cards);
-    free(player2.cards);
+    for (int player = 0; player < numPlayers; ++player) {
+        free(players[player].cards);
+    }
+    free(players);
     free(playedDeck.cards);
 
     return 0;
@@ -0,0 +1,306 @@
+/**
+ * @file matchmaker.c
+ * @brief Implementation of the matchmaker that pairs players from every shard of a server.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* nanosleep */
+#endif
+#include "matchmaker.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @struct Matchmaker
+ * @brief The queue of new tickets, the tickets still waiting and the pairing thread.
+ */
+struct Matchmaker {
+    MpscQueue queue;        /**< Tickets submitted since the last batch */
+    atomic_int sleeping;    /**< 1 while the thread may be blocked waiting for a ticket */
+    atomic_int stopping;    /**< 1 once the matchmaker is stopping */
+    int wakeFd;             /**< Event that wakes the thread */
+    int intervalMs;         /**< Time joins are gathered before each batch */
+    PlaceFn place;          /**< Called for each match formed */
+    void* context;          /**< Context passed to place */
+    int numShards;          /**< Number of shards */
+    atomic_int* loads;      /**< Load each shard last reported */
+    int* estimates;         /**< Loads during a batch, counting the matches placed in it */
+    JoinTicket** waiting;   /**< Tickets not yet paired; the thread's alone */
+    int numWaiting;         /**< Number of tickets waiting */
+    int waitingCapacity;    /**< Size of waiting */
+    pthread_t thread;       /**< The pairing thread */
+};
+
+/**
+ * @brief Orders tickets by configuration, then by rating; a qsort comparator.
+ *
+ * @param a Pointer to the first ticket pointer.
+ * @param b Pointer to the second ticket pointer.
+ * @return Negative, zero or positive as a sorts before, with or after b.
+ */
+static int compareTickets(const void* a, const void* b) {
+    const JoinTicket* first = *(JoinTicket* const*)a;
+    const JoinTicket* second = *(JoinTicket* const*)b;
+    if (first->numPlayers != second->numPlayers) {
+        return first->numPlayers - second->numPlayers;
+    }
+    if (first->numPacks != second->numPacks) {
+        return first->numPacks < second->numPacks ? -1 : 1;
+    }
+    if (first->ruleSet != second->ruleSet) {
+        return first->ruleSet - second->ruleSet;
+    }
+    return (first->rating > second->rating) - (first->rating < second->rating);
+}
+
+/**
+ * @brief Tells whether two tickets want the same game.
+ *
+ * @param first Pointer to the first ticket.
+ * @param second Pointer to the second ticket.
+ * @return 1 if their configurations match, 0 otherwise.
+ */
+static int sameConfiguration(const JoinTicket* first, const JoinTicket* second) {
+    return first->numPlayers == second->numPlayers && first->numPacks == second->numPacks
+           && first->ruleSet == second->ruleSet;
+}
+
+/**
+ * @brief Moves the tickets submitted since the last batch to the waiting list.
+ *
+ * @param matchmaker Pointer to the matchmaker.
+ */
+static void gatherTickets(Matchmaker* matchmaker) {
+    QueueNode* node;
+    while ((node = popMpscQueue(&matchmaker->queue)) != NULL) {
+        JoinTicket* ticket = (JoinTicket*)node;
+        if (matchmaker->numWaiting == matchmaker->waitingCapacity) {
+            int capacity = matchmaker->waitingCapacity > 0 ? 2 * matchmaker->waitingCapacity : 256;
+            JoinTicket** waiting = realloc(matchmaker->waiting, capacity * sizeof(JoinTicket*));
+            if (waiting == NULL) {
+                // Leave the rest queued until memory frees up.
+                pushMpscQueue(&matchmaker->queue, node);
+                return;
+            }
+            matchmaker->waiting = waiting;
+            matchmaker->waitingCapacity = capacity;
+        }
+        matchmaker->waiting[matchmaker->numWaiting++] = ticket;
+    }
+}
+
+/**
+ * @brief Returns the shard with the least load, counting matches placed during this batch.
+ *
+ * @param matchmaker Pointer to the matchmaker.
+ * @return The shard.
+ */
+static int leastLoadedShard(const Matchmaker* matchmaker) {
+    int best = 0;
+    for (int shard = 1; shard < matchmaker->numShards; ++shard) {
+        if (matchmaker->estimates[shard] < matchmaker->estimates[best]) {
+            best = shard;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Pairs the waiting tickets into matches and places each on a shard.
+ *
+ * @param matchmaker Pointer to the matchmaker.
+ */
+static void pairTickets(Matchmaker* matchmaker) {
+    JoinTicket** waiting = matchmaker->waiting;
+    int count = 0;
+    for (int i = 0; i < matchmaker->numWaiting; ++i) {
+        if (atomic_load_explicit(&waiting[i]->cancelled, memory_order_acquire)) {
+            free(waiting[i]);
+        } else {
+            waiting[count++] = waiting[i];
+        }
+    }
+    qsort(waiting, count, sizeof(JoinTicket*), compareTickets);
+    for (int shard = 0; shard < matchmaker->numShards; ++shard) {
+        matchmaker->estimates[shard] = atomic_load_explicit(&matchmaker->loads[shard], memory_order_relaxed);
+    }
+
+    // Sorted this way, a run of numPlayers tickets wants one game if its ends do.
+    int kept = 0;
+    int i = 0;
+    while (i < count) {
+        int numPlayers = waiting[i]->numPlayers;
+        JoinTicket* last = i + numPlayers <= count ? waiting[i + numPlayers - 1] : NULL;
+        if (last != NULL && sameConfiguration(waiting[i], last) && last->rating - waiting[i]->rating <= RATING_BAND) {
+            int shard = leastLoadedShard(matchmaker);
+            matchmaker->estimates[shard]++;
+            matchmaker->place(matchmaker->context, &waiting[i], numPlayers, shard);
+            i += numPlayers;
+        } else {
+            waiting[kept++] = waiting[i++];
+        }
+    }
+    matchmaker->numWaiting = kept;
+}
+
+/**
+ * @brief Blocks until a ticket is submitted or the matchmaker stops.
+ *
+ * @param matchmaker Pointer to the matchmaker.
+ */
+static void waitForTickets(Matchmaker* matchmaker) {
+    for (;;) {
+        // Announce the sleep before looking, so a ticket submitted meanwhile wakes the thread.
+        atomic_store(&matchmaker->sleeping, 1);
+        if (!isMpscQueueEmpty(&matchmaker->queue) || atomic_load(&matchmaker->stopping)) {
+            break;
+        }
+        uint64_t count;
+        ssize_t n = read(matchmaker->wakeFd, &count, sizeof(count));
+        (void)n;
+    }
+    atomic_store(&matchmaker->sleeping, 0);
+}
+
+/**
+ * @brief Pairs one batch of tickets per interval while any arrive; the matchmaker's thread.
+ *
+ * @param argument Pointer to the Matchmaker.
+ * @return NULL.
+ */
+static void* runMatchmaker(void* argument) {
+    Matchmaker* matchmaker = argument;
+    for (;;) {
+        waitForTickets(matchmaker);
+        if (atomic_load(&matchmaker->stopping)) {
+            break;
+        }
+        // Let the batch fill for one interval, so each pairing sees many joins at once.
+        struct timespec delay = { matchmaker->intervalMs / 1000, (long)(matchmaker->intervalMs % 1000) * 1000000 };
+        nanosleep(&delay, NULL);
+        gatherTickets(matchmaker);
+        pairTickets(matchmaker);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Starts a matchmaker and its thread.
+ *
+ * @param numShards Number of shards matches are placed on.
+ * @param intervalMs Time joins are gathered before each batch is paired.
+ * @param place Function called for each match formed.
+ * @param context Context passed to place.
+ * @return Pointer to the matchmaker, or NULL if it cannot start.
+ */
+Matchmaker* startMatchmaker(int numShards, int intervalMs, PlaceFn place, void* context) {
+    if (numShards < 1 || intervalMs < 0) {
+        return NULL;
+    }
+    Matchmaker* matchmaker = calloc(1, sizeof(Matchmaker));
+    if (matchmaker == NULL) {
+        return NULL;
+    }
+    matchmaker->loads = calloc(numShards, sizeof(atomic_int));
+    matchmaker->estimates = calloc(numShards, sizeof(int));
+    matchmaker->wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (matchmaker->loads == NULL || matchmaker->estimates == NULL || matchmaker->wakeFd < 0) {
+        goto failed;
+    }
+    initMpscQueue(&matchmaker->queue);
+    atomic_init(&matchmaker->sleeping, 0);
+    atomic_init(&matchmaker->stopping, 0);
+    for (int shard = 0; shard < numShards; ++shard) {
+        atomic_init(&matchmaker->loads[shard], 0);
+    }
+    matchmaker->intervalMs = intervalMs;
+    matchmaker->place = place;
+    matchmaker->context = context;
+    matchmaker->numShards = numShards;
+    if (pthread_create(&matchmaker->thread, NULL, runMatchmaker, matchmaker) != 0) {
+        goto failed;
+    }
+    return matchmaker;
+
+failed:
+    if (matchmaker->wakeFd >= 0) {
+        close(matchmaker->wakeFd);
+    }
+    free(matchmaker->loads);
+    free(matchmaker->estimates);
+    free(matchmaker);
+    return NULL;
+}
+
+/**
+ * @brief Submits a ticket to be paired; any thread may call this.
+ *
+ * @param matchmaker Pointer to the matchmaker.
+ * @param ticket Pointer to the ticket, with every field but node filled in and cancelled 0.
+ */
+void submitJoin(Matchmaker* matchmaker, JoinTicket* ticket) {
+    pushMpscQueue(&matchmaker->queue, &ticket->node);
+    // Only the submitter that finds the thread asleep pays for the system call.
+    if (atomic_load(&matchmaker->sleeping) && atomic_exchange(&matchmaker->sleeping, 0)) {
+        uint64_t one = 1;
+        ssize_t n = write(matchmaker->wakeFd, &one, sizeof(one));
+        (void)n;
+    }
+}
+
+/**
+ * @brief Withdraws a ticket whose player has left.
+ *
+ * A ticket not yet placed is freed by the matchmaker. One already placed belongs to
+ * whoever the place function passed it to, who must check cancelled before seating the
+ * player. Either way only that receiver may touch the ticket afterwards.
+ *
+ * @param ticket Pointer to the ticket.
+ */
+void cancelJoin(JoinTicket* ticket) {
+    atomic_store_explicit(&ticket->cancelled, 1, memory_order_release);
+}
+
+/**
+ * @brief Reports how loaded a shard is; any thread may call this.
+ *
+ * @param matchmaker Pointer to the matchmaker.
+ * @param shard The shard.
+ * @param load Its load, such as the number of matches it hosts.
+ */
+void reportShardLoad(Matchmaker* matchmaker, int shard, int load) {
+    atomic_store_explicit(&matchmaker->loads[shard], load, memory_order_relaxed);
+}
+
+/**
+ * @brief Stops a matchmaker's thread, frees the tickets still waiting and frees the matchmaker.
+ *
+ * @param matchmaker Pointer to the matchmaker, or NULL.
+ */
+void stopMatchmaker(Matchmaker* matchmaker) {
+    if (matchmaker == NULL) {
+        return;
+    }
+    atomic_store(&matchmaker->stopping, 1);
+    uint64_t one = 1;
+    ssize_t n = write(matchmaker->wakeFd, &one, sizeof(one));
+    (void)n;
+    pthread_join(matchmaker->thread, NULL);
+
+    gatherTickets(matchmaker);
+    for (int i = 0; i < matchmaker->numWaiting; ++i) {
+        free(matchmaker->waiting[i]);
+    }
+    close(matchmaker->wakeFd);
+    free(matchmaker->waiting);
+    free(matchmaker->loads);
+    free(matchmaker->estimates);
+    free(matchmaker);
+}
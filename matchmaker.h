@@ -0,0 +1,109 @@
+/**
+ * @file matchmaker.h
+ * @brief Header file for the matchmaker that pairs players from every shard of a server.
+ *
+ * Shards submit join tickets through a lock-free queue (see mpscqueue.h), so a join costs
+ * its shard one atomic exchange however many other shards are joining at the same time.
+ * The matchmaker's thread lets joins gather for one interval and pairs the whole batch:
+ * tickets are sorted by game configuration and rating, and each run of players wanting
+ * the same configuration whose ratings lie within one band becomes a match. Every match is
+ * placed on the shard reporting the least load; players still unpaired wait for the next
+ * batch.
+ *
+ * A ticket is a malloc'd block that starts with a JoinTicket, so the caller may extend it.
+ * Once submitted it belongs to the matchmaker until it is placed, when it passes to the
+ * place function; a ticket cancelled before it is placed is freed by the matchmaker.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef MATCHMAKER_H
+#define MATCHMAKER_H
+
+#include <stdatomic.h>
+#include "mpscqueue.h"
+
+/** Rating of a player who gives none. */
+#define DEFAULT_RATING 1500
+
+/** Widest spread of ratings within one match. */
+#define RATING_BAND 200
+
+/** Time joins are gathered before they are paired, in milliseconds, when none is given. */
+#define DEFAULT_PAIRING_INTERVAL_MS 2
+
+/**
+ * @struct JoinTicket
+ * @brief A player waiting to be paired.
+ */
+typedef struct {
+    QueueNode node;       /**< Link in the matchmaker's queue; free for the owner's use once placed */
+    atomic_int cancelled; /**< Set by the owner once the player has left */
+    int shard;            /**< Shard the player is connected to */
+    int numPlayers;       /**< Players wanted in the match */
+    int numPacks;         /**< Packs wanted in the match */
+    int ruleSet;          /**< RuleSetId wanted in the match */
+    int rating;           /**< The player's rating */
+} JoinTicket;
+
+/** The matchmaker of a server. */
+typedef struct Matchmaker Matchmaker;
+
+/**
+ * @brief Called on the matchmaker's thread with the tickets of a new match.
+ *
+ * @param context The context passed to startMatchmaker.
+ * @param tickets The tickets, one per seat in seat order; they now belong to the callee.
+ * @param count Number of tickets.
+ * @param shard Shard the match should be hosted on.
+ */
+typedef void (*PlaceFn)(void* context, JoinTicket* const* tickets, int count, int shard);
+
+/**
+ * @brief Starts a matchmaker and its thread.
+ *
+ * @param numShards Number of shards matches are placed on.
+ * @param intervalMs Time joins are gathered before each batch is paired.
+ * @param place Function called for each match formed.
+ * @param context Context passed to place.
+ * @return Pointer to the matchmaker, or NULL if it cannot start.
+ */
+Matchmaker* startMatchmaker(int numShards, int intervalMs, PlaceFn place, void* context);
+
+/**
+ * @brief Submits a ticket to be paired; any thread may call this.
+ *
+ * @param matchmaker Pointer to the matchmaker.
+ * @param ticket Pointer to the ticket, with every field but node filled in and cancelled 0.
+ */
+void submitJoin(Matchmaker* matchmaker, JoinTicket* ticket);
+
+/**
+ * @brief Withdraws a ticket whose player has left.
+ *
+ * A ticket not yet placed is freed by the matchmaker. One already placed belongs to
+ * whoever the place function passed it to, who must check cancelled before seating the
+ * player. Either way only that receiver may touch the ticket afterwards.
+ *
+ * @param ticket Pointer to the ticket.
+ */
+void cancelJoin(JoinTicket* ticket);
+
+/**
+ * @brief Reports how loaded a shard is; any thread may call this.
+ *
+ * @param matchmaker Pointer to the matchmaker.
+ * @param shard The shard.
+ * @param load Its load, such as the number of matches it hosts.
+ */
+void reportShardLoad(Matchmaker* matchmaker, int shard, int load);
+
+/**
+ * @brief Stops a matchmaker's thread, frees the tickets still waiting and frees the matchmaker.
+ *
+ * @param matchmaker Pointer to the matchmaker, or NULL.
+ */
+void stopMatchmaker(Matchmaker* matchmaker);
+
+#endif /* MATCHMAKER_H */
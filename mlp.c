@@ -0,0 +1,460 @@
+/**
+ * @file mlp.c
+ * @brief Implementation of evaluating small neural-network policies inside the engine.
+ *
+ * Each layer's weights are stored transposed, as [in][out] with the output width padded
+ * to a multiple of eight, so a row of eight outputs is one AVX register. The kernel
+ * evaluates four batch rows at a time: each weight vector is loaded once and combined
+ * with all four rows by fused multiply-add. Rows left over from the blocks of four use the
+ * same fused operations in the same order, so every row gets the same result whichever
+ * path computes it.
+ *
+ * Activations, inputs and logits live in scratch memory kept per thread and reused by
+ * later calls, as one Mlp is shared by every thread that plays it.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "mlp.h"
+#include "batchenv.h"
+#include "encoder.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define MLP_AVX2 1
+#endif
+
+/** Number of batch rows evaluated together by the kernel. */
+#define ROW_BLOCK 4
+
+/** Number of outputs in one SIMD vector. */
+#define LANES 8
+
+/** Number of games evaluated per forward pass when choosing moves. */
+#define MOVE_BATCH 256
+
+/**
+ * @enum ScratchSlot
+ * @brief The scratch buffers each thread keeps.
+ */
+typedef enum {
+    ScratchActivations, /**< Two layers of activations, for mlpForward */
+    ScratchMoves,       /**< Inputs and logits, for chooseMlpMoves */
+    NUM_SCRATCH_SLOTS   /**< Number of buffers */
+} ScratchSlot;
+
+/**
+ * @struct MlpScratch
+ * @brief Scratch memory of one thread, grown as needed and freed when the thread exits.
+ */
+typedef struct {
+    float* memory[NUM_SCRATCH_SLOTS];   /**< Each buffer, or NULL */
+    size_t capacity[NUM_SCRATCH_SLOTS]; /**< Number of floats in each buffer */
+} MlpScratch;
+
+/** Key of each thread's MlpScratch. */
+static pthread_key_t scratchKey;
+
+/** Creates scratchKey once. */
+static pthread_once_t scratchOnce = PTHREAD_ONCE_INIT;
+
+/** 1 once scratchKey has been created. */
+static int scratchKeyReady;
+
+/**
+ * @struct Mlp
+ * @brief A loaded policy network.
+ */
+struct Mlp {
+    int numLayers;                       /**< Number of layers */
+    int width[MAX_MLP_LAYERS + 1];       /**< Width of each layer's input and of the output */
+    int padded[MAX_MLP_LAYERS + 1];      /**< Widths rounded up to a multiple of LANES */
+    float* weights[MAX_MLP_LAYERS];      /**< Transposed weights, [in][padded out] */
+    float* biases[MAX_MLP_LAYERS];       /**< Biases, padded out with zeros */
+    int maxPadded;                       /**< Largest padded width */
+};
+
+/**
+ * @brief Rounds a width up to a multiple of LANES.
+ *
+ * @param width The width.
+ * @return The padded width.
+ */
+static int padWidth(int width) {
+    return (width + LANES - 1) / LANES * LANES;
+}
+
+/**
+ * @brief Allocates zeroed memory aligned for SIMD loads.
+ *
+ * @param count Number of floats.
+ * @return The memory, or NULL.
+ */
+static float* allocFloats(size_t count) {
+    size_t bytes = (count * sizeof(float) + 31) / 32 * 32;
+    float* memory = aligned_alloc(32, bytes > 0 ? bytes : 32);
+    if (memory != NULL) {
+        memset(memory, 0, bytes);
+    }
+    return memory;
+}
+
+/**
+ * @brief Frees a thread's scratch memory; the destructor of scratchKey.
+ *
+ * @param pointer Pointer to the MlpScratch.
+ */
+static void freeScratch(void* pointer) {
+    MlpScratch* scratch = pointer;
+    for (int slot = 0; slot < NUM_SCRATCH_SLOTS; ++slot) {
+        free(scratch->memory[slot]);
+    }
+    free(scratch);
+}
+
+/**
+ * @brief Creates scratchKey; run once by pthread_once.
+ */
+static void createScratchKey(void) {
+    scratchKeyReady = pthread_key_create(&scratchKey, freeScratch) == 0;
+}
+
+/**
+ * @brief Returns a scratch buffer of the calling thread, growing it if it is too small.
+ *
+ * The contents are whatever the last call left.
+ *
+ * @param slot Which buffer.
+ * @param count Number of floats needed.
+ * @return The buffer, aligned for SIMD loads, or NULL if memory runs out.
+ */
+static float* threadScratch(ScratchSlot slot, size_t count) {
+    pthread_once(&scratchOnce, createScratchKey);
+    if (!scratchKeyReady) {
+        return NULL;
+    }
+    MlpScratch* scratch = pthread_getspecific(scratchKey);
+    if (scratch == NULL) {
+        scratch = calloc(1, sizeof(MlpScratch));
+        if (scratch == NULL || pthread_setspecific(scratchKey, scratch) != 0) {
+            free(scratch);
+            return NULL;
+        }
+    }
+    if (scratch->capacity[slot] < count) {
+        float* memory = allocFloats(count);
+        if (memory == NULL) {
+            return NULL;
+        }
+        free(scratch->memory[slot]);
+        scratch->memory[slot] = memory;
+        scratch->capacity[slot] = count;
+    }
+    return scratch->memory[slot];
+}
+
+/**
+ * @brief Loads a policy network from a weights file.
+ *
+ * @param path Path of the weights file.
+ * @return The network, or NULL if the file cannot be read or is not a valid policy.
+ */
+Mlp* loadMlp(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    Mlp* mlp = calloc(1, sizeof(Mlp));
+    char magic[4];
+    uint32_t numLayers;
+    uint32_t widths[MAX_MLP_LAYERS + 1];
+    float* row = NULL;
+    if (mlp == NULL || fread(magic, 1, 4, file) != 4 || memcmp(magic, "MLP1", 4) != 0 ||
+        fread(&numLayers, sizeof(uint32_t), 1, file) != 1 || numLayers < 1 || numLayers > MAX_MLP_LAYERS ||
+        fread(widths, sizeof(uint32_t), numLayers + 1, file) != numLayers + 1 ||
+        widths[0] != OBSERVATION_SIZE || widths[numLayers] != NUM_ACTIONS) {
+        goto fail;
+    }
+
+    mlp->numLayers = (int)numLayers;
+    for (uint32_t i = 0; i <= numLayers; ++i) {
+        if (widths[i] < 1 || widths[i] > MAX_MLP_WIDTH) {
+            goto fail;
+        }
+        mlp->width[i] = (int)widths[i];
+        mlp->padded[i] = padWidth(mlp->width[i]);
+        if (mlp->padded[i] > mlp->maxPadded) {
+            mlp->maxPadded = mlp->padded[i];
+        }
+    }
+
+    row = malloc(MAX_MLP_WIDTH * sizeof(float));
+    if (row == NULL) {
+        goto fail;
+    }
+    for (int layer = 0; layer < mlp->numLayers; ++layer) {
+        int in = mlp->width[layer];
+        int out = mlp->width[layer + 1];
+        int stride = mlp->padded[layer + 1];
+        mlp->weights[layer] = allocFloats((size_t)in * stride);
+        mlp->biases[layer] = allocFloats(stride);
+        if (mlp->weights[layer] == NULL || mlp->biases[layer] == NULL) {
+            goto fail;
+        }
+        for (int o = 0; o < out; ++o) {
+            if (fread(row, sizeof(float), in, file) != (size_t)in) {
+                goto fail;
+            }
+            for (int i = 0; i < in; ++i) {
+                mlp->weights[layer][(size_t)i * stride + o] = row[i];
+            }
+        }
+        if (fread(mlp->biases[layer], sizeof(float), out, file) != (size_t)out) {
+            goto fail;
+        }
+    }
+
+    free(row);
+    fclose(file);
+    return mlp;
+
+fail:
+    free(row);
+    freeMlp(mlp);
+    fclose(file);
+    return NULL;
+}
+
+/**
+ * @brief Releases a policy network.
+ *
+ * @param mlp The network, or NULL.
+ */
+void freeMlp(Mlp* mlp) {
+    if (mlp == NULL) {
+        return;
+    }
+    for (int layer = 0; layer < MAX_MLP_LAYERS; ++layer) {
+        free(mlp->weights[layer]);
+        free(mlp->biases[layer]);
+    }
+    free(mlp);
+}
+
+/**
+ * @brief Returns a * b + c, rounded once where the AVX2 kernel is built, as it is there.
+ *
+ * @param a The first factor.
+ * @param b The second factor.
+ * @param c The addend.
+ * @return The result.
+ */
+static inline float multiplyAdd(float a, float b, float c) {
+#if defined(MLP_AVX2)
+    return fmaf(a, b, c);
+#else
+    return a * b + c;
+#endif
+}
+
+/**
+ * @brief Computes one layer for a batch: out = in * weights + bias, with optional ReLU.
+ *
+ * @param in Input rows, inStride floats apart.
+ * @param inStride Distance between input rows.
+ * @param inWidth Number of inputs used in each row.
+ * @param weights Transposed weights, [inWidth][outWidth].
+ * @param bias Biases, outWidth floats.
+ * @param out Output rows, outWidth floats apart.
+ * @param outWidth Padded number of outputs; a multiple of LANES.
+ * @param rows Number of rows.
+ * @param relu 1 to apply ReLU to the outputs.
+ */
+static void denseLayer(const float* in, int inStride, int inWidth, const float* weights, const float* bias,
+                       float* out, int outWidth, int rows, int relu) {
+    int r = 0;
+#if defined(MLP_AVX2)
+    __m256 zero = _mm256_setzero_ps();
+    for (; r + ROW_BLOCK <= rows; r += ROW_BLOCK) {
+        const float* x0 = in + (size_t)r * inStride;
+        const float* x1 = x0 + inStride;
+        const float* x2 = x1 + inStride;
+        const float* x3 = x2 + inStride;
+        for (int o = 0; o < outWidth; o += LANES) {
+            __m256 acc0 = _mm256_load_ps(bias + o);
+            __m256 acc1 = acc0;
+            __m256 acc2 = acc0;
+            __m256 acc3 = acc0;
+            for (int i = 0; i < inWidth; ++i) {
+                __m256 w = _mm256_load_ps(weights + (size_t)i * outWidth + o);
+                acc0 = _mm256_fmadd_ps(_mm256_set1_ps(x0[i]), w, acc0);
+                acc1 = _mm256_fmadd_ps(_mm256_set1_ps(x1[i]), w, acc1);
+                acc2 = _mm256_fmadd_ps(_mm256_set1_ps(x2[i]), w, acc2);
+                acc3 = _mm256_fmadd_ps(_mm256_set1_ps(x3[i]), w, acc3);
+            }
+            if (relu) {
+                acc0 = _mm256_max_ps(acc0, zero);
+                acc1 = _mm256_max_ps(acc1, zero);
+                acc2 = _mm256_max_ps(acc2, zero);
+                acc3 = _mm256_max_ps(acc3, zero);
+            }
+            float* y = out + (size_t)r * outWidth + o;
+            _mm256_storeu_ps(y, acc0);
+            _mm256_storeu_ps(y + outWidth, acc1);
+            _mm256_storeu_ps(y + 2 * outWidth, acc2);
+            _mm256_storeu_ps(y + 3 * outWidth, acc3);
+        }
+    }
+#endif
+    for (; r < rows; ++r) {
+        const float* x = in + (size_t)r * inStride;
+        float* y = out + (size_t)r * outWidth;
+        memcpy(y, bias, outWidth * sizeof(float));
+        for (int i = 0; i < inWidth; ++i) {
+            const float* w = weights + (size_t)i * outWidth;
+            for (int o = 0; o < outWidth; ++o) {
+                y[o] = multiplyAdd(x[i], w[o], y[o]);
+            }
+        }
+        if (relu) {
+            for (int o = 0; o < outWidth; ++o) {
+                y[o] = y[o] > 0.0f ? y[o] : 0.0f;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Evaluates the network on a batch of inputs.
+ *
+ * Activations are kept in scratch memory of the calling thread, so after the first call
+ * of a thread no memory is allocated.
+ *
+ * @param mlp The network.
+ * @param inputs batchSize rows of OBSERVATION_SIZE floats.
+ * @param batchSize Number of rows.
+ * @param logits Output buffer of batchSize rows of NUM_ACTIONS floats.
+ * @return 0 on success, -1 if memory runs out.
+ */
+int mlpForward(const Mlp* mlp, const float* inputs, int batchSize, float* logits) {
+    size_t layerSize = (size_t)batchSize * mlp->maxPadded;
+    float* scratch = threadScratch(ScratchActivations, 2 * layerSize);
+    if (scratch == NULL) {
+        return -1;
+    }
+    float* buffers[2] = { scratch, scratch + layerSize };
+
+    const float* in = inputs;
+    int inStride = OBSERVATION_SIZE;
+    for (int layer = 0; layer < mlp->numLayers; ++layer) {
+        float* out = buffers[layer % 2];
+        int last = layer == mlp->numLayers - 1;
+        denseLayer(in, inStride, mlp->width[layer], mlp->weights[layer], mlp->biases[layer],
+                   out, mlp->padded[layer + 1], batchSize, !last);
+        in = out;
+        inStride = mlp->padded[layer + 1];
+    }
+
+    for (int r = 0; r < batchSize; ++r) {
+        memcpy(logits + (size_t)r * NUM_ACTIONS, in + (size_t)r * inStride, NUM_ACTIONS * sizeof(float));
+    }
+    return 0;
+}
+
+/**
+ * @brief Chooses the legal move with the highest logit in each of several games.
+ *
+ * Games are encoded and evaluated MOVE_BATCH at a time. If memory runs out, the first
+ * legal move is played instead.
+ *
+ * @param states The game states.
+ * @param count Number of games.
+ * @param params The network (an Mlp).
+ * @param rng Unused.
+ * @param moves Output array receiving a legal move for each game.
+ */
+void chooseMlpMoves(const GameState* const* states, int count, const void* params, Rng* rng, Move* moves) {
+    (void)rng;
+    const Mlp* mlp = params;
+    int batchSize = count < MOVE_BATCH ? count : MOVE_BATCH;
+    float* inputs = threadScratch(ScratchMoves, (size_t)batchSize * (OBSERVATION_SIZE + NUM_ACTIONS));
+    float* logits = inputs != NULL ? inputs + (size_t)batchSize * OBSERVATION_SIZE : NULL;
+
+    for (int start = 0; start < count; start += batchSize) {
+        int size = count - start < batchSize ? count - start : batchSize;
+        int evaluated = inputs != NULL && logits != NULL;
+        if (evaluated) {
+            for (int k = 0; k < size; ++k) {
+                const GameState* state = states[start + k];
+                encodeObservationFloat(state, state->currentPlayer, inputs + (size_t)k * OBSERVATION_SIZE);
+            }
+            evaluated = mlpForward(mlp, inputs, size, logits) == 0;
+        }
+
+        for (int k = 0; k < size; ++k) {
+            CardMask legal = legalMoves(states[start + k]);
+            Move best = lowestCardId(legal);
+            if (evaluated) {
+                const float* row = logits + (size_t)k * NUM_ACTIONS;
+                for (CardMask m = legal & (legal - 1); m; m &= m - 1) {
+                    int action = lowestCardId(m);
+                    if (row[action] > row[best]) {
+                        best = action;
+                    }
+                }
+            }
+            moves[start + k] = best;
+        }
+    }
+}
+
+/**
+ * @brief Chooses the legal move with the highest logit in one game.
+ *
+ * @param state Pointer to the game state.
+ * @param params The network (an Mlp).
+ * @param rng Unused.
+ * @return A legal move.
+ */
+Move chooseMlpMove(const GameState* state, const void* params, Rng* rng) {
+    Move move;
+    chooseMlpMoves(&state, 1, params, rng, &move);
+    return move;
+}
+
+/**
+ * @brief Creates a strategy that plays a policy network loaded from a file.
+ *
+ * @param path Path of the weights file.
+ * @return The strategy, released with destroyMlpStrategy, or NULL on failure.
+ */
+Strategy* createMlpStrategy(const char* path) {
+    Mlp* mlp = loadMlp(path);
+    Strategy* strategy = malloc(sizeof(Strategy));
+    if (mlp == NULL || strategy == NULL) {
+        freeMlp(mlp);
+        free(strategy);
+        return NULL;
+    }
+    *strategy = (Strategy) { "mlp", chooseMlpMove, mlp, chooseMlpMoves };
+    return strategy;
+}
+
+/**
+ * @brief Releases a strategy created by createMlpStrategy.
+ *
+ * @param strategy The strategy, or NULL.
+ */
+void destroyMlpStrategy(Strategy* strategy) {
+    if (strategy != NULL) {
+        freeMlp((Mlp*)strategy->params);
+        free(strategy);
+    }
+}
@@ -0,0 +1,103 @@
+/**
+ * @file mlp.h
+ * @brief Header file for evaluating small neural-network policies inside the engine.
+ *
+ * A policy is a multilayer perceptron: ReLU hidden layers and a linear output layer with
+ * one logit per action. Its input is the float observation from encoder.h. Many games
+ * are evaluated together as one matrix product per layer, using AVX2 and FMA when the
+ * compiler targets them.
+ *
+ * Weights file format (all values little-endian):
+ *   4 bytes   magic "MLP1"
+ *   uint32    number of layers L (1 to MAX_MLP_LAYERS)
+ *   uint32    L + 1 layer widths; the first must be OBSERVATION_SIZE, the last NUM_ACTIONS
+ *   then for each layer: float32 weights[out][in] (row-major), float32 biases[out]
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef MLP_H
+#define MLP_H
+
+#include "gamestate.h"
+#include "strategy.h"
+
+/** Maximum number of layers in a policy. */
+#define MAX_MLP_LAYERS 8
+
+/** Maximum width of a layer. */
+#define MAX_MLP_WIDTH 4096
+
+/**
+ * @struct Mlp
+ * @brief Opaque loaded policy network.
+ */
+typedef struct Mlp Mlp;
+
+/**
+ * @brief Loads a policy network from a weights file.
+ *
+ * @param path Path of the weights file.
+ * @return The network, or NULL if the file cannot be read or is not a valid policy.
+ */
+Mlp* loadMlp(const char* path);
+
+/**
+ * @brief Releases a policy network.
+ *
+ * @param mlp The network, or NULL.
+ */
+void freeMlp(Mlp* mlp);
+
+/**
+ * @brief Evaluates the network on a batch of inputs.
+ *
+ * Activations are kept in scratch memory of the calling thread, so after the first call
+ * of a thread no memory is allocated.
+ *
+ * @param mlp The network.
+ * @param inputs batchSize rows of OBSERVATION_SIZE floats.
+ * @param batchSize Number of rows.
+ * @param logits Output buffer of batchSize rows of NUM_ACTIONS floats.
+ * @return 0 on success, -1 if memory runs out.
+ */
+int mlpForward(const Mlp* mlp, const float* inputs, int batchSize, float* logits);
+
+/**
+ * @brief Chooses the legal move with the highest logit in each of several games.
+ *
+ * @param states The game states.
+ * @param count Number of games.
+ * @param params The network (an Mlp).
+ * @param rng Unused.
+ * @param moves Output array receiving a legal move for each game.
+ */
+void chooseMlpMoves(const GameState* const* states, int count, const void* params, Rng* rng, Move* moves);
+
+/**
+ * @brief Chooses the legal move with the highest logit in one game.
+ *
+ * @param state Pointer to the game state.
+ * @param params The network (an Mlp).
+ * @param rng Unused.
+ * @return A legal move.
+ */
+Move chooseMlpMove(const GameState* state, const void* params, Rng* rng);
+
+/**
+ * @brief Creates a strategy that plays a policy network loaded from a file.
+ *
+ * @param path Path of the weights file.
+ * @return The strategy, released with destroyMlpStrategy, or NULL on failure.
+ */
+Strategy* createMlpStrategy(const char* path);
+
+/**
+ * @brief Releases a strategy created by createMlpStrategy.
+ *
+ * @param strategy The strategy, or NULL.
+ */
+void destroyMlpStrategy(Strategy* strategy);
+
+#endif /* MLP_H */
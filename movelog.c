@@ -0,0 +1,636 @@
+/**
+ * @file movelog.c
+ * @brief Implementation of the write-ahead log of the matches a server hosts.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* O_CLOEXEC, fdatasync, strndup */
+#endif
+#include "movelog.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Number of records read from the file at once. */
+#define READ_CHUNK_RECORDS 4096
+
+/**
+ * @struct MoveLog
+ * @brief A log file, the records waiting for it and its committer thread.
+ */
+struct MoveLog {
+    int fd;                             /**< The log file */
+    int commitIntervalMs;               /**< Time records are gathered before a commit */
+    CommitFn onCommit;                  /**< Called after each commit, or NULL */
+    void* context;                      /**< Context passed to onCommit */
+    pthread_mutex_t lock;               /**< Guards the fields down to failed */
+    pthread_cond_t wake;                /**< Signalled when records arrive or the log closes */
+    char* pending;                      /**< Records appended since the last commit began */
+    size_t pendingLength;               /**< Number of bytes in pending */
+    size_t pendingCapacity;             /**< Size of pending */
+    char* spare;                        /**< Buffer swapped with pending at each commit */
+    size_t spareCapacity;               /**< Size of spare */
+    uint64_t appended;                  /**< Sequence number of the last record appended */
+    int stopping;                       /**< 1 once the log is closing */
+    int failed;                         /**< 1 once a record has been lost */
+    atomic_uint_least64_t committed;    /**< Sequence number of the last record committed */
+    pthread_t committer;                /**< The committer thread */
+};
+
+/**
+ * @brief Computes the checksum of a record, FNV-1a over every field before check.
+ *
+ * @param record Pointer to the record.
+ * @return The checksum.
+ */
+static uint32_t recordChecksum(const LogRecord* record) {
+    const unsigned char* bytes = (const unsigned char*)record;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(LogRecord, check); ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Checks that a record is whole and of a known type.
+ *
+ * @param record Pointer to the record.
+ * @return 1 if the record is valid, 0 otherwise.
+ */
+static int isValidRecord(const LogRecord* record) {
+    return record->type >= LogStart && record->type <= LogSecret && record->check == recordChecksum(record);
+}
+
+/**
+ * @brief Writes a whole buffer to a file.
+ *
+ * @param fd The file.
+ * @param data The bytes.
+ * @param length Number of bytes.
+ * @return 0 on success, -1 on failure.
+ */
+static int writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        data += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Commits the records appended to a log, one interval at a time; the committer thread.
+ *
+ * @param argument Pointer to the MoveLog.
+ * @return NULL.
+ */
+static void* runCommitter(void* argument) {
+    MoveLog* log = argument;
+    pthread_mutex_lock(&log->lock);
+    for (;;) {
+        while (log->pendingLength == 0 && !log->stopping) {
+            pthread_cond_wait(&log->wake, &log->lock);
+        }
+        if (log->pendingLength == 0) {
+            break;
+        }
+        if (!log->stopping) {
+            // Let the group fill for one interval, so one sync covers every record in it.
+            pthread_mutex_unlock(&log->lock);
+            struct timespec delay = { log->commitIntervalMs / 1000, (long)(log->commitIntervalMs % 1000) * 1000000 };
+            nanosleep(&delay, NULL);
+            pthread_mutex_lock(&log->lock);
+        }
+
+        char* batch = log->pending;
+        size_t length = log->pendingLength;
+        size_t capacity = log->pendingCapacity;
+        uint64_t upTo = log->appended;
+        log->pending = log->spare;
+        log->pendingCapacity = log->spareCapacity;
+        log->pendingLength = 0;
+        pthread_mutex_unlock(&log->lock);
+
+        int written = writeAll(log->fd, batch, length) == 0 && fdatasync(log->fd) == 0;
+        int error = errno;
+        // Holding every reply back forever would stop the server; carry on, said aloud.
+        atomic_store_explicit(&log->committed, upTo, memory_order_release);
+        if (log->onCommit != NULL) {
+            log->onCommit(log->context);
+        }
+
+        pthread_mutex_lock(&log->lock);
+        if (!written && !log->failed) {
+            fprintf(stderr, "Move log write failed: %s; moves are no longer durable\n", strerror(error));
+            log->failed = 1;
+        }
+        log->spare = batch;
+        log->spareCapacity = capacity;
+    }
+    pthread_mutex_unlock(&log->lock);
+    return NULL;
+}
+
+/**
+ * @brief Finds where the valid records of a log file end.
+ *
+ * @param fd The file, positioned at its start.
+ * @return Number of bytes of whole, valid records before the first bad one, or -1 on a read error.
+ */
+static off_t validLogLength(int fd) {
+    static _Thread_local LogRecord records[READ_CHUNK_RECORDS];
+    off_t length = 0;
+    for (;;) {
+        ssize_t n = read(fd, records, sizeof(records));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        int count = (int)(n / LOG_RECORD_SIZE);
+        for (int i = 0; i < count; ++i) {
+            if (!isValidRecord(&records[i])) {
+                return length;
+            }
+            length += LOG_RECORD_SIZE;
+        }
+        if (n < (ssize_t)sizeof(records)) {
+            return length;
+        }
+    }
+}
+
+/**
+ * @brief Opens a log for appending and starts its committer thread.
+ *
+ * @param path Path of the log file, created if missing; existing records are kept.
+ * @param commitIntervalMs Time records are gathered before they are committed together.
+ * @param onCommit Function called after each commit, or NULL.
+ * @param context Context passed to onCommit.
+ * @return Pointer to the log, or NULL if it cannot be opened.
+ */
+MoveLog* openMoveLog(const char* path, int commitIntervalMs, CommitFn onCommit, void* context) {
+    if (commitIntervalMs < 0) {
+        return NULL;
+    }
+    MoveLog* log = calloc(1, sizeof(MoveLog));
+    if (log == NULL) {
+        return NULL;
+    }
+    log->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (log->fd < 0) {
+        free(log);
+        return NULL;
+    }
+
+    // A crash may have left a torn record at the end; new records go where it began.
+    off_t length = validLogLength(log->fd);
+    if (length < 0 || ftruncate(log->fd, length) != 0 || lseek(log->fd, length, SEEK_SET) != length) {
+        close(log->fd);
+        free(log);
+        return NULL;
+    }
+
+    log->commitIntervalMs = commitIntervalMs;
+    log->onCommit = onCommit;
+    log->context = context;
+    atomic_init(&log->committed, 0);
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->wake, NULL);
+    if (pthread_create(&log->committer, NULL, runCommitter, log) != 0) {
+        pthread_cond_destroy(&log->wake);
+        pthread_mutex_destroy(&log->lock);
+        close(log->fd);
+        free(log);
+        return NULL;
+    }
+    return log;
+}
+
+/**
+ * @brief Appends a record; it is committed within the commit interval.
+ *
+ * @param log Pointer to the log.
+ * @param record Pointer to the record; its checksum is filled in.
+ * @return Sequence number of the record, counted from 1.
+ */
+uint64_t appendLogRecord(MoveLog* log, LogRecord* record) {
+    record->reserved = 0;
+    record->check = recordChecksum(record);
+    pthread_mutex_lock(&log->lock);
+    if (log->pendingLength + LOG_RECORD_SIZE > log->pendingCapacity) {
+        size_t capacity = log->pendingCapacity > 0 ? 2 * log->pendingCapacity : 64 * LOG_RECORD_SIZE;
+        char* pending = realloc(log->pending, capacity);
+        if (pending == NULL) {
+            // Writing it through could overtake the batch being committed, so it is lost.
+            if (!log->failed) {
+                fprintf(stderr, "Move log out of memory; moves are no longer durable\n");
+                log->failed = 1;
+            }
+            uint64_t sequence = log->appended;
+            pthread_mutex_unlock(&log->lock);
+            return sequence;
+        }
+        log->pending = pending;
+        log->pendingCapacity = capacity;
+    }
+    if (log->pendingLength == 0) {
+        pthread_cond_signal(&log->wake);
+    }
+    memcpy(log->pending + log->pendingLength, record, LOG_RECORD_SIZE);
+    log->pendingLength += LOG_RECORD_SIZE;
+    uint64_t sequence = ++log->appended;
+    pthread_mutex_unlock(&log->lock);
+    return sequence;
+}
+
+/**
+ * @brief Returns how many records are safely on disk.
+ *
+ * @param log Pointer to the log.
+ * @return Sequence number of the last committed record, or 0 if none.
+ */
+uint64_t committedLogRecords(MoveLog* log) {
+    return atomic_load_explicit(&log->committed, memory_order_acquire);
+}
+
+/**
+ * @brief Commits every record appended, stops the committer thread and closes a log.
+ *
+ * @param log Pointer to the log, or NULL.
+ */
+void closeMoveLog(MoveLog* log) {
+    if (log == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&log->lock);
+    log->stopping = 1;
+    pthread_cond_signal(&log->wake);
+    pthread_mutex_unlock(&log->lock);
+    pthread_join(log->committer, NULL);
+    pthread_cond_destroy(&log->wake);
+    pthread_mutex_destroy(&log->lock);
+    close(log->fd);
+    free(log->pending);
+    free(log->spare);
+    free(log);
+}
+
+/**
+ * @brief Reads the epoch of the snapshot a log continues from.
+ *
+ * @param path Path of the log file.
+ * @param epoch Set to the epoch, or 0 if the log is missing, empty or continues from none.
+ * @return 0 on success, -1 if the file cannot be read.
+ */
+int readLogEpoch(const char* path, uint64_t* epoch) {
+    *epoch = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    LogRecord record;
+    ssize_t n;
+    do {
+        n = read(fd, &record, sizeof(record));
+    } while (n < 0 && errno == EINTR);
+    close(fd);
+    if (n < 0) {
+        return -1;
+    }
+    if (n == LOG_RECORD_SIZE && isValidRecord(&record) && record.type == LogSnapshot) {
+        *epoch = record.value;
+    }
+    return 0;
+}
+
+/**
+ * @brief Replaces a log with an empty one that continues from a snapshot.
+ *
+ * The new log is written beside the old one and moved over it, so a crash leaves one or
+ * the other whole. The log must not be open.
+ *
+ * @param path Path of the log file.
+ * @param epoch Epoch of the snapshot holding every match of the old log.
+ * @return 0 on success, -1 on failure, leaving the old log in place.
+ */
+int resetMoveLog(const char* path, uint64_t epoch) {
+    size_t length = strlen(path);
+    char* temporary = malloc(length + 5);
+    if (temporary == NULL) {
+        return -1;
+    }
+    snprintf(temporary, length + 5, "%s.tmp", path);
+    LogRecord record = { LogSnapshot, 0, 0, 0, 0, epoch, 0, 0 };
+    record.check = recordChecksum(&record);
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int done = fd >= 0 && writeAll(fd, (const char*)&record, LOG_RECORD_SIZE) == 0 && fdatasync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    done = done && replaceFile(temporary, path) == 0;
+    if (!done) {
+        unlink(temporary);
+    }
+    free(temporary);
+    return done ? 0 : -1;
+}
+
+/**
+ * @brief Moves a synced file over another and syncs their directory, so the move survives a crash.
+ *
+ * @param temporary Path of the new file, already synced.
+ * @param path Path the file replaces.
+ * @return 0 on success, -1 on failure.
+ */
+int replaceFile(const char* temporary, const char* path) {
+    if (rename(temporary, path) != 0) {
+        return -1;
+    }
+    // The new name is an entry of the directory, which is synced on its own.
+    const char* slash = strrchr(path, '/');
+    char* directory = slash == NULL ? strdup(".") : strndup(path, slash == path ? 1 : (size_t)(slash - path));
+    if (directory == NULL) {
+        return -1;
+    }
+    int fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    free(directory);
+    if (fd < 0) {
+        return -1;
+    }
+    int result = fsync(fd);
+    close(fd);
+    return result == 0 ? 0 : -1;
+}
+
+/**
+ * @struct Recovery
+ * @brief The matches being rebuilt, with a hash index from match id to position.
+ */
+typedef struct {
+    RecoveredMatch* matches; /**< Matches not yet ended */
+    int count;               /**< Number of matches */
+    int capacity;            /**< Size of matches */
+    int* slots;              /**< Open-addressed index: position in matches plus 1, or 0 if empty */
+    int numSlots;            /**< Size of slots, a power of two */
+} Recovery;
+
+/**
+ * @brief Returns the home slot of a match id.
+ *
+ * @param recovery Pointer to the recovery.
+ * @param match The match id.
+ * @return The slot where a search for the id starts.
+ */
+static int homeSlot(const Recovery* recovery, uint32_t match) {
+    return (int)((match * 2654435761u) & (uint32_t)(recovery->numSlots - 1));
+}
+
+/**
+ * @brief Finds the slot holding a match, or the empty slot where it would go.
+ *
+ * @param recovery Pointer to the recovery, which has at least one empty slot.
+ * @param match The match id.
+ * @return The slot.
+ */
+static int findSlot(const Recovery* recovery, uint32_t match) {
+    int slot = homeSlot(recovery, match);
+    while (recovery->slots[slot] != 0 && recovery->matches[recovery->slots[slot] - 1].match != match) {
+        slot = (slot + 1) & (recovery->numSlots - 1);
+    }
+    return slot;
+}
+
+/**
+ * @brief Doubles the index of a recovery and the space for its matches.
+ *
+ * @param recovery Pointer to the recovery.
+ * @return 0 on success, -1 if out of memory.
+ */
+static int growRecovery(Recovery* recovery) {
+    int capacity = recovery->capacity > 0 ? 2 * recovery->capacity : 256;
+    RecoveredMatch* matches = realloc(recovery->matches, capacity * sizeof(RecoveredMatch));
+    int* slots = calloc(2 * capacity, sizeof(int));
+    if (matches == NULL || slots == NULL) {
+        if (matches != NULL) {
+            recovery->matches = matches;
+        }
+        free(slots);
+        return -1;
+    }
+    free(recovery->slots);
+    recovery->matches = matches;
+    recovery->capacity = capacity;
+    recovery->slots = slots;
+    recovery->numSlots = 2 * capacity;
+    for (int i = 0; i < recovery->count; ++i) {
+        recovery->slots[findSlot(recovery, recovery->matches[i].match)] = i + 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Removes the match in a slot, keeping the index and the array packed.
+ *
+ * @param recovery Pointer to the recovery.
+ * @param slot A slot holding a match.
+ */
+static void removeRecovered(Recovery* recovery, int slot) {
+    int index = recovery->slots[slot] - 1;
+    int mask = recovery->numSlots - 1;
+
+    // Backward-shift deletion: pull later entries of the probe run into the gap.
+    int gap = slot;
+    for (int next = (gap + 1) & mask; recovery->slots[next] != 0; next = (next + 1) & mask) {
+        int home = homeSlot(recovery, recovery->matches[recovery->slots[next] - 1].match);
+        if (((next - home) & mask) >= ((next - gap) & mask)) {
+            recovery->slots[gap] = recovery->slots[next];
+            gap = next;
+        }
+    }
+    recovery->slots[gap] = 0;
+
+    // Fill the hole in the array with the last match.
+    int last = --recovery->count;
+    if (index != last) {
+        copyGameState(&recovery->matches[index].state, &recovery->matches[last].state);
+        recovery->matches[index].match = recovery->matches[last].match;
+        recovery->matches[index].secret = recovery->matches[last].secret;
+        recovery->slots[findSlot(recovery, recovery->matches[index].match)] = index + 1;
+    }
+}
+
+/**
+ * @brief Applies one log record to the matches being rebuilt.
+ *
+ * Records that do not fit the match they name are skipped.
+ *
+ * @param recovery Pointer to the recovery.
+ * @param record Pointer to a valid record.
+ * @return 0 on success, -1 if out of memory.
+ */
+static int replayRecord(Recovery* recovery, const LogRecord* record) {
+    if (recovery->count + 1 > recovery->capacity && growRecovery(recovery) != 0) {
+        return -1;
+    }
+    int slot = findSlot(recovery, record->match);
+    RecoveredMatch* match = recovery->slots[slot] != 0 ? &recovery->matches[recovery->slots[slot] - 1] : NULL;
+    switch (record->type) {
+    case LogStart:
+        if (match != NULL || record->player < 2 || record->player > MAX_PLAYERS || record->ruleSet >= NUM_RULE_SETS
+            || record->numPacks < 1 || record->numPacks > MAX_PACKS
+            || (long)record->player * INITIAL_HAND_SIZE >= (long)record->numPacks * NUM_CARD_IDS) {
+            return 0;
+        }
+        match = &recovery->matches[recovery->count++];
+        match->match = record->match;
+        match->secret = 0;
+        initGameState(&match->state, record->player, (int)record->numPacks, record->value);
+        match->state.ruleSet = record->ruleSet;
+        recovery->slots[slot] = recovery->count;
+        break;
+    case LogMove:
+        if (match != NULL && !isGameOver(&match->state) && match->state.currentPlayer == record->player
+            && record->value < 1 << 9 && isLegalMove(&match->state, (Move)record->value)) {
+            playMove(&match->state, (Move)record->value);
+        }
+        break;
+    case LogEnd:
+        if (match != NULL) {
+            removeRecovered(recovery, slot);
+        }
+        break;
+    case LogSnapshot:
+        // The snapshot's matches are the base the caller gave.
+        break;
+    case LogSecret:
+        if (match != NULL) {
+            match->secret = record->value;
+        }
+        break;
+    }
+    return 0;
+}
+
+/**
+ * @brief Rebuilds the matches of a log that had not ended.
+ *
+ * Each match is dealt again from its seed, or taken from the base the log continues from,
+ * and its logged moves are replayed. Reading stops at the first record that is torn or
+ * corrupt.
+ *
+ * @param path Path of the log file; a missing file holds no matches.
+ * @param base Matches the log continues from, such as those of a snapshot, or NULL.
+ * @param baseCount Number of matches in base.
+ * @param matches Set to a malloc'd array of the matches, or NULL if there are none.
+ * @param count Set to the number of matches.
+ * @param nextMatch Set to an id greater than any match in the log or base.
+ * @return 0 on success, -1 if the file cannot be read or memory runs out.
+ */
+int recoverMatches(const char* path, const RecoveredMatch* base, int baseCount, RecoveredMatch** matches, int* count,
+                   uint32_t* nextMatch) {
+    *matches = NULL;
+    *count = 0;
+    *nextMatch = 1;
+    Recovery recovery = { NULL, 0, 0, NULL, 0 };
+    while (recovery.capacity < baseCount + 1) {
+        if (growRecovery(&recovery) != 0) {
+            free(recovery.matches);
+            free(recovery.slots);
+            return -1;
+        }
+    }
+    for (int i = 0; i < baseCount; ++i) {
+        int slot = findSlot(&recovery, base[i].match);
+        if (recovery.slots[slot] != 0) {
+            continue;
+        }
+        RecoveredMatch* match = &recovery.matches[recovery.count++];
+        match->match = base[i].match;
+        match->secret = base[i].secret;
+        copyGameState(&match->state, &base[i].state);
+        recovery.slots[slot] = recovery.count;
+        if (base[i].match >= *nextMatch) {
+            *nextMatch = base[i].match + 1;
+        }
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 && errno != ENOENT) {
+        free(recovery.matches);
+        free(recovery.slots);
+        return -1;
+    }
+
+    static _Thread_local LogRecord records[READ_CHUNK_RECORDS];
+    int result = 0;
+    int done = fd < 0;
+    while (!done && result == 0) {
+        ssize_t n = read(fd, records, sizeof(records));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            result = -1;
+            break;
+        }
+        int numRecords = (int)(n / LOG_RECORD_SIZE);
+        done = n < (ssize_t)sizeof(records);
+        for (int i = 0; i < numRecords && result == 0; ++i) {
+            if (!isValidRecord(&records[i])) {
+                done = 1;
+                break;
+            }
+            if (records[i].match >= *nextMatch) {
+                *nextMatch = records[i].match + 1;
+            }
+            result = replayRecord(&recovery, &records[i]);
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(recovery.slots);
+    if (result != 0) {
+        free(recovery.matches);
+        return -1;
+    }
+
+    // A match whose last move won it but whose end was not logged is over all the same.
+    int kept = 0;
+    for (int i = 0; i < recovery.count; ++i) {
+        if (!isGameOver(&recovery.matches[i].state)) {
+            if (kept != i) {
+                recovery.matches[kept].match = recovery.matches[i].match;
+                recovery.matches[kept].secret = recovery.matches[i].secret;
+                copyGameState(&recovery.matches[kept].state, &recovery.matches[i].state);
+            }
+            kept++;
+        }
+    }
+    if (kept == 0) {
+        free(recovery.matches);
+        recovery.matches = NULL;
+    }
+    *matches = recovery.matches;
+    *count = kept;
+    return 0;
+}
@@ -0,0 +1,176 @@
+/**
+ * @file movelog.h
+ * @brief Header file for the write-ahead log of the matches a server hosts.
+ *
+ * Every match is logged as the seed and settings it was dealt from, the secret its resume
+ * tokens are made from, each move made in it and how it ended. Dealing is deterministic,
+ * so a match is rebuilt after a crash by dealing from its seed again and replaying its
+ * moves; nothing else needs to be stored.
+ *
+ * Any thread may append records; they are gathered in memory and a committer thread
+ * writes and syncs them once per commit interval, so one fdatasync covers every move made
+ * in that interval across all matches. Each record gets a sequence number, and the
+ * records up to committedLogRecords() are on disk: a server holds back its replies until
+ * the moves before them are committed, so a client is never told of a move a crash could
+ * lose.
+ *
+ * A log restarted after a snapshot (see snapshot.h) begins with a record naming the
+ * snapshot's epoch, and is replayed on top of that snapshot's matches.
+ *
+ * Records have a fixed size and a checksum, so recovery stops cleanly at a record torn by
+ * the crash. Like the frames of protocol.h, they are written in host order, which must be
+ * little-endian.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef MOVE_LOG_H
+#define MOVE_LOG_H
+
+#include <stdint.h>
+#include "gamestate.h"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Log records are read in place, which needs a little-endian host"
+#endif
+
+/** Size of every log record in bytes. */
+#define LOG_RECORD_SIZE 24
+
+/** Commit interval used when none is given, in milliseconds. */
+#define DEFAULT_COMMIT_INTERVAL_MS 5
+
+/**
+ * @enum LogRecordType
+ * @brief What a log record says happened.
+ */
+typedef enum {
+    LogStart = 1, /**< A match was dealt */
+    LogMove,      /**< A move was made */
+    LogEnd,       /**< A match ended */
+    LogSnapshot,  /**< The log continues from a snapshot; only ever the first record */
+    LogSecret     /**< A match was given the secret its resume tokens are made from */
+} LogRecordType;
+
+/**
+ * @struct LogRecord
+ * @brief One event of a match.
+ */
+typedef struct {
+    uint8_t type;      /**< LogRecordType */
+    uint8_t player;    /**< Start: number of players; move: player who moved; end: winner, or 0xFF */
+    uint8_t ruleSet;   /**< Start: RuleSetId of the rules */
+    uint8_t reserved;  /**< Always 0 */
+    uint32_t match;    /**< Id of the match */
+    uint64_t value;    /**< Start: seed of the deal; move: the Move; snapshot: its epoch; secret: the secret */
+    uint32_t numPacks; /**< Start: number of packs */
+    uint32_t check;    /**< Checksum of the fields above */
+} LogRecord;
+
+_Static_assert(sizeof(LogRecord) == LOG_RECORD_SIZE, "log records must have no padding");
+
+/**
+ * @struct RecoveredMatch
+ * @brief A match rebuilt from a log.
+ */
+typedef struct {
+    uint32_t match;  /**< Id of the match */
+    uint64_t secret; /**< Secret the match's resume tokens are made from, or 0 if none was logged */
+    GameState state; /**< The match after its last logged move; last, as only its used hands matter */
+} RecoveredMatch;
+
+/** A log being appended to. */
+typedef struct MoveLog MoveLog;
+
+/**
+ * @brief Called by the committer thread after records are committed.
+ *
+ * @param context The context passed to openMoveLog.
+ */
+typedef void (*CommitFn)(void* context);
+
+/**
+ * @brief Opens a log for appending and starts its committer thread.
+ *
+ * @param path Path of the log file, created if missing; existing records are kept.
+ * @param commitIntervalMs Time records are gathered before they are committed together.
+ * @param onCommit Function called after each commit, or NULL.
+ * @param context Context passed to onCommit.
+ * @return Pointer to the log, or NULL if it cannot be opened.
+ */
+MoveLog* openMoveLog(const char* path, int commitIntervalMs, CommitFn onCommit, void* context);
+
+/**
+ * @brief Appends a record; it is committed within the commit interval.
+ *
+ * @param log Pointer to the log.
+ * @param record Pointer to the record; its checksum is filled in.
+ * @return Sequence number of the record, counted from 1.
+ */
+uint64_t appendLogRecord(MoveLog* log, LogRecord* record);
+
+/**
+ * @brief Returns how many records are safely on disk.
+ *
+ * @param log Pointer to the log.
+ * @return Sequence number of the last committed record, or 0 if none.
+ */
+uint64_t committedLogRecords(MoveLog* log);
+
+/**
+ * @brief Commits every record appended, stops the committer thread and closes a log.
+ *
+ * @param log Pointer to the log, or NULL.
+ */
+void closeMoveLog(MoveLog* log);
+
+/**
+ * @brief Reads the epoch of the snapshot a log continues from.
+ *
+ * @param path Path of the log file.
+ * @param epoch Set to the epoch, or 0 if the log is missing, empty or continues from none.
+ * @return 0 on success, -1 if the file cannot be read.
+ */
+int readLogEpoch(const char* path, uint64_t* epoch);
+
+/**
+ * @brief Replaces a log with an empty one that continues from a snapshot.
+ *
+ * The new log is written beside the old one and moved over it, so a crash leaves one or
+ * the other whole. The log must not be open.
+ *
+ * @param path Path of the log file.
+ * @param epoch Epoch of the snapshot holding every match of the old log.
+ * @return 0 on success, -1 on failure, leaving the old log in place.
+ */
+int resetMoveLog(const char* path, uint64_t epoch);
+
+/**
+ * @brief Moves a synced file over another and syncs their directory, so the move survives a crash.
+ *
+ * @param temporary Path of the new file, already synced.
+ * @param path Path the file replaces.
+ * @return 0 on success, -1 on failure.
+ */
+int replaceFile(const char* temporary, const char* path);
+
+/**
+ * @brief Rebuilds the matches of a log that had not ended.
+ *
+ * Each match is dealt again from its seed, or taken from the base the log continues from,
+ * and its logged moves are replayed. Reading stops at the first record that is torn or
+ * corrupt.
+ *
+ * @param path Path of the log file; a missing file holds no matches.
+ * @param base Matches the log continues from, such as those of a snapshot, or NULL.
+ * @param baseCount Number of matches in base.
+ * @param matches Set to a malloc'd array of the matches, or NULL if there are none.
+ * @param count Set to the number of matches.
+ * @param nextMatch Set to an id greater than any match in the log or base.
+ * @return 0 on success, -1 if the file cannot be read or memory runs out.
+ */
+int recoverMatches(const char* path, const RecoveredMatch* base, int baseCount, RecoveredMatch** matches, int* count,
+                   uint32_t* nextMatch);
+
+#endif /* MOVE_LOG_H */
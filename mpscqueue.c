@@ -0,0 +1,79 @@
+/**
+ * @file mpscqueue.c
+ * @brief Implementation of a lock-free queue with many producers and one consumer.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "mpscqueue.h"
+#include <stddef.h>
+
+/**
+ * @brief Initializes an empty queue.
+ *
+ * @param queue Pointer to the queue.
+ */
+void initMpscQueue(MpscQueue* queue) {
+    atomic_init(&queue->stub.next, NULL);
+    atomic_init(&queue->head, &queue->stub);
+    queue->tail = &queue->stub;
+}
+
+/**
+ * @brief Adds a node to a queue; any thread may call this.
+ *
+ * @param queue Pointer to the queue.
+ * @param node Pointer to the node, which must be in no queue.
+ */
+void pushMpscQueue(MpscQueue* queue, QueueNode* node) {
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    // Sequentially consistent, so a consumer about to sleep either sees this node or is woken.
+    QueueNode* previous = atomic_exchange(&queue->head, node);
+    atomic_store_explicit(&previous->next, node, memory_order_release);
+}
+
+/**
+ * @brief Removes the oldest node of a queue; only its consumer may call this.
+ *
+ * @param queue Pointer to the queue.
+ * @return The node, or NULL if the queue is empty or a push is not yet complete.
+ */
+QueueNode* popMpscQueue(MpscQueue* queue) {
+    QueueNode* tail = queue->tail;
+    QueueNode* next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (tail == &queue->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        queue->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+    if (next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+
+    // The tail is the last node: it may only be taken once something stands behind it.
+    if (tail != atomic_load(&queue->head)) {
+        return NULL;
+    }
+    pushMpscQueue(queue, &queue->stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Tells whether a queue is empty, counting pushes still in progress; only its consumer may call this.
+ *
+ * @param queue Pointer to the queue.
+ * @return 1 if nothing has been pushed that is not yet popped, 0 otherwise.
+ */
+int isMpscQueueEmpty(MpscQueue* queue) {
+    return queue->tail == &queue->stub && atomic_load(&queue->head) == &queue->stub;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file mpscqueue.h
+ * @brief Header file for a lock-free queue with many producers and one consumer.
+ *
+ * The queue is intrusive: an item embeds a QueueNode, so pushing allocates nothing and
+ * never blocks. Any thread may push; only the owning thread pops. A push is one atomic
+ * exchange, so producers never wait on each other or on the consumer, however many push
+ * at once.
+ *
+ * A producer that has exchanged but not yet linked its node makes the queue look briefly
+ * cut short: popMpscQueue returns NULL although isMpscQueueEmpty does not report it empty.
+ * The consumer simply tries again later; producers wake it after their push completes.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <stdatomic.h>
+
+/**
+ * @struct QueueNode
+ * @brief Link embedded in each item of a queue.
+ */
+typedef struct QueueNode {
+    _Atomic(struct QueueNode*) next; /**< Next item pushed after this one */
+} QueueNode;
+
+/**
+ * @struct MpscQueue
+ * @brief A queue of QueueNodes, oldest first.
+ */
+typedef struct {
+    _Atomic(QueueNode*) head; /**< Node pushed last; producers swap themselves in here */
+    QueueNode* tail;          /**< Node to pop next; the consumer's alone */
+    QueueNode stub;           /**< Placeholder that keeps the queue from ever being empty of nodes */
+} MpscQueue;
+
+/**
+ * @brief Initializes an empty queue.
+ *
+ * @param queue Pointer to the queue.
+ */
+void initMpscQueue(MpscQueue* queue);
+
+/**
+ * @brief Adds a node to a queue; any thread may call this.
+ *
+ * @param queue Pointer to the queue.
+ * @param node Pointer to the node, which must be in no queue.
+ */
+void pushMpscQueue(MpscQueue* queue, QueueNode* node);
+
+/**
+ * @brief Removes the oldest node of a queue; only its consumer may call this.
+ *
+ * @param queue Pointer to the queue.
+ * @return The node, or NULL if the queue is empty or a push is not yet complete.
+ */
+QueueNode* popMpscQueue(MpscQueue* queue);
+
+/**
+ * @brief Tells whether a queue is empty, counting pushes still in progress; only its consumer may call this.
+ *
+ * @param queue Pointer to the queue.
+ * @return 1 if nothing has been pushed that is not yet popped, 0 otherwise.
+ */
+int isMpscQueueEmpty(MpscQueue* queue);
+
+#endif /* MPSC_QUEUE_H */
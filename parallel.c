@@ -0,0 +1,108 @@
+/**
+ * @file parallel.c
+ * @brief Implementation of running independent jobs on several threads.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "parallel.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * @struct ParallelRun
+ * @brief State shared by the threads of one runParallel call.
+ */
+typedef struct {
+    JobFn job;          /**< Function that runs one job */
+    void* context;      /**< Context passed to every job */
+    int numJobs;        /**< Number of jobs */
+    atomic_int nextJob; /**< Index of the next job to hand out */
+} ParallelRun;
+
+/**
+ * @struct Worker
+ * @brief Arguments of one worker thread.
+ */
+typedef struct {
+    ParallelRun* run; /**< The shared run */
+    int thread;       /**< Index of this thread */
+} Worker;
+
+/**
+ * @brief Returns the number of cores available to the process.
+ *
+ * @return The number of online processors, at least 1.
+ */
+int defaultThreadCount(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+/**
+ * @brief Takes jobs from the shared counter until none are left.
+ *
+ * @param arg Pointer to the Worker.
+ * @return NULL.
+ */
+static void* workerMain(void* arg) {
+    Worker* worker = arg;
+    ParallelRun* run = worker->run;
+    for (;;) {
+        int job = atomic_fetch_add_explicit(&run->nextJob, 1, memory_order_relaxed);
+        if (job >= run->numJobs) {
+            break;
+        }
+        run->job(job, worker->thread, run->context);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Runs numJobs jobs on numThreads threads and waits for all of them.
+ *
+ * The calling thread works as thread 0, so a single-threaded run starts no threads.
+ *
+ * @param numThreads Number of threads; 0 uses defaultThreadCount().
+ * @param numJobs Number of jobs.
+ * @param job Function that runs one job.
+ * @param context Context passed to every job.
+ * @return The number of threads actually used.
+ */
+int runParallel(int numThreads, int numJobs, JobFn job, void* context) {
+    if (numThreads <= 0) {
+        numThreads = defaultThreadCount();
+    }
+    if (numThreads > numJobs) {
+        numThreads = numJobs > 0 ? numJobs : 1;
+    }
+
+    ParallelRun run = { job, context, numJobs, 0 };
+    Worker* workers = malloc(numThreads * sizeof(Worker));
+    pthread_t* threads = malloc(numThreads * sizeof(pthread_t));
+    if (workers == NULL || threads == NULL) {
+        numThreads = 1;
+    }
+
+    int started = 1;
+    for (int i = 1; i < numThreads; ++i) {
+        workers[i] = (Worker) { &run, i };
+        if (pthread_create(&threads[i], NULL, workerMain, &workers[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    Worker self = { &run, 0 };
+    workerMain(&self);
+
+    for (int i = 1; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(workers);
+    free(threads);
+    return started;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file parallel.h
+ * @brief Header file for running independent jobs on several threads.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/**
+ * @brief Runs one job.
+ *
+ * @param job Index of the job, from 0 to numJobs - 1.
+ * @param thread Index of the thread running the job, from 0 to numThreads - 1.
+ * @param context The context passed to runParallel.
+ */
+typedef void (*JobFn)(int job, int thread, void* context);
+
+/**
+ * @brief Returns the number of cores available to the process.
+ *
+ * @return The number of online processors, at least 1.
+ */
+int defaultThreadCount(void);
+
+/**
+ * @brief Runs numJobs jobs on numThreads threads and waits for all of them.
+ *
+ * Jobs are handed out one at a time from a shared counter, so slow jobs do not hold up
+ * the others. A job never runs on two threads, and each thread index is used by only one
+ * thread, so jobs may keep per-thread scratch data indexed by thread.
+ *
+ * @param numThreads Number of threads; 0 uses defaultThreadCount().
+ * @param numJobs Number of jobs.
+ * @param job Function that runs one job.
+ * @param context Context passed to every job.
+ * @return The number of threads actually used.
+ */
+int runParallel(int numThreads, int numJobs, JobFn job, void* context);
+
+#endif /* PARALLEL_H */
@@ -0,0 +1,406 @@
+/**
+ * @file position.c
+ * @brief Implementation of the compact text format of a game position.
+ *
+ * Characters are decoded through small lookup tables, and cards are written from a table
+ * of the 52 two-character names, so neither direction branches per character class.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "position.h"
+#include <string.h>
+
+/** Rank characters, in Rank order. */
+static const char rankChars[NUM_RANKS + 1] = "23456789TJQKA";
+
+/** Suit characters, in Suit order. */
+static const char suitChars[NUM_SUITS + 1] = "cshd";
+
+/** Rank of each character plus one; 0 for characters that are not ranks. */
+static const uint8_t rankOfChar[128] = {
+    ['2'] = 1, ['3'] = 2, ['4'] = 3, ['5'] = 4, ['6'] = 5, ['7'] = 6, ['8'] = 7,
+    ['9'] = 8, ['T'] = 9, ['J'] = 10, ['Q'] = 11, ['K'] = 12, ['A'] = 13,
+};
+
+/** Suit of each character plus one; 0 for characters that are not suits. */
+static const uint8_t suitOfChar[128] = {
+    ['c'] = 1, ['s'] = 2, ['h'] = 3, ['d'] = 4,
+};
+
+/**
+ * @brief Decodes the card at the start of the text.
+ *
+ * @param text The text; at least two characters must be readable.
+ * @return The card identity, or -1 if the text does not start with a card.
+ */
+static int parseCard(const char* text) {
+    unsigned char r = (unsigned char)text[0];
+    unsigned char s = (unsigned char)text[1];
+    if (r >= 128 || s >= 128 || rankOfChar[r] == 0 || suitOfChar[s] == 0) {
+        return -1;
+    }
+    return (suitOfChar[s] - 1) * NUM_RANKS + rankOfChar[r] - 1;
+}
+
+/**
+ * @brief Parses a list of cards ending at a space, slash or the end of the text.
+ *
+ * @param text The text.
+ * @param capacity Most cards the list may hold.
+ * @param counts Count of each identity, increased for every card parsed.
+ * @param numCards Receives the number of cards parsed.
+ * @return The number of characters parsed, or -1 on error.
+ */
+static int parseCardList(const char* text, int capacity, uint16_t* counts, int* numCards) {
+    *numCards = 0;
+    if (text[0] == '-') {
+        return 1;
+    }
+    int length = 0;
+    while (text[length] != '\0' && text[length] != ' ' && text[length] != '/') {
+        if (text[length + 1] == '\0') {
+            return -1;
+        }
+        int card = parseCard(text + length);
+        if (card < 0 || *numCards >= capacity) {
+            return -1;
+        }
+        counts[card]++;
+        (*numCards)++;
+        length += 2;
+    }
+    return length;
+}
+
+/**
+ * @brief Parses a decimal number.
+ *
+ * @param text The text.
+ * @param maximum Largest accepted value.
+ * @param value Receives the number.
+ * @return The number of characters parsed, or -1 if there is no number or it exceeds maximum.
+ */
+static int parseNumber(const char* text, int maximum, int* value) {
+    int length = 0;
+    *value = 0;
+    while (text[length] >= '0' && text[length] <= '9') {
+        *value = *value * 10 + (text[length++] - '0');
+        if (*value > maximum) {
+            return -1;
+        }
+    }
+    return length > 0 ? length : -1;
+}
+
+/**
+ * @brief Parses a position into a game state.
+ *
+ * @param text The position text.
+ * @param state Pointer to the state that receives the position.
+ * @param seed Seed for later draws from the hidden deck.
+ * @return The number of characters parsed, or -1 if the text is not a valid position.
+ */
+int parsePosition(const char* text, GameState* state, uint64_t seed) {
+    memset(state, 0, offsetof(GameState, hands));
+    state->winner = -1;
+    seedRng(&state->rng, seed);
+
+    uint32_t seen[NUM_CARD_IDS] = { 0 };
+    uint16_t listed[NUM_CARD_IDS] = { 0 };
+    const char* p = text;
+    int n;
+    int count;
+    int budget = MAX_POSITION_CARDS;
+
+    int numPlayers = 0;
+    char separator = '/';
+    while (separator == '/') {
+        if (numPlayers == MAX_PLAYERS) {
+            return -1;
+        }
+        Hand* hand = &state->hands[numPlayers++];
+        memset(hand, 0, sizeof(*hand));
+        if ((n = parseCardList(p, budget, hand->counts, &count)) < 0) {
+            return -1;
+        }
+        p += n;
+        budget -= count;
+        separator = *p++;
+        hand->size = (uint16_t)count;
+        for (int id = 0; id < NUM_CARD_IDS; ++id) {
+            seen[id] += hand->counts[id];
+            if (hand->counts[id] > 0) {
+                hand->held |= (CardMask)1 << id;
+            }
+        }
+    }
+    if (separator != ' ' || numPlayers < 2) {
+        return -1;
+    }
+    state->numPlayers = (uint16_t)numPlayers;
+
+    int top = p[0] != '\0' ? parseCard(p) : -1;
+    if (top < 0 || p[2] != ' ') {
+        return -1;
+    }
+    state->topCard = (uint8_t)top;
+    state->activeSuit = (uint8_t)(top / NUM_RANKS);
+    state->direction = 1;
+    p += 3;
+
+    int unknownDeck = p[0] == '?';
+    if (unknownDeck) {
+        p++;
+    } else {
+        if ((n = parseCardList(p, budget, listed, &count)) < 0) {
+            return -1;
+        }
+        p += n;
+        budget -= count;
+    }
+    if (*p++ != ' ') {
+        return -1;
+    }
+
+    if ((n = parseCardList(p, budget, state->played, &count)) < 0) {
+        return -1;
+    }
+    p += n;
+    state->played[top]++;
+    state->playedSize = (uint16_t)(count + 1);
+    if (*p++ != ' ') {
+        return -1;
+    }
+
+    int toMove = 0;
+    if ((n = parseNumber(p, numPlayers, &toMove)) < 0 || toMove < 1 || p[n] != ' ') {
+        return -1;
+    }
+    state->currentPlayer = (uint16_t)(toMove - 1);
+    p += n + 1;
+
+    int numPacks = 0;
+    if ((n = parseNumber(p, MAX_PACKS, &numPacks)) < 0 || numPacks < 1) {
+        return -1;
+    }
+    p += n;
+    state->numPacks = (uint32_t)numPacks;
+
+    // Every identity must appear exactly numPacks times; the deck holds the rest.
+    for (int id = 0; id < NUM_CARD_IDS; ++id) {
+        uint32_t total = seen[id] + state->played[id];
+        uint32_t rest = (uint32_t)numPacks - total;
+        if (total > (uint32_t)numPacks || (!unknownDeck && listed[id] != rest)) {
+            return -1;
+        }
+        state->deck[id] = rest;
+        state->deckSuits[id / NUM_RANKS] += rest;
+        state->hiddenSize += rest;
+    }
+
+    for (int player = 0; player < numPlayers; ++player) {
+        if (state->hands[player].size == 0) {
+            state->winner = (int16_t)player;
+        }
+    }
+    return (int)(p - text);
+}
+
+/**
+ * @brief Appends a card to the output.
+ *
+ * @param out The output position.
+ * @param card The card identity.
+ * @return The output position after the card.
+ */
+static char* writeCard(char* out, int card) {
+    out[0] = rankChars[card % NUM_RANKS];
+    out[1] = suitChars[card / NUM_RANKS];
+    return out + 2;
+}
+
+/**
+ * @brief Appends a list of cards given as counts, or "-" if it is empty.
+ *
+ * @param out The output position.
+ * @param counts Count of each card identity.
+ * @param skip Identity to leave out once (the top card), or -1.
+ * @return The output position after the list.
+ */
+static char* writeCountList(char* out, const uint16_t* counts, int skip) {
+    char* start = out;
+    for (int id = 0; id < NUM_CARD_IDS; ++id) {
+        for (int k = counts[id] - (id == skip); k > 0; --k) {
+            out = writeCard(out, id);
+        }
+    }
+    if (out == start) {
+        *out++ = '-';
+    }
+    return out;
+}
+
+/**
+ * @brief Appends a decimal number to the output.
+ *
+ * @param out The output position.
+ * @param value The number; must not be negative.
+ * @return The output position after the number.
+ */
+static char* writeNumber(char* out, int value) {
+    char digits[10];
+    int length = 0;
+    do {
+        digits[length++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (length > 0) {
+        *out++ = digits[--length];
+    }
+    return out;
+}
+
+/**
+ * @brief Formats a game state as a position.
+ *
+ * @param state Pointer to the game state.
+ * @param includeDeck 1 to list the hidden deck's cards, 0 to write "?".
+ * @param buffer Output buffer; MAX_POSITION_LENGTH characters are enough for up to
+ *               MAX_POSITION_CARDS listed cards.
+ * @param size Size of the buffer.
+ * @return The length of the text without its null character, or -1 if the buffer is too small.
+ */
+int formatPosition(const GameState* state, int includeDeck, char* buffer, size_t size) {
+    int numCards = (includeDeck ? (int)state->hiddenSize : 0) + state->playedSize;
+    for (int player = 0; player < state->numPlayers; ++player) {
+        numCards += state->hands[player].size;
+    }
+    if (size < (size_t)(2 * numCards + 2 * state->numPlayers + 32)) {
+        return -1;
+    }
+
+    char* out = buffer;
+    for (int player = 0; player < state->numPlayers; ++player) {
+        out = writeCountList(out, state->hands[player].counts, -1);
+        *out++ = player + 1 < state->numPlayers ? '/' : ' ';
+    }
+
+    out = writeCard(out, state->topCard);
+    *out++ = ' ';
+
+    if (!includeDeck) {
+        *out++ = '?';
+    } else if (state->hiddenSize == 0) {
+        *out++ = '-';
+    } else {
+        for (int id = 0; id < NUM_CARD_IDS; ++id) {
+            for (uint32_t k = state->deck[id]; k > 0; --k) {
+                out = writeCard(out, id);
+            }
+        }
+    }
+    *out++ = ' ';
+
+    out = writeCountList(out, state->played, state->topCard);
+    *out++ = ' ';
+    out = writeNumber(out, state->currentPlayer + 1);
+    *out++ = ' ';
+    out = writeNumber(out, state->numPacks);
+    *out = '\0';
+    return (int)(out - buffer);
+}
+
+/**
+ * @brief Parses a move: a card such as "7h", a wild card with its declared suit such as
+ * "8c:s", or "draw".
+ *
+ * @param text The text.
+ * @param move Receives the move.
+ * @return The number of characters parsed, or -1 if the text does not start with a move.
+ */
+int parseMove(const char* text, Move* move) {
+    if (strncmp(text, "draw", 4) == 0) {
+        *move = MOVE_DRAW;
+        return 4;
+    }
+    if (text[0] == '\0') {
+        return -1;
+    }
+    int card = parseCard(text);
+    if (card < 0) {
+        return -1;
+    }
+    if (text[2] != ':') {
+        *move = card;
+        return 2;
+    }
+    unsigned char s = (unsigned char)text[3];
+    if (s >= 128 || suitOfChar[s] == 0) {
+        return -1;
+    }
+    *move = makeWildMove(card, (Suit)(suitOfChar[s] - 1));
+    return 4;
+}
+
+/**
+ * @brief Formats a move in the form read by parseMove.
+ *
+ * @param move The move.
+ * @param buffer Output buffer of at least MAX_MOVE_LENGTH characters.
+ * @return The length of the text without its null character.
+ */
+int formatMove(Move move, char* buffer) {
+    if (moveCard(move) == MOVE_DRAW) {
+        memcpy(buffer, "draw", 5);
+        return 4;
+    }
+    char* out = writeCard(buffer, moveCard(move));
+    if (declaredSuit(move) >= 0) {
+        *out++ = ':';
+        *out++ = suitChars[declaredSuit(move)];
+    }
+    *out = '\0';
+    return (int)(out - buffer);
+}
+
+/**
+ * @brief Formats what one player can see of a game.
+ *
+ * The view is "HAND TOP SUIT SIZES TO_MOVE": the player's own cards, the top card, the
+ * suit to follow, every player's hand size separated by slashes, and the player to move
+ * counted from 1. Other hands and the hidden deck stay hidden.
+ *
+ * @param state Pointer to the game state.
+ * @param player The player whose view to write, or -1 for a spectator, whose HAND is "-".
+ * @param buffer Output buffer; MAX_POSITION_LENGTH characters are enough while the hand
+ *               holds at most MAX_POSITION_CARDS cards.
+ * @param size Size of the buffer.
+ * @return The length of the text without its null character, or -1 if the buffer is too small.
+ */
+int formatPlayerView(const GameState* state, int player, char* buffer, size_t size) {
+    int handSize = player >= 0 ? state->hands[player].size : 0;
+    if (size < (size_t)(2 * handSize + 6 * state->numPlayers + 16)) {
+        return -1;
+    }
+
+    char* out = buffer;
+    if (player >= 0) {
+        out = writeCountList(out, state->hands[player].counts, -1);
+    } else {
+        *out++ = '-';
+    }
+    *out++ = ' ';
+    out = writeCard(out, state->topCard);
+    *out++ = ' ';
+    *out++ = suitChars[state->activeSuit];
+    *out++ = ' ';
+    for (int seat = 0; seat < state->numPlayers; ++seat) {
+        out = writeNumber(out, state->hands[seat].size);
+        *out++ = seat + 1 < state->numPlayers ? '/' : ' ';
+    }
+    out = writeNumber(out, state->currentPlayer + 1);
+    *out = '\0';
+    return (int)(out - buffer);
+}
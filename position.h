@@ -0,0 +1,109 @@
+/**
+ * @file position.h
+ * @brief Header file for the compact text format of a game position.
+ *
+ * A position is one line of six space-separated fields:
+ *
+ *   HAND1/HAND2[/HAND3...] TOP DECK PILE TO_MOVE PACKS
+ *
+ * Cards are two characters, rank then suit: "23456789TJQKA" and "cshd" (Club, Spade,
+ * Heart, Diamond), for example "Th" for the Ten of Hearts. The hands list each player's
+ * cards, one hand per player in turn order; TOP is the top card of the played pile; DECK
+ * lists the hidden deck's cards in any order, or is "?" to leave them out; PILE lists the
+ * rest of the played pile; TO_MOVE is the number of the player to move, counting from 1;
+ * PACKS is the number of packs. Empty lists are written as "-". For example:
+ *
+ *   2c9hAs/3d3s 7d ? - 1 1
+ *
+ * is a one-pack game where player 1 holds three cards, player 2 two, the Seven of
+ * Diamonds is face up and the hidden deck holds the other 46 cards.
+ *
+ * Positions describe games under the standard rules (see RULE_SETS).
+ *
+ * Moves are written as the card played, as the card and the declared suit for a wild card
+ * ("8c:s"), or as "draw".
+ *
+ * Parsing and formatting never allocate memory, so millions of positions can be loaded
+ * with one line buffer.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef POSITION_H
+#define POSITION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "gamestate.h"
+
+/** Most cards a position may list in its hands, deck and pile together. */
+#define MAX_POSITION_CARDS 4096
+
+/** Longest position text, including the terminating null character. */
+#define MAX_POSITION_LENGTH (2 * MAX_POSITION_CARDS + 2 * MAX_PLAYERS + 32)
+
+/** Longest move text, including the terminating null character. */
+#define MAX_MOVE_LENGTH 5
+
+/**
+ * @brief Parses a position into a game state.
+ *
+ * Parsing stops at the end of the sixth field, so a line may carry trailing text such as
+ * a comment or a newline. When the deck is "?", it is every card not listed elsewhere.
+ *
+ * @param text The position text.
+ * @param state Pointer to the state that receives the position.
+ * @param seed Seed for later draws from the hidden deck.
+ * @return The number of characters parsed, or -1 if the text is not a valid position.
+ */
+int parsePosition(const char* text, GameState* state, uint64_t seed);
+
+/**
+ * @brief Formats a game state as a position.
+ *
+ * @param state Pointer to the game state.
+ * @param includeDeck 1 to list the hidden deck's cards, 0 to write "?".
+ * @param buffer Output buffer; MAX_POSITION_LENGTH characters are enough for up to
+ *               MAX_POSITION_CARDS listed cards.
+ * @param size Size of the buffer.
+ * @return The length of the text without its null character, or -1 if the buffer is too small.
+ */
+int formatPosition(const GameState* state, int includeDeck, char* buffer, size_t size);
+
+/**
+ * @brief Parses a move: a card such as "7h", a wild card with its declared suit such as
+ * "8c:s", or "draw".
+ *
+ * @param text The text.
+ * @param move Receives the move.
+ * @return The number of characters parsed, or -1 if the text does not start with a move.
+ */
+int parseMove(const char* text, Move* move);
+
+/**
+ * @brief Formats a move in the form read by parseMove.
+ *
+ * @param move The move.
+ * @param buffer Output buffer of at least MAX_MOVE_LENGTH characters.
+ * @return The length of the text without its null character.
+ */
+int formatMove(Move move, char* buffer);
+
+/**
+ * @brief Formats what one player can see of a game.
+ *
+ * The view is "HAND TOP SUIT SIZES TO_MOVE": the player's own cards, the top card, the
+ * suit to follow, every player's hand size separated by slashes, and the player to move
+ * counted from 1. Other hands and the hidden deck stay hidden.
+ *
+ * @param state Pointer to the game state.
+ * @param player The player whose view to write, or -1 for a spectator, whose HAND is "-".
+ * @param buffer Output buffer; MAX_POSITION_LENGTH characters are enough while the hand
+ *               holds at most MAX_POSITION_CARDS cards.
+ * @param size Size of the buffer.
+ * @return The length of the text without its null character, or -1 if the buffer is too small.
+ */
+int formatPlayerView(const GameState* state, int player, char* buffer, size_t size);
+
+#endif /* POSITION_H */
@@ -0,0 +1,54 @@
+/**
+ * @file protocol.c
+ * @brief Implementation of the binary wire protocol of the game server.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "protocol.h"
+
+/** Text of each error, in ProtocolError order. */
+static const char* const errorTexts[NUM_PROTOCOL_ERRORS] = {
+    "unknown command",
+    "already joined",
+    "bad player count",
+    "not in a match",
+    "not your turn",
+    "illegal move",
+    "bad move",
+    "line too long",
+    "no such match",
+    "seat taken",
+    "bad settings",
+    "bad token",
+};
+
+/**
+ * @brief Returns the move a FramePlay or FrameDraw asks for.
+ *
+ * @param frame Pointer to the frame.
+ * @return The move, or -1 if the frame names no valid move.
+ */
+Move frameMove(const Frame* frame) {
+    if (frame->type == FrameDraw) {
+        return MOVE_DRAW;
+    }
+    if (frame->type != FramePlay || frame->card >= NUM_CARD_IDS) {
+        return -1;
+    }
+    if (frame->suit == NO_SUIT) {
+        return frame->card;
+    }
+    return frame->suit < NUM_SUITS ? makeWildMove(frame->card, (Suit)frame->suit) : -1;
+}
+
+/**
+ * @brief Returns the text of an error, as sent after "ERR" by the text protocol.
+ *
+ * @param error The error.
+ * @return The text.
+ */
+const char* protocolErrorText(ProtocolError error) {
+    return error >= 0 && error < NUM_PROTOCOL_ERRORS ? errorTexts[error] : "unknown error";
+}
@@ -0,0 +1,163 @@
+/**
+ * @file protocol.h
+ * @brief Header file for the binary wire protocol of the game server.
+ *
+ * Every message is one Frame of FRAME_SIZE bytes, so a reader never scans for a delimiter
+ * and decodes a frame by pointing at it in its receive buffer. Frame types are 0x80 and
+ * above; a connection whose first byte is a frame type speaks this protocol, and any other
+ * connection speaks the text protocol of server.h. Fields wider than a byte are
+ * little-endian.
+ *
+ * Client to server:
+ *
+ *   FrameJoin   value: number of players (0 for NUM_PLAYERS); extra: rating (0 for
+ *               DEFAULT_RATING); suit: number of packs (0 or NO_SUIT for the server's);
+ *               card: RuleSetId (NO_CARD for the server's)
+ *   FramePlay   card: card identity; suit: declared suit, or NO_SUIT
+ *   FrameDraw   draw from the hidden deck
+ *   FrameQuit   leave the server
+ *   FrameWatch  watch a match as a spectator
+ *   FrameResume take back a seat of a match recovered after a restart; seat: the seat;
+ *               value: low 16 bits of the match id; extra: high 16 bits
+ *   FrameToken  the token of the seat to resume, as the server sent it; sent just before
+ *               FrameResume
+ *
+ * Server to client:
+ *
+ *   FrameWait   the join was queued
+ *   FrameStart  seat: your seat; value: number of players
+ *   FrameDeal   card: a card identity added to your hand; value: how many of it
+ *   FrameTurn   seat: your seat; card: top card; suit: suit to follow
+ *   FrameDelta  seat: player who moved; card: the card played, or MOVE_DRAW; suit: suit
+ *               to follow; value: cards drawn during the move; extra: player who drew them
+ *   FrameOver   seat: the winner, or NO_SEAT
+ *   FrameError  value: a ProtocolError
+ *   FrameView   seat: a player; value: their hand size; card: top card; suit: suit to
+ *               follow; extra: player to move
+ *   FrameMatch  value: low 16 bits of the match id; extra: high 16 bits
+ *   FrameToken  value: low 16 bits of your seat's resume token; extra: high 16 bits
+ *
+ * A player learns their own cards only from FrameDeal, and everyone else's hand sizes
+ * from the deltas, so the server never sends a whole hand after the deal.
+ *
+ * FrameStart is followed by FrameMatch, whose id FrameResume names after a restart, and
+ * FrameToken, which only the seat's player is told and which must be given back to take
+ * the seat again. A player who resumes a seat is also sent one FrameView per player
+ * before their deal.
+ *
+ * A spectator is sent FrameStart with seat NO_SEAT, then one FrameView per player, then
+ * the FrameDelta of every move and the FrameOver; it never learns any card in a hand.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+#include "gamestate.h"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Frames are read in place, which needs a little-endian host"
+#endif
+
+/** Size of every frame in bytes. */
+#define FRAME_SIZE 8
+
+/** Suit field of a frame that names no suit. */
+#define NO_SUIT 0xFF
+
+/** Seat field of a frame that names no seat. */
+#define NO_SEAT 0xFF
+
+/**
+ * @enum FrameType
+ * @brief Type of a frame, its first byte.
+ */
+typedef enum {
+    FrameJoin = 0x80, /**< Client joins the lobby */
+    FramePlay,        /**< Client plays a card */
+    FrameDraw,        /**< Client draws */
+    FrameQuit,        /**< Client leaves */
+    FrameWatch,       /**< Client watches a match */
+    FrameResume,      /**< Client takes back a seat of a recovered match */
+    FrameWait = 0x90, /**< Server queued a join */
+    FrameStart,       /**< Server started a match */
+    FrameDeal,        /**< Server added cards to the client's hand */
+    FrameTurn,        /**< Server asks the client to move */
+    FrameDelta,       /**< Server reports a move */
+    FrameOver,        /**< Server ended the match */
+    FrameError,       /**< Server refused the last message */
+    FrameView,        /**< Server shows one player of the match */
+    FrameMatch,       /**< Server names the match just started */
+    FrameToken        /**< Server gives the seat's resume token; client gives it back to resume */
+} FrameType;
+
+/**
+ * @enum ProtocolError
+ * @brief Why the server refused a message, shared by both protocols.
+ */
+typedef enum {
+    ErrorUnknownCommand, /**< The message is not a command */
+    ErrorAlreadyJoined,  /**< The client is already waiting or playing */
+    ErrorBadPlayerCount, /**< The match size is out of range for the packs */
+    ErrorNotInMatch,     /**< The client is not playing a match */
+    ErrorNotYourTurn,    /**< Another player is to move */
+    ErrorIllegalMove,    /**< The move breaks the rules */
+    ErrorBadMove,        /**< The move cannot be read */
+    ErrorLineTooLong,    /**< A text line exceeded MAX_CLIENT_LINE */
+    ErrorNoMatch,        /**< There is no such match to watch or resume */
+    ErrorSeatTaken,      /**< The seat to resume is taken or does not exist */
+    ErrorBadSettings,    /**< The packs or rules asked for are out of range */
+    ErrorBadToken,       /**< The token given is not the seat's */
+    NUM_PROTOCOL_ERRORS  /**< Number of errors */
+} ProtocolError;
+
+/**
+ * @struct Frame
+ * @brief One message of the binary protocol; see the file comment for each type's fields.
+ */
+typedef struct {
+    uint8_t type;   /**< FrameType */
+    uint8_t seat;   /**< A seat, counted from 0 */
+    uint8_t card;   /**< A card identity or MOVE_DRAW */
+    uint8_t suit;   /**< A suit or NO_SUIT */
+    uint16_t value; /**< A count or code */
+    uint16_t extra; /**< A second count or seat */
+} Frame;
+
+_Static_assert(sizeof(Frame) == FRAME_SIZE, "frames must have no padding");
+
+/**
+ * @brief Builds a frame.
+ *
+ * @param type The frame type.
+ * @param seat The seat field.
+ * @param card The card field.
+ * @param suit The suit field.
+ * @param value The value field.
+ * @param extra The extra field.
+ * @return The frame.
+ */
+static inline Frame makeFrame(FrameType type, int seat, int card, int suit, int value, int extra) {
+    return (Frame) { (uint8_t)type, (uint8_t)seat, (uint8_t)card, (uint8_t)suit, (uint16_t)value, (uint16_t)extra };
+}
+
+/**
+ * @brief Returns the move a FramePlay or FrameDraw asks for.
+ *
+ * @param frame Pointer to the frame.
+ * @return The move, or -1 if the frame names no valid move.
+ */
+Move frameMove(const Frame* frame);
+
+/**
+ * @brief Returns the text of an error, as sent after "ERR" by the text protocol.
+ *
+ * @param error The error.
+ * @return The text.
+ */
+const char* protocolErrorText(ProtocolError error);
+
+#endif /* PROTOCOL_H */
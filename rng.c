@@ -0,0 +1,58 @@
+/**
+ * @file rng.c
+ * @brief Implementation of the seedable random number generator.
+ *
+ * The generator is SplitMix64: one addition and a short mixing function per value,
+ * which is fast and passes the usual statistical tests for simulation work.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "rng.h"
+
+/**
+ * @brief Seeds a random number generator.
+ *
+ * @param rng Pointer to the generator to seed.
+ * @param seed The seed value; equal seeds give equal sequences.
+ */
+void seedRng(Rng* rng, uint64_t seed) {
+    rng->state = seed;
+}
+
+/**
+ * @brief Returns the next 64 random bits from the generator.
+ *
+ * @param rng Pointer to the generator.
+ * @return A uniformly distributed 64-bit value.
+ */
+uint64_t nextRandom(Rng* rng) {
+    uint64_t z = (rng->state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Returns a uniformly distributed value in the range [0, bound).
+ *
+ * Uses a multiply-and-shift instead of a modulo, rejecting the few low products
+ * that would otherwise bias the result.
+ *
+ * @param rng Pointer to the generator.
+ * @param bound The exclusive upper bound; must be greater than zero.
+ * @return A random value below bound.
+ */
+uint32_t randomBelow(Rng* rng, uint32_t bound) {
+    uint64_t product = (uint64_t)(uint32_t)nextRandom(rng) * bound;
+    uint32_t low = (uint32_t)product;
+    if (low < bound) {
+        uint32_t threshold = (uint32_t)(-bound) % bound;
+        while (low < threshold) {
+            product = (uint64_t)(uint32_t)nextRandom(rng) * bound;
+            low = (uint32_t)product;
+        }
+    }
+    return (uint32_t)(product >> 32);
+}
@@ -0,0 +1,51 @@
+/**
+ * @file rng.h
+ * @brief Header file for the seedable random number generator.
+ *
+ * This file declares a small random number generator whose whole state is one 64-bit
+ * word. Unlike rand(), each generator is independent, so simulations can run on many
+ * threads at once, and the state can be stored, copied and restored with the game.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/**
+ * @struct Rng
+ * @brief State of a random number generator (SplitMix64).
+ */
+typedef struct {
+    uint64_t state; /**< The current generator state */
+} Rng;
+
+/**
+ * @brief Seeds a random number generator.
+ *
+ * @param rng Pointer to the generator to seed.
+ * @param seed The seed value; equal seeds give equal sequences.
+ */
+void seedRng(Rng* rng, uint64_t seed);
+
+/**
+ * @brief Returns the next 64 random bits from the generator.
+ *
+ * @param rng Pointer to the generator.
+ * @return A uniformly distributed 64-bit value.
+ */
+uint64_t nextRandom(Rng* rng);
+
+/**
+ * @brief Returns a uniformly distributed value in the range [0, bound).
+ *
+ * @param rng Pointer to the generator.
+ * @param bound The exclusive upper bound; must be greater than zero.
+ * @return A random value below bound.
+ */
+uint32_t randomBelow(Rng* rng, uint32_t bound);
+
+#endif /* RNG_H */
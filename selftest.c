@@ -0,0 +1,1029 @@
+/**
+ * @file selftest.c
+ * @brief Implementation of the self-tests that check the game engine, the persistence
+ * files and the server.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* kill, nanosleep, off_t */
+#endif
+#include "selftest.h"
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "analysis.h"
+#include "determinize.h"
+#include "gamerunner.h"
+#include "gamestate.h"
+#include "loadtest.h"
+#include "matchmaker.h"
+#include "movelog.h"
+#include "position.h"
+#include "server.h"
+#include "snapshot.h"
+#include "strategy.h"
+
+/** Number of random deals the determinization test checks against their constraints. */
+#define DETERMINIZE_DEALS 2000
+
+/** Number of deals the determinization test draws to check that they are uniform. */
+#define UNIFORM_DEALS 60000
+
+/** Most distinct opponent hands the uniformity check tells apart. */
+#define MAX_HAND_OUTCOMES 64
+
+/** Number of random games the undo test plays, undoes and replays. */
+#define UNDO_GAMES 2000
+
+/** Number of random positions the position test round-trips. */
+#define POSITION_GAMES 2000
+
+/** Counts and reports a check that fails; each test keeps its count in failures. */
+#define CHECK(condition)                                                                   \
+    do {                                                                                   \
+        if (!(condition)) {                                                                \
+            fprintf(stderr, "  %s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                                    \
+        }                                                                                  \
+    } while (0)
+
+/**
+ * @struct SelfTest
+ * @brief A named self-test.
+ */
+typedef struct {
+    const char* name; /**< Name given on the command line */
+    int (*run)(void); /**< Runs the test and returns the number of failed checks */
+} SelfTest;
+
+/**
+ * @brief Builds the path of a temporary file unique to this process.
+ *
+ * @param buffer Set to the path.
+ * @param size Size of buffer.
+ * @param name Name that tells the files of one process apart.
+ */
+static void temporaryPath(char* buffer, size_t size, const char* name) {
+    const char* directory = getenv("TMPDIR");
+    snprintf(buffer, size, "%s/cardgame-selftest-%ld-%s", directory != NULL ? directory : "/tmp", (long)getpid(), name);
+}
+
+/**
+ * @brief Compares two game states field by field, looking only at the hands in use.
+ *
+ * @param a Pointer to the first state.
+ * @param b Pointer to the second state.
+ * @return 1 if the states are the same, 0 otherwise.
+ */
+static int sameGameState(const GameState* a, const GameState* b) {
+    if (memcmp(a->deck, b->deck, sizeof(a->deck)) != 0 || memcmp(a->deckSuits, b->deckSuits, sizeof(a->deckSuits)) != 0
+        || a->hiddenSize != b->hiddenSize || a->numPacks != b->numPacks
+        || memcmp(a->played, b->played, sizeof(a->played)) != 0 || a->playedSize != b->playedSize
+        || a->topCard != b->topCard || a->activeSuit != b->activeSuit || a->ruleSet != b->ruleSet
+        || a->direction != b->direction || a->numPlayers != b->numPlayers || a->currentPlayer != b->currentPlayer
+        || a->winner != b->winner || a->turn != b->turn || a->rng.state != b->rng.state) {
+        return 0;
+    }
+    for (int player = 0; player < a->numPlayers; ++player) {
+        const Hand* first = &a->hands[player];
+        const Hand* second = &b->hands[player];
+        if (first->held != second->held || first->size != second->size
+            || memcmp(first->counts, second->counts, sizeof(first->counts)) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Tells whether an opponent hand can be split among a model's groups so that no card
+ * is one its group excludes.
+ *
+ * The groups exclude less the newer they are, so this holds exactly when, for every group,
+ * the hand has enough cards it allows for that group and all older ones together.
+ *
+ * @param model Pointer to the model, whose groups must be nested.
+ * @param hand The hand's card identities.
+ * @param size Number of cards in the hand.
+ * @return 1 if the hand fits the model, 0 otherwise.
+ */
+static int handFitsModel(const OpponentModel* model, const uint8_t* hand, int size) {
+    int needed = 0;
+    for (int group = 0; group < model->numGroups; ++group) {
+        needed += model->groups[group].size;
+        int allowed = 0;
+        for (int i = 0; i < size; ++i) {
+            allowed += !(model->groups[group].excluded & ((CardMask)1 << hand[i]));
+        }
+        if (allowed < needed) {
+            return 0;
+        }
+    }
+    return needed == size;
+}
+
+/**
+ * @brief Returns a key that tells a small opponent hand apart whatever the order of its cards.
+ *
+ * @param hand The hand's card identities.
+ * @param size Number of cards in the hand, at most 3.
+ * @return The key.
+ */
+static uint32_t handKey(const uint8_t* hand, int size) {
+    uint8_t sorted[3];
+    memcpy(sorted, hand, (size_t)size);
+    for (int i = 1; i < size; ++i) {
+        for (int j = i; j > 0 && sorted[j - 1] > sorted[j]; --j) {
+            uint8_t card = sorted[j];
+            sorted[j] = sorted[j - 1];
+            sorted[j - 1] = card;
+        }
+    }
+    uint32_t key = 0;
+    for (int i = 0; i < size; ++i) {
+        key = key * NUM_CARD_IDS + sorted[i] + 1;
+    }
+    return key;
+}
+
+/**
+ * @brief Counts, for every opponent hand, the deals that give it: each way of putting
+ * distinct unseen cards into the model's groups without breaking an exclusion.
+ *
+ * @param cards Identity of each unseen card; copies of one identity are separate cards.
+ * @param numCards Number of unseen cards.
+ * @param slots Exclusions of each card of the hand, one per card.
+ * @param numSlots Number of cards in the hand; at most 3.
+ * @param keys Keys of the hands found so far.
+ * @param ways Number of deals giving each hand found so far.
+ * @param numHands Number of hands found so far, updated.
+ * @param hand The cards chosen for the slots before this one.
+ * @param slot The slot to fill.
+ * @param used Mask of the unseen cards already chosen.
+ */
+static void countDeals(const uint8_t* cards, int numCards, const CardMask* slots, int numSlots, uint32_t* keys,
+                       uint64_t* ways, int* numHands, uint8_t* hand, int slot, uint32_t used) {
+    if (slot == numSlots) {
+        uint32_t key = handKey(hand, numSlots);
+        int index = 0;
+        while (index < *numHands && keys[index] != key) {
+            index++;
+        }
+        if (index == *numHands && *numHands < MAX_HAND_OUTCOMES) {
+            keys[(*numHands)++] = key;
+            ways[index] = 0;
+        }
+        if (index < *numHands) {
+            ways[index]++;
+        }
+        return;
+    }
+    for (int card = 0; card < numCards; ++card) {
+        if (!(used & (1u << card)) && !(slots[slot] & ((CardMask)1 << cards[card]))) {
+            hand[slot] = cards[card];
+            countDeals(cards, numCards, slots, numSlots, keys, ways, numHands, hand, slot + 1, used | 1u << card);
+        }
+    }
+}
+
+/**
+ * @brief Checks that sampleDeal keeps every card, deals each opponent group only cards it
+ * allows, refuses a model no deal fits, and deals uniformly among the consistent deals.
+ *
+ * @return Number of failed checks.
+ */
+static int testDeterminize(void) {
+    int failures = 0;
+    Rng rng;
+    seedRng(&rng, 3);
+    uint8_t hand[MAX_CONSTRAINT_GROUPS + 16];
+    uint32_t deck[NUM_CARD_IDS];
+    int dealt = 0;
+    for (int trial = 0; trial < DETERMINIZE_DEALS; ++trial) {
+        // Some cards of one or two packs are seen; the opponent drew on a few top cards.
+        uint32_t unseen[NUM_CARD_IDS];
+        int numUnseen = 0;
+        for (int id = 0; id < NUM_CARD_IDS; ++id) {
+            unseen[id] = randomBelow(&rng, 4) == 0 ? 0 : 1 + trial % 2;
+            numUnseen += (int)unseen[id];
+        }
+        OpponentModel model;
+        resetOpponentModel(&model, 1 + (int)randomBelow(&rng, 8));
+        for (int step = (int)randomBelow(&rng, 8); step > 0; --step) {
+            PlayingCard card = idToCard((int)randomBelow(&rng, NUM_CARD_IDS));
+            if (randomBelow(&rng, 4) == 0 && opponentHandSize(&model) > 1) {
+                noteOpponentPlay(&model, card);
+            } else {
+                noteOpponentDraw(&model, card);
+            }
+        }
+        for (int group = 1; group < model.numGroups; ++group) {
+            CardMask newer = model.groups[group].excluded;
+            CardMask older = model.groups[group - 1].excluded;
+            CHECK((older & newer) == newer);
+        }
+
+        int size = opponentHandSize(&model);
+        int deckSize = sampleDeal(unseen, &model, hand, deck, &rng);
+        if (deckSize < 0) {
+            continue;
+        }
+        dealt++;
+        CHECK(deckSize + size == numUnseen);
+        CHECK(handFitsModel(&model, hand, size));
+        for (int i = 0; i < size; ++i) {
+            deck[hand[i]]++;
+        }
+        CHECK(memcmp(deck, unseen, sizeof(deck)) == 0);
+    }
+    CHECK(dealt > DETERMINIZE_DEALS / 2);
+
+    // No deal fits two cards into a group that allows one unseen card.
+    uint32_t unseen[NUM_CARD_IDS] = { 0 };
+    unseen[0] = 1;
+    unseen[1] = 1;
+    OpponentModel model = { { { 2, (CardMask)1 << 1 } }, 1 };
+    CHECK(sampleDeal(unseen, &model, hand, deck, &rng) == -1);
+
+    // Seven unseen cards, two of them copies, and an older group that allows only three of them.
+    static const uint8_t cards[] = { 0, 0, 1, 2, 3, 3, 4 };
+    const CardMask olderExcluded = (CardMask)0x7;
+    const CardMask newerExcluded = (CardMask)0x1;
+    memset(unseen, 0, sizeof(unseen));
+    for (size_t i = 0; i < sizeof(cards); ++i) {
+        unseen[cards[i]]++;
+    }
+    model = (OpponentModel) { { { 1, olderExcluded }, { 2, newerExcluded } }, 2 };
+    const CardMask slots[] = { olderExcluded, newerExcluded, newerExcluded };
+    uint32_t keys[MAX_HAND_OUTCOMES];
+    uint64_t ways[MAX_HAND_OUTCOMES];
+    uint64_t seen[MAX_HAND_OUTCOMES] = { 0 };
+    int numHands = 0;
+    uint8_t chosen[3];
+    countDeals(cards, (int)sizeof(cards), slots, 3, keys, ways, &numHands, chosen, 0, 0);
+    uint64_t totalWays = 0;
+    for (int i = 0; i < numHands; ++i) {
+        totalWays += ways[i];
+    }
+    CHECK(numHands > 1 && numHands < MAX_HAND_OUTCOMES);
+
+    int outside = 0;
+    for (int deal = 0; deal < UNIFORM_DEALS; ++deal) {
+        CHECK(sampleDeal(unseen, &model, hand, deck, &rng) == (int)sizeof(cards) - 3);
+        uint32_t key = handKey(hand, 3);
+        int index = 0;
+        while (index < numHands && keys[index] != key) {
+            index++;
+        }
+        if (index < numHands) {
+            seen[index]++;
+        } else {
+            outside++;
+        }
+    }
+    CHECK(outside == 0);
+
+    // Each hand should turn up in proportion to its deals, within five standard deviations.
+    for (int i = 0; i < numHands; ++i) {
+        double expected = (double)UNIFORM_DEALS * (double)ways[i] / (double)totalWays;
+        double spread = 5.0 * sqrt(expected * (1.0 - (double)ways[i] / (double)totalWays)) + 1.0;
+        if (fabs((double)seen[i] - expected) > spread) {
+            fprintf(stderr, "  hand %u dealt %llu times, expected %.0f\n", keys[i], (unsigned long long)seen[i],
+                    expected);
+            CHECK(!"deals are uniform");
+        }
+    }
+    return failures;
+}
+
+/**
+ * @brief Checks that undoMove restores the state before every move of UNDO_GAMES random
+ * games, and that replaying their moves then reaches the same end.
+ *
+ * @return Number of failed checks.
+ */
+static int testUndo(void) {
+    int failures = 0;
+    GameState* history = malloc((MAX_TURNS + 1) * sizeof(GameState));
+    UndoRecord* undo = malloc(MAX_TURNS * sizeof(UndoRecord));
+    if (history == NULL || undo == NULL) {
+        free(history);
+        free(undo);
+        CHECK(!"memory allocated");
+        return failures;
+    }
+
+    long reshuffles = 0;
+    for (int game = 0; game < UNDO_GAMES && failures == 0; ++game) {
+        GameState state;
+        initGameState(&state, 2 + game % 3, 1 + game % 2, (uint64_t)game);
+        state.ruleSet = (uint8_t)(game % NUM_RULE_SETS);
+        Rng rng;
+        seedRng(&rng, (uint64_t)game);
+        int numMoves = 0;
+        while (!isGameOver(&state)) {
+            copyGameState(&history[numMoves], &state);
+            applyMove(&state, chooseRandomPlayable(&state, NULL, &rng), &undo[numMoves]);
+            reshuffles += undo[numMoves].reshuffleAfter != NO_CARD;
+            numMoves++;
+        }
+
+        GameState end;
+        copyGameState(&end, &state);
+        for (int i = numMoves - 1; i >= 0 && failures == 0; --i) {
+            undoMove(&state, &undo[i]);
+            CHECK(sameGameState(&state, &history[i]));
+        }
+        for (int i = 0; i < numMoves; ++i) {
+            UndoRecord again;
+            applyMove(&state, undo[i].move, &again);
+        }
+        CHECK(sameGameState(&state, &end));
+    }
+    // Reshuffles are the hardest moves to undo, so the games must include some.
+    CHECK(reshuffles > 0);
+
+    free(history);
+    free(undo);
+    return failures;
+}
+
+/**
+ * @brief Compares what a position records of two game states: the cards, whose turn it is
+ * and the number of packs.
+ *
+ * @param a Pointer to the first state.
+ * @param b Pointer to the second state.
+ * @return 1 if the positions are the same, 0 otherwise.
+ */
+static int samePosition(const GameState* a, const GameState* b) {
+    if (memcmp(a->deck, b->deck, sizeof(a->deck)) != 0 || memcmp(a->deckSuits, b->deckSuits, sizeof(a->deckSuits)) != 0
+        || a->hiddenSize != b->hiddenSize || a->numPacks != b->numPacks
+        || memcmp(a->played, b->played, sizeof(a->played)) != 0 || a->playedSize != b->playedSize
+        || a->topCard != b->topCard || a->activeSuit != b->activeSuit || a->numPlayers != b->numPlayers
+        || a->currentPlayer != b->currentPlayer) {
+        return 0;
+    }
+    for (int player = 0; player < a->numPlayers; ++player) {
+        if (a->hands[player].held != b->hands[player].held || a->hands[player].size != b->hands[player].size
+            || memcmp(a->hands[player].counts, b->hands[player].counts, sizeof(a->hands[player].counts)) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Checks that positions of POSITION_GAMES random games survive formatting and
+ * parsing, with and without their hidden deck, and that malformed positions are refused.
+ *
+ * @return Number of failed checks.
+ */
+static int testPositions(void) {
+    int failures = 0;
+    static char text[MAX_POSITION_LENGTH];
+    static char again[MAX_POSITION_LENGTH];
+    for (int game = 0; game < POSITION_GAMES && failures == 0; ++game) {
+        GameState state;
+        initGameState(&state, 2 + game % 3, 1 + game % 10, (uint64_t)game);
+        Rng rng;
+        seedRng(&rng, (uint64_t)game);
+        for (int move = 0; move < game % 300 && !isGameOver(&state); ++move) {
+            playMove(&state, chooseRandomPlayable(&state, NULL, &rng));
+        }
+
+        GameState parsed;
+        int length = formatPosition(&state, 1, text, sizeof(text));
+        CHECK(length > 0 && parsePosition(text, &parsed, 1) == length);
+        CHECK(samePosition(&parsed, &state));
+        CHECK(formatPosition(&parsed, 1, again, sizeof(again)) == length && strcmp(text, again) == 0);
+
+        // An unlisted deck is every card not seen elsewhere, so it comes back whole.
+        length = formatPosition(&state, 0, text, sizeof(text));
+        CHECK(length > 0 && parsePosition(text, &parsed, 1) == length);
+        CHECK(samePosition(&parsed, &state));
+    }
+
+    GameState state;
+    CHECK(parsePosition("2c9hAs/3d3s 7d ? - 1 1 # trailing text", &state, 1) == 22);
+    CHECK(state.numPlayers == 2 && state.hands[0].size == 3 && state.hands[1].size == 2 && state.hiddenSize == 46);
+    CHECK(formatPosition(&state, 1, text, 8) == -1);
+
+    static const char* const malformed[] = {
+        "",                        // nothing
+        "2c/3d",                   // missing fields
+        "2c 7d ? - 1 1",           // one player
+        "2c/3d 7x ? - 1 1",        // no such suit
+        "2c/3d 7d - - 1 1",        // the listed deck leaves out cards
+        "2c2c/3d 7d ? - 1 1",      // a card twice in one pack
+        "2c/3d 7d ? 7d 1 1",       // the top card twice in one pack
+        "2c/3d 7d ? - 3 1",        // no player 3
+        "2c/3d 7d ? - 0 1",        // no player 0
+        "2c/3d 7d ? - 1x 1",       // player is not a number
+        "2c/3d 7d ? - 1 0",        // no packs
+        "2c/3d 7d ? - 1 1000001",  // more than MAX_PACKS
+        "2c/3d 7d ?? - 1 1",       // deck is neither listed nor "?"
+    };
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); ++i) {
+        if (parsePosition(malformed[i], &state, 1) != -1) {
+            fprintf(stderr, "  accepted \"%s\"\n", malformed[i]);
+            CHECK(!"malformed position refused");
+        }
+    }
+    return failures;
+}
+
+/**
+ * @brief Appends a record to a move log.
+ *
+ * @param log Pointer to the log.
+ * @param type LogRecordType of the record.
+ * @param player Player field of the record.
+ * @param match Id of the match.
+ * @param value Value field of the record.
+ * @param numPacks Number of packs, for a start record.
+ * @return Sequence number of the record.
+ */
+static uint64_t appendTestRecord(MoveLog* log, int type, int player, uint32_t match, uint64_t value, int numPacks) {
+    LogRecord record = { (uint8_t)type, (uint8_t)player, 0, 0, match, value, (uint32_t)numPacks, 0 };
+    return appendLogRecord(log, &record);
+}
+
+/**
+ * @brief Plays a random move of a match and appends it to a move log.
+ *
+ * @param log Pointer to the log.
+ * @param match Id of the match.
+ * @param state Pointer to the match, which the move is made in.
+ * @param rng Pointer to the generator that picks the move.
+ * @return Sequence number of the record.
+ */
+static uint64_t appendTestMove(MoveLog* log, uint32_t match, GameState* state, Rng* rng) {
+    Move move = chooseRandomPlayable(state, NULL, rng);
+    uint64_t sequence = appendTestRecord(log, LogMove, state->currentPlayer, match, (uint64_t)move, 0);
+    playMove(state, move);
+    return sequence;
+}
+
+/**
+ * @brief Checks that a move log rebuilds the matches that had not ended with their secrets,
+ * ignores a torn last record, stops at a corrupt one and continues from a snapshot's epoch.
+ *
+ * @return Number of failed checks.
+ */
+static int testMoveLog(void) {
+    int failures = 0;
+    char path[256];
+    temporaryPath(path, sizeof(path), "movelog");
+    unlink(path);
+    MoveLog* log = openMoveLog(path, 1, NULL, NULL);
+    CHECK(log != NULL);
+    if (log == NULL) {
+        return failures;
+    }
+
+    // Match 5 is won without its end being logged, match 7 ends and match 9 is still going.
+    Rng rng;
+    seedRng(&rng, 1);
+    GameState won;
+    initGameState(&won, 2, 1, 5);
+    appendTestRecord(log, LogStart, 2, 5, 5, 1);
+    appendTestRecord(log, LogSecret, 0, 5, 0x5555, 0);
+    for (int move = 0; move < 10000 && !isGameOver(&won); ++move) {
+        appendTestMove(log, 5, &won, &rng);
+    }
+    CHECK(isGameOver(&won));
+    appendTestRecord(log, LogStart, 4, 7, 7, 1);
+    appendTestRecord(log, LogEnd, 0xFF, 7, 0, 0);
+
+    const uint64_t secret = 0x0123456789ABCDEFull;
+    GameState playing;
+    GameState beforeCorrupt;
+    initGameState(&playing, 3, 2, 9);
+    appendTestRecord(log, LogStart, 3, 9, 9, 2);
+    appendTestRecord(log, LogSecret, 0, 9, secret, 0);
+    uint64_t corrupt = 0;
+    for (int move = 0; move < 40 && !isGameOver(&playing); ++move) {
+        if (move == 20) {
+            copyGameState(&beforeCorrupt, &playing);
+            corrupt = appendTestMove(log, 9, &playing, &rng);
+        } else {
+            appendTestMove(log, 9, &playing, &rng);
+        }
+    }
+    CHECK(corrupt > 0 && !isGameOver(&playing));
+    closeMoveLog(log);
+
+    RecoveredMatch* matches = NULL;
+    int count = 0;
+    uint32_t nextMatch = 0;
+    CHECK(recoverMatches(path, NULL, 0, &matches, &count, &nextMatch) == 0);
+    CHECK(count == 1 && nextMatch == 10);
+    CHECK(count == 1 && matches[0].match == 9 && matches[0].secret == secret);
+    CHECK(count == 1 && sameGameState(&matches[0].state, &playing));
+    free(matches);
+
+    // A crash can tear the last record; recovery ignores it and reopening cuts it off.
+    FILE* file = fopen(path, "ab");
+    CHECK(file != NULL && fwrite("torn", 1, 4, file) == 4);
+    if (file != NULL) {
+        fclose(file);
+    }
+    CHECK(recoverMatches(path, NULL, 0, &matches, &count, &nextMatch) == 0);
+    CHECK(count == 1 && matches[0].secret == secret && sameGameState(&matches[0].state, &playing));
+    free(matches);
+    struct stat status;
+    closeMoveLog(openMoveLog(path, 1, NULL, NULL));
+    CHECK(stat(path, &status) == 0 && status.st_size == (off_t)(corrupt + 19) * LOG_RECORD_SIZE);
+
+    // Everything from a corrupt record on is ignored.
+    file = fopen(path, "r+b");
+    CHECK(file != NULL && fseek(file, (long)((corrupt - 1) * LOG_RECORD_SIZE + 8), SEEK_SET) == 0);
+    if (file != NULL) {
+        fputc(0xA5, file);
+        fclose(file);
+    }
+    CHECK(recoverMatches(path, NULL, 0, &matches, &count, &nextMatch) == 0);
+    CHECK(count == 1 && matches[0].secret == secret && sameGameState(&matches[0].state, &beforeCorrupt));
+
+    // Once the log is reset it holds only the epoch of the snapshot it continues from.
+    uint64_t epoch = 1;
+    CHECK(readLogEpoch(path, &epoch) == 0 && epoch == 0);
+    CHECK(resetMoveLog(path, 42) == 0);
+    CHECK(readLogEpoch(path, &epoch) == 0 && epoch == 42);
+    RecoveredMatch* again = NULL;
+    CHECK(recoverMatches(path, matches, count, &again, &count, &nextMatch) == 0);
+    CHECK(count == 1 && nextMatch == 10 && again[0].secret == secret && sameGameState(&again[0].state, &beforeCorrupt));
+    free(again);
+    free(matches);
+    CHECK(recoverMatches(path, NULL, 0, &matches, &count, &nextMatch) == 0);
+    CHECK(count == 0 && matches == NULL && nextMatch == 1);
+    unlink(path);
+    return failures;
+}
+
+/**
+ * @brief Flips the bits of one byte of a file.
+ *
+ * @param path Path of the file.
+ * @param offset Offset of the byte.
+ * @return 0 on success, -1 if the file cannot be changed.
+ */
+static int flipFileByte(const char* path, long offset) {
+    FILE* file = fopen(path, "r+b");
+    if (file == NULL) {
+        return -1;
+    }
+    int byte = fseek(file, offset, SEEK_SET) == 0 ? fgetc(file) : EOF;
+    int result = byte != EOF && fseek(file, offset, SEEK_SET) == 0 && fputc(byte ^ 0xFF, file) != EOF ? 0 : -1;
+    return fclose(file) == 0 ? result : -1;
+}
+
+/**
+ * @brief Checks that a snapshot gives back the matches written to it, and that a snapshot
+ * with a damaged header or match, or with inconsistent card counts, is refused.
+ *
+ * @return Number of failed checks.
+ */
+static int testSnapshot(void) {
+    int failures = 0;
+    char path[256];
+    temporaryPath(path, sizeof(path), "snapshot");
+    unlink(path);
+    Snapshot snapshot;
+    CHECK(openSnapshot(path, &snapshot) == 0);
+    CHECK(snapshot.count == 0 && snapshot.matches == NULL && snapshot.epoch == 0 && snapshot.nextMatch == 1);
+    closeSnapshot(&snapshot);
+
+    enum { SNAPSHOT_MATCHES = 3 };
+    static GameState states[SNAPSHOT_MATCHES];
+    Rng rng;
+    seedRng(&rng, 2);
+    SnapshotWriter* writer = beginSnapshot(path, 17);
+    CHECK(writer != NULL);
+    if (writer == NULL) {
+        return failures;
+    }
+    for (int i = 0; i < SNAPSHOT_MATCHES; ++i) {
+        initGameState(&states[i], 2 + i, 1 + i, (uint64_t)i);
+        states[i].ruleSet = (uint8_t)(i % NUM_RULE_SETS);
+        for (int move = 0; move < 10 * i; ++move) {
+            playMove(&states[i], chooseRandomPlayable(&states[i], NULL, &rng));
+        }
+        CHECK(addSnapshotMatch(writer, (uint32_t)(10 + i), 1000u + (uint64_t)i, &states[i]) == 0);
+    }
+    uint64_t epoch = 0;
+    CHECK(commitSnapshot(writer, 50, &epoch) == 0 && epoch != 0);
+
+    CHECK(openSnapshot(path, &snapshot) == 0);
+    CHECK(snapshot.count == SNAPSHOT_MATCHES && snapshot.nextMatch == 50);
+    CHECK(snapshot.epoch == epoch && snapshot.logEpoch == 17);
+    for (int i = 0; i < snapshot.count && i < SNAPSHOT_MATCHES; ++i) {
+        CHECK(snapshot.matches[i].match == (uint32_t)(10 + i) && snapshot.matches[i].secret == 1000u + (uint64_t)i);
+        CHECK(sameGameState(&snapshot.matches[i].state, &states[i]));
+    }
+    closeSnapshot(&snapshot);
+
+    // A byte changed anywhere in a match or in the header is caught; changing it back is not.
+    struct stat status;
+    CHECK(stat(path, &status) == 0);
+    long inMatch = (long)status.st_size - (long)sizeof(RecoveredMatch) / 2;
+    CHECK(flipFileByte(path, inMatch) == 0 && openSnapshot(path, &snapshot) == -1);
+    CHECK(flipFileByte(path, inMatch) == 0 && openSnapshot(path, &snapshot) == 0);
+    closeSnapshot(&snapshot);
+    CHECK(flipFileByte(path, 24) == 0 && openSnapshot(path, &snapshot) == -1);
+    CHECK(flipFileByte(path, 24) == 0 && openSnapshot(path, &snapshot) == 0);
+    closeSnapshot(&snapshot);
+
+    // A match whose checksum holds but whose cards do not add up is refused too.
+    int card = 0;
+    while (card < NUM_CARD_IDS - 1 && states[0].deck[card] == 0) {
+        card++;
+    }
+    states[0].deck[card]--;
+    states[0].hands[0].counts[card]++;
+    writer = beginSnapshot(path, 0);
+    CHECK(writer != NULL && addSnapshotMatch(writer, 1, 0, &states[0]) == 0);
+    CHECK(writer != NULL && commitSnapshot(writer, 2, &epoch) == 0);
+    CHECK(openSnapshot(path, &snapshot) == -1);
+    unlink(path);
+    return failures;
+}
+
+/** Most matches the matchmaker test records. */
+#define MAX_TEST_PLACEMENTS 8
+
+/**
+ * @struct TestTicket
+ * @brief A join ticket of the matchmaker test, extended with the player it stands for.
+ */
+typedef struct {
+    JoinTicket ticket; /**< The ticket */
+    int player;        /**< Player the ticket stands for */
+} TestTicket;
+
+/**
+ * @struct Placements
+ * @brief The two-player matches a matchmaker has placed, recorded by recordPlacement.
+ */
+typedef struct {
+    pthread_mutex_t lock;                /**< Guards the fields below */
+    int count;                           /**< Matches placed, including any not recorded */
+    int players[MAX_TEST_PLACEMENTS][2]; /**< Players of each match, in seat order */
+    int shards[MAX_TEST_PLACEMENTS];     /**< Shard each match was placed on */
+} Placements;
+
+/**
+ * @brief Records a placed match and frees its tickets; a PlaceFn.
+ *
+ * @param context Pointer to the Placements.
+ * @param tickets The tickets of the match.
+ * @param count Number of tickets.
+ * @param shard Shard the match was placed on.
+ */
+static void recordPlacement(void* context, JoinTicket* const* tickets, int count, int shard) {
+    Placements* placements = context;
+    pthread_mutex_lock(&placements->lock);
+    if (placements->count < MAX_TEST_PLACEMENTS) {
+        for (int seat = 0; seat < 2; ++seat) {
+            placements->players[placements->count][seat] = seat < count ? ((TestTicket*)tickets[seat])->player : -1;
+        }
+        placements->shards[placements->count] = count == 2 ? shard : -1;
+    }
+    placements->count++;
+    pthread_mutex_unlock(&placements->lock);
+    for (int seat = 0; seat < count; ++seat) {
+        free(tickets[seat]);
+    }
+}
+
+/**
+ * @brief Submits a ticket for a two-player match.
+ *
+ * @param matchmaker Pointer to the matchmaker.
+ * @param player Player the ticket stands for.
+ * @param numPacks Packs wanted.
+ * @param ruleSet RuleSetId wanted.
+ * @param rating The player's rating.
+ * @return Pointer to the ticket, which the matchmaker now owns, or NULL if out of memory.
+ */
+static JoinTicket* submitTestJoin(Matchmaker* matchmaker, int player, int numPacks, int ruleSet, int rating) {
+    TestTicket* ticket = calloc(1, sizeof(TestTicket));
+    if (ticket == NULL) {
+        return NULL;
+    }
+    atomic_init(&ticket->ticket.cancelled, 0);
+    ticket->ticket.numPlayers = 2;
+    ticket->ticket.numPacks = numPacks;
+    ticket->ticket.ruleSet = ruleSet;
+    ticket->ticket.rating = rating;
+    ticket->player = player;
+    submitJoin(matchmaker, &ticket->ticket);
+    return &ticket->ticket;
+}
+
+/**
+ * @brief Waits up to five seconds for a matchmaker to place a number of matches, then a
+ * few pairing intervals more so that any extra match shows up too.
+ *
+ * @param placements Pointer to the matches placed.
+ * @param count Number of matches to wait for.
+ * @param intervalMs The matchmaker's pairing interval.
+ * @return Number of matches placed.
+ */
+static int waitForPlacements(Placements* placements, int count, int intervalMs) {
+    for (int i = 0; i < 5000; ++i) {
+        pthread_mutex_lock(&placements->lock);
+        int placed = placements->count;
+        pthread_mutex_unlock(&placements->lock);
+        if (placed >= count) {
+            break;
+        }
+        struct timespec delay = { 0, 1000000 };
+        nanosleep(&delay, NULL);
+    }
+    struct timespec settle = { 0, 3 * intervalMs * 1000000L };
+    nanosleep(&settle, NULL);
+    pthread_mutex_lock(&placements->lock);
+    int placed = placements->count;
+    pthread_mutex_unlock(&placements->lock);
+    return placed;
+}
+
+/**
+ * @brief Tells whether a recorded match seats two given players, in either order.
+ *
+ * @param placements Pointer to the matches placed.
+ * @param index Index of the match.
+ * @param first One player.
+ * @param second The other player.
+ * @return 1 if the match seats exactly those players, 0 otherwise.
+ */
+static int placedMatch(Placements* placements, int index, int first, int second) {
+    pthread_mutex_lock(&placements->lock);
+    const int* players = placements->players[index];
+    int found = index < placements->count
+                && ((players[0] == first && players[1] == second) || (players[0] == second && players[1] == first));
+    pthread_mutex_unlock(&placements->lock);
+    return found;
+}
+
+/**
+ * @brief Checks that the matchmaker pairs only players wanting the same game within one
+ * rating band, never places a cancelled ticket and places matches on the least loaded shard.
+ *
+ * @return Number of failed checks.
+ */
+static int testMatchmaker(void) {
+    int failures = 0;
+    // Joins made together must land in one batch, so the interval is long.
+    const int intervalMs = 100;
+    Placements placements;
+    memset(&placements, 0, sizeof(placements));
+    pthread_mutex_init(&placements.lock, NULL);
+    Matchmaker* matchmaker = startMatchmaker(2, intervalMs, recordPlacement, &placements);
+    CHECK(matchmaker != NULL);
+    if (matchmaker == NULL) {
+        pthread_mutex_destroy(&placements.lock);
+        return failures;
+    }
+    reportShardLoad(matchmaker, 0, 1000);
+
+    // Only players 1 and 2 want the same game within one band; player 7 leaves before pairing.
+    submitTestJoin(matchmaker, 1, 1, 0, 1500);
+    submitTestJoin(matchmaker, 2, 1, 0, 1500 + RATING_BAND);
+    submitTestJoin(matchmaker, 3, 2, 0, 1500);
+    submitTestJoin(matchmaker, 4, 1, NUM_RULE_SETS - 1, 1500);
+    submitTestJoin(matchmaker, 5, 1, 0, 3000);
+    submitTestJoin(matchmaker, 6, 1, 0, 3000 + RATING_BAND + 1);
+    JoinTicket* leaving = submitTestJoin(matchmaker, 7, 3, 0, 1500);
+    submitTestJoin(matchmaker, 8, 3, 0, 1500);
+    if (leaving != NULL) {
+        cancelJoin(leaving);
+    }
+    CHECK(waitForPlacements(&placements, 1, intervalMs) == 1);
+    CHECK(placedMatch(&placements, 0, 1, 2) && placements.shards[0] == 1);
+
+    // Once shard 1 is the busier one, the next match goes to shard 0.
+    reportShardLoad(matchmaker, 1, 2000);
+    submitTestJoin(matchmaker, 9, 2, 0, 1400);
+    CHECK(waitForPlacements(&placements, 2, intervalMs) == 2);
+    CHECK(placedMatch(&placements, 1, 3, 9) && placements.shards[1] == 0);
+    stopMatchmaker(matchmaker);
+    pthread_mutex_destroy(&placements.lock);
+    return failures;
+}
+
+/**
+ * @struct BackgroundServer
+ * @brief A server run on a thread of its own for a test.
+ */
+typedef struct {
+    ServerConfig config; /**< The server settings */
+    ServerStats stats;   /**< Totals of the run, once it has stopped */
+    int result;          /**< What runServer returned */
+    pthread_t thread;    /**< The thread running the server */
+} BackgroundServer;
+
+/**
+ * @brief Runs a server until it is stopped; a thread's start routine.
+ *
+ * @param argument Pointer to the BackgroundServer.
+ * @return NULL.
+ */
+static void* serveInBackground(void* argument) {
+    BackgroundServer* server = argument;
+    server->result = runServer(&server->config, &server->stats);
+    return NULL;
+}
+
+/**
+ * @brief Starts a server on a Unix socket and waits until it listens.
+ *
+ * @param server Pointer to the server, whose config is filled in.
+ * @return 0 on success, -1 if the server did not come up.
+ */
+static int startBackgroundServer(BackgroundServer* server) {
+    unlink(server->config.socketPath);
+    if (pthread_create(&server->thread, NULL, serveInBackground, server) != 0) {
+        return -1;
+    }
+    struct stat status;
+    for (int i = 0; i < 500 && stat(server->config.socketPath, &status) != 0; ++i) {
+        struct timespec delay = { 0, 10000000 };
+        nanosleep(&delay, NULL);
+    }
+    return stat(server->config.socketPath, &status) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Stops a server started with startBackgroundServer, as SIGTERM would.
+ *
+ * @param server Pointer to the server; its stats are filled in once it has stopped.
+ */
+static void stopBackgroundServer(BackgroundServer* server) {
+    kill(getpid(), SIGTERM);
+    pthread_join(server->thread, NULL);
+}
+
+/**
+ * @brief Checks that matches keep finishing when far more clients connect than the memory
+ * budget admits at once.
+ *
+ * @return Number of failed checks.
+ */
+static int testMemoryBudget(void) {
+    int failures = 0;
+    char path[256];
+    temporaryPath(path, sizeof(path), "budget.sock");
+    BackgroundServer server;
+    memset(&server, 0, sizeof(server));
+    // Sessions are charged their connection, an output chunk and a share of a match, about
+    // 1 KB with the default MAX_PLAYERS and 3 KB with 254.
+    server.config = (ServerConfig) { path, 0, 2, 0, 1, RulesStandard, 0, 0, findStrategy("first"), NULL,
+                                     0, NULL, 0, 1, 48 * 1024, 1 };
+    if (startBackgroundServer(&server) != 0) {
+        CHECK(!"server started");
+        return failures;
+    }
+
+    // A few dozen of these clients fit the budget; the rest wait for them to finish.
+    LoadTestConfig config = { path, 0, 300, 2, 1, RulesStandard, findStrategy("first"), ThinkNone, 0, 3, 2, 1 };
+    LoadTestResult result;
+    int ran = runLoadTest(&config, &result);
+    stopBackgroundServer(&server);
+    CHECK(ran == 0);
+    CHECK(server.result == 0);
+    // Stalled, the server would finish a couple of hundred matches before the budget filled up.
+    CHECK(server.stats.matchesFinished >= 1000);
+    CHECK(result.errors == 0);
+    return failures;
+}
+
+/**
+ * @brief Checks that games of MAX_PLAYERS players play through, analyse and are served
+ * like any other; build with a larger MAX_PLAYERS to check that it works.
+ *
+ * @return Number of failed checks.
+ */
+static int testMaxPlayers(void) {
+    int failures = 0;
+    int numPacks = MAX_PLAYERS * INITIAL_HAND_SIZE / NUM_CARD_IDS + 1;
+    const Strategy* policy = findStrategy("random");
+    const Strategy* seats[MAX_PLAYERS];
+    for (int seat = 0; seat < MAX_PLAYERS; ++seat) {
+        seats[seat] = policy;
+    }
+
+    GameState state;
+    initGameState(&state, MAX_PLAYERS, numPacks, 1);
+    GameState middle;
+    copyGameState(&middle, &state);
+    GameRunner runner;
+    startRunner(&runner, &state, seats, 1);
+    UndoRecord undo;
+    int moves = 0;
+    while (stepRunner(&runner, &undo) == RunnerMoved) {
+        if (++moves == MAX_TURNS / 2) {
+            copyGameState(&middle, &runner.state);
+        }
+    }
+    CHECK(isGameOver(&runner.state));
+    CHECK(runner.state.winner >= -1 && runner.state.winner < MAX_PLAYERS);
+
+    // The middle of the game, or its deal if it ended early, is analysed on several threads.
+    AnalysisConfig analysis = { policy, 4, 2, 1 };
+    MoveEvaluation evaluations[MAX_MOVES];
+    int numMoves = 0;
+    CHECK(analyzePositions(&middle, 1, &analysis, evaluations, &numMoves) == 0);
+    CHECK(numMoves > 0);
+    for (int i = 0; i < numMoves; ++i) {
+        CHECK(evaluations[i].rollouts == 4 && evaluations[i].winRate >= 0 && evaluations[i].winRate <= 1);
+    }
+
+    char path[256];
+    temporaryPath(path, sizeof(path), "players.sock");
+    BackgroundServer server;
+    memset(&server, 0, sizeof(server));
+    server.config = (ServerConfig) { path, 0, 2, 0, numPacks, RulesStandard, 0, 0, policy, NULL,
+                                     0, NULL, 0, 1, 0, 1 };
+    if (startBackgroundServer(&server) != 0) {
+        CHECK(!"server started");
+        return failures;
+    }
+    LoadTestConfig config = { path, 0, 2 * MAX_PLAYERS, MAX_PLAYERS, numPacks, RulesStandard, policy, ThinkNone,
+                              0, 2, 2, 1 };
+    LoadTestResult result;
+    int ran = runLoadTest(&config, &result);
+    stopBackgroundServer(&server);
+    CHECK(ran == 0);
+    CHECK(server.result == 0);
+    // With many players a match can outlast the run, so it is enough that both tables play.
+    CHECK(server.stats.matchesStarted >= 2 && server.stats.moves >= 2 * MAX_PLAYERS);
+    CHECK(result.errors == 0);
+    return failures;
+}
+
+/** Every self-test, in the order they run. */
+static const SelfTest selfTests[] = {
+    { "determinize", testDeterminize },
+    { "undo", testUndo },
+    { "position", testPositions },
+    { "movelog", testMoveLog },
+    { "snapshot", testSnapshot },
+    { "matchmaker", testMatchmaker },
+    { "budget", testMemoryBudget },
+    { "players", testMaxPlayers },
+};
+
+/**
+ * @brief Runs the named self-tests, or all of them, and reports which failed.
+ *
+ * Usage: selftest [NAME...]
+ *
+ * @param argc Number of arguments after the "selftest" command.
+ * @param argv The arguments after the "selftest" command.
+ * @return 0 if every test passed, 1 otherwise or if a name is unknown.
+ */
+int runSelfTestCli(int argc, char** argv) {
+    int numTests = (int)(sizeof(selfTests) / sizeof(selfTests[0]));
+    for (int i = 0; i < argc; ++i) {
+        int known = 0;
+        for (int test = 0; test < numTests; ++test) {
+            known |= strcmp(argv[i], selfTests[test].name) == 0;
+        }
+        if (!known) {
+            fprintf(stderr, "Unknown test: %s\nTests:", argv[i]);
+            for (int test = 0; test < numTests; ++test) {
+                fprintf(stderr, " %s", selfTests[test].name);
+            }
+            fprintf(stderr, "\n");
+            return 1;
+        }
+    }
+
+    int failed = 0;
+    for (int test = 0; test < numTests; ++test) {
+        int chosen = argc == 0;
+        for (int i = 0; i < argc; ++i) {
+            chosen |= strcmp(argv[i], selfTests[test].name) == 0;
+        }
+        if (!chosen) {
+            continue;
+        }
+        int failures = selfTests[test].run();
+        printf("%-12s %s\n", selfTests[test].name, failures == 0 ? "ok" : "FAILED");
+        failed += failures != 0;
+    }
+    printf("%d of %d tests failed\n", failed, argc == 0 ? numTests : argc);
+    return failed == 0 ? 0 : 1;
+}
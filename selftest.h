@@ -0,0 +1,29 @@
+/**
+ * @file selftest.h
+ * @brief Header file for the self-tests that check the game engine, the persistence files
+ * and the server.
+ *
+ * Each test checks one module against the properties the rest of the program relies on,
+ * and reports every check that fails with its source line. The server tests run a real
+ * server on a Unix socket in a temporary directory, so they need no setup and leave
+ * nothing behind.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef SELFTEST_H
+#define SELFTEST_H
+
+/**
+ * @brief Runs the named self-tests, or all of them, and reports which failed.
+ *
+ * Usage: selftest [NAME...]
+ *
+ * @param argc Number of arguments after the "selftest" command.
+ * @param argv The arguments after the "selftest" command.
+ * @return 0 if every test passed, 1 otherwise or if a name is unknown.
+ */
+int runSelfTestCli(int argc, char** argv);
+
+#endif /* SELFTEST_H */
@@ -0,0 +1,2414 @@
+/**
+ * @file server.c
+ * @brief Implementation of the game server that hosts many matches at once.
+ *
+ * Each event loop waits on its own epoll instance, which also watches the shared listening
+ * socket with EPOLLEXCLUSIVE so a new connection wakes only one loop; shards on TCP have a
+ * listening socket each instead. Loops pass connections and join requests to each other
+ * through one lock-free ring per pair of loops (see spscqueue.h). Connections are
+ * edge-triggered: input is read until the socket is drained, and replies are gathered in
+ * per-connection buffers that are flushed once at the end of each batch of events, so a
+ * move that notifies every seat costs one send per seat rather than one per line.
+ * Each connection speaks either the text protocol or the binary one of protocol.h.
+ * Connections, matches and output chunks come from each loop's own slab caches (see
+ * slab.h). Matches come in size classes by number of players, as a match holds only its
+ * players' hands. Each connection reserves its share of a match when it is accepted, the
+ * most one player's part of any match can cost, so a match never waits for memory once
+ * its players are paired. As the memory budget runs low a loop
+ * first stops accepting and then stops reading from connections outside a match, and
+ * resumes once enough has been freed.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* accept4 */
+#endif
+#include "server.h"
+#include <errno.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "broadcast.h"
+#include "gamerunner.h"
+#include "matchmaker.h"
+#include "movelog.h"
+#include "parallel.h"
+#include "position.h"
+#include "protocol.h"
+#include "slab.h"
+#include "snapshot.h"
+#include "spscqueue.h"
+#include "timerwheel.h"
+
+/** Most events taken from epoll at once. */
+#define MAX_EVENTS 256
+
+/** How often an idle loop checks whether the server should stop, in milliseconds. */
+#define POLL_INTERVAL_MS 200
+
+/** Resolution of the turn and match timeouts, in milliseconds. */
+#define TIMER_TICK_MS 10
+
+/**
+ * Set by the signal handler when the server should stop. An atomic rather than a
+ * volatile sig_atomic_t, as every loop thread reads it while the signal may land on any
+ * thread; a lock-free atomic is also safe to set from a signal handler.
+ */
+static atomic_int stopRequested;
+
+_Static_assert(ATOMIC_INT_LOCK_FREE == 2, "the signal handler needs a lock-free stop flag");
+
+/** Slots in each ring that carries connections and join requests from one loop to another. */
+#define HANDOFF_RING_SIZE 256
+
+_Static_assert(HANDOFF_RING_SIZE >= MAX_PLAYERS, "the matchmaker must fit a whole match into one loop's ring");
+
+/** Set in a message between loops that is a resuming Connection rather than a JoinRequest. */
+#define RESUME_MESSAGE ((uintptr_t)1)
+
+/** Eighths of the memory budget in use at which loops stop accepting connections. */
+#define ACCEPT_WATERMARK 6
+
+/**
+ * Eighths of the memory budget in use at which loops stop reading from connections outside
+ * a match; above ACCEPT_WATERMARK, so the players already accepted can still join.
+ */
+#define READ_WATERMARK 7
+
+/** Match ids a loop takes at once, so loops rarely touch the shared counter. */
+#define MATCH_ID_BLOCK 64
+
+/** Id of the next block of match ids, shared by every loop. */
+static atomic_uint nextMatchId;
+
+typedef struct Match Match;
+typedef struct Connection Connection;
+typedef struct Server Server;
+typedef struct Pairing Pairing;
+
+/**
+ * @enum TimeoutKind
+ * @brief Which limit a match timer enforces.
+ */
+typedef enum {
+    TurnTimeout,  /**< The player to move ran out of time */
+    MatchTimeout, /**< The match ran out of time */
+    ResumeTimeout /**< The players of a recovered match did not all come back in time */
+} TimeoutKind;
+
+/**
+ * @struct MatchTimer
+ * @brief A timer of a match and what it is for.
+ */
+typedef struct {
+    Timer timer;      /**< The timer; first, so a fired Timer is its MatchTimer */
+    Match* match;     /**< The match */
+    TimeoutKind kind; /**< What the timer enforces */
+} MatchTimer;
+
+/**
+ * @struct JoinRequest
+ * @brief A player's ticket with the matchmaker, which then carries them to their match's loop.
+ *
+ * Once placed, the request goes to the player's loop, which hands the player over with
+ * it to the loop hosting the match; a player who has left travels as NULL, so the host
+ * still learns the seat will stay empty.
+ */
+typedef struct JoinRequest {
+    JoinTicket ticket;                /**< The ticket; first, so a placed JoinTicket is its JoinRequest */
+    Connection* connection;           /**< The player, or NULL once they have left */
+    Pairing* pairing;                 /**< Match the player was placed in, once placed */
+    int seat;                         /**< Seat in that match */
+    struct JoinRequest* nextOutgoing; /**< Next request the player's loop has still to send on */
+} JoinRequest;
+
+/**
+ * @struct Pairing
+ * @brief A match the matchmaker formed, gathering its players on the loop that will host it.
+ *
+ * Only the hosting loop touches a pairing once the matchmaker has sent it out.
+ */
+struct Pairing {
+    int loop;                       /**< Index of the loop hosting the match */
+    int numPlayers;                 /**< Number of players */
+    int numPacks;                   /**< Number of packs */
+    int ruleSet;                    /**< RuleSetId of the rules */
+    int settled;                    /**< Seats whose player has arrived or is known to have left */
+    Connection* seats[MAX_PLAYERS]; /**< Player arrived in each seat, or NULL */
+};
+
+/**
+ * @struct Connection
+ * @brief A client connected to an event loop.
+ */
+struct Connection {
+    int fd;                      /**< The socket */
+    int closed;                  /**< 1 once the socket has been closed */
+    Match* match;                /**< Match being played, or NULL */
+    Match* watching;             /**< Match being watched, or NULL */
+    int seat;                    /**< Seat in the match */
+    int waitingFor;              /**< Players wanted while in the lobby, or 0 */
+    int rating;                  /**< Rating given with the join */
+    int wantedPacks;             /**< Packs asked for with the join */
+    int wantedRules;             /**< RuleSetId asked for with the join */
+    JoinRequest* request;        /**< Join request not yet settled on its match's loop, or NULL */
+    Pairing* pairing;            /**< Match being gathered on this loop, while waiting for the others */
+    Connection* previous;        /**< Previous connection in the loop's list or lobby */
+    Connection* next;            /**< Next connection in the loop's list or lobby */
+    Connection* nextDirty;       /**< Next connection with output to flush */
+    int dirty;                   /**< 1 while on the list of connections to flush */
+    int overflowed;              /**< 1 if output was dropped; closed at the end of the batch */
+    int binary;                  /**< 1 for the protocol of protocol.h, 0 for text, -1 until known */
+    uint64_t holdUntil;          /**< Log record that must be committed before output is sent */
+    int throttled;               /**< 1 while input is left unread until memory frees up */
+    Connection* nextThrottled;   /**< Next throttled connection to read once memory frees up */
+    int leaving;                 /**< 1 while being handed to another loop */
+    int resumeLoop;              /**< Loop the connection is handed to */
+    uint32_t resumeMatch;        /**< Match the connection asked to resume */
+    int resumeSeat;              /**< Seat the connection asked to resume */
+    uint32_t resumeToken;        /**< Token the connection gave for the seat to resume */
+    Connection* nextHandoff;     /**< Next connection being handed over */
+    _Alignas(Frame) char in[MAX_CLIENT_LINE]; /**< Start of a line or frame not yet complete */
+    int inLength;                /**< Number of characters in in */
+    OutputQueue out;             /**< Output not yet sent */
+};
+
+/**
+ * @struct ConnectionList
+ * @brief A doubly linked list of connections.
+ */
+typedef struct {
+    Connection* head; /**< First connection, or NULL */
+    Connection* tail; /**< Last connection, or NULL */
+    int size;         /**< Number of connections */
+} ConnectionList;
+
+/**
+ * @struct Match
+ * @brief A match between connections of one event loop.
+ */
+struct Match {
+    uint32_t id;                      /**< Id of the match, kept across restarts */
+    uint64_t secret;                  /**< Secret the resume tokens of its seats are made from */
+    int recovered;                    /**< Index in the server's recovered matches, or -1 */
+    int prepaid;                      /**< 1 if paid for by its players' reservations, 0 if charged itself */
+    Connection* seats[MAX_PLAYERS];   /**< Connection in each seat, or NULL for an empty seat */
+    MatchTimer turnTimer;             /**< Fires when the player to move runs out of time */
+    MatchTimer matchTimer;            /**< Fires when the match runs out of time */
+    MatchTimer resumeTimer;           /**< Fires when a recovered match still has empty seats */
+    ConnectionList spectators;        /**< Connections watching the match */
+    Match* previous;                  /**< Previous match in the loop's list */
+    Match* next;                      /**< Next match in the loop's list */
+    GameRunner runner;                /**< The game, suspended for its player to move; last, see matchClassBytes */
+};
+
+/** Number of size classes of matches; class k holds matches of up to 2 << k players. */
+#define MATCH_CLASSES 8
+
+_Static_assert((2 << (MATCH_CLASSES - 1)) >= MAX_PLAYERS, "every number of players needs a match class");
+
+/**
+ * @brief Returns the size class of a match.
+ *
+ * @param numPlayers Number of players in the match.
+ * @return The smallest class that holds that many players.
+ */
+static int matchClass(int numPlayers) {
+    int size = 0;
+    while ((2 << size) < numPlayers) {
+        size++;
+    }
+    return size;
+}
+
+/**
+ * @brief Returns the bytes a match of one size class takes.
+ *
+ * The game's hands come last in the match, and only the players' hands are ever touched,
+ * so a match stops after the hands its class holds.
+ *
+ * @param size The size class.
+ * @return Bytes of each match of the class.
+ */
+static size_t matchClassBytes(int size) {
+    int numPlayers = (2 << size) < MAX_PLAYERS ? 2 << size : MAX_PLAYERS;
+    return offsetof(Match, runner) + offsetof(GameRunner, state) + offsetof(GameState, hands)
+           + (size_t)numPlayers * sizeof(Hand);
+}
+
+/**
+ * @struct EventLoop
+ * @brief State of one event loop; only its own thread touches it.
+ */
+typedef struct {
+    const ServerConfig* config;           /**< The server settings */
+    Server* server;                       /**< The server the loop belongs to */
+    int index;                            /**< Index of the loop in the server */
+    int listenFd;                         /**< The shared listening socket */
+    int epollFd;                          /**< This loop's epoll instance */
+    int wakeFd;                           /**< Event signalled by other threads to wake the loop */
+    int cpu;                              /**< Core the loop's thread is pinned to, or -1 */
+    Connection* leaving;                  /**< Resuming connections to hand to other loops at the end of the batch */
+    JoinRequest* outgoing;                /**< Placed join requests to send to the loops hosting their matches */
+    uint32_t nextId;                      /**< Next match id of the loop's block */
+    uint32_t idLimit;                     /**< End of the loop's block of match ids */
+    uint64_t logged;                      /**< Last log record appended by this loop */
+    int stopping;                         /**< 1 while the loop shuts down; nothing more is logged */
+    Rng rng;                              /**< Generator for the deal seeds and timeout policy */
+    Rng secrets;                          /**< Generator for the match secrets, seeded unpredictably */
+    TimerWheel timers;                    /**< Turn and match timeouts */
+    ConnectionList lobby;                 /**< Connections waiting for a match */
+    ConnectionList playing;               /**< Every other open connection */
+    Match* matches;                       /**< Running matches, newest first */
+    int numMatches;                       /**< Number of running matches */
+    int reportedLoad;                     /**< Number of matches last reported to the matchmaker */
+    Match* featured;                      /**< Match new spectators watch, or NULL */
+    Connection* dirty;                    /**< Connections with output to flush */
+    Connection* closed;                   /**< Connections closed during this batch */
+    SlabCache sessionCache;               /**< Free Connections */
+    SlabCache matchCaches[MATCH_CLASSES]; /**< Free Matches of each size class */
+    SlabCache chunkCache;                 /**< Free output chunks */
+    int acceptPaused;                     /**< 1 while the listening socket is left unwatched for lack of memory */
+    int numThrottled;                     /**< Number of throttled connections */
+    ServerStats stats;                    /**< Totals of this loop */
+} EventLoop;
+
+/**
+ * @struct RecoveryEntry
+ * @brief Where a match recovered from the snapshot or log is hosted.
+ */
+typedef struct {
+    uint32_t match; /**< Id of the match */
+    int loop;       /**< Index of the loop hosting it */
+    Match* live;    /**< The match while it lasts, or NULL; touched only by its loop */
+} RecoveryEntry;
+
+/**
+ * @struct Server
+ * @brief What the loops of a server share.
+ */
+struct Server {
+    EventLoop* loops;                     /**< The event loops */
+    int numLoops;                         /**< Number of loops */
+    SpscQueue* rings;                     /**< Ring from each loop, and from the matchmaker, to each loop */
+    MoveLog* log;                         /**< The write-ahead log, or NULL */
+    Matchmaker* matchmaker;               /**< Pairs the players who join on any loop */
+    uint64_t logEpoch;                    /**< Epoch of the snapshot the log continues from, or 0 */
+    RecoveryEntry* recovered;             /**< Matches recovered from the snapshot or log, by id */
+    int numRecovered;                     /**< Number of recovered matches */
+    MemoryBudget budget;                  /**< Memory the loops' sessions, matches and output may take */
+    SlabDepot sessionDepot;               /**< Slabs of Connections */
+    SlabDepot matchDepots[MATCH_CLASSES]; /**< Slabs of Matches of each size class */
+    size_t matchShare;                    /**< Bytes each connection reserves toward the matches it plays */
+    SlabDepot chunkDepot;                 /**< Slabs of output chunks */
+};
+
+/**
+ * @brief Returns the ring that carries messages from one loop, or the matchmaker, to another.
+ *
+ * @param server Pointer to the server.
+ * @param target Index of the receiving loop.
+ * @param source Index of the sending loop, or numLoops for the matchmaker.
+ * @return The ring; only source pushes to it and only target pops from it.
+ */
+static SpscQueue* ringBetween(Server* server, int target, int source) {
+    return &server->rings[target * (server->numLoops + 1) + source];
+}
+
+/**
+ * @brief Adds a connection to the end of a list.
+ *
+ * @param list Pointer to the list.
+ * @param connection Pointer to the connection, which must be in no list.
+ */
+static void pushConnection(ConnectionList* list, Connection* connection) {
+    connection->previous = list->tail;
+    connection->next = NULL;
+    if (list->tail != NULL) {
+        list->tail->next = connection;
+    } else {
+        list->head = connection;
+    }
+    list->tail = connection;
+    list->size++;
+}
+
+/**
+ * @brief Removes a connection from a list.
+ *
+ * @param list Pointer to the list.
+ * @param connection Pointer to a connection in the list.
+ */
+static void removeConnection(ConnectionList* list, Connection* connection) {
+    if (connection->previous != NULL) {
+        connection->previous->next = connection->next;
+    } else {
+        list->head = connection->next;
+    }
+    if (connection->next != NULL) {
+        connection->next->previous = connection->previous;
+    } else {
+        list->tail = connection->previous;
+    }
+    connection->previous = connection->next = NULL;
+    list->size--;
+}
+
+/**
+ * @brief Returns the list a connection is in.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ * @return The lobby while it waits for a match, the match's spectators while it watches
+ *         one, otherwise the list of other connections.
+ */
+static ConnectionList* listOf(EventLoop* loop, Connection* connection) {
+    if (connection->watching != NULL) {
+        return &connection->watching->spectators;
+    }
+    return connection->waitingFor > 0 ? &loop->lobby : &loop->playing;
+}
+
+static void closeConnection(EventLoop* loop, Connection* connection);
+
+/**
+ * @brief Puts a connection on the list of connections to flush at the end of the batch.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ */
+static void markDirty(EventLoop* loop, Connection* connection) {
+    if (!connection->dirty) {
+        connection->dirty = 1;
+        connection->nextDirty = loop->dirty;
+        loop->dirty = connection;
+    }
+}
+
+/**
+ * @brief Appends text to a connection's output; it is sent at the end of the batch.
+ *
+ * A client that leaves more than MAX_PENDING_OUTPUT unread is disconnected at the end of
+ * the batch, so matches being updated never lose a seat part way through. With a move
+ * log, the output waits until every record this loop has logged so far is committed.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ * @param text The text.
+ * @param length Number of characters in text.
+ */
+static void queueOutput(EventLoop* loop, Connection* connection, const char* text, size_t length) {
+    if (connection->closed || connection->overflowed) {
+        return;
+    }
+    markDirty(loop, connection);
+    if (connection->holdUntil < loop->logged) {
+        connection->holdUntil = loop->logged;
+    }
+    if (queueBytes(&connection->out, text, length, MAX_PENDING_OUTPUT) != 0) {
+        connection->overflowed = 1;
+    }
+}
+
+/**
+ * @brief Appends a message encoded once for many connections to a connection's output.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ * @param buffer Pointer to the message; the connection holds a reference until it is sent.
+ */
+static void queueBroadcast(EventLoop* loop, Connection* connection, SharedBuffer* buffer) {
+    if (connection->closed || connection->overflowed) {
+        return;
+    }
+    markDirty(loop, connection);
+    if (connection->holdUntil < loop->logged) {
+        connection->holdUntil = loop->logged;
+    }
+    if (queueShared(&connection->out, buffer, MAX_PENDING_OUTPUT) != 0) {
+        connection->overflowed = 1;
+    }
+}
+
+/**
+ * @brief Appends a formatted line to a connection's output.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ * @param format printf format of the line, without its newline.
+ */
+static void sendLine(EventLoop* loop, Connection* connection, const char* format, ...) {
+    char line[MAX_POSITION_LENGTH + 16];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    if (length < 0 || length > (int)sizeof(line) - 2) {
+        length = (int)sizeof(line) - 2;
+    }
+    line[length++] = '\n';
+    queueOutput(loop, connection, line, (size_t)length);
+}
+
+/**
+ * @brief Sends as much of a connection's output as the socket takes.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ */
+static void flushOutput(EventLoop* loop, Connection* connection) {
+    // Whatever the socket does not take waits for EPOLLOUT.
+    if (flushOutputQueue(&connection->out, connection->fd) != 0) {
+        closeConnection(loop, connection);
+    }
+}
+
+/**
+ * @brief Appends a frame to a connection's output.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ * @param frame The frame.
+ */
+static void sendFrame(EventLoop* loop, Connection* connection, Frame frame) {
+    queueOutput(loop, connection, (const char*)&frame, sizeof(frame));
+}
+
+/**
+ * @brief Tells a connection that its last message was refused.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ * @param error Why the message was refused.
+ */
+static void sendError(EventLoop* loop, Connection* connection, ProtocolError error) {
+    if (connection->binary == 1) {
+        sendFrame(loop, connection, makeFrame(FrameError, NO_SEAT, NO_CARD, NO_SUIT, error, 0));
+    } else {
+        sendLine(loop, connection, "ERR %s", protocolErrorText(error));
+    }
+}
+
+/**
+ * @brief Appends a record of a match to the move log, if the server keeps one.
+ *
+ * @param loop Pointer to the event loop.
+ * @param match Pointer to the match.
+ * @param type What happened.
+ * @param player The record's player field.
+ * @param value The record's value field.
+ */
+static void logEvent(EventLoop* loop, const Match* match, LogRecordType type, int player, uint64_t value) {
+    MoveLog* log = loop->server->log;
+    if (log == NULL || loop->stopping) {
+        return;
+    }
+    const GameState* state = &match->runner.state;
+    LogRecord record = { (uint8_t)type, (uint8_t)player, state->ruleSet, 0, match->id, value, state->numPacks, 0 };
+    loop->logged = appendLogRecord(log, &record);
+}
+
+/**
+ * @brief Sends a message to every spectator of a match, encoding it once per protocol.
+ *
+ * @param loop Pointer to the event loop.
+ * @param match Pointer to the match.
+ * @param line The message for text spectators, with its newline.
+ * @param length Number of characters in line.
+ * @param frame The message for binary spectators.
+ */
+static void sendToSpectators(EventLoop* loop, Match* match, const char* line, size_t length, Frame frame) {
+    SharedBuffer* text = NULL;
+    SharedBuffer* binary = NULL;
+    for (Connection* connection = match->spectators.head; connection != NULL; connection = connection->next) {
+        SharedBuffer** buffer = connection->binary == 1 ? &binary : &text;
+        if (*buffer == NULL) {
+            *buffer = connection->binary == 1 ? createSharedBuffer(&frame, sizeof(frame), &loop->chunkCache)
+                                              : createSharedBuffer(line, length, &loop->chunkCache);
+        }
+        if (*buffer != NULL) {
+            queueBroadcast(loop, connection, *buffer);
+        } else {
+            // A spectator that misses a move would show the wrong game; drop it instead.
+            connection->overflowed = 1;
+            markDirty(loop, connection);
+        }
+    }
+    releaseSharedBuffer(text, &loop->chunkCache);
+    releaseSharedBuffer(binary, &loop->chunkCache);
+}
+
+/**
+ * @brief Ends a match, tells its seats and spectators the result and frees it.
+ *
+ * @param loop Pointer to the event loop.
+ * @param match Pointer to the match.
+ * @param winner The winning seat, or -1 for no winner.
+ */
+static void endMatch(EventLoop* loop, Match* match, int winner) {
+    cancelTimer(&loop->timers, &match->turnTimer.timer);
+    cancelTimer(&loop->timers, &match->matchTimer.timer);
+    cancelTimer(&loop->timers, &match->resumeTimer.timer);
+    logEvent(loop, match, LogEnd, winner >= 0 ? winner : NO_SEAT, 0);
+    for (int seat = 0; seat < match->runner.state.numPlayers; ++seat) {
+        Connection* connection = match->seats[seat];
+        if (connection == NULL) {
+            continue;
+        }
+        connection->match = NULL;
+        if (connection->binary == 1) {
+            sendFrame(loop, connection, makeFrame(FrameOver, winner >= 0 ? winner : NO_SEAT, NO_CARD, NO_SUIT, 0, 0));
+        } else {
+            sendLine(loop, connection, "OVER %d", winner + 1);
+        }
+    }
+
+    if (match->spectators.size > 0) {
+        char line[16];
+        int length = snprintf(line, sizeof(line), "OVER %d\n", winner + 1);
+        sendToSpectators(loop, match, line, (size_t)length,
+                         makeFrame(FrameOver, winner >= 0 ? winner : NO_SEAT, NO_CARD, NO_SUIT, 0, 0));
+    }
+    while (match->spectators.head != NULL) {
+        Connection* connection = match->spectators.head;
+        removeConnection(&match->spectators, connection);
+        connection->watching = NULL;
+        pushConnection(&loop->playing, connection);
+    }
+
+    if (match->previous != NULL) {
+        match->previous->next = match->next;
+    } else {
+        loop->matches = match->next;
+    }
+    if (match->next != NULL) {
+        match->next->previous = match->previous;
+    }
+    if (loop->featured == match) {
+        loop->featured = NULL;
+    }
+    if (match->recovered >= 0) {
+        loop->server->recovered[match->recovered].live = NULL;
+    }
+    loop->numMatches--;
+    SlabCache* cache = &loop->matchCaches[matchClass(match->runner.state.numPlayers)];
+    if (match->prepaid) {
+        freeReservedSlab(cache, match);
+    } else {
+        freeSlab(cache, match);
+    }
+}
+
+/**
+ * @brief Stops counting a connection as throttled, as it is read, closed or handed on.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ */
+static void unthrottle(EventLoop* loop, Connection* connection) {
+    if (connection->throttled) {
+        connection->throttled = 0;
+        loop->numThrottled--;
+    }
+}
+
+/**
+ * @brief Closes a connection; it is freed at the end of the batch.
+ *
+ * A match the connection was playing ends without a winner.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ */
+static void closeConnection(EventLoop* loop, Connection* connection) {
+    if (connection->closed) {
+        return;
+    }
+    connection->closed = 1;
+    removeConnection(listOf(loop, connection), connection);
+    unthrottle(loop, connection);
+    connection->waitingFor = 0;
+    if (connection->request != NULL) {
+        // Whoever holds the request next sees the player has gone.
+        connection->request->connection = NULL;
+        if (!connection->leaving) {
+            cancelJoin(&connection->request->ticket);
+        }
+        connection->request = NULL;
+    }
+    if (connection->pairing != NULL) {
+        connection->pairing->seats[connection->seat] = NULL;
+        connection->pairing = NULL;
+    }
+    connection->watching = NULL;
+    if (connection->match != NULL) {
+        Match* match = connection->match;
+        match->seats[connection->seat] = NULL;
+        connection->match = NULL;
+        endMatch(loop, match, -1);
+    }
+    epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    connection->next = loop->closed;
+    loop->closed = connection;
+}
+
+/**
+ * @brief Converts a timeout to timer ticks, rounding up.
+ *
+ * @param milliseconds The timeout.
+ * @return The number of ticks.
+ */
+static uint64_t timeoutTicks(int milliseconds) {
+    return ((uint64_t)milliseconds + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+}
+
+/**
+ * @brief Tells the player to move that it is their turn and starts their turn timer.
+ *
+ * @param loop Pointer to the event loop.
+ * @param match Pointer to the match.
+ */
+static void sendTurn(EventLoop* loop, Match* match) {
+    const GameState* state = &match->runner.state;
+    int player = state->currentPlayer;
+    Connection* connection = match->seats[player];
+    if (loop->config->turnTimeoutMs > 0) {
+        scheduleTimer(&loop->timers, &match->turnTimer.timer, loop->timers.now + timeoutTicks(loop->config->turnTimeoutMs));
+    }
+    if (connection == NULL) {
+        return;
+    }
+    if (connection->binary == 1) {
+        sendFrame(loop, connection, makeFrame(FrameTurn, player, state->topCard, state->activeSuit, 0, 0));
+        return;
+    }
+    char view[MAX_POSITION_LENGTH];
+    if (formatPlayerView(state, player, view, sizeof(view)) < 0) {
+        strcpy(view, "?");
+    }
+    sendLine(loop, connection, "TURN %s", view);
+}
+
+/**
+ * @brief Adds a new match to a loop's matches and starts its match timer.
+ *
+ * @param loop Pointer to the event loop.
+ * @param match Pointer to the match, whose runner is started.
+ * @param id Id of the match.
+ * @param recovered Index in the server's recovered matches, or -1.
+ */
+static void hostMatch(EventLoop* loop, Match* match, uint32_t id, int recovered) {
+    match->id = id;
+    match->recovered = recovered;
+    memset(match->seats, 0, sizeof(match->seats));
+    match->turnTimer = (MatchTimer) { { NULL, NULL, 0 }, match, TurnTimeout };
+    match->matchTimer = (MatchTimer) { { NULL, NULL, 0 }, match, MatchTimeout };
+    match->resumeTimer = (MatchTimer) { { NULL, NULL, 0 }, match, ResumeTimeout };
+    match->spectators = (ConnectionList) { NULL, NULL, 0 };
+    match->previous = NULL;
+    match->next = loop->matches;
+    if (loop->matches != NULL) {
+        loop->matches->previous = match;
+    }
+    loop->matches = match;
+    loop->numMatches++;
+    if (loop->config->matchTimeoutMs > 0) {
+        scheduleTimer(&loop->timers, &match->matchTimer.timer, loop->timers.now + timeoutTicks(loop->config->matchTimeoutMs));
+    }
+}
+
+/**
+ * @brief Returns the token a player must give to resume a seat of a match.
+ *
+ * Tokens are mixed from the match's secret, which is never sent, so knowing the token of
+ * one seat tells nothing of another's.
+ *
+ * @param match Pointer to the match.
+ * @param seat The seat.
+ * @return The token.
+ */
+static uint32_t seatToken(const Match* match, int seat) {
+    Rng rng;
+    seedRng(&rng, match->secret + (uint64_t)seat);
+    return (uint32_t)(nextRandom(&rng) >> 32);
+}
+
+/**
+ * @brief Tells a player the seat they have in a match and the token to resume it with.
+ *
+ * Binary clients are sent their hand as one FrameDeal per distinct card, after one
+ * FrameView per player if they resume a match already under way.
+ *
+ * @param loop Pointer to the event loop.
+ * @param match Pointer to the match.
+ * @param seat The player's seat.
+ * @param resumed 1 if the player takes back a seat of a recovered match.
+ */
+static void sendSeat(EventLoop* loop, Match* match, int seat, int resumed) {
+    Connection* connection = match->seats[seat];
+    const GameState* state = &match->runner.state;
+    uint32_t token = seatToken(match, seat);
+    if (connection->binary != 1) {
+        sendLine(loop, connection, "START %d %d %u %u", seat + 1, state->numPlayers, match->id, token);
+        return;
+    }
+    sendFrame(loop, connection, makeFrame(FrameStart, seat, NO_CARD, NO_SUIT, state->numPlayers, 0));
+    sendFrame(loop, connection, makeFrame(FrameMatch, NO_SEAT, NO_CARD, NO_SUIT, match->id & 0xFFFF, match->id >> 16));
+    sendFrame(loop, connection, makeFrame(FrameToken, NO_SEAT, NO_CARD, NO_SUIT, token & 0xFFFF, token >> 16));
+    for (int player = 0; resumed && player < state->numPlayers; ++player) {
+        sendFrame(loop, connection, makeFrame(FrameView, player, state->topCard, state->activeSuit,
+                                              state->hands[player].size, state->currentPlayer));
+    }
+    const Hand* hand = &state->hands[seat];
+    for (CardMask held = hand->held; held != 0; held &= held - 1) {
+        int card = __builtin_ctzll(held);
+        sendFrame(loop, connection, makeFrame(FrameDeal, seat, card, NO_SUIT, hand->counts[card], 0));
+    }
+}
+
+/**
+ * @brief Returns a new match id from the loop's block, taking another block when it runs out.
+ *
+ * @param loop Pointer to the event loop.
+ * @return The id.
+ */
+static uint32_t newMatchId(EventLoop* loop) {
+    if (loop->nextId == loop->idLimit) {
+        loop->nextId = atomic_fetch_add_explicit(&nextMatchId, MATCH_ID_BLOCK, memory_order_relaxed);
+        loop->idLimit = loop->nextId + MATCH_ID_BLOCK;
+    }
+    return loop->nextId++;
+}
+
+/**
+ * @brief Starts a match between the players of a pairing, who are all in the lobby.
+ *
+ * @param loop Pointer to the event loop.
+ * @param pairing Pointer to the pairing, every seat of which holds its player.
+ * @return 0 on success, -1 if the match cannot be allocated.
+ */
+static int startMatch(EventLoop* loop, const Pairing* pairing) {
+    // Every player reserved a share of a match when accepted, so only a failing malloc stops it.
+    Match* match = allocReservedSlab(&loop->matchCaches[matchClass(pairing->numPlayers)]);
+    if (match == NULL) {
+        return -1;
+    }
+    match->prepaid = 1;
+    GameState state;
+    uint64_t seed = nextRandom(&loop->rng);
+    initGameState(&state, pairing->numPlayers, pairing->numPacks, seed);
+    state.ruleSet = (uint8_t)pairing->ruleSet;
+    startRunner(&match->runner, &state, NULL, 0);
+    match->secret = nextRandom(&loop->secrets);
+    hostMatch(loop, match, newMatchId(loop), -1);
+    logEvent(loop, match, LogStart, pairing->numPlayers, seed);
+    logEvent(loop, match, LogSecret, 0, match->secret);
+    for (int seat = 0; seat < pairing->numPlayers; ++seat) {
+        Connection* connection = pairing->seats[seat];
+        removeConnection(&loop->lobby, connection);
+        connection->waitingFor = 0;
+        connection->pairing = NULL;
+        pushConnection(&loop->playing, connection);
+        connection->match = match;
+        connection->seat = seat;
+        match->seats[seat] = connection;
+        sendSeat(loop, match, seat, 0);
+    }
+    loop->stats.matchesStarted++;
+    sendTurn(loop, match);
+    return 0;
+}
+
+/**
+ * @brief Submits a lobby connection's join to the matchmaker.
+ *
+ * @param loop Pointer to the event loop, which the connection belongs to.
+ * @param connection Pointer to the connection, with the settings of its join.
+ * @return 0 on success, -1 if the request cannot be allocated.
+ */
+static int submitRequest(EventLoop* loop, Connection* connection) {
+    JoinRequest* request = malloc(sizeof(JoinRequest));
+    if (request == NULL) {
+        return -1;
+    }
+    atomic_init(&request->ticket.cancelled, 0);
+    request->ticket.shard = loop->index;
+    request->ticket.numPlayers = connection->waitingFor;
+    request->ticket.numPacks = connection->wantedPacks;
+    request->ticket.ruleSet = connection->wantedRules;
+    request->ticket.rating = connection->rating;
+    request->connection = connection;
+    request->pairing = NULL;
+    request->seat = 0;
+    connection->request = request;
+    submitJoin(loop->server->matchmaker, &request->ticket);
+    return 0;
+}
+
+/**
+ * @brief Handles a request to join a match.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ * @param numPlayers The number of players wanted.
+ * @param rating The player's rating.
+ * @param numPacks The number of packs wanted.
+ * @param ruleSet The RuleSetId wanted, or -1 for rules the server does not know.
+ */
+static void handleJoin(EventLoop* loop, Connection* connection, int numPlayers, int rating, int numPacks, int ruleSet) {
+    if (connection->match != NULL || connection->waitingFor > 0) {
+        sendError(loop, connection, ErrorAlreadyJoined);
+        return;
+    }
+    if (numPacks < 1 || numPacks > MAX_PACKS || ruleSet < 0 || ruleSet >= NUM_RULE_SETS) {
+        sendError(loop, connection, ErrorBadSettings);
+        return;
+    }
+    if (numPlayers < 2 || numPlayers > MAX_PLAYERS || (long)numPlayers * INITIAL_HAND_SIZE >= (long)numPacks * NUM_CARD_IDS) {
+        sendError(loop, connection, ErrorBadPlayerCount);
+        return;
+    }
+
+    removeConnection(&loop->playing, connection);
+    connection->waitingFor = numPlayers;
+    connection->rating = rating;
+    connection->wantedPacks = numPacks;
+    connection->wantedRules = ruleSet;
+    pushConnection(&loop->lobby, connection);
+    if (submitRequest(loop, connection) != 0) {
+        closeConnection(loop, connection);
+        return;
+    }
+    if (connection->binary == 1) {
+        sendFrame(loop, connection, makeFrame(FrameWait, NO_SEAT, NO_CARD, NO_SUIT, numPlayers, 0));
+    } else {
+        sendLine(loop, connection, "WAIT");
+    }
+}
+
+/**
+ * @brief Starts a pairing's match once each of its players has arrived or is known to
+ * have left; if any left, the others are submitted to the matchmaker again.
+ *
+ * @param loop Pointer to the event loop hosting the pairing.
+ * @param pairing Pointer to the pairing, which is freed.
+ */
+static void settlePairing(EventLoop* loop, Pairing* pairing) {
+    int present = 0;
+    for (int seat = 0; seat < pairing->numPlayers; ++seat) {
+        present += pairing->seats[seat] != NULL;
+    }
+    if (present < pairing->numPlayers || startMatch(loop, pairing) != 0) {
+        for (int seat = 0; seat < pairing->numPlayers; ++seat) {
+            Connection* connection = pairing->seats[seat];
+            if (connection == NULL) {
+                continue;
+            }
+            connection->pairing = NULL;
+            if (submitRequest(loop, connection) != 0) {
+                closeConnection(loop, connection);
+            }
+        }
+    }
+    free(pairing);
+}
+
+/**
+ * @brief Handles a request to watch a match.
+ *
+ * Spectators are sent to the loop's featured match, which stays featured until it ends so
+ * that spectators gather on one match; the newest match is featured next.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ */
+static void handleWatch(EventLoop* loop, Connection* connection) {
+    if (connection->match != NULL || connection->waitingFor > 0 || connection->watching != NULL) {
+        sendError(loop, connection, ErrorAlreadyJoined);
+        return;
+    }
+    if (loop->featured == NULL) {
+        loop->featured = loop->matches;
+    }
+    Match* match = loop->featured;
+    if (match == NULL) {
+        sendError(loop, connection, ErrorNoMatch);
+        return;
+    }
+
+    removeConnection(&loop->playing, connection);
+    connection->watching = match;
+    pushConnection(&match->spectators, connection);
+    loop->stats.spectators++;
+    const GameState* state = &match->runner.state;
+    if (connection->binary == 1) {
+        sendFrame(loop, connection, makeFrame(FrameStart, NO_SEAT, NO_CARD, NO_SUIT, state->numPlayers, 0));
+        for (int seat = 0; seat < state->numPlayers; ++seat) {
+            sendFrame(loop, connection, makeFrame(FrameView, seat, state->topCard, state->activeSuit,
+                                                  state->hands[seat].size, state->currentPlayer));
+        }
+        return;
+    }
+    char view[MAX_POSITION_LENGTH];
+    if (formatPlayerView(state, -1, view, sizeof(view)) < 0) {
+        strcpy(view, "?");
+    }
+    sendLine(loop, connection, "WATCHING %d %s", state->numPlayers, view);
+}
+
+/**
+ * @brief Finds a match recovered at startup.
+ *
+ * @param server Pointer to the server.
+ * @param id Id of the match.
+ * @return Pointer to its entry, or NULL if no such match was recovered.
+ */
+static RecoveryEntry* findRecovered(Server* server, uint32_t id) {
+    int low = 0;
+    int high = server->numRecovered;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (server->recovered[middle].match < id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < server->numRecovered && server->recovered[low].match == id ? &server->recovered[low] : NULL;
+}
+
+/**
+ * @brief Handles a request to take back a seat of a match recovered at startup.
+ *
+ * Recovered matches are spread over the loops, so a connection asking for a match hosted
+ * by another loop is handed to that loop at the end of the batch, which then handles the
+ * request again.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ * @param id Id of the match.
+ * @param seat The seat, counted from 0.
+ * @param token The token the player was given for the seat.
+ */
+static void handleResume(EventLoop* loop, Connection* connection, uint32_t id, int seat, uint32_t token) {
+    if (connection->match != NULL || connection->waitingFor > 0 || connection->watching != NULL) {
+        sendError(loop, connection, ErrorAlreadyJoined);
+        return;
+    }
+    RecoveryEntry* entry = findRecovered(loop->server, id);
+    if (entry == NULL) {
+        sendError(loop, connection, ErrorNoMatch);
+        return;
+    }
+    if (entry->loop != loop->index) {
+        connection->leaving = 1;
+        connection->resumeLoop = entry->loop;
+        connection->resumeMatch = id;
+        connection->resumeSeat = seat;
+        connection->resumeToken = token;
+        connection->nextHandoff = loop->leaving;
+        loop->leaving = connection;
+        return;
+    }
+
+    Match* match = entry->live;
+    if (match == NULL) {
+        sendError(loop, connection, ErrorNoMatch);
+        return;
+    }
+    if (seat < 0 || seat >= match->runner.state.numPlayers) {
+        sendError(loop, connection, ErrorSeatTaken);
+        return;
+    }
+    if (token != seatToken(match, seat)) {
+        sendError(loop, connection, ErrorBadToken);
+        return;
+    }
+    if (match->seats[seat] != NULL) {
+        sendError(loop, connection, ErrorSeatTaken);
+        return;
+    }
+    connection->match = match;
+    connection->seat = seat;
+    match->seats[seat] = connection;
+    sendSeat(loop, match, seat, 1);
+    if (match->runner.state.currentPlayer == seat) {
+        sendTurn(loop, match);
+    }
+    int present = 0;
+    for (int other = 0; other < match->runner.state.numPlayers; ++other) {
+        present += match->seats[other] != NULL;
+    }
+    if (present == match->runner.state.numPlayers) {
+        cancelTimer(&loop->timers, &match->resumeTimer.timer);
+    }
+}
+
+/**
+ * @brief Tells every seat and spectator of a match about a move.
+ *
+ * Binary clients get a FrameDelta, and the player who drew is also sent the cards drawn.
+ * Spectators share one copy of the move per protocol.
+ *
+ * @param loop Pointer to the event loop.
+ * @param match Pointer to the match.
+ * @param undo Pointer to the record of the move.
+ */
+static void sendMove(EventLoop* loop, Match* match, const UndoRecord* undo) {
+    const GameState* state = &match->runner.state;
+    char text[MAX_MOVE_LENGTH];
+    formatMove(undo->move, text);
+    Frame delta = makeFrame(FrameDelta, undo->player, moveCard(undo->move), state->activeSuit, undo->numDrawn, undo->drawer);
+    for (int seat = 0; seat < state->numPlayers; ++seat) {
+        Connection* connection = match->seats[seat];
+        if (connection == NULL) {
+            continue;
+        }
+        if (connection->binary != 1) {
+            sendLine(loop, connection, "MOVED %d %s", undo->player + 1, text);
+            continue;
+        }
+        sendFrame(loop, connection, delta);
+        if (seat == undo->drawer) {
+            for (int i = 0; i < undo->numDrawn; ++i) {
+                sendFrame(loop, connection, makeFrame(FrameDeal, seat, undo->drawn[i], NO_SUIT, 1, 0));
+            }
+        }
+    }
+    if (match->spectators.size > 0) {
+        char line[32];
+        int length = snprintf(line, sizeof(line), "MOVED %d %s\n", undo->player + 1, text);
+        sendToSpectators(loop, match, line, (size_t)length, delta);
+    }
+}
+
+/**
+ * @brief Submits a move for a player of a match and resumes the match, in the manner of takeTurn.
+ *
+ * @param loop Pointer to the event loop.
+ * @param match Pointer to the match, which may be freed if it ends.
+ * @param player The player making the move.
+ * @param move The move.
+ * @return SubmitAccepted if the move was made.
+ */
+static SubmitResult resumeMatch(EventLoop* loop, Match* match, int player, Move move) {
+    SubmitResult result = submitMove(&match->runner, player, move);
+    if (result != SubmitAccepted) {
+        return result;
+    }
+
+    // Step the match until it waits for a player again; the undo records carry the cards
+    // drawn, which binary clients are told about.
+    UndoRecord undo;
+    RunnerEvent event;
+    while ((event = stepRunner(&match->runner, &undo)) == RunnerMoved) {
+        loop->stats.moves++;
+        logEvent(loop, match, LogMove, undo.player, (uint64_t)undo.move);
+        sendMove(loop, match, &undo);
+    }
+    if (event == RunnerFinished) {
+        loop->stats.matchesFinished++;
+        endMatch(loop, match, match->runner.state.winner);
+    } else {
+        sendTurn(loop, match);
+    }
+    return SubmitAccepted;
+}
+
+/**
+ * @brief Handles a move sent by a connection.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ * @param move The move.
+ */
+static void handleMove(EventLoop* loop, Connection* connection, Move move) {
+    if (connection->match == NULL) {
+        sendError(loop, connection, ErrorNotInMatch);
+        return;
+    }
+    SubmitResult result = resumeMatch(loop, connection->match, connection->seat, move);
+    if (result != SubmitAccepted) {
+        sendError(loop, connection, result == SubmitNotYourTurn ? ErrorNotYourTurn : ErrorIllegalMove);
+    }
+}
+
+/**
+ * @brief Enforces a match timer that fired; a TimerFn.
+ *
+ * A player out of time has the timeout policy's move made for them; a match out of time,
+ * or a recovered match whose players did not all come back, ends without a winner.
+ *
+ * @param timer Pointer to the timer, the first member of a MatchTimer.
+ * @param context Pointer to the EventLoop.
+ */
+static void enforceTimeout(Timer* timer, void* context) {
+    EventLoop* loop = context;
+    MatchTimer* matchTimer = (MatchTimer*)timer;
+    Match* match = matchTimer->match;
+    if (matchTimer->kind != TurnTimeout) {
+        loop->stats.matchesTimedOut++;
+        endMatch(loop, match, -1);
+        return;
+    }
+    const GameState* state = &match->runner.state;
+    const Strategy* policy = loop->config->timeoutPolicy;
+    Move move = policy->chooseMove(state, policy->params, &loop->rng);
+    loop->stats.turnsTimedOut++;
+    if (resumeMatch(loop, match, state->currentPlayer, move) != SubmitAccepted) {
+        resumeMatch(loop, match, state->currentPlayer, MOVE_DRAW);
+    }
+}
+
+/**
+ * @brief Handles one line sent by a text connection.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ * @param line The line, without its newline.
+ */
+static void handleLine(EventLoop* loop, Connection* connection, const char* line) {
+    Move move;
+    if (strncmp(line, "JOIN", 4) == 0 && (line[4] == '\0' || line[4] == ' ')) {
+        int numPlayers = NUM_PLAYERS;
+        int rating = DEFAULT_RATING;
+        int numPacks = loop->config->numPacks;
+        char rules[32];
+        int n = line[4] == ' ' ? sscanf(line + 5, "%d %d %d %31s", &numPlayers, &rating, &numPacks, rules) : 0;
+        if (line[4] == ' ' && n < 1) {
+            numPlayers = 0;
+        }
+        handleJoin(loop, connection, numPlayers, rating, numPacks, n == 4 ? findRuleSet(rules) : (int)loop->config->ruleSet);
+    } else if (strncmp(line, "PLAY ", 5) == 0) {
+        int n = parseMove(line + 5, &move);
+        if (n < 0 || line[5 + n] != '\0') {
+            sendError(loop, connection, ErrorBadMove);
+        } else {
+            handleMove(loop, connection, move);
+        }
+    } else if (strcmp(line, "DRAW") == 0) {
+        handleMove(loop, connection, MOVE_DRAW);
+    } else if (strcmp(line, "WATCH") == 0) {
+        handleWatch(loop, connection);
+    } else if (strncmp(line, "RESUME ", 7) == 0) {
+        char* end;
+        unsigned long id = strtoul(line + 7, &end, 10);
+        int seat = (int)strtol(end, &end, 10);
+        unsigned long token = strtoul(end, &end, 10);
+        if (*end != '\0' || id > UINT32_MAX || token > UINT32_MAX) {
+            sendError(loop, connection, ErrorUnknownCommand);
+        } else {
+            handleResume(loop, connection, (uint32_t)id, seat - 1, (uint32_t)token);
+        }
+    } else if (strcmp(line, "QUIT") == 0) {
+        closeConnection(loop, connection);
+    } else if (line[0] != '\0') {
+        sendError(loop, connection, ErrorUnknownCommand);
+    }
+}
+
+/**
+ * @brief Handles one frame sent by a binary connection.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ * @param frame Pointer to the frame, in place in the receive buffer.
+ */
+static void handleFrame(EventLoop* loop, Connection* connection, const Frame* frame) {
+    switch (frame->type) {
+    case FrameJoin:
+        handleJoin(loop, connection, frame->value != 0 ? frame->value : NUM_PLAYERS,
+                   frame->extra != 0 ? frame->extra : DEFAULT_RATING,
+                   frame->suit != 0 && frame->suit != NO_SUIT ? frame->suit : loop->config->numPacks,
+                   frame->card != NO_CARD ? frame->card : (int)loop->config->ruleSet);
+        break;
+    case FramePlay:
+    case FrameDraw: {
+        Move move = frameMove(frame);
+        if (move < 0) {
+            sendError(loop, connection, ErrorBadMove);
+        } else {
+            handleMove(loop, connection, move);
+        }
+        break;
+    }
+    case FrameWatch:
+        handleWatch(loop, connection);
+        break;
+    case FrameToken:
+        connection->resumeToken = (uint32_t)frame->value | (uint32_t)frame->extra << 16;
+        break;
+    case FrameResume:
+        handleResume(loop, connection, (uint32_t)frame->value | (uint32_t)frame->extra << 16, frame->seat,
+                     connection->resumeToken);
+        break;
+    case FrameQuit:
+        closeConnection(loop, connection);
+        break;
+    default:
+        sendError(loop, connection, ErrorUnknownCommand);
+        break;
+    }
+}
+
+/**
+ * @brief Handles the complete lines or frames at the start of a connection's input.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ * @param from Index of the first character not yet looked at.
+ * @param end Number of characters in the input.
+ * @return Number of characters handled.
+ */
+static int handleInput(EventLoop* loop, Connection* connection, int from, int end) {
+    int start = 0;
+    if (connection->binary == 1) {
+        // Frames are decoded where they lie; the buffer is aligned and consumed in whole frames.
+        while (end - start >= FRAME_SIZE && !connection->closed && !connection->leaving) {
+            handleFrame(loop, connection, (const Frame*)(connection->in + start));
+            start += FRAME_SIZE;
+        }
+        return start;
+    }
+    for (int i = from; i < end && !connection->closed && !connection->leaving; ++i) {
+        if (connection->in[i] == '\n') {
+            connection->in[i] = '\0';
+            if (i > start && connection->in[i - 1] == '\r') {
+                connection->in[i - 1] = '\0';
+            }
+            handleLine(loop, connection, connection->in + start);
+            start = i + 1;
+        }
+    }
+    return start;
+}
+
+/**
+ * @brief Reads everything a connection has sent and handles each complete line or frame.
+ *
+ * The first byte chooses the protocol: a frame type selects the binary protocol. Once a
+ * connection is being handed to another loop, its input is left for that loop. While
+ * memory is tight, only players seated in a match are read, so matches can still finish
+ * and free memory while nothing starts new ones; the rest are read once memory frees up.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection.
+ */
+static void readInput(EventLoop* loop, Connection* connection) {
+    if (connection->match == NULL && (connection->throttled || isMemoryAbove(&loop->server->budget, READ_WATERMARK))) {
+        if (!connection->throttled) {
+            connection->throttled = 1;
+            loop->numThrottled++;
+        }
+        return;
+    }
+    unthrottle(loop, connection);
+    while (!connection->closed && !connection->leaving) {
+        ssize_t n = recv(connection->fd, connection->in + connection->inLength,
+                         sizeof(connection->in) - connection->inLength, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (n <= 0) {
+            closeConnection(loop, connection);
+            return;
+        }
+        if (connection->binary < 0) {
+            connection->binary = (unsigned char)connection->in[0] >= FrameJoin;
+        }
+
+        int end = connection->inLength + (int)n;
+        int start = handleInput(loop, connection, connection->inLength, end);
+        memmove(connection->in, connection->in + start, end - start);
+        connection->inLength = end - start;
+        if (connection->inLength == (int)sizeof(connection->in) && !connection->leaving) {
+            sendError(loop, connection, ErrorLineTooLong);
+            flushOutput(loop, connection);
+            closeConnection(loop, connection);
+        }
+    }
+}
+
+/**
+ * @brief Stops watching the listening socket, leaving new connections in its backlog until
+ * memory frees up.
+ *
+ * @param loop Pointer to the event loop.
+ */
+static void pauseAccepting(EventLoop* loop) {
+    if (!loop->acceptPaused) {
+        epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, loop->listenFd, NULL);
+        loop->acceptPaused = 1;
+    }
+}
+
+/**
+ * @brief Frees a connection and the share of a match it reserved.
+ *
+ * @param loop Pointer to the event loop freeing it.
+ * @param connection Pointer to the connection, whose socket is closed.
+ */
+static void freeConnection(EventLoop* loop, Connection* connection) {
+    freeOutputQueue(&connection->out);
+    releaseMemory(&loop->server->budget, loop->server->matchShare);
+    freeSlab(&loop->sessionCache, connection);
+}
+
+/**
+ * @brief Accepts every pending connection, or pauses accepting while memory is low.
+ *
+ * Each connection takes its first output chunk straight away and reserves its share of a
+ * match, which pays for the matches it plays in, so a connection once accepted needs
+ * little more memory to play.
+ *
+ * @param loop Pointer to the event loop.
+ */
+static void acceptConnections(EventLoop* loop) {
+    MemoryBudget* budget = &loop->server->budget;
+    size_t reserve = loop->server->matchShare;
+    for (;;) {
+        if (isMemoryAbove(budget, ACCEPT_WATERMARK)) {
+            pauseAccepting(loop);
+            return;
+        }
+        int fd = accept4(loop->listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            // EAGAIN: another loop took it or none are left; anything else is retried on the next wakeup.
+            return;
+        }
+        Connection* connection = NULL;
+        if (reserveMemory(budget, reserve) == 0) {
+            connection = allocSlab(&loop->sessionCache);
+            if (connection == NULL) {
+                releaseMemory(budget, reserve);
+            }
+        }
+        if (connection == NULL) {
+            close(fd);
+            pauseAccepting(loop);
+            return;
+        }
+        memset(connection, 0, sizeof(*connection));
+        connection->fd = fd;
+        connection->binary = -1;
+        connection->out.chunks = &loop->chunkCache;
+        if (reserveOutputChunk(&connection->out) != 0) {
+            close(fd);
+            freeConnection(loop, connection);
+            pauseAccepting(loop);
+            return;
+        }
+        if (loop->config->socketPath == NULL) {
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        }
+        struct epoll_event event = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = connection };
+        if (epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            freeConnection(loop, connection);
+            continue;
+        }
+        pushConnection(&loop->playing, connection);
+        loop->stats.connections++;
+    }
+}
+
+/**
+ * @brief Wakes a loop that may be waiting for events.
+ *
+ * @param loop Pointer to the event loop; any thread may call this.
+ */
+static void wakeLoop(EventLoop* loop) {
+    uint64_t one = 1;
+    ssize_t n = write(loop->wakeFd, &one, sizeof(one));
+    (void)n; // A full counter means the loop is already due to wake.
+}
+
+/**
+ * @brief Wakes every loop after the move log commits, so held output goes out; a CommitFn.
+ *
+ * @param context Pointer to the Server.
+ */
+static void wakeLoops(void* context) {
+    Server* server = context;
+    for (int i = 0; i < server->numLoops; ++i) {
+        wakeLoop(&server->loops[i]);
+    }
+}
+
+/**
+ * @brief Places a match the matchmaker formed; a PlaceFn, called on the matchmaker's thread.
+ *
+ * Each request goes to its player's loop, which hands the player to the loop hosting the
+ * match; that loop starts the match once every seat is settled.
+ *
+ * @param context Pointer to the Server.
+ * @param tickets The JoinRequests of the players, in seat order.
+ * @param count Number of players.
+ * @param shard Index of the loop to host the match.
+ */
+static void placeMatch(void* context, JoinTicket* const* tickets, int count, int shard) {
+    Server* server = context;
+    int room = 1;
+    for (int seat = 0; seat < count; ++seat) {
+        size_t sameHome = 0;
+        for (int other = 0; other < count; ++other) {
+            sameHome += tickets[other]->shard == tickets[seat]->shard;
+        }
+        room &= spscQueueSpace(ringBetween(server, tickets[seat]->shard, server->numLoops)) >= sameHome;
+    }
+    Pairing* pairing = room ? malloc(sizeof(Pairing)) : NULL;
+    if (pairing == NULL) {
+        // The players wait for a later batch.
+        for (int seat = 0; seat < count; ++seat) {
+            submitJoin(server->matchmaker, tickets[seat]);
+        }
+        return;
+    }
+    pairing->loop = shard;
+    pairing->numPlayers = count;
+    pairing->numPacks = tickets[0]->numPacks;
+    pairing->ruleSet = tickets[0]->ruleSet;
+    pairing->settled = 0;
+    memset(pairing->seats, 0, sizeof(pairing->seats));
+    for (int seat = 0; seat < count; ++seat) {
+        JoinRequest* request = (JoinRequest*)tickets[seat];
+        request->pairing = pairing;
+        request->seat = seat;
+    }
+    // Once the first request is sent the pairing may be settled and freed at any moment.
+    for (int seat = 0; seat < count; ++seat) {
+        int home = tickets[seat]->shard;
+        pushSpscQueue(ringBetween(server, home, server->numLoops), tickets[seat]);
+        wakeLoop(&server->loops[home]);
+    }
+}
+
+/**
+ * @brief Sends each connection leaving a loop, and each placed join request, on to the loop
+ * hosting the match it asked for or was placed in.
+ *
+ * A player placed in a match is sent with their join request even if they have left, so
+ * the hosting loop still learns their seat stays empty. Whatever finds its ring full stays
+ * for a later batch.
+ *
+ * @param loop Pointer to the event loop.
+ */
+static void handOffConnections(EventLoop* loop) {
+    Server* server = loop->server;
+    Connection* waiting = NULL;
+    while (loop->leaving != NULL) {
+        Connection* connection = loop->leaving;
+        loop->leaving = connection->nextHandoff;
+        if (connection->closed) {
+            continue;
+        }
+        SpscQueue* ring = ringBetween(server, connection->resumeLoop, loop->index);
+        if (spscQueueSpace(ring) == 0) {
+            connection->nextHandoff = waiting;
+            waiting = connection;
+            continue;
+        }
+        removeConnection(&loop->playing, connection);
+        unthrottle(loop, connection);
+        epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, connection->fd, NULL);
+        pushSpscQueue(ring, (void*)((uintptr_t)connection | RESUME_MESSAGE));
+        wakeLoop(&server->loops[connection->resumeLoop]);
+    }
+    loop->leaving = waiting;
+
+    JoinRequest* unsent = NULL;
+    while (loop->outgoing != NULL) {
+        JoinRequest* request = loop->outgoing;
+        loop->outgoing = request->nextOutgoing;
+        SpscQueue* ring = ringBetween(server, request->pairing->loop, loop->index);
+        if (spscQueueSpace(ring) == 0) {
+            request->nextOutgoing = unsent;
+            unsent = request;
+            continue;
+        }
+        Connection* connection = request->connection;
+        if (connection != NULL) {
+            connection->request = NULL;
+            removeConnection(&loop->lobby, connection);
+            unthrottle(loop, connection);
+            epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, connection->fd, NULL);
+        }
+        pushSpscQueue(ring, request);
+        wakeLoop(&server->loops[request->pairing->loop]);
+    }
+    loop->outgoing = unsent;
+}
+
+/**
+ * @brief Handles the input a connection received on another loop after the request that
+ * brought it here, then reads on.
+ *
+ * @param loop Pointer to the event loop, which has just taken the connection in.
+ * @param connection Pointer to the connection.
+ */
+static void continueInput(EventLoop* loop, Connection* connection) {
+    if (connection->closed) {
+        return;
+    }
+    int start = handleInput(loop, connection, 0, connection->inLength);
+    memmove(connection->in, connection->in + start, connection->inLength - start);
+    connection->inLength -= start;
+    readInput(loop, connection);
+}
+
+/**
+ * @brief Adds a connection handed over by another loop to this loop's epoll instance.
+ *
+ * @param loop Pointer to the event loop.
+ * @param connection Pointer to the connection, which is freed if it cannot be added.
+ * @return 0 on success, -1 if the connection was dropped.
+ */
+static int adoptConnection(EventLoop* loop, Connection* connection) {
+    connection->leaving = 0;
+    connection->out.chunks = &loop->chunkCache;
+    struct epoll_event event = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = connection };
+    if (epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, connection->fd, &event) != 0) {
+        close(connection->fd);
+        freeConnection(loop, connection);
+        return -1;
+    }
+    pushConnection(listOf(loop, connection), connection);
+    if (connection->out.pending > 0) {
+        markDirty(loop, connection);
+    }
+    return 0;
+}
+
+/**
+ * @brief Handles a join request sent to a loop.
+ *
+ * A request arrives first at its player's loop, which seats the player if it hosts the
+ * match and otherwise sends the player, or word that they left, to the loop that does.
+ *
+ * @param loop Pointer to the event loop.
+ * @param request Pointer to the request, placed by the matchmaker.
+ */
+static void receiveRequest(EventLoop* loop, JoinRequest* request) {
+    Pairing* pairing = request->pairing;
+    Connection* connection = request->connection;
+    int home = request->ticket.shard == loop->index;
+    if (home && pairing->loop != loop->index) {
+        if (connection != NULL) {
+            connection->leaving = 1;
+        }
+        request->nextOutgoing = loop->outgoing;
+        loop->outgoing = request;
+        return;
+    }
+
+    int seat = request->seat;
+    free(request);
+    if (connection != NULL && !home && adoptConnection(loop, connection) != 0) {
+        connection = NULL;
+    }
+    if (connection != NULL) {
+        connection->request = NULL;
+        connection->pairing = pairing;
+        connection->seat = seat;
+    }
+    pairing->seats[seat] = connection;
+    if (++pairing->settled == pairing->numPlayers) {
+        settlePairing(loop, pairing);
+    }
+    if (connection != NULL && !home) {
+        continueInput(loop, connection);
+    }
+}
+
+/**
+ * @brief Takes in the connections and join requests other threads sent.
+ *
+ * @param loop Pointer to the event loop.
+ */
+static void adoptConnections(EventLoop* loop) {
+    uint64_t count;
+    ssize_t n = read(loop->wakeFd, &count, sizeof(count));
+    (void)n;
+    for (int source = 0; source <= loop->server->numLoops; ++source) {
+        SpscQueue* ring = ringBetween(loop->server, loop->index, source);
+        void* message;
+        while ((message = popSpscQueue(ring)) != NULL) {
+            if (((uintptr_t)message & RESUME_MESSAGE) == 0) {
+                receiveRequest(loop, message);
+                continue;
+            }
+            Connection* connection = (Connection*)((uintptr_t)message & ~RESUME_MESSAGE);
+            if (adoptConnection(loop, connection) != 0) {
+                continue;
+            }
+            handleResume(loop, connection, connection->resumeMatch, connection->resumeSeat, connection->resumeToken);
+
+            // Input that arrived behind the request was left for this loop.
+            continueInput(loop, connection);
+        }
+    }
+}
+
+/**
+ * @brief Watches the listening socket again and reads the throttled connections, each once
+ * memory has been freed below its watermark.
+ *
+ * @param loop Pointer to the event loop.
+ */
+static void relieveBackpressure(EventLoop* loop) {
+    MemoryBudget* budget = &loop->server->budget;
+    if (loop->acceptPaused && !isMemoryAbove(budget, ACCEPT_WATERMARK)) {
+        // Level-triggered, so connections left in the backlog are reported straight away.
+        struct epoll_event listenEvent = { .events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL };
+        loop->acceptPaused = epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->listenFd, &listenEvent) != 0;
+    }
+    if (loop->numThrottled == 0 || isMemoryAbove(budget, READ_WATERMARK)) {
+        return;
+    }
+
+    // Gather them first, as reading moves connections between lists.
+    Connection* throttled = NULL;
+    ConnectionList* lists[] = { &loop->playing, &loop->lobby };
+    for (int i = 0; i < 2; ++i) {
+        for (Connection* connection = lists[i]->head; connection != NULL; connection = connection->next) {
+            if (connection->throttled) {
+                connection->nextThrottled = throttled;
+                throttled = connection;
+            }
+        }
+    }
+    for (Match* match = loop->matches; match != NULL; match = match->next) {
+        for (Connection* connection = match->spectators.head; connection != NULL; connection = connection->next) {
+            if (connection->throttled) {
+                connection->nextThrottled = throttled;
+                throttled = connection;
+            }
+        }
+    }
+    while (throttled != NULL) {
+        Connection* connection = throttled;
+        throttled = connection->nextThrottled;
+        if (connection->throttled) {
+            unthrottle(loop, connection);
+            readInput(loop, connection);
+        }
+    }
+}
+
+/**
+ * @brief Flushes the output gathered during a batch and frees the connections closed in it.
+ *
+ * Output that follows log records not yet committed stays on the dirty list for a later
+ * batch; the loop is woken when the log commits. Connections held back while memory was
+ * tight are read first if it has since been freed.
+ *
+ * @param loop Pointer to the event loop.
+ */
+static void finishBatch(EventLoop* loop) {
+    if ((loop->acceptPaused || loop->numThrottled > 0) && !loop->stopping) {
+        relieveBackpressure(loop);
+    }
+    MoveLog* log = loop->server->log;
+    uint64_t committed = log != NULL ? committedLogRecords(log) : 0;
+    Connection* held = NULL;
+    while (loop->dirty != NULL) {
+        Connection* connection = loop->dirty;
+        loop->dirty = connection->nextDirty;
+        if (!connection->overflowed && !connection->closed && !connection->leaving && connection->holdUntil > committed) {
+            connection->nextDirty = held;
+            held = connection;
+            continue;
+        }
+        connection->dirty = 0;
+        if (connection->overflowed) {
+            closeConnection(loop, connection);
+        } else if (!connection->closed && connection->holdUntil <= committed) {
+            flushOutput(loop, connection);
+        }
+    }
+    loop->dirty = held;
+    handOffConnections(loop);
+    if (loop->numMatches != loop->reportedLoad) {
+        reportShardLoad(loop->server->matchmaker, loop->index, loop->numMatches);
+        loop->reportedLoad = loop->numMatches;
+    }
+    while (loop->closed != NULL) {
+        Connection* connection = loop->closed;
+        loop->closed = connection->next;
+        freeConnection(loop, connection);
+    }
+}
+
+/**
+ * @brief Closes every connection of a loop; its matches are freed by runServer.
+ *
+ * @param loop Pointer to the event loop.
+ */
+static void closeAllConnections(EventLoop* loop) {
+    for (Match* match = loop->matches; match != NULL; match = match->next) {
+        while (match->spectators.head != NULL) {
+            closeConnection(loop, match->spectators.head);
+        }
+    }
+    while (loop->lobby.head != NULL) {
+        closeConnection(loop, loop->lobby.head);
+    }
+    while (loop->playing.head != NULL) {
+        closeConnection(loop, loop->playing.head);
+    }
+    finishBatch(loop);
+}
+
+/**
+ * @brief Counts a join request that will never be received towards its pairing, and frees it.
+ *
+ * @param loop Pointer to the event loop the request was sent to or left on.
+ * @param request Pointer to the request; its connection, if any, is closed and freed.
+ */
+static void dropRequest(EventLoop* loop, JoinRequest* request) {
+    Pairing* pairing = request->pairing;
+    if (request->connection != NULL) {
+        close(request->connection->fd);
+        freeConnection(loop, request->connection);
+    }
+    free(request);
+    // The players who did arrive were closed with their loop.
+    if (++pairing->settled == pairing->numPlayers) {
+        free(pairing);
+    }
+}
+
+/**
+ * @brief Drops the connections and join requests sent to a loop, or left unsent by it, too
+ * late, once every loop and the matchmaker have stopped.
+ *
+ * @param loop Pointer to the event loop.
+ */
+static void dropHandoffs(EventLoop* loop) {
+    while (loop->outgoing != NULL) {
+        JoinRequest* request = loop->outgoing;
+        loop->outgoing = request->nextOutgoing;
+        dropRequest(loop, request);
+    }
+    for (int source = 0; source <= loop->server->numLoops; ++source) {
+        SpscQueue* ring = ringBetween(loop->server, loop->index, source);
+        void* message;
+        while ((message = popSpscQueue(ring)) != NULL) {
+            if (((uintptr_t)message & RESUME_MESSAGE) == 0) {
+                dropRequest(loop, message);
+                continue;
+            }
+            Connection* connection = (Connection*)((uintptr_t)message & ~RESUME_MESSAGE);
+            close(connection->fd);
+            freeConnection(loop, connection);
+        }
+    }
+}
+
+/**
+ * @brief Empties the seats of every match of a loop, so closing its players leaves the
+ * matches running for the snapshot or log to keep.
+ *
+ * @param loop Pointer to the event loop.
+ */
+static void suspendMatches(EventLoop* loop) {
+    for (Match* match = loop->matches; match != NULL; match = match->next) {
+        for (int seat = 0; seat < match->runner.state.numPlayers; ++seat) {
+            if (match->seats[seat] != NULL) {
+                match->seats[seat]->match = NULL;
+                match->seats[seat] = NULL;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Returns the current timer tick.
+ *
+ * @return The monotonic clock in units of TIMER_TICK_MS.
+ */
+static uint64_t currentTick(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000) / TIMER_TICK_MS;
+}
+
+/**
+ * @brief Gives each loop a core of its own, in the order the process may run on them,
+ * going round again if there are more loops than cores.
+ *
+ * @param loops The event loops.
+ * @param numLoops Number of loops.
+ */
+static void assignCores(EventLoop* loops, int numLoops) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+        return;
+    }
+    int cpu = -1;
+    for (int i = 0; i < numLoops; ++i) {
+        do {
+            cpu = (cpu + 1) % CPU_SETSIZE;
+        } while (!CPU_ISSET(cpu, &allowed));
+        loops[i].cpu = cpu;
+    }
+}
+
+/**
+ * @brief Runs one event loop until the server is asked to stop; a job of runParallel.
+ *
+ * @param job Index of the loop.
+ * @param thread Index of the thread running the loop.
+ * @param context Pointer to the array of EventLoops.
+ */
+static void runEventLoop(int job, int thread, void* context) {
+    (void)thread;
+    EventLoop* loop = &((EventLoop*)context)[job];
+    if (loop->cpu >= 0) {
+        cpu_set_t core;
+        CPU_ZERO(&core);
+        CPU_SET(loop->cpu, &core);
+        pthread_setaffinity_np(pthread_self(), sizeof(core), &core);
+    }
+    loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epollFd < 0) {
+        return;
+    }
+    struct epoll_event listenEvent = { .events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL };
+    struct epoll_event wakeEvent = { .events = EPOLLIN, .data.ptr = loop };
+    if (epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->listenFd, &listenEvent) != 0
+        || epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->wakeFd, &wakeEvent) != 0) {
+        close(loop->epollFd);
+        return;
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    while (!atomic_load_explicit(&stopRequested, memory_order_relaxed)) {
+        // While any timer is set, wake every tick so timeouts fire on time.
+        int timeout = loop->timers.count > 0 ? TIMER_TICK_MS : POLL_INTERVAL_MS;
+        int count = epoll_wait(loop->epollFd, events, MAX_EVENTS, timeout);
+        advanceTimerWheel(&loop->timers, currentTick(), enforceTimeout, loop);
+        for (int i = 0; i < count; ++i) {
+            Connection* connection = events[i].data.ptr;
+            if (connection == NULL) {
+                acceptConnections(loop);
+                continue;
+            }
+            if (events[i].data.ptr == loop) {
+                adoptConnections(loop);
+                continue;
+            }
+            if (connection->closed) {
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                flushOutput(loop, connection);
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                readInput(loop, connection);
+                // A client that hangs up while throttled goes now, freeing its memory, unread.
+                if (connection->throttled && (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+                    closeConnection(loop, connection);
+                }
+            }
+        }
+        finishBatch(loop);
+    }
+
+    loop->stopping = 1;
+    if (loop->config->logPath != NULL || loop->config->snapshotPath != NULL) {
+        suspendMatches(loop);
+    }
+    closeAllConnections(loop);
+    close(loop->epollFd);
+}
+
+/**
+ * @brief Records that the server should stop.
+ *
+ * @param signal The signal received.
+ */
+static void requestStop(int signal) {
+    (void)signal;
+    atomic_store_explicit(&stopRequested, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Opens a listening socket.
+ *
+ * @param config Pointer to the server settings.
+ * @param reusePort 1 to let other sockets of the process listen on the same TCP port.
+ * @return The socket, or -1 on failure.
+ */
+static int openListener(const ServerConfig* config, int reusePort) {
+    int unixSocket = config->socketPath != NULL;
+    int fd = socket(unixSocket ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    int status;
+    if (unixSocket) {
+        struct sockaddr_un address = { .sun_family = AF_UNIX };
+        if (strlen(config->socketPath) >= sizeof(address.sun_path)) {
+            close(fd);
+            return -1;
+        }
+        strcpy(address.sun_path, config->socketPath);
+        unlink(config->socketPath);
+        status = bind(fd, (struct sockaddr*)&address, sizeof(address));
+    } else {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (reusePort) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        }
+        struct sockaddr_in address = { .sin_family = AF_INET, .sin_port = htons((uint16_t)config->port) };
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        status = bind(fd, (struct sockaddr*)&address, sizeof(address));
+    }
+    if (status != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Orders recovery entries by match id; a qsort comparator.
+ *
+ * @param a Pointer to the first entry.
+ * @param b Pointer to the second entry.
+ * @return Negative, zero or positive as a's match id is below, equal to or above b's.
+ */
+static int compareRecovered(const void* a, const void* b) {
+    uint32_t first = ((const RecoveryEntry*)a)->match;
+    uint32_t second = ((const RecoveryEntry*)b)->match;
+    return (first > second) - (first < second);
+}
+
+/**
+ * @brief Hosts recovered matches on the loops and indexes them by id.
+ *
+ * Matches are dealt round the loops in turn and wait for their players to resume their
+ * seats; a match not full again by the resume timeout ends without a winner.
+ *
+ * @param server Pointer to the server, whose loops are set up but not running.
+ * @param matches The matches.
+ * @param count Number of matches.
+ * @return 0 on success, -1 if memory runs out or the matches do not fit the memory budget.
+ */
+static int hostRecovered(Server* server, const RecoveredMatch* matches, int count) {
+    if (count == 0) {
+        return 0;
+    }
+    server->recovered = malloc(count * sizeof(RecoveryEntry));
+    if (server->recovered == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < count; ++i) {
+        EventLoop* loop = &server->loops[i % server->numLoops];
+        Match* match = allocSlab(&loop->matchCaches[matchClass(matches[i].state.numPlayers)]);
+        if (match == NULL) {
+            return -1;
+        }
+        match->prepaid = 0;
+        match->secret = matches[i].secret;
+        startRunner(&match->runner, &matches[i].state, NULL, 0);
+        hostMatch(loop, match, matches[i].match, -1);
+        if (loop->config->resumeTimeoutMs > 0) {
+            scheduleTimer(&loop->timers, &match->resumeTimer.timer,
+                          loop->timers.now + timeoutTicks(loop->config->resumeTimeoutMs));
+        }
+        sendTurn(loop, match);
+        server->recovered[server->numRecovered++] = (RecoveryEntry) { match->id, loop->index, match };
+        loop->stats.matchesRecovered++;
+    }
+
+    qsort(server->recovered, server->numRecovered, sizeof(RecoveryEntry), compareRecovered);
+    for (int i = 0; i < server->numRecovered; ++i) {
+        server->recovered[i].live->recovered = i;
+    }
+    return 0;
+}
+
+/**
+ * @brief Rebuilds the matches a snapshot or move log left unfinished and hosts them on the loops.
+ *
+ * A log that continues from the snapshot is replayed on top of it. A log the snapshot
+ * already covers, because the server stopped before the log was restarted, is not
+ * replayed; it is restarted now. Without a log the snapshot is removed once restored, as
+ * nothing would keep it current after a crash.
+ *
+ * @param server Pointer to the server, whose loops are set up but not running.
+ * @param config Pointer to the server settings.
+ * @return 0 on success, -1 if the files cannot be read, do not belong together or memory runs out.
+ */
+static int restoreMatches(Server* server, const ServerConfig* config) {
+    Snapshot snapshot = { NULL, 0, 1, 0, 0, NULL, 0 };
+    if (config->snapshotPath != NULL && openSnapshot(config->snapshotPath, &snapshot) != 0) {
+        fprintf(stderr, "Cannot read snapshot %s\n", config->snapshotPath);
+        return -1;
+    }
+    const RecoveredMatch* matches = snapshot.matches;
+    int count = snapshot.count;
+    uint32_t nextMatch = snapshot.nextMatch;
+    RecoveredMatch* replayed = NULL;
+    int result = 0;
+
+    if (config->logPath != NULL) {
+        uint64_t epoch;
+        uint32_t logNextMatch = 1;
+        result = readLogEpoch(config->logPath, &epoch);
+        if (result == 0 && epoch != 0 && epoch == snapshot.epoch) {
+            result = recoverMatches(config->logPath, snapshot.matches, snapshot.count, &replayed, &count, &logNextMatch);
+            matches = replayed;
+            server->logEpoch = epoch;
+        } else if (result == 0 && epoch == snapshot.logEpoch && snapshot.epoch != 0) {
+            result = resetMoveLog(config->logPath, snapshot.epoch);
+            server->logEpoch = snapshot.epoch;
+        } else if (result == 0 && epoch == 0) {
+            result = recoverMatches(config->logPath, NULL, 0, &replayed, &count, &logNextMatch);
+            matches = replayed;
+        } else if (result == 0) {
+            fprintf(stderr, "Move log %s does not continue from the snapshot given\n", config->logPath);
+            result = -1;
+        }
+        if (logNextMatch > nextMatch) {
+            nextMatch = logNextMatch;
+        }
+    }
+
+    if (result == 0) {
+        atomic_store(&nextMatchId, nextMatch);
+        result = hostRecovered(server, matches, count);
+    }
+    if (result == 0 && config->logPath == NULL && snapshot.epoch != 0) {
+        unlink(config->snapshotPath);
+    }
+    free(replayed);
+    closeSnapshot(&snapshot);
+    return result;
+}
+
+/**
+ * @brief Writes every match of the loops to the snapshot and restarts the log from it.
+ *
+ * The loops must have stopped. If the log cannot be restarted it is kept whole; the
+ * snapshot names it as covered, so it is not replayed twice.
+ *
+ * @param server Pointer to the server.
+ * @param config Pointer to the server settings.
+ * @return Number of matches written, or -1 on failure.
+ */
+static long saveSnapshot(Server* server, const ServerConfig* config) {
+    SnapshotWriter* writer = beginSnapshot(config->snapshotPath, server->logEpoch);
+    if (writer == NULL) {
+        return -1;
+    }
+    long count = 0;
+    for (int i = 0; i < server->numLoops; ++i) {
+        for (Match* match = server->loops[i].matches; match != NULL; match = match->next) {
+            if (addSnapshotMatch(writer, match->id, match->secret, &match->runner.state) != 0) {
+                break;
+            }
+            count++;
+        }
+    }
+    uint64_t epoch;
+    if (commitSnapshot(writer, atomic_load(&nextMatchId), &epoch) != 0) {
+        return -1;
+    }
+    if (config->logPath != NULL && resetMoveLog(config->logPath, epoch) != 0) {
+        fprintf(stderr, "Cannot restart move log %s; it is kept until the next start\n", config->logPath);
+    }
+    return count;
+}
+
+/**
+ * @brief Runs a server until it receives SIGINT or SIGTERM.
+ *
+ * @param config Pointer to the server settings.
+ * @param stats Pointer to the totals of the run, or NULL.
+ * @return 0 on success, -1 if the settings are invalid or the socket cannot be opened.
+ */
+int runServer(const ServerConfig* config, ServerStats* stats) {
+    if (config->numPacks < 1 || config->numPacks > MAX_PACKS || config->ruleSet < 0
+        || config->turnTimeoutMs < 0 || config->matchTimeoutMs < 0 || config->resumeTimeoutMs < 0
+        || config->timeoutPolicy == NULL || config->commitIntervalMs < 0 || config->pairingIntervalMs < 0
+        || config->memoryBudget > LONG_MAX
+        || config->ruleSet >= NUM_RULE_SETS || (config->socketPath == NULL && (config->port < 1 || config->port > 65535))) {
+        return -1;
+    }
+
+    int numThreads = config->numThreads > 0 ? config->numThreads : defaultThreadCount();
+    Server server;
+    memset(&server, 0, sizeof(server));
+    server.loops = calloc(numThreads, sizeof(EventLoop));
+    server.numLoops = numThreads;
+    server.rings = calloc((size_t)numThreads * (numThreads + 1), sizeof(SpscQueue));
+    if (server.loops == NULL || server.rings == NULL) {
+        free(server.loops);
+        free(server.rings);
+        return -1;
+    }
+    initMemoryBudget(&server.budget, config->memoryBudget);
+    initSlabDepot(&server.sessionDepot, sizeof(Connection), &server.budget);
+    // A share pays for a match with the fewest players its class holds, the dearest per player.
+    for (int size = 0; size < MATCH_CLASSES; ++size) {
+        initSlabDepot(&server.matchDepots[size], matchClassBytes(size), &server.budget);
+    }
+    for (int numPlayers = 2; numPlayers <= MAX_PLAYERS; ++numPlayers) {
+        size_t bytes = server.matchDepots[matchClass(numPlayers)].objectSize;
+        size_t share = (bytes + (size_t)numPlayers - 1) / (size_t)numPlayers;
+        server.matchShare = share > server.matchShare ? share : server.matchShare;
+    }
+    initSlabDepot(&server.chunkDepot, BUFFER_CHUNK_SIZE, &server.budget);
+    Rng seeds;
+    seedRng(&seeds, config->seed);
+    uint64_t now = currentTick();
+    int ready = 1;
+    for (int i = 0; i < numThreads; ++i) {
+        EventLoop* loop = &server.loops[i];
+        loop->config = config;
+        loop->server = &server;
+        loop->index = i;
+        loop->listenFd = -1;
+        loop->cpu = -1;
+        loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        ready &= loop->wakeFd >= 0;
+        for (int source = 0; source <= numThreads; ++source) {
+            ready &= initSpscQueue(ringBetween(&server, i, source), HANDOFF_RING_SIZE) == 0;
+        }
+        seedRng(&loop->rng, nextRandom(&seeds));
+        ready &= getrandom(&loop->secrets.state, sizeof(loop->secrets.state), 0) == sizeof(loop->secrets.state);
+        initTimerWheel(&loop->timers, now);
+        initSlabCache(&loop->sessionCache, &server.sessionDepot);
+        for (int size = 0; size < MATCH_CLASSES; ++size) {
+            initSlabCache(&loop->matchCaches[size], &server.matchDepots[size]);
+        }
+        initSlabCache(&loop->chunkCache, &server.chunkDepot);
+    }
+    if (config->shardPerCore) {
+        assignCores(server.loops, numThreads);
+    }
+
+    atomic_store(&nextMatchId, 1);
+    if (ready && (config->logPath != NULL || config->snapshotPath != NULL)) {
+        ready = restoreMatches(&server, config) == 0;
+    }
+    // From here the matches are the loops' own, and are saved even if the server cannot start.
+    int restored = ready;
+    if (ready && config->logPath != NULL) {
+        server.log = openMoveLog(config->logPath, config->commitIntervalMs, wakeLoops, &server);
+        ready = server.log != NULL;
+    }
+    if (ready) {
+        server.matchmaker = startMatchmaker(numThreads, config->pairingIntervalMs, placeMatch, &server);
+        ready = server.matchmaker != NULL;
+    }
+    // Shards on TCP each listen on their own socket, and the kernel spreads connections over them.
+    int ownListeners = config->shardPerCore && config->socketPath == NULL;
+    for (int i = 0; ready && i < numThreads; ++i) {
+        server.loops[i].listenFd = i == 0 || ownListeners ? openListener(config, ownListeners) : server.loops[0].listenFd;
+        ready = server.loops[i].listenFd >= 0;
+    }
+
+    if (ready) {
+        struct sigaction action = { .sa_handler = requestStop };
+        struct sigaction oldInt, oldTerm;
+        sigemptyset(&action.sa_mask);
+        atomic_store(&stopRequested, 0);
+        sigaction(SIGINT, &action, &oldInt);
+        sigaction(SIGTERM, &action, &oldTerm);
+
+        // Every job is a loop that runs until the server stops, so each needs its own thread.
+        runParallel(numThreads, numThreads, runEventLoop, server.loops);
+        stopMatchmaker(server.matchmaker);
+        server.matchmaker = NULL;
+        for (int i = 0; i < numThreads; ++i) {
+            dropHandoffs(&server.loops[i]);
+        }
+
+        sigaction(SIGINT, &oldInt, NULL);
+        sigaction(SIGTERM, &oldTerm, NULL);
+    }
+    for (int i = 0; i < numThreads; ++i) {
+        if (server.loops[i].listenFd >= 0 && (i == 0 || ownListeners)) {
+            close(server.loops[i].listenFd);
+        }
+    }
+    if (config->socketPath != NULL && server.loops[0].listenFd >= 0) {
+        unlink(config->socketPath);
+    }
+    stopMatchmaker(server.matchmaker);
+    closeMoveLog(server.log);
+    long saved = 0;
+    if (restored && config->snapshotPath != NULL) {
+        saved = saveSnapshot(&server, config);
+        if (saved < 0) {
+            fprintf(stderr, "Cannot write snapshot %s\n", config->snapshotPath);
+        }
+    }
+
+    if (stats != NULL) {
+        memset(stats, 0, sizeof(*stats));
+        for (int i = 0; i < numThreads; ++i) {
+            const ServerStats* loopStats = &server.loops[i].stats;
+            stats->connections += loopStats->connections;
+            stats->matchesStarted += loopStats->matchesStarted;
+            stats->matchesFinished += loopStats->matchesFinished;
+            stats->matchesRecovered += loopStats->matchesRecovered;
+            stats->moves += loopStats->moves;
+            stats->turnsTimedOut += loopStats->turnsTimedOut;
+            stats->matchesTimedOut += loopStats->matchesTimedOut;
+            stats->spectators += loopStats->spectators;
+        }
+        stats->matchesSaved = saved > 0 ? saved : 0;
+    }
+    for (int i = 0; i < numThreads; ++i) {
+        EventLoop* loop = &server.loops[i];
+        if (loop->wakeFd >= 0) {
+            close(loop->wakeFd);
+        }
+        for (int source = 0; source <= numThreads; ++source) {
+            freeSpscQueue(ringBetween(&server, i, source));
+        }
+    }
+    // Matches still running when the loops stopped, or recovered for loops that never ran, go with their slabs.
+    destroySlabDepot(&server.sessionDepot);
+    for (int size = 0; size < MATCH_CLASSES; ++size) {
+        destroySlabDepot(&server.matchDepots[size]);
+    }
+    destroySlabDepot(&server.chunkDepot);
+    free(server.rings);
+    free(server.recovered);
+    free(server.loops);
+    return ready ? 0 : -1;
+}
+
+/**
+ * @brief Prints the usage of the serve command.
+ */
+static void printServerUsage(void) {
+    fprintf(stderr, "Usage: serve [--port N | --unix PATH] [--threads N] [--shards] [--packs N] [--rules NAME]\n"
+                    "             [--turn-timeout MS] [--match-timeout MS] [--timeout-policy SPEC]\n"
+                    "             [--log PATH] [--commit-ms MS] [--snapshot PATH] [--resume-timeout MS]\n"
+                    "             [--pair-ms MS] [--memory MB] [--seed N]\n");
+    fprintf(stderr, "Rules:");
+    for (int id = 0; id < NUM_RULE_SETS; ++id) {
+        fprintf(stderr, " %s", getRuleSet((RuleSetId)id)->name);
+    }
+    fprintf(stderr, "\n");
+}
+
+/**
+ * @brief Runs a server from command-line arguments.
+ *
+ * @param argc Number of arguments after the "serve" command.
+ * @param argv The arguments after the "serve" command.
+ * @return 0 on success, 1 on invalid arguments or if the server cannot start.
+ */
+int runServerCli(int argc, char** argv) {
+    ServerConfig config = { NULL, DEFAULT_SERVER_PORT, 0, 0, 1, RulesStandard, 0, 0, findStrategy("first"), NULL,
+                            DEFAULT_COMMIT_INTERVAL_MS, NULL, DEFAULT_RESUME_TIMEOUT_MS, DEFAULT_PAIRING_INTERVAL_MS, 0,
+                            (uint64_t)time(NULL) };
+    const Strategy* opened = NULL;
+    int status = 1;
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            config.port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--unix") == 0 && i + 1 < argc) {
+            config.socketPath = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            config.numThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--packs") == 0 && i + 1 < argc) {
+            config.numPacks = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rules") == 0 && i + 1 < argc) {
+            int ruleSet = findRuleSet(argv[++i]);
+            if (ruleSet < 0) {
+                fprintf(stderr, "Unknown rules: %s\n", argv[i]);
+                printServerUsage();
+                closeStrategy(opened);
+                return 1;
+            }
+            config.ruleSet = (RuleSetId)ruleSet;
+        } else if (strcmp(argv[i], "--turn-timeout") == 0 && i + 1 < argc) {
+            config.turnTimeoutMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--match-timeout") == 0 && i + 1 < argc) {
+            config.matchTimeoutMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--timeout-policy") == 0 && i + 1 < argc) {
+            closeStrategy(opened);
+            opened = openStrategy(argv[++i]);
+            if (opened == NULL) {
+                fprintf(stderr, "Unknown strategy: %s\n", argv[i]);
+                printServerUsage();
+                return 1;
+            }
+            config.timeoutPolicy = opened;
+        } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            config.logPath = argv[++i];
+        } else if (strcmp(argv[i], "--commit-ms") == 0 && i + 1 < argc) {
+            config.commitIntervalMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            config.snapshotPath = argv[++i];
+        } else if (strcmp(argv[i], "--resume-timeout") == 0 && i + 1 < argc) {
+            config.resumeTimeoutMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--shards") == 0) {
+            config.shardPerCore = 1;
+        } else if (strcmp(argv[i], "--pair-ms") == 0 && i + 1 < argc) {
+            config.pairingIntervalMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc) {
+            config.memoryBudget = strtoull(argv[++i], NULL, 10) << 20;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            config.seed = strtoull(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            printServerUsage();
+            closeStrategy(opened);
+            return 1;
+        }
+    }
+
+    if (config.socketPath != NULL) {
+        fprintf(stderr, "Listening on %s\n", config.socketPath);
+    } else {
+        fprintf(stderr, "Listening on 127.0.0.1:%d\n", config.port);
+    }
+    ServerStats stats;
+    if (runServer(&config, &stats) != 0) {
+        fprintf(stderr, "Cannot start the server\n");
+        printServerUsage();
+    } else {
+        printf("%ld connections, %ld matches started, %ld finished, %ld recovered, %ld moves\n",
+               stats.connections, stats.matchesStarted, stats.matchesFinished, stats.matchesRecovered, stats.moves);
+        printf("%ld turns timed out, %ld matches timed out, %ld spectators, %ld matches saved\n",
+               stats.turnsTimedOut, stats.matchesTimedOut, stats.spectators, stats.matchesSaved);
+        status = 0;
+    }
+    closeStrategy(opened);
+    return status;
+}
@@ -0,0 +1,166 @@
+/**
+ * @file server.h
+ * @brief Header file for the game server that hosts many matches at once.
+ *
+ * The server listens on a localhost TCP port or a Unix domain socket and runs one event
+ * loop per core. Each loop owns the connections it accepts and the matches it hosts, so a
+ * match is only ever touched by one thread and needs no locks. Sockets are non-blocking
+ * and every match is a compact GameState, so one process holds thousands of matches.
+ *
+ * Joins from every loop go to one matchmaker (see matchmaker.h), which pairs them in
+ * batches by match size, packs, rules and rating, so players meet whichever loop accepted
+ * them. Each match is hosted by the loop with the fewest matches, and its players are
+ * handed to that loop before it starts.
+ *
+ * With --shards, each loop is a shard pinned to a core of its own. On TCP every shard also
+ * listens on its own SO_REUSEPORT socket, so the kernel spreads new connections over the
+ * shards without waking the others; a Unix socket cannot be shared that way and stays one
+ * socket for all. Loops never share a lock: they hand connections and join requests to
+ * each other through one single-producer ring per pair (see spscqueue.h), and each takes
+ * match ids in blocks.
+ *
+ * A player who takes longer than the turn timeout has a move made for them by the timeout
+ * policy, and a match that outlasts the match timeout ends without a winner. Both are
+ * kept in a timer wheel per loop (see timerwheel.h), as they are set and cleared on
+ * nearly every move.
+ *
+ * With a move log (see movelog.h), every deal, move and result is logged and the log is
+ * committed once per commit interval; replies wait for the commit, so a client is never
+ * told of a move that a crash could lose. On startup the unfinished matches in the log are
+ * rebuilt, and their players take their seats back with RESUME, giving the token each
+ * was sent for their seat at START; the tokens are made from a secret drawn when the
+ * match starts, logged and snapshotted with it, so no one else can take a seat. A
+ * recovered match whose players have not all come back within the resume timeout ends
+ * without a winner, as a match does when a player leaves.
+ *
+ * With a snapshot (see snapshot.h), every running match is written to one file when the
+ * server stops and mapped back in when it starts, so a restart restores its matches
+ * without replaying their moves; the log then starts again from the snapshot. Players are
+ * disconnected without an OVER and resume as after a crash.
+ *
+ * Sessions, matches and output buffers are carved from slabs, cached per loop (see slab.h),
+ * and charged to one memory budget, set with --memory in MB. Each session reserves its
+ * share of a match when it is accepted, so players already admitted are always paired and
+ * play. Rather than run out of memory, the server applies backpressure as the budget runs
+ * low: at three quarters loops stop accepting connections, and at seven eighths they stop
+ * reading from clients that are not playing, so running matches finish while nothing new
+ * is taken on, and catch up once memory has been freed.
+ *
+ * Spectators watch a loop's featured match, the one earlier spectators were sent to while
+ * it lasts, so that a popular match gathers them. Each move is encoded once for all of a
+ * match's spectators and shared by their output queues (see broadcast.h).
+ *
+ * Clients speak either the fixed-size binary frames of protocol.h or a line-based text
+ * protocol, chosen by the first byte they send. Text client to server:
+ *
+ *   JOIN [PLAYERS [RATING [PACKS [RULES]]]]
+ *                     wait for a match of PLAYERS players (default 2) with PACKS packs
+ *                     played under RULES (default the server's), against players rated
+ *                     near RATING (default 1500)
+ *   PLAY MOVE         play a move in the form of parseMove, for example "PLAY 7h"
+ *   DRAW              draw from the hidden deck
+ *   WATCH             watch a match as a spectator
+ *   RESUME MATCH SEAT TOKEN
+ *                     take back SEAT, counted from 1, of a match recovered after a
+ *                     restart, with the TOKEN START gave for it
+ *   QUIT              leave the server
+ *
+ * Server to client:
+ *
+ *   WAIT                     the join was queued
+ *   START SEAT PLAYERS MATCH TOKEN
+ *                            a match began or was resumed; SEAT counts from 1 and
+ *                            TOKEN is needed to resume it
+ *   TURN VIEW                it is your move; VIEW is formatPlayerView's text
+ *   WATCHING PLAYERS VIEW    you are watching a match; VIEW has no hand
+ *   MOVED SEAT MOVE          a player moved
+ *   OVER WINNER              the match ended; WINNER counts from 1, 0 for no winner
+ *   ERR REASON               the last line was refused
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "gamestate.h"
+#include "strategy.h"
+
+/** TCP port the server listens on unless told otherwise. */
+#define DEFAULT_SERVER_PORT 7777
+
+/** Time the players of a recovered match have to take back their seats unless told otherwise. */
+#define DEFAULT_RESUME_TIMEOUT_MS 60000
+
+/** Longest line a client may send, including its newline; a multiple of FRAME_SIZE. */
+#define MAX_CLIENT_LINE 64
+
+/** Most output a client may leave unread before it is disconnected. */
+#define MAX_PENDING_OUTPUT (1 << 20)
+
+/**
+ * @struct ServerConfig
+ * @brief Settings of a server.
+ */
+typedef struct {
+    const char* socketPath;        /**< Unix domain socket to listen on, or NULL for TCP */
+    int port;                      /**< Localhost TCP port, when socketPath is NULL */
+    int numThreads;                /**< Number of event loops; 0 runs one per core */
+    int shardPerCore;              /**< 1 to pin each loop to a core and give it its own TCP listener */
+    int numPacks;                  /**< Number of packs per match unless a player asks otherwise */
+    RuleSetId ruleSet;             /**< Rules the matches are played under unless a player asks otherwise */
+    int turnTimeoutMs;             /**< Time a player has for each move, or 0 for no limit */
+    int matchTimeoutMs;            /**< Time a match may last, or 0 for no limit */
+    const Strategy* timeoutPolicy; /**< Strategy that moves for a player who runs out of time */
+    const char* logPath;           /**< Move log to recover from and append to, or NULL for none */
+    int commitIntervalMs;          /**< Time moves are gathered before the log commits them */
+    const char* snapshotPath;      /**< Snapshot to restore from and write at shutdown, or NULL for none */
+    int resumeTimeoutMs;           /**< Time the players of a recovered match have to resume, or 0 for no limit */
+    int pairingIntervalMs;         /**< Time joins are gathered before the matchmaker pairs them */
+    size_t memoryBudget;           /**< Most bytes sessions, matches and output may take, or 0 for no limit */
+    uint64_t seed;                 /**< Seed for the deals */
+} ServerConfig;
+
+/**
+ * @struct ServerStats
+ * @brief Totals of a server run.
+ */
+typedef struct {
+    long connections;      /**< Connections accepted */
+    long matchesStarted;   /**< Matches that began */
+    long matchesFinished;  /**< Matches played to the end */
+    long matchesRecovered; /**< Matches rebuilt from the snapshot or move log at startup */
+    long moves;            /**< Moves made */
+    long turnsTimedOut;    /**< Moves made by the timeout policy */
+    long matchesTimedOut;  /**< Matches ended by the match or resume timeout */
+    long spectators;       /**< Spectators who started watching a match */
+    long matchesSaved;     /**< Matches written to the snapshot at shutdown */
+} ServerStats;
+
+/**
+ * @brief Runs a server until it receives SIGINT or SIGTERM.
+ *
+ * @param config Pointer to the server settings.
+ * @param stats Pointer to the totals of the run, or NULL.
+ * @return 0 on success, -1 if the settings are invalid or the socket cannot be opened.
+ */
+int runServer(const ServerConfig* config, ServerStats* stats);
+
+/**
+ * @brief Runs a server from command-line arguments.
+ *
+ * Usage: serve [--port N | --unix PATH] [--threads N] [--shards] [--packs N] [--rules NAME]
+ *              [--turn-timeout MS] [--match-timeout MS] [--timeout-policy SPEC]
+ *              [--log PATH] [--commit-ms MS] [--snapshot PATH] [--resume-timeout MS]
+ *              [--pair-ms MS] [--memory MB] [--seed N]
+ *
+ * @param argc Number of arguments after the "serve" command.
+ * @param argv The arguments after the "serve" command.
+ * @return 0 on success, 1 on invalid arguments or if the server cannot start.
+ */
+int runServerCli(int argc, char** argv);
+
+#endif /* SERVER_H */
@@ -0,0 +1,266 @@
+/**
+ * @file slab.c
+ * @brief Implementation of slab allocation of fixed-size objects under a memory budget.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "slab.h"
+#include <stdlib.h>
+
+/** Bytes at the start of each slab that link it into its depot's list; keeps objects aligned. */
+#define SLAB_HEADER 64
+
+/**
+ * @brief Initializes a budget.
+ *
+ * @param budget Pointer to the budget.
+ * @param limit Most bytes in use, or 0 for no limit.
+ */
+void initMemoryBudget(MemoryBudget* budget, size_t limit) {
+    budget->limit = limit;
+    atomic_init(&budget->used, 0);
+}
+
+/**
+ * @brief Charges a buffer allocated outside any slab to a budget; any thread may call this.
+ *
+ * @param budget Pointer to the budget, or NULL for none.
+ * @param bytes Size of the buffer.
+ * @return 0 on success, -1 if the budget would be exceeded.
+ */
+int reserveMemory(MemoryBudget* budget, size_t bytes) {
+    if (budget == NULL) {
+        return 0;
+    }
+    long used = atomic_fetch_add_explicit(&budget->used, (long)bytes, memory_order_relaxed) + (long)bytes;
+    if (budget->limit > 0 && used > (long)budget->limit) {
+        atomic_fetch_sub_explicit(&budget->used, (long)bytes, memory_order_relaxed);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns bytes charged with reserveMemory to a budget; any thread may call this.
+ *
+ * @param budget Pointer to the budget, or NULL for none.
+ * @param bytes Size of the buffer freed.
+ */
+void releaseMemory(MemoryBudget* budget, size_t bytes) {
+    if (budget != NULL) {
+        atomic_fetch_sub_explicit(&budget->used, (long)bytes, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Tells whether a budget is used past a watermark, so callers should hold back new work.
+ *
+ * @param budget Pointer to the budget.
+ * @param eighths The watermark, in eighths of the limit.
+ * @return 1 if more than eighths/8 of the limit is in use, 0 otherwise or without a limit.
+ */
+int isMemoryAbove(MemoryBudget* budget, int eighths) {
+    if (budget->limit == 0) {
+        return 0;
+    }
+    long used = atomic_load_explicit(&budget->used, memory_order_relaxed);
+    return used > (long)(budget->limit / 8 * (size_t)eighths);
+}
+
+/**
+ * @brief Initializes a depot.
+ *
+ * @param depot Pointer to the depot.
+ * @param objectSize Size of the objects, at least two pointers.
+ * @param budget Pointer to the budget objects are charged to, whose limit is already set.
+ */
+void initSlabDepot(SlabDepot* depot, size_t objectSize, MemoryBudget* budget) {
+    depot->objectSize = (objectSize + 15) & ~(size_t)15;
+    // Large objects, such as matches with many seats, get larger slabs rather than none.
+    depot->slabBytes = SLAB_HEADER + SLAB_BATCH * depot->objectSize;
+    if (depot->slabBytes < SLAB_BYTES) {
+        depot->slabBytes = SLAB_BYTES;
+    }
+    // A small budget is not mostly held back in charges the caches have yet to report.
+    depot->reportBytes = (long)(SLAB_BATCH * depot->objectSize);
+    if (budget->limit > 0 && depot->reportBytes > (long)(budget->limit / 256)) {
+        depot->reportBytes = (long)(budget->limit / 256);
+    }
+    if (depot->reportBytes < (long)depot->objectSize) {
+        depot->reportBytes = (long)depot->objectSize;
+    }
+    depot->budget = budget;
+    pthread_mutex_init(&depot->lock, NULL);
+    depot->batches = NULL;
+    depot->slabs = NULL;
+}
+
+/**
+ * @brief Frees every slab of a depot; objects still in use are freed with them.
+ *
+ * @param depot Pointer to the depot, which no cache may use afterwards.
+ */
+void destroySlabDepot(SlabDepot* depot) {
+    while (depot->slabs != NULL) {
+        void* slab = depot->slabs;
+        depot->slabs = *(void**)slab;
+        free(slab);
+    }
+    depot->batches = NULL;
+    pthread_mutex_destroy(&depot->lock);
+}
+
+/**
+ * @brief Initializes an empty cache.
+ *
+ * @param cache Pointer to the cache.
+ * @param depot Pointer to the depot of the cache's size.
+ */
+void initSlabCache(SlabCache* cache, SlabDepot* depot) {
+    cache->depot = depot;
+    cache->free = NULL;
+    cache->count = 0;
+    cache->unreported = 0;
+}
+
+/**
+ * @brief Adds bytes charged or released by a cache to what it has yet to report, reporting
+ * them to the budget once they add up to the depot's reportBytes.
+ *
+ * @param cache Pointer to the cache.
+ * @param bytes Bytes charged, or negative for bytes released.
+ */
+static void chargeCache(SlabCache* cache, long bytes) {
+    cache->unreported += bytes;
+    if (cache->unreported >= cache->depot->reportBytes || cache->unreported <= -cache->depot->reportBytes) {
+        atomic_fetch_add_explicit(&cache->depot->budget->used, cache->unreported, memory_order_relaxed);
+        cache->unreported = 0;
+    }
+}
+
+/**
+ * @brief Fills an empty cache with a batch from its depot, or with a new slab.
+ *
+ * @param cache Pointer to the cache.
+ * @return 0 on success, -1 if memory runs out.
+ */
+static int refillCache(SlabCache* cache) {
+    SlabDepot* depot = cache->depot;
+    pthread_mutex_lock(&depot->lock);
+    void* batch = depot->batches;
+    if (batch != NULL) {
+        depot->batches = ((void**)batch)[1];
+        pthread_mutex_unlock(&depot->lock);
+        cache->free = batch;
+        cache->count = SLAB_BATCH;
+        return 0;
+    }
+    pthread_mutex_unlock(&depot->lock);
+
+    char* slab = malloc(depot->slabBytes);
+    if (slab == NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&depot->lock);
+    *(void**)slab = depot->slabs;
+    depot->slabs = slab;
+    pthread_mutex_unlock(&depot->lock);
+
+    // Carve from the back, so the objects come out in address order.
+    size_t count = (depot->slabBytes - SLAB_HEADER) / depot->objectSize;
+    for (size_t i = count; i-- > 0;) {
+        void* object = slab + SLAB_HEADER + i * depot->objectSize;
+        *(void**)object = cache->free;
+        cache->free = object;
+    }
+    cache->count = (int)count;
+    return 0;
+}
+
+/**
+ * @brief Takes an object from a cache.
+ *
+ * @param cache Pointer to the cache.
+ * @return Pointer to the object, or NULL if the budget is spent or memory runs out.
+ */
+void* allocSlab(SlabCache* cache) {
+    SlabDepot* depot = cache->depot;
+    MemoryBudget* budget = depot->budget;
+    if (budget->limit > 0
+        && atomic_load_explicit(&budget->used, memory_order_relaxed) + cache->unreported + (long)depot->objectSize
+               > (long)budget->limit) {
+        return NULL;
+    }
+    void* object = allocReservedSlab(cache);
+    if (object != NULL) {
+        chargeCache(cache, (long)depot->objectSize);
+    }
+    return object;
+}
+
+/**
+ * @brief Takes an object from a cache for memory already set aside with reserveMemory; the
+ * budget is neither checked nor charged.
+ *
+ * @param cache Pointer to the cache.
+ * @return Pointer to the object, or NULL if memory runs out.
+ */
+void* allocReservedSlab(SlabCache* cache) {
+    if (cache->free == NULL && refillCache(cache) != 0) {
+        return NULL;
+    }
+    void* object = cache->free;
+    cache->free = *(void**)object;
+    cache->count--;
+    return object;
+}
+
+/**
+ * @brief Returns an object to a cache.
+ *
+ * The object may have come from any cache of the same depot.
+ *
+ * @param cache Pointer to the cache.
+ * @param object Pointer to the object, or NULL.
+ */
+void freeSlab(SlabCache* cache, void* object) {
+    if (object != NULL) {
+        chargeCache(cache, -(long)cache->depot->objectSize);
+        freeReservedSlab(cache, object);
+    }
+}
+
+/**
+ * @brief Returns an object taken with allocReservedSlab to a cache; its reservation is kept.
+ *
+ * @param cache Pointer to the cache.
+ * @param object Pointer to the object, or NULL.
+ */
+void freeReservedSlab(SlabCache* cache, void* object) {
+    if (object == NULL) {
+        return;
+    }
+    *(void**)object = cache->free;
+    cache->free = object;
+    cache->count++;
+    if (cache->count < 2 * SLAB_BATCH) {
+        return;
+    }
+
+    // Keep one batch for the shard and give the other to the depot for whichever needs it.
+    void* batch = cache->free;
+    void* last = batch;
+    for (int i = 1; i < SLAB_BATCH; ++i) {
+        last = *(void**)last;
+    }
+    cache->free = *(void**)last;
+    *(void**)last = NULL;
+    cache->count -= SLAB_BATCH;
+    SlabDepot* depot = cache->depot;
+    pthread_mutex_lock(&depot->lock);
+    ((void**)batch)[1] = depot->batches;
+    depot->batches = batch;
+    pthread_mutex_unlock(&depot->lock);
+}
@@ -0,0 +1,165 @@
+/**
+ * @file slab.h
+ * @brief Header file for slab allocation of fixed-size objects under a memory budget.
+ *
+ * Objects of one size, such as the server's sessions, matches or buffer chunks, are carved
+ * from slabs of at least SLAB_BYTES and recycled rather than returned to malloc, so a long-running
+ * server does not fragment its heap with allocations of the same few sizes. Each shard
+ * allocates from its own SlabCache and frees into it, without locks. A cache holding too
+ * many free objects gives a batch back to the depot its size class shares, and an empty
+ * cache takes a batch from the depot before carving a new slab, so objects freed on one
+ * shard end up reused on others.
+ *
+ * Every object handed out is charged to a MemoryBudget, as are larger buffers reserved
+ * with reserveMemory. Caches report their charges in batches of up to SLAB_BATCH objects,
+ * kept small against the limit, so the shared counter is touched once per many
+ * allocations without drifting far from the truth. An allocation fails rather than exceed
+ * the budget, and isMemoryAbove warns in time for the caller to hold back work instead.
+ * Memory set aside with reserveMemory for objects taken later is spent with
+ * allocReservedSlab, which neither checks nor charges the budget again.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+/** Bytes in each slab, unless SLAB_BATCH objects need more. */
+#define SLAB_BYTES (64 * 1024)
+
+/** Objects moved between a cache and its depot at once. */
+#define SLAB_BATCH 32
+
+/**
+ * @struct MemoryBudget
+ * @brief The bytes in use across every shard and the most they may reach.
+ */
+typedef struct {
+    size_t limit;     /**< Most bytes in use, or 0 for no limit */
+    atomic_long used; /**< Bytes in use, less what caches have yet to report */
+} MemoryBudget;
+
+/**
+ * @struct SlabDepot
+ * @brief The slabs and spare batches of one object size, shared by every cache of that size.
+ */
+typedef struct {
+    size_t objectSize;    /**< Size of each object, rounded up to 16 bytes */
+    size_t slabBytes;     /**< Size of each slab, room for at least SLAB_BATCH objects */
+    long reportBytes;     /**< Charges a cache gathers before it reports them to the budget */
+    MemoryBudget* budget; /**< Budget the objects are charged to */
+    pthread_mutex_t lock; /**< Guards batches and slabs */
+    void* batches;        /**< Batches of SLAB_BATCH free objects given back by caches */
+    void* slabs;          /**< Every slab carved, freed with the depot */
+} SlabDepot;
+
+/**
+ * @struct SlabCache
+ * @brief One shard's free objects of one size; only its own thread touches it.
+ */
+typedef struct {
+    SlabDepot* depot; /**< Depot of the cache's size */
+    void* free;       /**< Free objects, linked through their first word */
+    int count;        /**< Number of free objects */
+    long unreported;  /**< Bytes charged or released but not yet added to the budget */
+} SlabCache;
+
+/**
+ * @brief Initializes a budget.
+ *
+ * @param budget Pointer to the budget.
+ * @param limit Most bytes in use, or 0 for no limit.
+ */
+void initMemoryBudget(MemoryBudget* budget, size_t limit);
+
+/**
+ * @brief Charges a buffer allocated outside any slab to a budget; any thread may call this.
+ *
+ * @param budget Pointer to the budget, or NULL for none.
+ * @param bytes Size of the buffer.
+ * @return 0 on success, -1 if the budget would be exceeded.
+ */
+int reserveMemory(MemoryBudget* budget, size_t bytes);
+
+/**
+ * @brief Returns bytes charged with reserveMemory to a budget; any thread may call this.
+ *
+ * @param budget Pointer to the budget, or NULL for none.
+ * @param bytes Size of the buffer freed.
+ */
+void releaseMemory(MemoryBudget* budget, size_t bytes);
+
+/**
+ * @brief Tells whether a budget is used past a watermark, so callers should hold back new work.
+ *
+ * @param budget Pointer to the budget.
+ * @param eighths The watermark, in eighths of the limit.
+ * @return 1 if more than eighths/8 of the limit is in use, 0 otherwise or without a limit.
+ */
+int isMemoryAbove(MemoryBudget* budget, int eighths);
+
+/**
+ * @brief Initializes a depot.
+ *
+ * @param depot Pointer to the depot.
+ * @param objectSize Size of the objects, at least two pointers.
+ * @param budget Pointer to the budget objects are charged to, whose limit is already set.
+ */
+void initSlabDepot(SlabDepot* depot, size_t objectSize, MemoryBudget* budget);
+
+/**
+ * @brief Frees every slab of a depot; objects still in use are freed with them.
+ *
+ * @param depot Pointer to the depot, which no cache may use afterwards.
+ */
+void destroySlabDepot(SlabDepot* depot);
+
+/**
+ * @brief Initializes an empty cache.
+ *
+ * @param cache Pointer to the cache.
+ * @param depot Pointer to the depot of the cache's size.
+ */
+void initSlabCache(SlabCache* cache, SlabDepot* depot);
+
+/**
+ * @brief Takes an object from a cache.
+ *
+ * @param cache Pointer to the cache.
+ * @return Pointer to the object, or NULL if the budget is spent or memory runs out.
+ */
+void* allocSlab(SlabCache* cache);
+
+/**
+ * @brief Takes an object from a cache for memory already set aside with reserveMemory; the
+ * budget is neither checked nor charged.
+ *
+ * @param cache Pointer to the cache.
+ * @return Pointer to the object, or NULL if memory runs out.
+ */
+void* allocReservedSlab(SlabCache* cache);
+
+/**
+ * @brief Returns an object to a cache.
+ *
+ * The object may have come from any cache of the same depot.
+ *
+ * @param cache Pointer to the cache.
+ * @param object Pointer to the object, or NULL.
+ */
+void freeSlab(SlabCache* cache, void* object);
+
+/**
+ * @brief Returns an object taken with allocReservedSlab to a cache; its reservation is kept.
+ *
+ * @param cache Pointer to the cache.
+ * @param object Pointer to the object, or NULL.
+ */
+void freeReservedSlab(SlabCache* cache, void* object);
+
+#endif /* SLAB_H */
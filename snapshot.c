@@ -0,0 +1,390 @@
+/**
+ * @file snapshot.c
+ * @brief Implementation of snapshots of every match a server hosts.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* O_CLOEXEC, MAP_POPULATE, pwrite */
+#endif
+#include "snapshot.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Bytes before the first match; matches are aligned to it. */
+#define SNAPSHOT_HEADER_SIZE 64
+
+/** Matches gathered before they are written. */
+#define WRITE_CHUNK_MATCHES 64
+
+/** First bytes of every snapshot, naming its format. */
+static const char snapshotMagic[8] = "CGSNAP2";
+
+/**
+ * @struct SnapshotHeader
+ * @brief Start of a snapshot file.
+ */
+typedef struct {
+    char magic[8];       /**< snapshotMagic */
+    uint32_t entrySize;  /**< sizeof(RecoveredMatch) of the writer */
+    uint32_t maxPlayers; /**< MAX_PLAYERS of the writer */
+    uint32_t numCardIds; /**< NUM_CARD_IDS of the writer */
+    uint32_t count;      /**< Number of matches */
+    uint32_t nextMatch;  /**< Id greater than any match the server had started */
+    uint32_t reserved;   /**< Always 0 */
+    uint64_t epoch;      /**< Epoch of the snapshot */
+    uint64_t logEpoch;   /**< Epoch of the log the snapshot covers, or 0 */
+    uint64_t matchCheck; /**< Checksum of the matches, see checksumMatches */
+    uint64_t check;      /**< Checksum of the fields above */
+} SnapshotHeader;
+
+_Static_assert(sizeof(SnapshotHeader) <= SNAPSHOT_HEADER_SIZE, "snapshot header must fit before the matches");
+_Static_assert(SNAPSHOT_HEADER_SIZE % _Alignof(RecoveredMatch) == 0, "mapped matches must be aligned");
+_Static_assert(sizeof(RecoveredMatch) % sizeof(uint64_t) == 0, "matches are checksummed a word at a time");
+
+/**
+ * @struct SnapshotWriter
+ * @brief A snapshot file being written and the matches not yet written to it.
+ */
+struct SnapshotWriter {
+    int fd;                                        /**< The temporary file */
+    char* path;                                    /**< Final path of the snapshot */
+    char* temporary;                               /**< Path of the file being written */
+    uint64_t logEpoch;                             /**< Epoch of the log the snapshot covers */
+    uint32_t count;                                /**< Matches added */
+    uint64_t matchCheck;                           /**< Checksum of the matches added */
+    int failed;                                    /**< 1 once a write has failed */
+    int buffered;                                  /**< Matches in buffer */
+    RecoveredMatch buffer[WRITE_CHUNK_MATCHES];    /**< Matches not yet written */
+};
+
+/**
+ * @brief Computes the checksum of a header, FNV-1a over every field before check.
+ *
+ * @param header Pointer to the header.
+ * @return The checksum.
+ */
+static uint64_t headerChecksum(const SnapshotHeader* header) {
+    const unsigned char* bytes = (const unsigned char*)header;
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < offsetof(SnapshotHeader, check); ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief Folds matches into a checksum, FNV-1a taken a 64-bit word at a time.
+ *
+ * Words rather than bytes keep checking tens of thousands of matches cheap next to
+ * copying them.
+ *
+ * @param hash The checksum so far; 14695981039346656037 before the first match.
+ * @param matches The matches.
+ * @param count Number of matches.
+ * @return The checksum including the matches.
+ */
+static uint64_t checksumMatches(uint64_t hash, const RecoveredMatch* matches, size_t count) {
+    const unsigned char* bytes = (const unsigned char*)matches;
+    size_t words = count * (sizeof(RecoveredMatch) / sizeof(uint64_t));
+    for (size_t i = 0; i < words; ++i) {
+        uint64_t word;
+        memcpy(&word, bytes + i * sizeof(word), sizeof(word));
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief Checks that a state is one the server can host: the fields it indexes by are in
+ * range, and every count agrees with the cards it counts.
+ *
+ * Each card id must have exactly numPacks copies between the hidden deck, the played pile
+ * and the hands, and every size and mask must match the counts it summarises, so a damaged
+ * match can neither read out of bounds nor deal cards that do not exist.
+ *
+ * @param state Pointer to the state.
+ * @return 1 if the state can be hosted, 0 otherwise.
+ */
+static int isRestorableState(const GameState* state) {
+    if (!(state->numPlayers >= 2 && state->numPlayers <= MAX_PLAYERS && state->currentPlayer < state->numPlayers
+          && state->ruleSet < NUM_RULE_SETS && state->winner == -1 && state->topCard < NUM_CARD_IDS
+          && state->activeSuit < NUM_SUITS && (state->direction == 1 || state->direction == -1)
+          && state->numPacks >= 1 && state->numPacks <= MAX_PACKS && state->played[state->topCard] >= 1)) {
+        return 0;
+    }
+
+    // Sums are 64-bit so that no damaged count can wrap around to a matching total.
+    uint64_t hiddenSize = 0;
+    uint64_t playedSize = 0;
+    uint64_t suitSizes[NUM_SUITS] = { 0 };
+    uint64_t handSizes[MAX_PLAYERS] = { 0 };
+    for (int id = 0; id < NUM_CARD_IDS; ++id) {
+        uint64_t copies = (uint64_t)state->deck[id] + state->played[id];
+        hiddenSize += state->deck[id];
+        suitSizes[id / NUM_RANKS] += state->deck[id];
+        playedSize += state->played[id];
+        for (int seat = 0; seat < state->numPlayers; ++seat) {
+            const Hand* hand = &state->hands[seat];
+            if ((hand->counts[id] > 0) != (int)((hand->held >> id) & 1u)) {
+                return 0;
+            }
+            copies += hand->counts[id];
+            handSizes[seat] += hand->counts[id];
+        }
+        if (copies != state->numPacks) {
+            return 0;
+        }
+    }
+    if (hiddenSize != state->hiddenSize || playedSize != state->playedSize) {
+        return 0;
+    }
+    for (int suit = 0; suit < NUM_SUITS; ++suit) {
+        if (suitSizes[suit] != state->deckSuits[suit]) {
+            return 0;
+        }
+    }
+    for (int seat = 0; seat < state->numPlayers; ++seat) {
+        if (handSizes[seat] != state->hands[seat].size || (state->hands[seat].held >> NUM_CARD_IDS) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Maps a snapshot file and checks its header and matches.
+ *
+ * @param path Path of the snapshot; a missing file is an empty snapshot with epoch 0.
+ * @param snapshot Set to the snapshot; close it with closeSnapshot.
+ * @return 0 on success, -1 if the file cannot be read or is not a valid snapshot.
+ */
+int openSnapshot(const char* path, Snapshot* snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->nextMatch = 1;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < SNAPSHOT_HEADER_SIZE) {
+        close(fd);
+        return -1;
+    }
+
+    // Every match is about to be copied, so read the whole file in now.
+    size_t length = (size_t)status.st_size;
+    void* mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return -1;
+    }
+    const SnapshotHeader* header = mapping;
+    if (memcmp(header->magic, snapshotMagic, sizeof(snapshotMagic)) != 0 || header->check != headerChecksum(header)
+        || header->entrySize != sizeof(RecoveredMatch) || header->maxPlayers != MAX_PLAYERS
+        || header->numCardIds != NUM_CARD_IDS || header->count > INT32_MAX
+        || length != SNAPSHOT_HEADER_SIZE + (size_t)header->count * sizeof(RecoveredMatch)) {
+        munmap(mapping, length);
+        return -1;
+    }
+    const RecoveredMatch* matches = (const RecoveredMatch*)((const char*)mapping + SNAPSHOT_HEADER_SIZE);
+    if (header->matchCheck != checksumMatches(14695981039346656037ull, matches, header->count)) {
+        munmap(mapping, length);
+        return -1;
+    }
+    for (uint32_t i = 0; i < header->count; ++i) {
+        if (!isRestorableState(&matches[i].state)) {
+            munmap(mapping, length);
+            return -1;
+        }
+    }
+
+    snapshot->matches = header->count > 0 ? matches : NULL;
+    snapshot->count = (int)header->count;
+    snapshot->nextMatch = header->nextMatch;
+    snapshot->epoch = header->epoch;
+    snapshot->logEpoch = header->logEpoch;
+    snapshot->mapping = mapping;
+    snapshot->mappingLength = length;
+    return 0;
+}
+
+/**
+ * @brief Unmaps a snapshot.
+ *
+ * @param snapshot Pointer to the snapshot.
+ */
+void closeSnapshot(Snapshot* snapshot) {
+    if (snapshot->mapping != NULL) {
+        munmap(snapshot->mapping, snapshot->mappingLength);
+    }
+    memset(snapshot, 0, sizeof(*snapshot));
+}
+
+/**
+ * @brief Writes a whole buffer to a file at an offset.
+ *
+ * @param fd The file.
+ * @param data The bytes.
+ * @param length Number of bytes.
+ * @param offset Where in the file the bytes go.
+ * @return 0 on success, -1 on failure.
+ */
+static int writeAllAt(int fd, const void* data, size_t length, off_t offset) {
+    const char* bytes = data;
+    while (length > 0) {
+        ssize_t n = pwrite(fd, bytes, length, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        bytes += n;
+        length -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes the matches a writer has gathered.
+ *
+ * @param writer Pointer to the writer.
+ */
+static void flushSnapshot(SnapshotWriter* writer) {
+    if (writer->buffered == 0) {
+        return;
+    }
+    writer->matchCheck = checksumMatches(writer->matchCheck, writer->buffer, (size_t)writer->buffered);
+    off_t offset = SNAPSHOT_HEADER_SIZE + (off_t)(writer->count - (uint32_t)writer->buffered) * (off_t)sizeof(RecoveredMatch);
+    if (!writer->failed && writeAllAt(writer->fd, writer->buffer, writer->buffered * sizeof(RecoveredMatch), offset) != 0) {
+        writer->failed = 1;
+    }
+    writer->buffered = 0;
+}
+
+/**
+ * @brief Frees a writer, removing its file unless it was committed.
+ *
+ * @param writer Pointer to the writer.
+ * @param committed 1 if the file was moved to its final path.
+ */
+static void freeSnapshotWriter(SnapshotWriter* writer, int committed) {
+    if (writer->fd >= 0) {
+        close(writer->fd);
+    }
+    if (!committed) {
+        unlink(writer->temporary);
+    }
+    free(writer->path);
+    free(writer->temporary);
+    free(writer);
+}
+
+/**
+ * @brief Starts writing a snapshot beside its final path.
+ *
+ * @param path Path the snapshot will have once committed.
+ * @param logEpoch Epoch of the log whose every record the snapshot includes, or 0.
+ * @return Pointer to the writer, or NULL if the file cannot be created.
+ */
+SnapshotWriter* beginSnapshot(const char* path, uint64_t logEpoch) {
+    SnapshotWriter* writer = calloc(1, sizeof(SnapshotWriter));
+    if (writer == NULL) {
+        return NULL;
+    }
+    size_t length = strlen(path);
+    writer->path = malloc(length + 1);
+    writer->temporary = malloc(length + 5);
+    if (writer->path == NULL || writer->temporary == NULL) {
+        free(writer->path);
+        free(writer->temporary);
+        free(writer);
+        return NULL;
+    }
+    memcpy(writer->path, path, length + 1);
+    snprintf(writer->temporary, length + 5, "%s.tmp", path);
+    writer->fd = open(writer->temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (writer->fd < 0) {
+        freeSnapshotWriter(writer, 1);
+        return NULL;
+    }
+    writer->logEpoch = logEpoch;
+    writer->matchCheck = 14695981039346656037ull;
+    return writer;
+}
+
+/**
+ * @brief Adds a match to a snapshot being written.
+ *
+ * @param writer Pointer to the writer.
+ * @param match Id of the match.
+ * @param secret Secret the match's resume tokens are made from.
+ * @param state The match.
+ * @return 0 on success, -1 if writing failed.
+ */
+int addSnapshotMatch(SnapshotWriter* writer, uint32_t match, uint64_t secret, const GameState* state) {
+    RecoveredMatch* entry = &writer->buffer[writer->buffered++];
+    // Unused hands are zeroed rather than left as whatever the buffer held.
+    memset(entry, 0, sizeof(*entry));
+    entry->match = match;
+    entry->secret = secret;
+    copyGameState(&entry->state, state);
+    writer->count++;
+    if (writer->buffered == WRITE_CHUNK_MATCHES) {
+        flushSnapshot(writer);
+    }
+    return writer->failed ? -1 : 0;
+}
+
+/**
+ * @brief Finishes a snapshot, syncs it and moves it over the previous one.
+ *
+ * The writer is freed whether or not the snapshot could be committed; a snapshot that
+ * fails leaves the previous one in place.
+ *
+ * @param writer Pointer to the writer.
+ * @param nextMatch Id greater than any match the server has started.
+ * @param epoch Set to the new snapshot's epoch.
+ * @return 0 on success, -1 if writing failed.
+ */
+int commitSnapshot(SnapshotWriter* writer, uint32_t nextMatch, uint64_t* epoch) {
+    flushSnapshot(writer);
+
+    // The clock makes each epoch new; it is never 0, which stands for no snapshot.
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+    header.entrySize = sizeof(RecoveredMatch);
+    header.maxPlayers = MAX_PLAYERS;
+    header.numCardIds = NUM_CARD_IDS;
+    header.count = writer->count;
+    header.nextMatch = nextMatch;
+    header.epoch = ((uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec) | 1;
+    header.logEpoch = writer->logEpoch;
+    header.matchCheck = writer->matchCheck;
+    header.check = headerChecksum(&header);
+
+    char padded[SNAPSHOT_HEADER_SIZE] = { 0 };
+    memcpy(padded, &header, sizeof(header));
+    int committed = !writer->failed && writeAllAt(writer->fd, padded, sizeof(padded), 0) == 0 && fsync(writer->fd) == 0
+                    && replaceFile(writer->temporary, writer->path) == 0;
+    freeSnapshotWriter(writer, committed);
+    if (!committed) {
+        return -1;
+    }
+    *epoch = header.epoch;
+    return 0;
+}
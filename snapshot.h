@@ -0,0 +1,96 @@
+/**
+ * @file snapshot.h
+ * @brief Header file for snapshots of every match a server hosts.
+ *
+ * A snapshot is one file: a header followed by an array of RecoveredMatch, written exactly
+ * as they lie in memory. GameState is fixed-size and holds no pointers, so the file is
+ * mapped and its matches used in place; restoring tens of thousands of matches costs one
+ * copy of each, not a replay of its moves.
+ *
+ * A server writes a snapshot when it shuts down. With a move log (see movelog.h), the log
+ * is then restarted with a record naming the snapshot's epoch, so after a crash the log is
+ * replayed on top of the snapshot it continues from rather than from the first deal.
+ *
+ * Like log records, snapshots are written in host order and only read by the build that
+ * wrote them; the header records the layout and a mismatched file is refused. The header
+ * also holds a checksum of the matches, and each match must have consistent card counts,
+ * so a damaged file is refused too rather than hosted.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "movelog.h"
+
+/**
+ * @struct Snapshot
+ * @brief A snapshot file mapped into memory.
+ */
+typedef struct {
+    const RecoveredMatch* matches; /**< The matches, in the mapping; NULL if there are none */
+    int count;                     /**< Number of matches */
+    uint32_t nextMatch;            /**< Id greater than any match the server had started */
+    uint64_t epoch;                /**< Epoch a log continuing from the snapshot starts with */
+    uint64_t logEpoch;             /**< Epoch of the log the snapshot covers, 0 if it began with none */
+    void* mapping;                 /**< The mapped file, or NULL */
+    size_t mappingLength;          /**< Size of the mapping */
+} Snapshot;
+
+/** A snapshot being written. */
+typedef struct SnapshotWriter SnapshotWriter;
+
+/**
+ * @brief Maps a snapshot file and checks its header and matches.
+ *
+ * @param path Path of the snapshot; a missing file is an empty snapshot with epoch 0.
+ * @param snapshot Set to the snapshot; close it with closeSnapshot.
+ * @return 0 on success, -1 if the file cannot be read or is not a valid snapshot.
+ */
+int openSnapshot(const char* path, Snapshot* snapshot);
+
+/**
+ * @brief Unmaps a snapshot.
+ *
+ * @param snapshot Pointer to the snapshot.
+ */
+void closeSnapshot(Snapshot* snapshot);
+
+/**
+ * @brief Starts writing a snapshot beside its final path.
+ *
+ * @param path Path the snapshot will have once committed.
+ * @param logEpoch Epoch of the log whose every record the snapshot includes, or 0.
+ * @return Pointer to the writer, or NULL if the file cannot be created.
+ */
+SnapshotWriter* beginSnapshot(const char* path, uint64_t logEpoch);
+
+/**
+ * @brief Adds a match to a snapshot being written.
+ *
+ * @param writer Pointer to the writer.
+ * @param match Id of the match.
+ * @param secret Secret the match's resume tokens are made from.
+ * @param state The match.
+ * @return 0 on success, -1 if writing failed.
+ */
+int addSnapshotMatch(SnapshotWriter* writer, uint32_t match, uint64_t secret, const GameState* state);
+
+/**
+ * @brief Finishes a snapshot, syncs it and moves it over the previous one.
+ *
+ * The writer is freed whether or not the snapshot could be committed; a snapshot that
+ * fails leaves the previous one in place.
+ *
+ * @param writer Pointer to the writer.
+ * @param nextMatch Id greater than any match the server has started.
+ * @param epoch Set to the new snapshot's epoch.
+ * @return 0 on success, -1 if writing failed.
+ */
+int commitSnapshot(SnapshotWriter* writer, uint32_t nextMatch, uint64_t* epoch);
+
+#endif /* SNAPSHOT_H */
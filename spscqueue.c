@@ -0,0 +1,97 @@
+/**
+ * @file spscqueue.c
+ * @brief Implementation of a bounded lock-free queue with one producer and one consumer.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "spscqueue.h"
+#include <stdlib.h>
+
+/**
+ * @brief Initializes an empty queue.
+ *
+ * @param queue Pointer to the queue.
+ * @param capacity Most items the queue holds, a power of two.
+ * @return 0 on success, -1 if the capacity is invalid or memory runs out.
+ */
+int initSpscQueue(SpscQueue* queue, size_t capacity) {
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return -1;
+    }
+    queue->slots = malloc(capacity * sizeof(void*));
+    if (queue->slots == NULL) {
+        return -1;
+    }
+    queue->mask = capacity - 1;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    queue->tailCopy = 0;
+    queue->headCopy = 0;
+    return 0;
+}
+
+/**
+ * @brief Frees a queue's ring; the items still in it are not freed.
+ *
+ * @param queue Pointer to the queue.
+ */
+void freeSpscQueue(SpscQueue* queue) {
+    free(queue->slots);
+    queue->slots = NULL;
+}
+
+/**
+ * @brief Returns how many items can be pushed before the queue is full; only its producer may call this.
+ *
+ * The consumer only ever makes room, so the producer can count on at least this much.
+ *
+ * @param queue Pointer to the queue.
+ * @return The number of free slots.
+ */
+size_t spscQueueSpace(SpscQueue* queue) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    queue->tailCopy = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    return queue->mask + 1 - (head - queue->tailCopy);
+}
+
+/**
+ * @brief Adds an item to a queue; only its producer may call this.
+ *
+ * @param queue Pointer to the queue.
+ * @param item The item, which must not be NULL.
+ * @return 0 on success, -1 if the queue is full.
+ */
+int pushSpscQueue(SpscQueue* queue, void* item) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (head - queue->tailCopy > queue->mask) {
+        // Full as far as the producer last knew: look again before giving up.
+        queue->tailCopy = atomic_load_explicit(&queue->tail, memory_order_acquire);
+        if (head - queue->tailCopy > queue->mask) {
+            return -1;
+        }
+    }
+    queue->slots[head & queue->mask] = item;
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return 0;
+}
+
+/**
+ * @brief Removes the oldest item of a queue; only its consumer may call this.
+ *
+ * @param queue Pointer to the queue.
+ * @return The item, or NULL if the queue is empty.
+ */
+void* popSpscQueue(SpscQueue* queue) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail == queue->headCopy) {
+        queue->headCopy = atomic_load_explicit(&queue->head, memory_order_acquire);
+        if (tail == queue->headCopy) {
+            return NULL;
+        }
+    }
+    void* item = queue->slots[tail & queue->mask];
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return item;
+}
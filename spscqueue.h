@@ -0,0 +1,83 @@
+/**
+ * @file spscqueue.h
+ * @brief Header file for a bounded lock-free queue with one producer and one consumer.
+ *
+ * The queue is a ring of pointers. The producer alone moves the head and the consumer
+ * alone moves the tail, so neither ever writes a line the other writes, and each keeps a
+ * copy of the other's index so it only reads the shared one when the copy says the ring
+ * is full or empty. The two indices sit on separate cache lines, so a producer and a
+ * consumer on different cores do not slow each other down.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+/** Bytes of padding that keep the producer's and consumer's fields on separate cache lines. */
+#define SPSC_PADDING 64
+
+/**
+ * @struct SpscQueue
+ * @brief A ring of pointers, oldest first.
+ */
+typedef struct {
+    void** slots;                /**< The ring */
+    size_t mask;                 /**< Capacity minus one; the capacity is a power of two */
+    char padding[SPSC_PADDING];  /**< Keeps head off the line of the fields above */
+    atomic_size_t head;          /**< Count of items pushed; written by the producer */
+    size_t tailCopy;             /**< The producer's last reading of tail */
+    char padding2[SPSC_PADDING]; /**< Keeps tail off head's line */
+    atomic_size_t tail;          /**< Count of items popped; written by the consumer */
+    size_t headCopy;             /**< The consumer's last reading of head */
+    char padding3[SPSC_PADDING]; /**< Keeps whatever follows off tail's line */
+} SpscQueue;
+
+/**
+ * @brief Initializes an empty queue.
+ *
+ * @param queue Pointer to the queue.
+ * @param capacity Most items the queue holds, a power of two.
+ * @return 0 on success, -1 if the capacity is invalid or memory runs out.
+ */
+int initSpscQueue(SpscQueue* queue, size_t capacity);
+
+/**
+ * @brief Frees a queue's ring; the items still in it are not freed.
+ *
+ * @param queue Pointer to the queue.
+ */
+void freeSpscQueue(SpscQueue* queue);
+
+/**
+ * @brief Returns how many items can be pushed before the queue is full; only its producer may call this.
+ *
+ * The consumer only ever makes room, so the producer can count on at least this much.
+ *
+ * @param queue Pointer to the queue.
+ * @return The number of free slots.
+ */
+size_t spscQueueSpace(SpscQueue* queue);
+
+/**
+ * @brief Adds an item to a queue; only its producer may call this.
+ *
+ * @param queue Pointer to the queue.
+ * @param item The item, which must not be NULL.
+ * @return 0 on success, -1 if the queue is full.
+ */
+int pushSpscQueue(SpscQueue* queue, void* item);
+
+/**
+ * @brief Removes the oldest item of a queue; only its consumer may call this.
+ *
+ * @param queue Pointer to the queue.
+ * @return The item, or NULL if the queue is empty.
+ */
+void* popSpscQueue(SpscQueue* queue);
+
+#endif /* SPSC_QUEUE_H */
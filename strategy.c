@@ -0,0 +1,310 @@
+/**
+ * @file strategy.c
+ * @brief Implementation of playing strategies (bots) that run on the compact game engine.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "strategy.h"
+#include "mlp.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Default weights of the heuristic strategy: keep to the longest suit.
+ */
+static const HeuristicWeights defaultHeuristicWeights = { { 1.0 } };
+
+/**
+ * @brief Table of built-in strategies.
+ */
+static const Strategy strategies[] = {
+    { "first", chooseFirstPlayable, NULL, NULL },
+    { "random", chooseRandomPlayable, NULL, NULL },
+    { "suit", chooseLongestSuit, NULL, NULL },
+    { "heuristic", chooseHeuristic, &defaultHeuristicWeights, NULL },
+};
+
+/**
+ * @brief Plays the lowest matching card identity, or draws; the rule used by takeTurn.
+ *
+ * @param state Pointer to the game state.
+ * @param params Unused.
+ * @param rng Unused.
+ * @return A legal move.
+ */
+Move chooseFirstPlayable(const GameState* state, const void* params, Rng* rng) {
+    (void)params;
+    (void)rng;
+    return lowestCardId(legalMoves(state));
+}
+
+/**
+ * @brief Plays a uniformly random matching card, or draws.
+ *
+ * @param state Pointer to the game state.
+ * @param params Unused.
+ * @param rng Pointer to the random number generator.
+ * @return A legal move.
+ */
+Move chooseRandomPlayable(const GameState* state, const void* params, Rng* rng) {
+    (void)params;
+    CardMask legal = legalMoves(state);
+    for (uint32_t skip = randomBelow(rng, (uint32_t)countCardIds(legal)); skip > 0; --skip) {
+        legal &= legal - 1;
+    }
+    return lowestCardId(legal);
+}
+
+/**
+ * @brief Plays a matching card from the suit the player holds most of, or draws.
+ *
+ * @param state Pointer to the game state.
+ * @param params Unused.
+ * @param rng Unused.
+ * @return A legal move.
+ */
+Move chooseLongestSuit(const GameState* state, const void* params, Rng* rng) {
+    (void)params;
+    (void)rng;
+    const uint16_t* hand = state->hands[state->currentPlayer].counts;
+    int suitCount[NUM_SUITS] = { 0 };
+    for (int id = 0; id < NUM_CARD_IDS; ++id) {
+        suitCount[id / NUM_RANKS] += hand[id];
+    }
+
+    Move best = MOVE_DRAW;
+    int bestCount = -1;
+    for (CardMask legal = legalMoves(state) & ~DRAW_MOVE_BIT; legal; legal &= legal - 1) {
+        int id = lowestCardId(legal);
+        if (suitCount[id / NUM_RANKS] > bestCount) {
+            best = id;
+            bestCount = suitCount[id / NUM_RANKS];
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Plays the matching card with the highest weighted feature score, or draws.
+ *
+ * @param state Pointer to the game state.
+ * @param params Pointer to the HeuristicWeights.
+ * @param rng Unused.
+ * @return A legal move.
+ */
+Move chooseHeuristic(const GameState* state, const void* params, Rng* rng) {
+    (void)rng;
+    const double* weights = ((const HeuristicWeights*)params)->weights;
+    CardMask legal = legalMoves(state);
+    if (legal & DRAW_MOVE_BIT) {
+        return MOVE_DRAW;
+    }
+
+    const uint16_t* hand = state->hands[state->currentPlayer].counts;
+    int suitCount[NUM_SUITS] = { 0 };
+    int rankCount[NUM_RANKS] = { 0 };
+    int playedSuit[NUM_SUITS] = { 0 };
+    int playedRank[NUM_RANKS] = { 0 };
+    for (int id = 0; id < NUM_CARD_IDS; ++id) {
+        suitCount[id / NUM_RANKS] += hand[id];
+        rankCount[id % NUM_RANKS] += hand[id];
+        playedSuit[id / NUM_RANKS] += state->played[id];
+        playedRank[id % NUM_RANKS] += state->played[id];
+    }
+    double perHeld = 1.0 / state->hands[state->currentPlayer].size;
+    double perMatching = 1.0 / (state->numPacks * (NUM_RANKS + NUM_SUITS - 2));
+
+    Move best = MOVE_DRAW;
+    double bestScore = 0.0;
+    for (; legal; legal &= legal - 1) {
+        int id = lowestCardId(legal);
+        int suit = id / NUM_RANKS;
+        int rank = id % NUM_RANKS;
+        double score = weights[FeatureSuitLength] * (suitCount[suit] - 1) * perHeld
+                     + weights[FeatureRankPairs] * (rankCount[rank] - 1) * perHeld
+                     + weights[FeatureHighRank] * rank / (NUM_RANKS - 1.0)
+                     + weights[FeatureMatchesSeen] * (playedSuit[suit] + playedRank[rank] - 2 * state->played[id]) * perMatching
+                     + weights[FeatureClub + suit];
+        if (best == MOVE_DRAW || score > bestScore) {
+            best = id;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Looks up a built-in strategy by name.
+ *
+ * @param name The strategy name.
+ * @return Pointer to the strategy, or NULL if there is none with that name.
+ */
+const Strategy* findStrategy(const char* name) {
+    for (size_t i = 0; i < sizeof(strategies) / sizeof(strategies[0]); ++i) {
+        if (strcmp(strategies[i].name, name) == 0) {
+            return &strategies[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Opens a strategy from a command-line specification.
+ *
+ * @param spec The specification.
+ * @return Pointer to the strategy, or NULL if it is unknown or cannot be loaded.
+ */
+const Strategy* openStrategy(const char* spec) {
+    if (strncmp(spec, "mlp:", 4) == 0) {
+        return createMlpStrategy(spec + 4);
+    }
+    if (strncmp(spec, "heuristic:", 10) == 0) {
+        Strategy* strategy = malloc(sizeof(Strategy));
+        HeuristicWeights* weights = calloc(1, sizeof(HeuristicWeights));
+        if (strategy == NULL || weights == NULL) {
+            free(strategy);
+            free(weights);
+            return NULL;
+        }
+        const char* text = spec + 10;
+        for (int i = 0; i < NUM_HEURISTIC_FEATURES && *text != '\0'; ++i) {
+            char* end;
+            weights->weights[i] = strtod(text, &end);
+            text = *end == ',' ? end + 1 : end;
+        }
+        *strategy = (Strategy) { "heuristic", chooseHeuristic, weights, NULL };
+        return strategy;
+    }
+    return findStrategy(spec);
+}
+
+/**
+ * @brief Releases a strategy returned by openStrategy.
+ *
+ * Built-in strategies are static and are left alone.
+ *
+ * @param strategy Pointer to the strategy, or NULL.
+ */
+void closeStrategy(const Strategy* strategy) {
+    const Strategy* end = strategies + sizeof(strategies) / sizeof(strategies[0]);
+    if (strategy == NULL || (strategy >= strategies && strategy < end)) {
+        return;
+    }
+    if (strategy->chooseMove == chooseMlpMove) {
+        destroyMlpStrategy((Strategy*)strategy);
+    } else {
+        free((void*)strategy->params);
+        free((void*)strategy);
+    }
+}
+
+/**
+ * @brief Chooses a move in each of several games with one strategy.
+ *
+ * @param strategy Pointer to the strategy.
+ * @param states The game states.
+ * @param count Number of games.
+ * @param rng Pointer to the generator passed to the strategy.
+ * @param moves Output array receiving a legal move for each game.
+ */
+void chooseMoves(const Strategy* strategy, const GameState* const* states, int count, Rng* rng, Move* moves) {
+    if (strategy->chooseMoves != NULL) {
+        strategy->chooseMoves(states, count, strategy->params, rng, moves);
+        return;
+    }
+    for (int i = 0; i < count; ++i) {
+        moves[i] = strategy->chooseMove(states[i], strategy->params, rng);
+    }
+}
+
+/**
+ * @brief Returns the table of built-in strategies.
+ *
+ * @param count Receives the number of strategies in the table.
+ * @return Pointer to the first strategy.
+ */
+const Strategy* builtinStrategies(int* count) {
+    *count = (int)(sizeof(strategies) / sizeof(strategies[0]));
+    return strategies;
+}
+
+/**
+ * @brief Plays a game to the end with one strategy per seat.
+ *
+ * @param state Pointer to the game state, which is played out in place.
+ * @param seats The strategy for each of the state's numPlayers players.
+ * @param rng Pointer to the generator passed to the strategies.
+ * @return The winning player, or -1 if the game reached MAX_TURNS.
+ */
+int playGame(GameState* state, const Strategy* const* seats, Rng* rng) {
+    while (!isGameOver(state)) {
+        const Strategy* strategy = seats[state->currentPlayer];
+        playMove(state, strategy->chooseMove(state, strategy->params, rng));
+    }
+    return state->winner;
+}
+
+/**
+ * @brief Plays several games to the end in lockstep.
+ *
+ * @param states The game states, played out in place.
+ * @param seats One strategy per player, game after game; every game must have the same
+ *              number of players.
+ * @param count Number of games.
+ * @param rng Pointer to the generator passed to the strategies.
+ * @return 0 on success, -1 if memory runs out.
+ */
+int playGames(GameState* states, const Strategy* const* seats, int count, Rng* rng) {
+    uint8_t* pending = malloc(count);
+    int* index = malloc(count * sizeof(int));
+    const GameState** batch = malloc(count * sizeof(GameState*));
+    Move* moves = malloc(count * sizeof(Move));
+    if (pending == NULL || index == NULL || batch == NULL || moves == NULL) {
+        free(pending);
+        free(index);
+        free(batch);
+        free(moves);
+        return -1;
+    }
+
+    int seatsPerGame = count > 0 ? states[0].numPlayers : 0;
+    for (;;) {
+        int numPending = 0;
+        for (int i = 0; i < count; ++i) {
+            pending[i] = (uint8_t)!isGameOver(&states[i]);
+            numPending += pending[i];
+        }
+        if (numPending == 0) {
+            break;
+        }
+
+        // Each pass decides every pending game whose player to move uses one strategy.
+        for (int first = 0; numPending > 0; ++first) {
+            if (!pending[first]) {
+                continue;
+            }
+            const Strategy* strategy = seats[first * seatsPerGame + states[first].currentPlayer];
+            int size = 0;
+            for (int i = first; i < count; ++i) {
+                if (pending[i] && seats[i * seatsPerGame + states[i].currentPlayer] == strategy) {
+                    index[size] = i;
+                    batch[size++] = &states[i];
+                    pending[i] = 0;
+                }
+            }
+            chooseMoves(strategy, batch, size, rng, moves);
+            for (int k = 0; k < size; ++k) {
+                playMove(&states[index[k]], moves[k]);
+            }
+            numPending -= size;
+        }
+    }
+
+    free(pending);
+    free(index);
+    free(batch);
+    free(moves);
+    return 0;
+}
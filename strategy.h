@@ -0,0 +1,193 @@
+/**
+ * @file strategy.h
+ * @brief Header file for playing strategies (bots) that run on the compact game engine.
+ *
+ * A strategy chooses a legal move for the player to move. It may read the whole game
+ * state, but fair strategies only look at the current player's hand, the top card, the
+ * played pile and the sizes of the other hands and the hidden deck.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef STRATEGY_H
+#define STRATEGY_H
+
+#include "gamestate.h"
+#include "rng.h"
+
+/**
+ * @brief Chooses a legal move for the player to move.
+ *
+ * @param state Pointer to the game state.
+ * @param params Strategy-specific parameters, or NULL.
+ * @param rng Pointer to the random number generator the strategy may use.
+ * @return A legal move.
+ */
+typedef Move (*ChooseMoveFn)(const GameState* state, const void* params, Rng* rng);
+
+/**
+ * @brief Chooses a legal move in each of several games at once.
+ *
+ * @param states The game states.
+ * @param count Number of games.
+ * @param params Strategy-specific parameters, or NULL.
+ * @param rng Pointer to the random number generator the strategy may use.
+ * @param moves Output array receiving a legal move for each game.
+ */
+typedef void (*ChooseMovesFn)(const GameState* const* states, int count, const void* params, Rng* rng, Move* moves);
+
+/**
+ * @struct Strategy
+ * @brief A named strategy and its parameters.
+ */
+typedef struct {
+    const char* name;          /**< Name used on the command line and in reports */
+    ChooseMoveFn chooseMove;   /**< Function that chooses the move */
+    const void* params;        /**< Parameters passed to chooseMove */
+    ChooseMovesFn chooseMoves; /**< Faster batched version of chooseMove, or NULL */
+} Strategy;
+
+/**
+ * @enum HeuristicFeature
+ * @brief Features scored by the heuristic strategy for each playable card.
+ */
+typedef enum {
+    FeatureSuitLength,   /**< Other held cards of the card's suit, per held card */
+    FeatureRankPairs,    /**< Other held cards of the card's rank, per held card */
+    FeatureHighRank,     /**< Rank of the card, from 0 (Two) to 1 (Ace) */
+    FeatureMatchesSeen,  /**< Share of the cards matching it that are already in the played pile */
+    FeatureClub,         /**< 1 if the card is a Club */
+    FeatureSpade,        /**< 1 if the card is a Spade */
+    FeatureHeart,        /**< 1 if the card is a Heart */
+    FeatureDiamond,      /**< 1 if the card is a Diamond */
+    NUM_HEURISTIC_FEATURES
+} HeuristicFeature;
+
+/**
+ * @struct HeuristicWeights
+ * @brief Parameters of the heuristic strategy: one weight per feature.
+ */
+typedef struct {
+    double weights[NUM_HEURISTIC_FEATURES]; /**< Weight of each HeuristicFeature */
+} HeuristicWeights;
+
+/**
+ * @brief Plays the lowest matching card identity, or draws; the rule used by takeTurn.
+ *
+ * @param state Pointer to the game state.
+ * @param params Unused.
+ * @param rng Unused.
+ * @return A legal move.
+ */
+Move chooseFirstPlayable(const GameState* state, const void* params, Rng* rng);
+
+/**
+ * @brief Plays a uniformly random matching card, or draws.
+ *
+ * @param state Pointer to the game state.
+ * @param params Unused.
+ * @param rng Pointer to the random number generator.
+ * @return A legal move.
+ */
+Move chooseRandomPlayable(const GameState* state, const void* params, Rng* rng);
+
+/**
+ * @brief Plays a matching card from the suit the player holds most of, or draws.
+ *
+ * Keeping to the longest suit leaves the most matching cards for the next turn.
+ *
+ * @param state Pointer to the game state.
+ * @param params Unused.
+ * @param rng Unused.
+ * @return A legal move.
+ */
+Move chooseLongestSuit(const GameState* state, const void* params, Rng* rng);
+
+/**
+ * @brief Plays the matching card with the highest weighted feature score, or draws.
+ *
+ * Positive weights prefer cards with more of a feature; for example, a positive suit
+ * length weight keeps to the longest suit and a negative rank pairs weight keeps pairs.
+ *
+ * @param state Pointer to the game state.
+ * @param params Pointer to the HeuristicWeights.
+ * @param rng Unused.
+ * @return A legal move.
+ */
+Move chooseHeuristic(const GameState* state, const void* params, Rng* rng);
+
+/**
+ * @brief Looks up a built-in strategy by name.
+ *
+ * @param name The strategy name.
+ * @return Pointer to the strategy, or NULL if there is none with that name.
+ */
+const Strategy* findStrategy(const char* name);
+
+/**
+ * @brief Opens a strategy from a command-line specification.
+ *
+ * The specification is the name of a built-in strategy, "heuristic:W1,W2,..." for the
+ * heuristic strategy with the given weights (missing weights are 0), or "mlp:FILE" for a
+ * neural policy loaded from a weights file (see mlp.h).
+ *
+ * @param spec The specification.
+ * @return Pointer to the strategy, or NULL if it is unknown or cannot be loaded.
+ */
+const Strategy* openStrategy(const char* spec);
+
+/**
+ * @brief Releases a strategy returned by openStrategy.
+ *
+ * @param strategy Pointer to the strategy, or NULL.
+ */
+void closeStrategy(const Strategy* strategy);
+
+/**
+ * @brief Chooses a move in each of several games with one strategy.
+ *
+ * Uses the strategy's batched function if it has one, otherwise chooses game by game.
+ *
+ * @param strategy Pointer to the strategy.
+ * @param states The game states.
+ * @param count Number of games.
+ * @param rng Pointer to the generator passed to the strategy.
+ * @param moves Output array receiving a legal move for each game.
+ */
+void chooseMoves(const Strategy* strategy, const GameState* const* states, int count, Rng* rng, Move* moves);
+
+/**
+ * @brief Returns the table of built-in strategies.
+ *
+ * @param count Receives the number of strategies in the table.
+ * @return Pointer to the first strategy.
+ */
+const Strategy* builtinStrategies(int* count);
+
+/**
+ * @brief Plays a game to the end with one strategy per seat.
+ *
+ * @param state Pointer to the game state, which is played out in place.
+ * @param seats The strategy for each of the state's numPlayers players.
+ * @param rng Pointer to the generator passed to the strategies.
+ * @return The winning player, or -1 if the game reached MAX_TURNS.
+ */
+int playGame(GameState* state, const Strategy* const* seats, Rng* rng);
+
+/**
+ * @brief Plays several games to the end in lockstep.
+ *
+ * Each round, every unfinished game makes one move, and the games whose player to move
+ * uses the same strategy are decided in one batch. The winners are left in each state.
+ *
+ * @param states The game states, played out in place.
+ * @param seats One strategy per player, game after game; every game must have the same
+ *              number of players.
+ * @param count Number of games.
+ * @param rng Pointer to the generator passed to the strategies.
+ * @return 0 on success, -1 if memory runs out.
+ */
+int playGames(GameState* states, const Strategy* const* seats, int count, Rng* rng);
+
+#endif /* STRATEGY_H */
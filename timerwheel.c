@@ -0,0 +1,153 @@
+/**
+ * @file timerwheel.c
+ * @brief Implementation of the hierarchical timer wheel used for server timeouts.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "timerwheel.h"
+
+/** Ticks covered by the whole wheel. */
+#define WHEEL_SPAN ((uint64_t)1 << (TIMER_SLOT_BITS * TIMER_LEVELS))
+
+/**
+ * @brief Initializes an empty wheel.
+ *
+ * @param wheel Pointer to the wheel.
+ * @param now The current tick.
+ */
+void initTimerWheel(TimerWheel* wheel, uint64_t now) {
+    for (int level = 0; level < TIMER_LEVELS; ++level) {
+        for (int slot = 0; slot < TIMER_SLOTS; ++slot) {
+            Timer* head = &wheel->slots[level][slot];
+            head->next = head->previous = head;
+        }
+    }
+    wheel->now = now;
+    wheel->count = 0;
+}
+
+/**
+ * @brief Links a timer into the slot for its expiry, relative to the wheel's tick.
+ *
+ * @param wheel Pointer to the wheel.
+ * @param timer Pointer to a timer that is in no slot.
+ * @param earliest The first tick the timer may fire on: the next tick for a new timer, or
+ *                 the current one for a timer cascading down while that tick is processed.
+ */
+static void insertTimer(TimerWheel* wheel, Timer* timer, uint64_t earliest) {
+    uint64_t due = timer->expiry > earliest ? timer->expiry : earliest;
+    uint64_t delta = due - wheel->now;
+    if (delta >= WHEEL_SPAN) {
+        // Park it as far ahead as the wheel reaches; it is placed again when that slot cascades.
+        due = wheel->now + WHEEL_SPAN - 1;
+        delta = WHEEL_SPAN - 1;
+    }
+    int level = 0;
+    while (delta >= (uint64_t)1 << (TIMER_SLOT_BITS * (level + 1))) {
+        level++;
+    }
+    Timer* head = &wheel->slots[level][(due >> (TIMER_SLOT_BITS * level)) & (TIMER_SLOTS - 1)];
+    timer->next = head;
+    timer->previous = head->previous;
+    head->previous->next = timer;
+    head->previous = timer;
+}
+
+/**
+ * @brief Unlinks a timer from its slot.
+ *
+ * @param timer Pointer to a scheduled timer.
+ */
+static void unlinkTimer(Timer* timer) {
+    timer->previous->next = timer->next;
+    timer->next->previous = timer->previous;
+    timer->next = timer->previous = NULL;
+}
+
+/**
+ * @brief Schedules a timer, replacing any time it was already scheduled for.
+ *
+ * @param wheel Pointer to the wheel.
+ * @param timer Pointer to the timer.
+ * @param expiry Tick at which the timer fires; a tick already passed fires on the next one.
+ */
+void scheduleTimer(TimerWheel* wheel, Timer* timer, uint64_t expiry) {
+    if (isTimerScheduled(timer)) {
+        unlinkTimer(timer);
+    } else {
+        wheel->count++;
+    }
+    timer->expiry = expiry;
+    insertTimer(wheel, timer, wheel->now + 1);
+}
+
+/**
+ * @brief Cancels a timer; does nothing if it is not scheduled.
+ *
+ * @param wheel Pointer to the wheel.
+ * @param timer Pointer to the timer.
+ */
+void cancelTimer(TimerWheel* wheel, Timer* timer) {
+    if (isTimerScheduled(timer)) {
+        unlinkTimer(timer);
+        wheel->count--;
+    }
+}
+
+/**
+ * @brief Moves every timer of one slot into the levels below.
+ *
+ * @param wheel Pointer to the wheel.
+ * @param level The level of the slot, at least 1.
+ * @param slot The slot.
+ */
+static void cascade(TimerWheel* wheel, int level, int slot) {
+    Timer* head = &wheel->slots[level][slot];
+    Timer* timer = head->next;
+    head->next = head->previous = head;
+    while (timer != head) {
+        Timer* next = timer->next;
+        insertTimer(wheel, timer, wheel->now);
+        timer = next;
+    }
+}
+
+/**
+ * @brief Advances the wheel to a tick and fires every timer due by then.
+ *
+ * @param wheel Pointer to the wheel.
+ * @param now The current tick; earlier ticks than the wheel's are ignored.
+ * @param fire Function called for each timer that fires.
+ * @param context Context passed to fire.
+ * @return The number of timers fired.
+ */
+long advanceTimerWheel(TimerWheel* wheel, uint64_t now, TimerFn fire, void* context) {
+    long fired = 0;
+    while (wheel->now < now) {
+        if (wheel->count == 0) {
+            wheel->now = now;
+            break;
+        }
+        uint64_t tick = ++wheel->now;
+        int slot = (int)(tick & (TIMER_SLOTS - 1));
+
+        // Each time a level wraps around, refill it from the next slot of the level above.
+        for (int level = 1; level < TIMER_LEVELS && slot == 0; ++level) {
+            slot = (int)((tick >> (TIMER_SLOT_BITS * level)) & (TIMER_SLOTS - 1));
+            cascade(wheel, level, slot);
+        }
+
+        // Take the head each time, as a callback may cancel other timers of this slot.
+        Timer* head = &wheel->slots[0][tick & (TIMER_SLOTS - 1)];
+        while (head->next != head) {
+            Timer* timer = head->next;
+            unlinkTimer(timer);
+            wheel->count--;
+            fire(timer, context);
+            fired++;
+        }
+    }
+    return fired;
+}
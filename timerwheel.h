@@ -0,0 +1,111 @@
+/**
+ * @file timerwheel.h
+ * @brief Header file for the hierarchical timer wheel used for server timeouts.
+ *
+ * Time is counted in ticks. The wheel has TIMER_LEVELS levels of TIMER_SLOTS slots; level
+ * L holds timers due within TIMER_SLOTS^(L+1) ticks, in the slot for their due tick at
+ * that level's resolution. Each slot is a circular list, so scheduling and cancelling a
+ * timer take constant time whatever the number of timers. When the lowest level wraps
+ * around, the next slot of the level above is emptied into the levels below, so every
+ * timer is moved at most TIMER_LEVELS - 1 times before it fires.
+ *
+ * Timers are embedded in the objects they time; the callback finds its object from the
+ * timer's address.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Number of bits of the tick each level covers. */
+#define TIMER_SLOT_BITS 6
+
+/** Number of slots per level. */
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+
+/** Number of levels; timers further ahead than TIMER_SLOTS^TIMER_LEVELS ticks wait in the top level. */
+#define TIMER_LEVELS 4
+
+/**
+ * @struct Timer
+ * @brief A timer; all zero when not scheduled.
+ */
+typedef struct Timer {
+    struct Timer* next;     /**< Next timer in the slot, or NULL when not scheduled */
+    struct Timer* previous; /**< Previous timer in the slot */
+    uint64_t expiry;        /**< Tick at which the timer fires */
+} Timer;
+
+/**
+ * @struct TimerWheel
+ * @brief The slots of every level and the current tick.
+ *
+ * The slots are circular lists that point at themselves, so a wheel must not be moved
+ * once initialized.
+ */
+typedef struct {
+    Timer slots[TIMER_LEVELS][TIMER_SLOTS]; /**< The head of each slot's list */
+    uint64_t now;                           /**< The last tick processed */
+    long count;                             /**< Number of scheduled timers */
+} TimerWheel;
+
+/**
+ * @brief Called for each timer that fires; it may schedule or cancel any timer.
+ *
+ * @param timer Pointer to the timer, which is no longer scheduled.
+ * @param context The context passed to advanceTimerWheel.
+ */
+typedef void (*TimerFn)(Timer* timer, void* context);
+
+/**
+ * @brief Initializes an empty wheel.
+ *
+ * @param wheel Pointer to the wheel.
+ * @param now The current tick.
+ */
+void initTimerWheel(TimerWheel* wheel, uint64_t now);
+
+/**
+ * @brief Schedules a timer, replacing any time it was already scheduled for.
+ *
+ * @param wheel Pointer to the wheel.
+ * @param timer Pointer to the timer.
+ * @param expiry Tick at which the timer fires; a tick already passed fires on the next one.
+ */
+void scheduleTimer(TimerWheel* wheel, Timer* timer, uint64_t expiry);
+
+/**
+ * @brief Cancels a timer; does nothing if it is not scheduled.
+ *
+ * @param wheel Pointer to the wheel.
+ * @param timer Pointer to the timer.
+ */
+void cancelTimer(TimerWheel* wheel, Timer* timer);
+
+/**
+ * @brief Checks if a timer is scheduled.
+ *
+ * @param timer Pointer to the timer.
+ * @return 1 if the timer is scheduled, 0 otherwise.
+ */
+static inline int isTimerScheduled(const Timer* timer) {
+    return timer->next != NULL;
+}
+
+/**
+ * @brief Advances the wheel to a tick and fires every timer due by then.
+ *
+ * @param wheel Pointer to the wheel.
+ * @param now The current tick; earlier ticks than the wheel's are ignored.
+ * @param fire Function called for each timer that fires.
+ * @param context Context passed to fire.
+ * @return The number of timers fired.
+ */
+long advanceTimerWheel(TimerWheel* wheel, uint64_t now, TimerFn fire, void* context);
+
+#endif /* TIMER_WHEEL_H */
@@ -0,0 +1,571 @@
+/**
+ * @file tournament.c
+ * @brief Implementation of running strategy tournaments and rating the strategies.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* clock_gettime */
+#endif
+#include "tournament.h"
+#include "parallel.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** Converts a Bradley-Terry strength difference to Elo points. */
+#define ELO_PER_UNIT (400.0 / 2.302585092994046)
+
+/** Virtual drawn games each player has against a rating-0 reference, to keep ratings finite. */
+#define PRIOR_GAMES 2.0
+
+/** Maximum number of Newton iterations when fitting ratings. */
+#define MAX_RATING_ITERATIONS 100
+
+/** Number of deals one job plays; its games run in lockstep so strategies can batch. */
+#define DEALS_PER_JOB 32
+
+/**
+ * @struct RoundContext
+ * @brief Work shared by the threads playing one round of a tournament.
+ */
+typedef struct {
+    const TournamentConfig* config; /**< The tournament settings */
+    const int* pairings;            /**< Pairs of strategy indices, two per pairing */
+    int round;                      /**< Index of the round, used to vary the deals */
+    double* threadScore;            /**< Per-thread score matrices */
+    int* threadGames;               /**< Per-thread game-count matrices */
+    GameState* threadStates;        /**< Per-thread games, 2 * DEALS_PER_JOB each */
+} RoundContext;
+
+/**
+ * @brief Derives the seed of one deal, shared by every pairing in the round.
+ *
+ * @param seed The tournament seed.
+ * @param round The round index.
+ * @param deal The deal index within the round.
+ * @return The seed for the deal.
+ */
+static uint64_t dealSeed(uint64_t seed, int round, int deal) {
+    Rng rng;
+    seedRng(&rng, seed ^ ((uint64_t)round << 32) ^ (uint64_t)deal);
+    return nextRandom(&rng);
+}
+
+/**
+ * @brief Plays a block of deals of one pairing with both seatings and records the results.
+ *
+ * @param job Index of the job: pairing * jobsPerPairing + block.
+ * @param thread Index of the thread, selecting its result matrices and games.
+ * @param context Pointer to the RoundContext.
+ */
+static void playDealsJob(int job, int thread, void* context) {
+    RoundContext* round = context;
+    const TournamentConfig* config = round->config;
+    int n = config->numStrategies;
+    int jobsPerPairing = (config->dealsPerPairing + DEALS_PER_JOB - 1) / DEALS_PER_JOB;
+    int pairing = job / jobsPerPairing;
+    int firstDeal = job % jobsPerPairing * DEALS_PER_JOB;
+    int numDeals = config->dealsPerPairing - firstDeal < DEALS_PER_JOB ? config->dealsPerPairing - firstDeal : DEALS_PER_JOB;
+    int a = round->pairings[2 * pairing];
+    int b = round->pairings[2 * pairing + 1];
+    double* score = round->threadScore + (size_t)thread * n * n;
+    int* games = round->threadGames + (size_t)thread * n * n;
+
+    // Game 2k plays deal k with a in seat 0; game 2k + 1 plays it with the seats swapped.
+    GameState* states = round->threadStates + (size_t)thread * 2 * DEALS_PER_JOB;
+    const Strategy* seats[2 * DEALS_PER_JOB * NUM_PLAYERS];
+    for (int k = 0; k < numDeals; ++k) {
+        uint64_t seed = dealSeed(config->seed, round->round, firstDeal + k);
+        dealGameState(&states[2 * k], NUM_PLAYERS, config->handSize, config->numPacks, seed);
+        dealGameState(&states[2 * k + 1], NUM_PLAYERS, config->handSize, config->numPacks, seed);
+        states[2 * k].ruleSet = states[2 * k + 1].ruleSet = (uint8_t)config->ruleSet;
+        seats[4 * k] = seats[4 * k + 3] = config->strategies[a];
+        seats[4 * k + 1] = seats[4 * k + 2] = config->strategies[b];
+    }
+    Rng rng;
+    seedRng(&rng, dealSeed(~config->seed, round->round, job));
+    if (playGames(states, seats, 2 * numDeals, &rng) != 0) {
+        for (int g = 0; g < 2 * numDeals; ++g) {
+            playGame(&states[g], &seats[g * NUM_PLAYERS], &rng);
+        }
+    }
+
+    for (int g = 0; g < 2 * numDeals; ++g) {
+        int first = g % 2 ? b : a;
+        int second = g % 2 ? a : b;
+        int winner = states[g].winner;
+        double firstPoints = winner == 0 ? 1.0 : (winner == 1 ? 0.0 : 0.5);
+        score[first * n + second] += firstPoints;
+        score[second * n + first] += 1.0 - firstPoints;
+        games[first * n + second]++;
+        games[second * n + first]++;
+    }
+}
+
+/**
+ * @brief Pairs strategies for a Swiss round by total score, avoiding rematches when possible.
+ *
+ * @param config Pointer to the tournament settings.
+ * @param score The score matrix so far.
+ * @param games The game-count matrix so far.
+ * @param pairings Output array receiving two strategy indices per pairing.
+ * @return The number of pairings.
+ */
+static int pairSwissRound(const TournamentConfig* config, const double* score, const int* games, int* pairings) {
+    int n = config->numStrategies;
+    int* order = malloc(n * sizeof(int));
+    double* total = calloc(n, sizeof(double));
+    int* paired = calloc(n, sizeof(int));
+    int numPairings = 0;
+    if (order == NULL || total == NULL || paired == NULL) {
+        goto done;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            total[i] += score[i * n + j];
+        }
+        int k = i;
+        while (k > 0 && total[order[k - 1]] < total[i]) {
+            order[k] = order[k - 1];
+            k--;
+        }
+        order[k] = i;
+    }
+
+    // With an odd field, the bye goes to the lowest-scoring player who has not sat out more
+    // rounds than anyone else, that is, one with the most games.
+    if (n % 2 == 1) {
+        int bye = -1;
+        int byeGames = 0;
+        for (int i = n - 1; i >= 0; --i) {
+            int played = 0;
+            for (int j = 0; j < n; ++j) {
+                played += games[order[i] * n + j];
+            }
+            if (bye == -1 || played > byeGames) {
+                bye = order[i];
+                byeGames = played;
+            }
+        }
+        paired[bye] = 1;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        int a = order[i];
+        if (paired[a]) {
+            continue;
+        }
+        int opponent = -1;
+        for (int k = i + 1; k < n; ++k) {
+            int b = order[k];
+            if (paired[b]) {
+                continue;
+            }
+            if (opponent == -1) {
+                opponent = b;
+            }
+            if (games[a * n + b] == 0) {
+                opponent = b;
+                break;
+            }
+        }
+        if (opponent == -1) {
+            continue;
+        }
+        paired[a] = paired[opponent] = 1;
+        pairings[2 * numPairings] = a;
+        pairings[2 * numPairings + 1] = opponent;
+        numPairings++;
+    }
+
+done:
+    free(order);
+    free(total);
+    free(paired);
+    return numPairings;
+}
+
+/**
+ * @brief Runs a tournament and rates the strategies.
+ *
+ * @param config Pointer to the tournament settings.
+ * @param result Pointer to the result, which must be released with freeTournamentResult.
+ * @return 0 on success, -1 if the settings are invalid or memory runs out.
+ */
+int runTournament(const TournamentConfig* config, TournamentResult* result) {
+    int n = config->numStrategies;
+    memset(result, 0, sizeof(*result));
+    if (n < 2 || config->dealsPerPairing < 1 || config->numPacks < 1 || config->numPacks > MAX_PACKS
+        || config->handSize < 1 || (long)NUM_PLAYERS * config->handSize >= (long)config->numPacks * NUM_CARD_IDS
+        || config->ruleSet < 0 || config->ruleSet >= NUM_RULE_SETS
+        || (config->pairing == Swiss && config->swissRounds < 1)) {
+        return -1;
+    }
+
+    int numThreads = config->numThreads > 0 ? config->numThreads : defaultThreadCount();
+    int numRounds = config->pairing == Swiss ? config->swissRounds : 1;
+    int maxPairings = config->pairing == Swiss ? n / 2 : n * (n - 1) / 2;
+
+    result->numStrategies = n;
+    result->score = calloc((size_t)n * n, sizeof(double));
+    result->games = calloc((size_t)n * n, sizeof(int));
+    result->ratings = calloc(n, sizeof(Rating));
+    int* pairings = malloc(2 * maxPairings * sizeof(int));
+    double* threadScore = malloc((size_t)numThreads * n * n * sizeof(double));
+    int* threadGames = malloc((size_t)numThreads * n * n * sizeof(int));
+    // On the heap rather than each job's stack, as a state grows with MAX_PLAYERS.
+    GameState* threadStates = malloc((size_t)numThreads * 2 * DEALS_PER_JOB * sizeof(GameState));
+    if (result->score == NULL || result->games == NULL || result->ratings == NULL ||
+        pairings == NULL || threadScore == NULL || threadGames == NULL || threadStates == NULL) {
+        free(pairings);
+        free(threadScore);
+        free(threadGames);
+        free(threadStates);
+        freeTournamentResult(result);
+        return -1;
+    }
+
+    for (int round = 0; round < numRounds; ++round) {
+        int numPairings = 0;
+        if (config->pairing == Swiss) {
+            numPairings = pairSwissRound(config, result->score, result->games, pairings);
+        } else {
+            for (int a = 0; a < n; ++a) {
+                for (int b = a + 1; b < n; ++b) {
+                    pairings[2 * numPairings] = a;
+                    pairings[2 * numPairings + 1] = b;
+                    numPairings++;
+                }
+            }
+        }
+
+        memset(threadScore, 0, (size_t)numThreads * n * n * sizeof(double));
+        memset(threadGames, 0, (size_t)numThreads * n * n * sizeof(int));
+        RoundContext context = { config, pairings, round, threadScore, threadGames, threadStates };
+        int jobsPerPairing = (config->dealsPerPairing + DEALS_PER_JOB - 1) / DEALS_PER_JOB;
+        runParallel(numThreads, numPairings * jobsPerPairing, playDealsJob, &context);
+
+        for (int t = 0; t < numThreads; ++t) {
+            for (int k = 0; k < n * n; ++k) {
+                result->score[k] += threadScore[(size_t)t * n * n + k];
+                result->games[k] += threadGames[(size_t)t * n * n + k];
+            }
+        }
+    }
+
+    free(pairings);
+    free(threadScore);
+    free(threadGames);
+    free(threadStates);
+
+    computeRatings(n, result->score, result->games, result->ratings);
+    return 0;
+}
+
+/**
+ * @brief Releases the memory held by a tournament result.
+ *
+ * @param result Pointer to the result.
+ */
+void freeTournamentResult(TournamentResult* result) {
+    free(result->score);
+    free(result->games);
+    free(result->ratings);
+    memset(result, 0, sizeof(*result));
+}
+
+/**
+ * @brief Solves a symmetric positive-definite system in place by Cholesky factorization.
+ *
+ * @param n Size of the system.
+ * @param matrix The n-by-n matrix; overwritten by its Cholesky factor.
+ * @param rhs The right-hand side; overwritten by the solution.
+ * @return 0 on success, -1 if the matrix is not positive definite.
+ */
+static int choleskySolve(int n, double* matrix, double* rhs) {
+    for (int j = 0; j < n; ++j) {
+        double diagonal = matrix[j * n + j];
+        for (int k = 0; k < j; ++k) {
+            diagonal -= matrix[j * n + k] * matrix[j * n + k];
+        }
+        if (diagonal <= 0.0) {
+            return -1;
+        }
+        diagonal = sqrt(diagonal);
+        matrix[j * n + j] = diagonal;
+        for (int i = j + 1; i < n; ++i) {
+            double value = matrix[i * n + j];
+            for (int k = 0; k < j; ++k) {
+                value -= matrix[i * n + k] * matrix[j * n + k];
+            }
+            matrix[i * n + j] = value / diagonal;
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        for (int k = 0; k < i; ++k) {
+            rhs[i] -= matrix[i * n + k] * rhs[k];
+        }
+        rhs[i] /= matrix[i * n + i];
+    }
+    for (int i = n - 1; i >= 0; --i) {
+        for (int k = i + 1; k < n; ++k) {
+            rhs[i] -= matrix[k * n + i] * rhs[k];
+        }
+        rhs[i] /= matrix[i * n + i];
+    }
+    return 0;
+}
+
+/**
+ * @brief Builds the gradient and Fisher information of the Bradley-Terry log-likelihood.
+ *
+ * Win probabilities for every pair are computed in one pass over the flat matrices, so
+ * the loops run over contiguous memory and vectorize.
+ *
+ * @param n Number of players.
+ * @param theta Current strengths.
+ * @param score Pairwise points.
+ * @param games Pairwise game counts.
+ * @param prob Scratch n-by-n matrix for win probabilities.
+ * @param gradient Output gradient.
+ * @param information Output n-by-n information matrix.
+ */
+static void buildNewtonSystem(int n, const double* theta, const double* score, const int* games,
+                              double* prob, double* gradient, double* information) {
+    for (int k = 0; k < n * n; ++k) {
+        prob[k] = 1.0 / (1.0 + exp(theta[k % n] - theta[k / n]));
+    }
+
+    for (int i = 0; i < n; ++i) {
+        double p = 1.0 / (1.0 + exp(-theta[i]));
+        gradient[i] = PRIOR_GAMES * (0.5 - p);
+        double diagonal = PRIOR_GAMES * p * (1.0 - p);
+        for (int j = 0; j < n; ++j) {
+            int k = i * n + j;
+            double weight = games[k] * prob[k] * (1.0 - prob[k]);
+            gradient[i] += score[k] - games[k] * prob[k];
+            information[k] = -weight;
+            diagonal += weight;
+        }
+        information[i * n + i] = diagonal;
+    }
+}
+
+/**
+ * @brief Fits Bradley-Terry ratings with confidence intervals to pairwise results.
+ *
+ * The strengths are the maximum-likelihood fit with a weak prior (PRIOR_GAMES drawn games
+ * against a rating-0 reference), found by Newton's method. Ratings are relative to the
+ * field average, and the confidence intervals come from the inverse of the Fisher
+ * information at the fit.
+ *
+ * @param numPlayers Number of players.
+ * @param score score[i * numPlayers + j]: points of i against j.
+ * @param games games[i * numPlayers + j]: games between i and j.
+ * @param ratings Output array receiving the rating of each player.
+ */
+void computeRatings(int numPlayers, const double* score, const int* games, Rating* ratings) {
+    int n = numPlayers;
+    double* theta = calloc(n, sizeof(double));
+    double* gradient = malloc(n * sizeof(double));
+    double* information = malloc((size_t)n * n * sizeof(double));
+    double* prob = malloc((size_t)n * n * sizeof(double));
+    if (theta == NULL || gradient == NULL || information == NULL || prob == NULL) {
+        memset(ratings, 0, n * sizeof(Rating));
+        goto done;
+    }
+
+    for (int iteration = 0; iteration < MAX_RATING_ITERATIONS; ++iteration) {
+        buildNewtonSystem(n, theta, score, games, prob, gradient, information);
+        if (choleskySolve(n, information, gradient) != 0) {
+            break;
+        }
+        double largest = 0.0;
+        for (int i = 0; i < n; ++i) {
+            theta[i] += gradient[i];
+            largest = fmax(largest, fabs(gradient[i]));
+        }
+        if (largest < 1e-9) {
+            break;
+        }
+    }
+
+    // Ratings are reported relative to the field average, so both the strengths and their
+    // covariance (the inverse information) are centred before taking the intervals.
+    double mean = 0.0;
+    for (int i = 0; i < n; ++i) {
+        mean += theta[i] / n;
+    }
+    buildNewtonSystem(n, theta, score, games, prob, gradient, information);
+    double* factor = malloc((size_t)n * n * sizeof(double));
+    double* covariance = malloc((size_t)n * n * sizeof(double));
+    if (factor == NULL || covariance == NULL) {
+        memset(ratings, 0, n * sizeof(Rating));
+        free(factor);
+        free(covariance);
+        goto done;
+    }
+    for (int i = 0; i < n; ++i) {
+        memcpy(factor, information, (size_t)n * n * sizeof(double));
+        memset(gradient, 0, n * sizeof(double));
+        gradient[i] = 1.0;
+        if (choleskySolve(n, factor, gradient) != 0) {
+            memset(gradient, 0, n * sizeof(double));
+        }
+        memcpy(covariance + (size_t)i * n, gradient, n * sizeof(double));
+    }
+
+    double total = 0.0;
+    for (int k = 0; k < n * n; ++k) {
+        total += covariance[k];
+    }
+    for (int i = 0; i < n; ++i) {
+        double row = 0.0;
+        for (int j = 0; j < n; ++j) {
+            row += covariance[i * n + j];
+        }
+        double variance = fmax(covariance[i * n + i] - 2.0 * row / n + total / ((double)n * n), 0.0);
+        double margin = 1.96 * sqrt(variance) * ELO_PER_UNIT;
+        ratings[i].elo = (theta[i] - mean) * ELO_PER_UNIT;
+        ratings[i].eloLow = ratings[i].elo - margin;
+        ratings[i].eloHigh = ratings[i].elo + margin;
+    }
+    free(factor);
+    free(covariance);
+
+done:
+    free(theta);
+    free(gradient);
+    free(information);
+    free(prob);
+}
+
+/**
+ * @brief Prints the usage of the tournament command.
+ */
+static void printTournamentUsage(void) {
+    int count;
+    const Strategy* strategies = builtinStrategies(&count);
+    fprintf(stderr, "Usage: tournament [--swiss ROUNDS] [--deals N] [--packs N] [--hand-size N] [--rules NAME] [--threads N] [--seed N] STRATEGY...\n");
+    fprintf(stderr, "Strategies:");
+    for (int i = 0; i < count; ++i) {
+        fprintf(stderr, " %s", strategies[i].name);
+    }
+    fprintf(stderr, " heuristic:W1,W2,... mlp:WEIGHTS_FILE\n");
+    fprintf(stderr, "Rules:");
+    for (int id = 0; id < NUM_RULE_SETS; ++id) {
+        fprintf(stderr, " %s", getRuleSet((RuleSetId)id)->name);
+    }
+    fprintf(stderr, "\n");
+}
+
+/**
+ * @brief Runs a tournament from command-line arguments and prints the ratings.
+ *
+ * @param argc Number of arguments after the "tournament" command.
+ * @param argv The arguments after the "tournament" command.
+ * @return 0 on success, 1 on invalid arguments.
+ */
+int runTournamentCli(int argc, char** argv) {
+    TournamentConfig config = { NULL, 0, RoundRobin, 0, 100, 1, INITIAL_HAND_SIZE, RulesStandard, 0, (uint64_t)time(NULL) };
+    const Strategy** strategies = malloc((argc + 1) * sizeof(Strategy*));
+    const char** names = malloc((argc + 1) * sizeof(char*));
+    int status = 1;
+    if (strategies == NULL || names == NULL) {
+        goto done;
+    }
+
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--swiss") == 0 && i + 1 < argc) {
+            config.pairing = Swiss;
+            config.swissRounds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--deals") == 0 && i + 1 < argc) {
+            config.dealsPerPairing = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--packs") == 0 && i + 1 < argc) {
+            config.numPacks = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--hand-size") == 0 && i + 1 < argc) {
+            config.handSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rules") == 0 && i + 1 < argc) {
+            int ruleSet = findRuleSet(argv[++i]);
+            if (ruleSet < 0) {
+                fprintf(stderr, "Unknown rules: %s\n", argv[i]);
+                printTournamentUsage();
+                goto done;
+            }
+            config.ruleSet = (RuleSetId)ruleSet;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            config.numThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            config.seed = strtoull(argv[++i], NULL, 10);
+        } else if ((strategies[config.numStrategies] = openStrategy(argv[i])) != NULL) {
+            names[config.numStrategies++] = argv[i];
+        } else {
+            fprintf(stderr, "Unknown argument or strategy: %s\n", argv[i]);
+            printTournamentUsage();
+            goto done;
+        }
+    }
+    config.strategies = strategies;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    TournamentResult result;
+    if (runTournament(&config, &result) != 0) {
+        printTournamentUsage();
+        goto done;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    int n = config.numStrategies;
+    int* order = malloc(n * sizeof(int));
+    if (order == NULL) {
+        freeTournamentResult(&result);
+        goto done;
+    }
+    long totalGames = 0;
+    for (int i = 0; i < n; ++i) {
+        int k = i;
+        while (k > 0 && result.ratings[order[k - 1]].elo < result.ratings[i].elo) {
+            order[k] = order[k - 1];
+            k--;
+        }
+        order[k] = i;
+        for (int j = 0; j < n; ++j) {
+            totalGames += result.games[i * n + j];
+        }
+    }
+
+    printf("%-4s %-12s %8s %19s %8s %8s\n", "Rank", "Strategy", "Elo", "95% interval", "Score", "Games");
+    for (int r = 0; r < n; ++r) {
+        int i = order[r];
+        double points = 0.0;
+        int games = 0;
+        for (int j = 0; j < n; ++j) {
+            points += result.score[i * n + j];
+            games += result.games[i * n + j];
+        }
+        printf("%-4d %-12s %8.1f [%8.1f, %8.1f] %7.1f%% %8d\n", r + 1, names[i], result.ratings[i].elo,
+               result.ratings[i].eloLow, result.ratings[i].eloHigh, games > 0 ? 100.0 * points / games : 0.0, games);
+    }
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("\n%ld games in %.2f s (%.0f games/s)\n", totalGames / 2, seconds, totalGames / 2 / seconds);
+
+    free(order);
+    freeTournamentResult(&result);
+    status = 0;
+
+done:
+    for (int i = 0; strategies != NULL && i < config.numStrategies; ++i) {
+        closeStrategy(strategies[i]);
+    }
+    free(strategies);
+    free(names);
+    return status;
+}
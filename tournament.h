@@ -0,0 +1,104 @@
+/**
+ * @file tournament.h
+ * @brief Header file for running strategy tournaments and rating the strategies.
+ *
+ * A tournament plays every pairing of strategies (round robin) or pairs them by score
+ * each round (Swiss). Every pairing in a round plays the same deals, each deal twice with
+ * the seats swapped, so luck of the cards cancels out. Games run on all cores, and the
+ * results are fitted to a Bradley-Terry model and reported as Elo ratings.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef TOURNAMENT_H
+#define TOURNAMENT_H
+
+#include <stdint.h>
+#include "strategy.h"
+
+/**
+ * @enum PairingMode
+ * @brief How strategies are paired in a tournament.
+ */
+typedef enum {
+    RoundRobin, /**< Every strategy plays every other strategy once */
+    Swiss       /**< Each round pairs strategies with similar scores */
+} PairingMode;
+
+/**
+ * @struct TournamentConfig
+ * @brief Settings of a tournament.
+ */
+typedef struct {
+    const Strategy* const* strategies; /**< The strategies taking part */
+    int numStrategies;                 /**< Number of strategies */
+    PairingMode pairing;               /**< How strategies are paired */
+    int swissRounds;                   /**< Number of rounds in Swiss mode, at least 1 */
+    int dealsPerPairing;               /**< Deals per pairing; each is played with both seatings */
+    int numPacks;                      /**< Number of packs per game */
+    int handSize;                      /**< Cards dealt to each player */
+    RuleSetId ruleSet;                 /**< Rules the games are played under */
+    int numThreads;                    /**< Number of worker threads; 0 uses every core */
+    uint64_t seed;                     /**< Seed for the deals */
+} TournamentConfig;
+
+/**
+ * @struct Rating
+ * @brief Fitted rating of one strategy.
+ */
+typedef struct {
+    double elo;     /**< Elo rating relative to the average of the field */
+    double eloLow;  /**< Lower end of the 95% confidence interval */
+    double eloHigh; /**< Upper end of the 95% confidence interval */
+} Rating;
+
+/**
+ * @struct TournamentResult
+ * @brief Results of a tournament.
+ */
+typedef struct {
+    int numStrategies; /**< Number of strategies */
+    double* score;     /**< score[i * numStrategies + j]: points of i against j (draws count half) */
+    int* games;        /**< games[i * numStrategies + j]: games between i and j */
+    Rating* ratings;   /**< Rating of each strategy */
+} TournamentResult;
+
+/**
+ * @brief Runs a tournament and rates the strategies.
+ *
+ * @param config Pointer to the tournament settings.
+ * @param result Pointer to the result, which must be released with freeTournamentResult.
+ * @return 0 on success, -1 if the settings are invalid or memory runs out.
+ */
+int runTournament(const TournamentConfig* config, TournamentResult* result);
+
+/**
+ * @brief Releases the memory held by a tournament result.
+ *
+ * @param result Pointer to the result.
+ */
+void freeTournamentResult(TournamentResult* result);
+
+/**
+ * @brief Fits Bradley-Terry ratings with confidence intervals to pairwise results.
+ *
+ * @param numPlayers Number of players.
+ * @param score score[i * numPlayers + j]: points of i against j.
+ * @param games games[i * numPlayers + j]: games between i and j.
+ * @param ratings Output array receiving the rating of each player.
+ */
+void computeRatings(int numPlayers, const double* score, const int* games, Rating* ratings);
+
+/**
+ * @brief Runs a tournament from command-line arguments and prints the ratings.
+ *
+ * Usage: tournament [--swiss ROUNDS] [--deals N] [--packs N] [--rules NAME] [--threads N] [--seed N] STRATEGY...
+ *
+ * @param argc Number of arguments after the "tournament" command.
+ * @param argv The arguments after the "tournament" command.
+ * @return 0 on success, 1 on invalid arguments.
+ */
+int runTournamentCli(int argc, char** argv);
+
+#endif /* TOURNAMENT_H */
@@ -0,0 +1,255 @@
+/**
+ * @file tuner.c
+ * @brief Implementation of tuning the weights of the heuristic strategy.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide .....
+ * @date Last modified: 1-12-2023
+ */
+
+#include "tuner.h"
+#include "parallel.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** Number of deals one job plays in lockstep. */
+#define DEALS_PER_JOB 64
+
+/** Maximum number of candidates evaluated together. */
+#define MAX_CANDIDATES 2
+
+/**
+ * @struct EvaluationContext
+ * @brief Work shared by the threads evaluating candidate weights.
+ */
+typedef struct {
+    const Strategy* candidates; /**< Heuristic strategy of each candidate */
+    const Strategy* opponent;   /**< The opponent strategy */
+    int numDeals;               /**< Deals per candidate */
+    int numPacks;               /**< Number of packs per game */
+    uint64_t seed;              /**< Seed for the deals */
+    double* threadPoints;       /**< Points per thread and candidate */
+    GameState* threadStates;    /**< Games per thread, 2 * DEALS_PER_JOB each */
+} EvaluationContext;
+
+/**
+ * @brief Plays a block of deals for one candidate and records its points.
+ *
+ * @param job Index of the job: candidate * jobsPerCandidate + block.
+ * @param thread Index of the thread, selecting its point totals and games.
+ * @param context Pointer to the EvaluationContext.
+ */
+static void evaluateJob(int job, int thread, void* context) {
+    EvaluationContext* evaluation = context;
+    int jobsPerCandidate = (evaluation->numDeals + DEALS_PER_JOB - 1) / DEALS_PER_JOB;
+    int candidate = job / jobsPerCandidate;
+    int firstDeal = job % jobsPerCandidate * DEALS_PER_JOB;
+    int numDeals = evaluation->numDeals - firstDeal < DEALS_PER_JOB ? evaluation->numDeals - firstDeal : DEALS_PER_JOB;
+    const Strategy* heuristic = &evaluation->candidates[candidate];
+
+    // Every candidate plays the same deals, so their difference is not drowned by card luck.
+    GameState* states = evaluation->threadStates + (size_t)thread * 2 * DEALS_PER_JOB;
+    const Strategy* seats[2 * DEALS_PER_JOB * NUM_PLAYERS];
+    for (int k = 0; k < numDeals; ++k) {
+        Rng rng;
+        seedRng(&rng, evaluation->seed + (uint64_t)(firstDeal + k));
+        uint64_t seed = nextRandom(&rng);
+        initGameState(&states[2 * k], NUM_PLAYERS, evaluation->numPacks, seed);
+        initGameState(&states[2 * k + 1], NUM_PLAYERS, evaluation->numPacks, seed);
+        seats[4 * k] = seats[4 * k + 3] = heuristic;
+        seats[4 * k + 1] = seats[4 * k + 2] = evaluation->opponent;
+    }
+    Rng rng;
+    seedRng(&rng, ~evaluation->seed ^ (uint64_t)firstDeal);
+    if (playGames(states, seats, 2 * numDeals, &rng) != 0) {
+        for (int g = 0; g < 2 * numDeals; ++g) {
+            playGame(&states[g], &seats[g * NUM_PLAYERS], &rng);
+        }
+    }
+
+    double points = 0.0;
+    for (int g = 0; g < 2 * numDeals; ++g) {
+        int seat = g % 2;
+        points += states[g].winner == seat ? 1.0 : (states[g].winner < 0 ? 0.5 : 0.0);
+    }
+    evaluation->threadPoints[thread * MAX_CANDIDATES + candidate] += points;
+}
+
+/**
+ * @brief Measures the scores of several candidate weights on the same deals.
+ *
+ * @param weights The candidate weights.
+ * @param numCandidates Number of candidates, at most MAX_CANDIDATES.
+ * @param opponent Pointer to the opponent strategy.
+ * @param numDeals Number of deals per candidate.
+ * @param numPacks Number of packs per game.
+ * @param numThreads Number of worker threads; 0 uses every core.
+ * @param seed Seed for the deals.
+ * @param scores Output array receiving the share of points won by each candidate.
+ */
+static void evaluateCandidates(const HeuristicWeights* weights, int numCandidates, const Strategy* opponent,
+                               int numDeals, int numPacks, int numThreads, uint64_t seed, double* scores) {
+    if (numThreads <= 0) {
+        numThreads = defaultThreadCount();
+    }
+    Strategy candidates[MAX_CANDIDATES];
+    for (int c = 0; c < numCandidates; ++c) {
+        candidates[c] = (Strategy) { "heuristic", chooseHeuristic, &weights[c], NULL };
+        scores[c] = 0.0;
+    }
+    double* threadPoints = calloc((size_t)numThreads * MAX_CANDIDATES, sizeof(double));
+    // On the heap rather than each job's stack, as a state grows with MAX_PLAYERS.
+    GameState* threadStates = malloc((size_t)numThreads * 2 * DEALS_PER_JOB * sizeof(GameState));
+    if (threadPoints == NULL || threadStates == NULL || numDeals < 1) {
+        free(threadPoints);
+        free(threadStates);
+        return;
+    }
+
+    EvaluationContext context = { candidates, opponent, numDeals, numPacks, seed, threadPoints, threadStates };
+    int jobsPerCandidate = (numDeals + DEALS_PER_JOB - 1) / DEALS_PER_JOB;
+    runParallel(numThreads, numCandidates * jobsPerCandidate, evaluateJob, &context);
+
+    for (int t = 0; t < numThreads; ++t) {
+        for (int c = 0; c < numCandidates; ++c) {
+            scores[c] += threadPoints[t * MAX_CANDIDATES + c] / (2.0 * numDeals);
+        }
+    }
+    free(threadPoints);
+    free(threadStates);
+}
+
+/**
+ * @brief Measures the score of heuristic weights against an opponent.
+ *
+ * @param weights Pointer to the weights.
+ * @param opponent Pointer to the opponent strategy.
+ * @param numDeals Number of deals; each is played with both seatings.
+ * @param numPacks Number of packs per game.
+ * @param numThreads Number of worker threads; 0 uses every core.
+ * @param seed Seed for the deals; equal seeds give the same deals.
+ * @return The share of points won, from 0 to 1.
+ */
+double evaluateHeuristic(const HeuristicWeights* weights, const Strategy* opponent, int numDeals, int numPacks, int numThreads, uint64_t seed) {
+    double score;
+    evaluateCandidates(weights, 1, opponent, numDeals, numPacks, numThreads, seed, &score);
+    return score;
+}
+
+/**
+ * @brief Tunes heuristic weights with SPSA.
+ *
+ * Uses the usual gain sequences a / (k + 1 + A)^0.602 and c / (k + 1)^0.101, with the
+ * stability constant A set to a tenth of the iterations. Both candidates of an iteration
+ * play the same fresh deals.
+ *
+ * @param config Pointer to the tuning settings.
+ * @param weights The starting weights, replaced by the tuned weights.
+ * @param progress Called after each iteration with the iteration, the weights and the
+ *                 scores of the two candidates; may be NULL.
+ */
+void tuneHeuristic(const TunerConfig* config, HeuristicWeights* weights,
+                   void (*progress)(int iteration, const HeuristicWeights* weights, double plusScore, double minusScore)) {
+    Rng rng;
+    seedRng(&rng, config->seed);
+    double stability = config->iterations / 10.0;
+
+    for (int k = 0; k < config->iterations; ++k) {
+        double a = config->stepSize / pow(k + 1 + stability, 0.602);
+        double c = config->perturbation / pow(k + 1, 0.101);
+
+        double delta[NUM_HEURISTIC_FEATURES];
+        HeuristicWeights candidates[2];
+        for (int i = 0; i < NUM_HEURISTIC_FEATURES; ++i) {
+            delta[i] = (nextRandom(&rng) & 1) ? 1.0 : -1.0;
+            candidates[0].weights[i] = weights->weights[i] + c * delta[i];
+            candidates[1].weights[i] = weights->weights[i] - c * delta[i];
+        }
+
+        double scores[2];
+        evaluateCandidates(candidates, 2, config->opponent, config->dealsPerIteration, config->numPacks,
+                           config->numThreads, nextRandom(&rng), scores);
+        for (int i = 0; i < NUM_HEURISTIC_FEATURES; ++i) {
+            weights->weights[i] += a * (scores[0] - scores[1]) / (2.0 * c * delta[i]);
+        }
+
+        if (progress != NULL) {
+            progress(k, weights, scores[0], scores[1]);
+        }
+    }
+}
+
+/**
+ * @brief Prints the progress of a tuning run.
+ *
+ * @param iteration The iteration just finished.
+ * @param weights The current weights.
+ * @param plusScore Score of the positively perturbed candidate.
+ * @param minusScore Score of the negatively perturbed candidate.
+ */
+static void printTunerProgress(int iteration, const HeuristicWeights* weights, double plusScore, double minusScore) {
+    printf("%5d  %.3f %.3f ", iteration + 1, plusScore, minusScore);
+    for (int i = 0; i < NUM_HEURISTIC_FEATURES; ++i) {
+        printf(" %+.3f", weights->weights[i]);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+/**
+ * @brief Tunes heuristic weights from command-line arguments and prints the result.
+ *
+ * @param argc Number of arguments after the "tune" command.
+ * @param argv The arguments after the "tune" command.
+ * @return 0 on success, 1 on invalid arguments.
+ */
+int runTunerCli(int argc, char** argv) {
+    TunerConfig config = { NULL, 200, 2000, 1, 0, 2.0, 0.5, (uint64_t)time(NULL) };
+    const char* opponent = "first";
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            config.iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--deals") == 0 && i + 1 < argc) {
+            config.dealsPerIteration = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--opponent") == 0 && i + 1 < argc) {
+            opponent = argv[++i];
+        } else if (strcmp(argv[i], "--packs") == 0 && i + 1 < argc) {
+            config.numPacks = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            config.numThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            config.seed = strtoull(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Usage: tune [--iterations N] [--deals N] [--opponent STRATEGY] [--packs N] [--threads N] [--seed N]\n");
+            return 1;
+        }
+    }
+
+    config.opponent = openStrategy(opponent);
+    if (config.opponent == NULL || config.numPacks < 1 || config.numPacks > MAX_PACKS || config.dealsPerIteration < 1) {
+        fprintf(stderr, "Invalid opponent or settings\n");
+        closeStrategy(config.opponent);
+        return 1;
+    }
+
+    const Strategy* start = findStrategy("heuristic");
+    HeuristicWeights weights = *(const HeuristicWeights*)start->params;
+    uint64_t validationSeed = ~config.seed;
+    double before = evaluateHeuristic(&weights, config.opponent, 4 * config.dealsPerIteration, config.numPacks, config.numThreads, validationSeed);
+
+    printf("Iter   plus  minus  weights (suit length, rank pairs, high rank, matches seen, club, spade, heart, diamond)\n");
+    tuneHeuristic(&config, &weights, printTunerProgress);
+
+    double after = evaluateHeuristic(&weights, config.opponent, 4 * config.dealsPerIteration, config.numPacks, config.numThreads, validationSeed);
+    printf("\nScore against %s on validation deals: %.3f before, %.3f after\n", opponent, before, after);
+    printf("Strategy: heuristic:");
+    for (int i = 0; i < NUM_HEURISTIC_FEATURES; ++i) {
+        printf("%s%.4f", i > 0 ? "," : "", weights.weights[i]);
+    }
+    printf("\n");
+
+    closeStrategy(config.opponent);
+    return 0;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file tuner.h
+ * @brief Header file for tuning the weights of the heuristic strategy.
+ *
+ * The tuner uses simultaneous perturbation stochastic approximation (SPSA): each
+ * iteration perturbs every weight at once in a random direction, plays both perturbed
+ * candidates against a fixed opponent on the same deals, and steps the weights along the
+ * measured difference. Games run in large lockstep batches on all cores.
+ *
+ * @author Niamh Greally, Lucy Fogarty, Olamide ....
+ * @date Last modified: 1-12-2023
+ */
+
+#ifndef TUNER_H
+#define TUNER_H
+
+#include <stdint.h>
+#include "strategy.h"
+
+/**
+ * @struct TunerConfig
+ * @brief Settings of a tuning run.
+ */
+typedef struct {
+    const Strategy* opponent; /**< Strategy the candidates are measured against */
+    int iterations;           /**< Number of SPSA iterations */
+    int dealsPerIteration;    /**< Deals per candidate per iteration; each is played with both seatings */
+    int numPacks;             /**< Number of packs per game */
+    int numThreads;           /**< Number of worker threads; 0 uses every core */
+    double stepSize;          /**< SPSA gain a: size of the first weight update */
+    double perturbation;      /**< SPSA gain c: size of the first perturbation */
+    uint64_t seed;            /**< Seed for the deals and perturbations */
+} TunerConfig;
+
+/**
+ * @brief Measures the score of heuristic weights against an opponent.
+ *
+ * @param weights Pointer to the weights.
+ * @param opponent Pointer to the opponent strategy.
+ * @param numDeals Number of deals; each is played with both seatings.
+ * @param numPacks Number of packs per game.
+ * @param numThreads Number of worker threads; 0 uses every core.
+ * @param seed Seed for the deals; equal seeds give the same deals.
+ * @return The share of points won, from 0 to 1.
+ */
+double evaluateHeuristic(const HeuristicWeights* weights, const Strategy* opponent, int numDeals, int numPacks, int numThreads, uint64_t seed);
+
+/**
+ * @brief Tunes heuristic weights with SPSA.
+ *
+ * @param config Pointer to the tuning settings.
+ * @param weights The starting weights, replaced by the tuned weights.
+ * @param progress Called after each iteration with the iteration, the weights and the
+ *                 scores of the two candidates; may be NULL.
+ */
+void tuneHeuristic(const TunerConfig* config, HeuristicWeights* weights,
+                   void (*progress)(int iteration, const HeuristicWeights* weights, double plusScore, double minusScore));
+
+/**
+ * @brief Tunes heuristic weights from command-line arguments and prints the result.
+ *
+ * Usage: tune [--iterations N] [--deals N] [--opponent STRATEGY] [--packs N] [--threads N] [--seed N]
+ *
+ * @param argc Number of arguments after the "tune" command.
+ * @param argv The arguments after the "tune" command.
+ * @return 0 on success, 1 on invalid arguments.
+ */
+int runTunerCli(int argc, char** argv);
+
+#endif /* TUNER_H */